@@ -31,7 +31,7 @@ namespace WaterMeter {
     }
 
     bool Aggregator::canSend() const {
-        return _dataQueue->canSend(_payload);
+        return _isReserved || _dataQueue->canSend(_payload);
     }
 
     long Aggregator::convertToLong(const char* stringParam, const long defaultValue) {
@@ -41,11 +41,10 @@ namespace WaterMeter {
         return strtol(stringParam, nullptr, 10);
     }
 
+    // Only resets the counters. Subclasses clear what they need, since sent payloads only contain what was filled.
     void Aggregator::flush() {
+        release();
         _messageCount = 0;
-        for (SensorSample& i : _payload->buffer.samples.value) {
-            i.l = 0;
-        }
         _flushRate = _desiredFlushRate;
     }
 
@@ -68,12 +67,30 @@ namespace WaterMeter {
         return true;
     }
 
+    void Aggregator::release() {
+        if (!_isReserved) return;
+        _dataQueue->release(sizeof(DataQueuePayload), _payload->topic);
+        _isReserved = false;
+    }
+
+    bool Aggregator::reserve() {
+        if (!_isReserved) {
+            _isReserved = _dataQueue->reserve(sizeof(DataQueuePayload), _payload->topic);
+        }
+        return _isReserved;
+    }
+
     bool Aggregator::send() {
         if (!shouldSend()) return false;
         _blocked = !canSend();
         if (_blocked) return false;
         _payload->timestamp = Clock::getTimestamp();
-        if (!_dataQueue->send(getPayload())) {
+        if (_isReserved) {
+            // the reservation is used up, whatever the outcome
+            _isReserved = false;
+            if (!_dataQueue->commit(getPayload(), sizeof(DataQueuePayload))) return false;
+        }
+        else if (!_dataQueue->send(getPayload())) {
             return false;
         }
         flush();
@@ -11,6 +11,7 @@
 
 // parent of SampleAggregator and ResultAggregator. Collects payloads until the buffer is full and then sends it out.
 // We do this to limit the amount of traffic (larger less frequent messages).
+// An aggregator that needs to know up front whether its batch can go out reserves room in the queue once per batch.
 
 #ifndef HEADER_AGGREGATOR
 #define HEADER_AGGREGATOR
@@ -38,6 +39,8 @@ namespace WaterMeter {
     protected:
         static long convertToLong(const char* stringParam, long defaultValue = 0L);
         static long limit(long input, long min, long max);
+        void release();
+        bool reserve();
         Clock* _clock;
         DataQueue* _dataQueue;
         DataQueuePayload* _payload;
@@ -45,6 +48,7 @@ namespace WaterMeter {
         ChangePublisher<long> _blocked;
         long _desiredFlushRate = 0;
         long _messageCount = 0;
+        bool _isReserved = false;
     };
 }
 #endif
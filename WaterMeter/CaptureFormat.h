@@ -0,0 +1,48 @@
+// Copyright 2024 Rik Essenius
+// 
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License. You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and limitations under the License.
+
+// Binary capture format for raw sensor data: a 32 byte header followed by packed little endian int16 x/y pairs.
+// Used for streaming captures off the device, and for replaying recordings in tests.
+// A sample count of StreamingSampleCount means the number of samples follows from the data length.
+
+#ifndef HEADER_CAPTURE_FORMAT
+#define HEADER_CAPTURE_FORMAT
+
+#include <cstdint>
+
+namespace WaterMeter {
+    enum class CaptureSensorType : uint8_t { Unknown = 0, Hmc, Qmc, Null };
+
+    struct CaptureHeader {
+        char magic[4];
+        uint16_t version;
+        uint16_t headerSize;
+        uint32_t sampleRateHz;
+        uint32_t sampleCount;
+        float gain;
+        uint16_t noiseRange;
+        CaptureSensorType sensorType;
+        uint8_t reserved[9];
+    };
+
+    struct CaptureSample {
+        int16_t x;
+        int16_t y;
+    };
+
+    static_assert(sizeof(CaptureHeader) == 32, "Capture header must be 32 bytes");
+    static_assert(sizeof(CaptureSample) == 4, "Capture samples must be packed int16 pairs");
+
+    constexpr char CaptureMagic[] = { 'W', 'M', 'C', 'P' };
+    constexpr uint16_t CaptureVersion = 1;
+    constexpr uint32_t StreamingSampleCount = 0xFFFFFFFF;
+}
+#endif
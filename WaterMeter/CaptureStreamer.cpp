@@ -0,0 +1,177 @@
+// Copyright 2024 Rik Essenius
+// 
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License. You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and limitations under the License.
+
+#include <cstdlib>
+#include <cstring>
+#include <SafeCString.h>
+
+#include "CaptureStreamer.h"
+#include "ConnectionState.h"
+#include "SampleAggregator.h"
+
+namespace WaterMeter {
+    constexpr uint16_t CaptureStreamer::DefaultPort;
+    constexpr double CaptureStreamer::QmcMinimumGain;
+
+    CaptureStreamer::CaptureStreamer(EventServer* eventServer, const unsigned long measureIntervalMicros,
+        const MagnetoSensorReader* sensorReader) :
+        EventClient(eventServer),
+        _sensorReader(sensorReader),
+        _measureIntervalMicros(measureIntervalMicros),
+        _batchSizeDesired(SampleAggregator::DefaultFlushRate) {}
+
+    void CaptureStreamer::begin() {
+        _eventServer->subscribe(this, Topic::BatchSizeDesired);
+        _eventServer->subscribe(this, Topic::Capture);
+        _eventServer->subscribe(this, Topic::Connection);
+        _eventServer->subscribe(this, Topic::SensorData);
+        _eventServer->provides(this, Topic::Capture);
+    }
+
+    long CaptureStreamer::get(const Topic topic, const long defaultValue) {
+        return topic == Topic::Capture ? _streaming : defaultValue;
+    }
+
+    // the sensor library doesn't expose the sensor type, but the gains of the two chips don't overlap
+    CaptureSensorType CaptureStreamer::sensorType(const bool isReal, const double gain) {
+        if (!isReal) return CaptureSensorType::Null;
+        return gain >= QmcMinimumGain ? CaptureSensorType::Qmc : CaptureSensorType::Hmc;
+    }
+
+    void CaptureStreamer::update(const Topic topic, const char* payload) {
+        if (topic == Topic::Capture) {
+            if (_streaming) {
+                stop("Capture stopped");
+            }
+            if (strlen(payload) > 0 && strcmp(payload, "off") != 0) {
+                start(payload);
+            }
+            return;
+        }
+        // this comes in from MQTT as text
+        if (topic == Topic::BatchSizeDesired) {
+            update(topic, strcmp(payload, "DEFAULT") == 0 ? SampleAggregator::DefaultFlushRate : strtol(payload, nullptr, 10));
+            return;
+        }
+        if (topic == Topic::SensorData && _streaming) {
+            const auto sensorPayload = reinterpret_cast<const DataQueuePayload*>(payload);
+            if (sensorPayload->topic == Topic::Samples) {
+                writeSamples(sensorPayload);
+            }
+        }
+    }
+
+    void CaptureStreamer::update(const Topic topic, const long payload) {
+        if (topic == Topic::Connection) {
+            if (_streaming && payload != static_cast<long>(ConnectionState::MqttReady)) {
+                stop("Capture stopped: connection lost");
+            }
+            return;
+        }
+        if (topic == Topic::BatchSizeDesired) {
+            // remember what to go back to, but keep the maximum while streaming
+            _batchSizeDesired = payload;
+            if (_streaming) {
+                _eventServer->publish(this, Topic::BatchSizeDesired, static_cast<long>(SampleAggregator::MaxFlushRate));
+            }
+        }
+    }
+
+    // protected methods
+
+    bool CaptureStreamer::connectSocket(const char* host, const uint16_t port) {
+        return _client.connect(host, port) != 0;
+    }
+
+    bool CaptureStreamer::parseTarget(const char* target, char* host, const size_t hostSize, uint16_t& port) {
+        const char* separator = strrchr(target, ':');
+        const auto hostLength = separator == nullptr ? strlen(target) : static_cast<size_t>(separator - target);
+        if (hostLength == 0 || hostLength >= hostSize) return false;
+        strncpy(host, target, hostLength);
+        host[hostLength] = 0;
+        port = DefaultPort;
+        if (separator != nullptr) {
+            char* end;
+            const auto portNumber = strtol(separator + 1, &end, 10);
+            if (*end != 0 || portNumber <= 0 || portNumber > 65535) return false;
+            port = static_cast<uint16_t>(portNumber);
+        }
+        return true;
+    }
+
+    bool CaptureStreamer::start(const char* target) {
+        if (!parseTarget(target, _host, HostSize, _port)) {
+            SafeCString::sprintf(_messageBuffer, "Capture: invalid target '%s'", target);
+            _eventServer->publish(Topic::ConnectionError, _messageBuffer);
+            return false;
+        }
+        // this is a synchronous call, but it only happens when the capture target is set
+        if (!connectSocket(_host, _port)) {
+            SafeCString::sprintf(_messageBuffer, "Capture: could not connect to %s:%d", _host, _port);
+            _eventServer->publish(Topic::ConnectionError, _messageBuffer);
+            return false;
+        }
+        CaptureHeader header{};
+        memcpy(header.magic, CaptureMagic, sizeof header.magic);
+        header.version = CaptureVersion;
+        header.headerSize = sizeof(CaptureHeader);
+        header.sampleRateHz = static_cast<uint32_t>(1000000UL / _measureIntervalMicros);
+        header.sampleCount = StreamingSampleCount;
+        // the sensor is chosen at startup, so it doesn't change while we read it from this task
+        if (_sensorReader != nullptr) {
+            const bool isReal = _sensorReader->isReal();
+            if (isReal) {
+                header.gain = static_cast<float>(_sensorReader->getGain());
+                header.noiseRange = static_cast<uint16_t>(_sensorReader->getNoiseRange());
+            }
+            header.sensorType = sensorType(isReal, header.gain);
+        }
+        _streaming = true;
+        _eventServer->publish(this, Topic::BatchSizeDesired, static_cast<long>(SampleAggregator::MaxFlushRate));
+        if (!writeAll(reinterpret_cast<const uint8_t*>(&header), sizeof header)) {
+            return false;
+        }
+        SafeCString::sprintf(_messageBuffer, "Capture streaming to %s:%d", _host, _port);
+        _eventServer->publish(Topic::Info, _messageBuffer);
+        return true;
+    }
+
+    void CaptureStreamer::stop(const char* reason) {
+        stopSocket();
+        _streaming = false;
+        _eventServer->publish(this, Topic::BatchSizeDesired, _batchSizeDesired);
+        _eventServer->publish(Topic::Info, reason);
+    }
+
+    void CaptureStreamer::stopSocket() {
+        _client.stop();
+    }
+
+    bool CaptureStreamer::writeAll(const uint8_t* buffer, const size_t size) {
+        if (writeSocket(buffer, size) == size) return true;
+        stop("Capture: connection lost");
+        return false;
+    }
+
+    void CaptureStreamer::writeSamples(const DataQueuePayload* payload) {
+        CaptureSample samples[MaxSamples];
+        const auto count = payload->buffer.samples.count;
+        for (uint16_t i = 0; i < count; i++) {
+            samples[i].x = payload->buffer.samples.value[i].x;
+            samples[i].y = payload->buffer.samples.value[i].y;
+        }
+        writeAll(reinterpret_cast<const uint8_t*>(samples), count * sizeof(CaptureSample));
+    }
+
+    size_t CaptureStreamer::writeSocket(const uint8_t* buffer, const size_t size) {
+        return _client.write(buffer, size);
+    }
+}
@@ -0,0 +1,69 @@
+// Copyright 2024 Rik Essenius
+// 
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License. You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and limitations under the License.
+
+// Streams the raw samples over a plain TCP connection in the binary capture format (see CaptureFormat),
+// bypassing the JSON serialization and MQTT. Setting the capture property to host:port connects to a listener there
+// (e.g. nc -l 8320 > field.capture), and "off" stops the stream. While streaming, the serializer
+// skips the samples, so they don't go to the broker as well.
+// The samples only come in batches, so while streaming the batch size is kept at the maximum; the desired batch size
+// is restored afterwards. They also only come while MQTT is connected, so the stream stops when the connection drops,
+// rather than leaving gaps in the capture.
+// With a sensor reader, the header describes the active sensor: its gain, noise range and type.
+
+#ifndef HEADER_CAPTURE_STREAMER
+#define HEADER_CAPTURE_STREAMER
+
+#include <WiFiClientSecure.h>
+
+#include "CaptureFormat.h"
+#include "DataQueuePayload.h"
+#include "EventServer.h"
+#include "MagnetoSensorReader.h"
+
+namespace WaterMeter {
+    class CaptureStreamer : public EventClient {
+    public:
+        CaptureStreamer(EventServer* eventServer, unsigned long measureIntervalMicros,
+            const MagnetoSensorReader* sensorReader = nullptr);
+        void begin();
+        using EventClient::get;
+        long get(Topic topic, long defaultValue) override;
+        bool isStreaming() const { return _streaming; }
+        static CaptureSensorType sensorType(bool isReal, double gain);
+        using EventClient::update;
+        void update(Topic topic, const char* payload) override;
+        void update(Topic topic, long payload) override;
+
+        static constexpr uint16_t DefaultPort = 8320;
+        // The QMC5883L has a gain of 3000 or 12000 LSB/Gauss, the HMC5883L between 230 and 1370.
+        static constexpr double QmcMinimumGain = 3000.0;
+    protected:
+        virtual bool connectSocket(const char* host, uint16_t port);
+        virtual size_t writeSocket(const uint8_t* buffer, size_t size);
+        virtual void stopSocket();
+        static bool parseTarget(const char* target, char* host, size_t hostSize, uint16_t& port);
+        bool start(const char* target);
+        void stop(const char* reason);
+        bool writeAll(const uint8_t* buffer, size_t size);
+        void writeSamples(const DataQueuePayload* payload);
+
+        static constexpr size_t HostSize = 64;
+        WiFiClient _client;
+        const MagnetoSensorReader* _sensorReader;
+        unsigned long _measureIntervalMicros;
+        bool _streaming = false;
+        long _batchSizeDesired;
+        char _host[HostSize] = {};
+        uint16_t _port = DefaultPort;
+        char _messageBuffer[100] = {};
+    };
+}
+#endif
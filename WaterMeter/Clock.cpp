@@ -12,37 +12,71 @@
 #include "Clock.h"
 #include <sys/time.h>
 #include <cstring>
+#ifdef ESP32
+#include <esp_timer.h>
+#else
+#include <chrono>
+#endif
 
 namespace WaterMeter {
     constexpr unsigned long long MicrosecondsPerSecond = 1000000ULL;
+    constexpr long long SecondsPerDay = 86400LL;
+    constexpr long long SynchronizeIntervalMicros = 1000000LL;
 
-    SemaphoreHandle_t Clock::_timeMutex = xSemaphoreCreateMutex();
-    SemaphoreHandle_t Clock::_formatTimeMutex = xSemaphoreCreateMutex();
+    std::atomic<uint32_t> Clock::_offsetSequence(0);
+    long long Clock::_offset = 0;
+    long long Clock::_synchronizedAt = 0;
+    std::atomic<uint32_t> Clock::_prefixSequence(0);
+    long long Clock::_prefixSeconds = -1;
+    char Clock::_prefix[PrefixSize] = {};
 
     Clock::Clock(EventServer* eventServer) : EventClient(eventServer) {}
 
     void Clock::begin() {
+        synchronize();
         _eventServer->provides(this, Topic::Time);
     }
 
-    // return the number of microseconds since epoch. Can be called from multiple tasks, so using a semaphore
+    // return the number of microseconds since epoch. Can be called from multiple tasks.
     Timestamp Clock::getTimestamp() {
-        timeval currentTime{};
-        xSemaphoreTake(_timeMutex, portMAX_DELAY);
-        gettimeofday(&currentTime, nullptr);
-        xSemaphoreGive(_timeMutex);
-        return static_cast<Timestamp>(currentTime.tv_sec) * 1000000ULL + static_cast<Timestamp>(currentTime.tv_usec);
+        const auto now = monotonicMicros();
+        const auto sequence = _offsetSequence.load(std::memory_order_acquire);
+        // zero means never synchronized, odd means someone is writing
+        if (sequence == 0 || (sequence & 1) != 0) return synchronize(now);
+        const auto offset = _offset;
+        const auto synchronizedAt = _synchronizedAt;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (_offsetSequence.load(std::memory_order_relaxed) != sequence || now - synchronizedAt > SynchronizeIntervalMicros) {
+            return synchronize(now);
+        }
+        return static_cast<Timestamp>(now + offset);
     }
 
     bool Clock::formatTimestamp(const Timestamp timestamp, char* destination, const size_t size) {
         if (size < BufferSize) return false;
-        const auto microseconds = static_cast<long>(timestamp % MicrosecondsPerSecond);
-        const auto seconds = static_cast<time_t>(timestamp / MicrosecondsPerSecond);
-        xSemaphoreTake(_formatTimeMutex, portMAX_DELAY);
-        (void)strftime(destination, size, "%Y-%m-%dT%H:%M:%S.", gmtime(&seconds)); // NOLINT(concurrency-mt-unsafe)
-        xSemaphoreGive(_formatTimeMutex);
-        char* currentPosition = destination + strlen(destination);
-        (void)snprintf(currentPosition, size - strlen(destination), "%06ldZ", microseconds);
+        const auto microseconds = static_cast<unsigned long>(timestamp % MicrosecondsPerSecond);
+        const auto seconds = static_cast<long long>(timestamp / MicrosecondsPerSecond);
+
+        bool cached = false;
+        const auto sequence = _prefixSequence.load(std::memory_order_acquire);
+        if ((sequence & 1) == 0 && _prefixSeconds == seconds) {
+            memcpy(destination, _prefix, PrefixSize);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            cached = _prefixSequence.load(std::memory_order_relaxed) == sequence;
+        }
+        if (!cached) {
+            formatPrefix(seconds, destination);
+            // only update the cache if nobody else is doing that; otherwise we just don't cache this time
+            auto expected = sequence & ~1U;
+            if (_prefixSequence.compare_exchange_strong(expected, expected + 1, std::memory_order_acquire)) {
+                _prefixSeconds = seconds;
+                memcpy(_prefix, destination, PrefixSize);
+                _prefixSequence.store(expected + 2, std::memory_order_release);
+            }
+        }
+        writeDigits(microseconds, 6, destination + PrefixSize);
+        destination[PrefixSize + 6] = 'Z';
+        destination[PrefixSize + 7] = 0;
         return true;
     }
 
@@ -54,4 +88,68 @@ namespace WaterMeter {
         }
         return defaultValue;
     }
-}
\ No newline at end of file
+
+    // Refresh the offset right away, e.g. after the time server set the time
+    void Clock::synchronize() {
+        (void)synchronize(monotonicMicros());
+    }
+
+    // private methods
+
+    // write YYYY-MM-DDTHH:MM:SS. (civil from days algorithm by Howard Hinnant, so no need for the non-reentrant gmtime)
+    void Clock::formatPrefix(const long long seconds, char* destination) {
+        const long long days = seconds / SecondsPerDay;
+        const auto secondOfDay = static_cast<unsigned long>(seconds % SecondsPerDay);
+        const long long shiftedDays = days + 719468;
+        const long long era = shiftedDays / 146097;
+        const auto dayOfEra = static_cast<unsigned long>(shiftedDays - era * 146097);
+        const unsigned long yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+        const unsigned long dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+        const unsigned long monthIndex = (5 * dayOfYear + 2) / 153;
+        const unsigned long day = dayOfYear - (153 * monthIndex + 2) / 5 + 1;
+        const unsigned long month = monthIndex < 10 ? monthIndex + 3 : monthIndex - 9;
+        const auto year = static_cast<unsigned long>(yearOfEra + era * 400 + (month <= 2 ? 1 : 0));
+
+        writeDigits(year, 4, destination);
+        destination[4] = '-';
+        writeDigits(month, 2, destination + 5);
+        destination[7] = '-';
+        writeDigits(day, 2, destination + 8);
+        destination[10] = 'T';
+        writeDigits(secondOfDay / 3600, 2, destination + 11);
+        destination[13] = ':';
+        writeDigits(secondOfDay / 60 % 60, 2, destination + 14);
+        destination[16] = ':';
+        writeDigits(secondOfDay % 60, 2, destination + 17);
+        destination[19] = '.';
+    }
+
+    long long Clock::monotonicMicros() {
+#ifdef ESP32
+        return esp_timer_get_time();
+#else
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    Timestamp Clock::synchronize(const long long monotonicTime) {
+        timeval currentTime{};
+        gettimeofday(&currentTime, nullptr);
+        const auto wallTime = static_cast<long long>(currentTime.tv_sec) * 1000000LL + static_cast<long long>(currentTime.tv_usec);
+        auto sequence = _offsetSequence.load(std::memory_order_relaxed);
+        // if another task is already writing, we leave it to that one
+        if ((sequence & 1) == 0 && _offsetSequence.compare_exchange_strong(sequence, sequence + 1, std::memory_order_acquire)) {
+            _offset = wallTime - monotonicTime;
+            _synchronizedAt = monotonicTime;
+            _offsetSequence.store(sequence + 2, std::memory_order_release);
+        }
+        return static_cast<Timestamp>(wallTime);
+    }
+
+    void Clock::writeDigits(unsigned long value, const int digits, char* destination) {
+        for (int i = digits - 1; i >= 0; i--) {
+            destination[i] = static_cast<char>('0' + value % 10);
+            value /= 10;
+        }
+    }
+}
@@ -9,7 +9,10 @@
 // is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
 // See the License for the specific language governing permissions and limitations under the License.
 
-// Get the current time and format it appropriately. We use a mutex to ensure different processes do not do this simultaneously.
+// Get the current time and format it appropriately, without locks so any task can do this without waiting for another.
+// The time is the monotonic timer plus an offset to the (NTP based) wall clock, which gets refreshed every second.
+// Formatting caches the date and time prefix of the last second, so most calls only need to write the microseconds.
+// Both the offset and the cache are protected by a sequence counter: readers retry or recalculate if a writer was busy.
 
 #ifndef HEADER_CLOCK
 #define HEADER_CLOCK
@@ -22,6 +25,7 @@
 // ReSharper disable once CppUnusedIncludeDirective -- semphr.h requires freeRTOS.h
 #include <freertos/freeRTOS.h>
 #include <freertos/semphr.h>
+#include <atomic>
 
 namespace WaterMeter {
     using Timestamp = unsigned long long;
@@ -34,12 +38,24 @@ namespace WaterMeter {
 
         static Timestamp getTimestamp();
         static bool formatTimestamp(Timestamp timestamp, char* destination, size_t size);
+        static void synchronize();
 
-    private:
         static constexpr int BufferSize = 28;
+    private:
+        static constexpr int PrefixSize = 20;
         char _buffer[BufferSize] = {};
-        static SemaphoreHandle_t _timeMutex;
-        static SemaphoreHandle_t _formatTimeMutex;
+
+        static void formatPrefix(long long seconds, char* destination);
+        static long long monotonicMicros();
+        static Timestamp synchronize(long long monotonicTime);
+        static void writeDigits(unsigned long value, int digits, char* destination);
+
+        static std::atomic<uint32_t> _offsetSequence;
+        static long long _offset;
+        static long long _synchronizedAt;
+        static std::atomic<uint32_t> _prefixSequence;
+        static long long _prefixSeconds;
+        static char _prefix[PrefixSize];
     };
 }
 #endif
@@ -17,28 +17,15 @@
 
 namespace WaterMeter {
     Communicator::Communicator(EventServer* eventServer, OledDriver* oledDriver, Device* device,
-        DataQueue* dataQueue, Serializer* serializer,
-        QueueClient* fromSamplerQueueClient, QueueClient* fromConnectorQueueClient) :
+        DataQueue* dataQueue, Serializer* serializer, EventBus* eventBus) :
         EventClient(eventServer),
         _oledDriver(oledDriver),
         _device(device),
         _dataQueue(dataQueue),
         _serializer(serializer),
-        _samplerQueueClient(fromSamplerQueueClient),
-        _connectorQueueClient(fromConnectorQueueClient) {}
+        _eventBus(eventBus) {}
 
     void Communicator::begin() const {
-
-        // what can be sent to mqtt (note: nothing sent to the sampler)
-        _eventServer->subscribe(_connectorQueueClient, Topic::Alert);
-        _eventServer->subscribe(_connectorQueueClient, Topic::BatchSize);
-        _eventServer->subscribe(_connectorQueueClient, Topic::FreeHeap);
-        _eventServer->subscribe(_connectorQueueClient, Topic::FreeStack);
-        _eventServer->subscribe(_connectorQueueClient, Topic::Rate);
-        _eventServer->subscribe(_connectorQueueClient, Topic::SensorWasReset);
-        _eventServer->subscribe(_connectorQueueClient, Topic::SensorState);
-        _eventServer->subscribe(_connectorQueueClient, Topic::NoDisplayFound);
-        _eventServer->subscribe(_connectorQueueClient, Topic::MeterPayload);
         _eventServer->subscribe(_serializer, Topic::SensorData);
 
         // Dependencies are reduced by publishing a 'Begin' event for objects that only need to get initialized.
@@ -51,25 +38,32 @@ namespace WaterMeter {
 
     void Communicator::loop() const {
         int i = 0;
-        while (_samplerQueueClient->receive() || _connectorQueueClient->receive()) {
+        while (_eventBus->receive(TaskId::Communicator)) {
             i++;
-            // make sure to wait occasionally to allow other task to run
-            if (i % 4 == 0) delay(5);
+            // make sure to give way occasionally. A yield would skip the lower priority log task and the idle task.
+            if (i % 4 == 0) vTaskDelay(1);
         }
         DataQueuePayload* payload;
         while ((payload = _dataQueue->receive()) != nullptr) {
             _eventServer->publish(Topic::SensorData, reinterpret_cast<const char*>(payload));
-            delay(5);
+            vTaskDelay(1);
         }
-        _device->reportHealth();
-        const auto waitedTime = _oledDriver->display();
-        if (waitedTime < 10) {
-            delay(10 - static_cast<int>(waitedTime));
+        const auto healthWaitMillis = (_device->reportHealth() + 999UL) / 1000UL;
+        const auto waitedMillis = _oledDriver->display();
+        if (healthWaitMillis > waitedMillis) {
+            // Sleep until a message or data comes in, or the next health report is due.
+            // The display only changes on events, so those wake us up for it.
+            const TickType_t ticks = pdMS_TO_TICKS(healthWaitMillis - waitedMillis);
+            ulTaskNotifyTake(pdTRUE, ticks == 0 ? 1 : ticks);
         }
     }
 
     [[ noreturn ]] void Communicator::task(void* parameter) {
         const auto me = static_cast<Communicator*>(parameter);
+        // the queues wake us up when something comes in
+        const auto handle = xTaskGetCurrentTaskHandle();
+        me->_eventBus->notifyOnReceive(TaskId::Communicator, handle);
+        me->_dataQueue->notifyOnSend(handle);
         for (;;) {
             me->loop();
         }
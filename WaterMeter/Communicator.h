@@ -17,16 +17,15 @@
 
 #include "DataQueue.h"
 #include "Device.h"
+#include "EventBus.h"
 #include "OledDriver.h"
-#include "QueueClient.h"
 #include "Serializer.h"
 
 namespace WaterMeter {
     class Communicator final : public EventClient {
     public:
         Communicator(EventServer* eventServer, OledDriver* oledDriver, Device* device,
-            DataQueue* dataQueue, Serializer* serializer,
-            QueueClient* fromSamplerQueueClient, QueueClient* fromConnectorQueueClient);
+            DataQueue* dataQueue, Serializer* serializer, EventBus* eventBus);
         void begin() const;
         void loop() const;
         static void task(void* parameter);
@@ -36,8 +35,7 @@ namespace WaterMeter {
         Device* _device;
         DataQueue* _dataQueue;
         Serializer* _serializer;
-        QueueClient* _samplerQueueClient;
-        QueueClient* _connectorQueueClient;
+        EventBus* _eventBus;
     };
 }
 #endif
@@ -9,6 +9,7 @@
 // is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
 // See the License for the specific language governing permissions and limitations under the License.
 
+#include <cstring>
 #include <SafeCString.h>
 #include "Configuration.h"
 #include "secrets.h"
@@ -45,6 +46,12 @@ namespace WaterMeter {
     constexpr auto Firmware = "firmware";
     constexpr auto Url = "url";
 
+    constexpr auto Config = "config";
+    constexpr auto Blob = "blob";
+
+    constexpr uint8_t UseTlsFlag = 1;
+    constexpr uint8_t BssidFlag = 2;
+
     void Configuration::begin(const bool useSecrets) {
         // we use both an #ifdef and an if to enable testing without having to recompile
 #ifdef HEADER_SECRETS
@@ -57,11 +64,86 @@ namespace WaterMeter {
         }
 #endif
 
-        getIpConfig();
-        _next = getWifiConfig(_buffer);
-        _next = getTlsConfig(_next);
-        _next = getMqttConfig(_next);
-        getFirmwareConfig(_next);
+        _preferences->begin(Config, true);
+        const size_t blobSize = _preferences->getBytes(Blob, _buffer, BufferSize);
+        _preferences->end();
+        if (!parseBlob(blobSize)) {
+            rebuildBlob();
+        }
+    }
+
+    // Reads the certificates once, straight into a fixed buffer, so there are no heap allocations.
+    // Called from setup() before the tasks start, since the tasks use the same preferences.
+    // A certificate that doesn't fit in what is left of the buffer stays empty.
+    void Configuration::loadTlsConfig() {
+        if (_isTlsLoaded) return;
+        _isTlsLoaded = true;
+        const char* keys[] = { RootCaCert, DeviceCert, DeviceKey };
+        const char** targets[] = { &tls.rootCaCertificate, &tls.deviceCertificate, &tls.devicePrivateKey };
+        char* next = _tlsBuffer;
+        _preferences->begin(Tls, true);
+        for (int i = 0; i < 3; i++) {
+            *targets[i] = nullptr;
+            if (!_preferences->isKey(keys[i])) continue;
+            const size_t space = static_cast<size_t>(_tlsBuffer + TlsBufferSize - next);
+            if (_preferences->getString(keys[i], next, space) == 0) continue;
+            *targets[i] = next;
+            next += strlen(next) + 1;
+        }
+        _preferences->end();
+    }
+
+    // Blob: version (uint16), size (uint16), CRC-32 of the rest (uint32), IP addresses (5 x uint32), port (uint32),
+    // flags (uint8), mask of the strings that are there (uint8), BSSID (6 bytes), then the strings with terminators.
+    size_t Configuration::buildBlob(uint8_t* blob) const {
+        const char* strings[BlobStringCount] = {
+            wifi.deviceName, wifi.ssid, wifi.password, mqtt.broker, mqtt.user, mqtt.password, firmware.baseUrl
+        };
+        const uint32_t fixed[] = {
+            ip.localIp, ip.gateway, ip.subnetMask, ip.primaryDns, ip.secondaryDns, mqtt.port
+        };
+        uint8_t* next = blob + BlobHeaderSize;
+        memcpy(next, fixed, sizeof fixed);
+        next += sizeof fixed;
+        *next++ = static_cast<uint8_t>((mqtt.useTls ? UseTlsFlag : 0) | (wifi.bssid != nullptr ? BssidFlag : 0));
+        uint8_t* mask = next++;
+        *mask = 0;
+        if (wifi.bssid != nullptr) memcpy(next, wifi.bssid, 6);
+        else memset(next, 0, 6);
+        next += 6;
+        for (int i = 0; i < BlobStringCount; i++) {
+            if (strings[i] == nullptr) continue;
+            const size_t length = strlen(strings[i]) + 1;
+            if (next + length > blob + BufferSize) return 0;
+            memcpy(next, strings[i], length);
+            next += length;
+            *mask |= static_cast<uint8_t>(1 << i);
+        }
+        const auto size = static_cast<uint16_t>(next - blob);
+        const uint32_t crc = crc32(blob + BlobHeaderSize, size - BlobHeaderSize);
+        const uint16_t version = BlobVersion;
+        memcpy(blob, &version, sizeof version);
+        memcpy(blob + 2, &size, sizeof size);
+        memcpy(blob + 4, &crc, sizeof crc);
+        return size;
+    }
+
+    const char** Configuration::blobString(const int index) {
+        const char** strings[BlobStringCount] = {
+            &wifi.deviceName, &wifi.ssid, &wifi.password, &mqtt.broker, &mqtt.user, &mqtt.password, &firmware.baseUrl
+        };
+        return strings[index];
+    }
+
+    uint32_t Configuration::crc32(const uint8_t* data, const size_t size) {
+        uint32_t crc = 0xFFFFFFFF;
+        for (size_t i = 0; i < size; i++) {
+            crc ^= data[i];
+            for (int bit = 0; bit < 8; bit++) {
+                crc = crc >> 1 ^ (0xEDB88320 & (0 - (crc & 1)));
+            }
+        }
+        return ~crc;
     }
 
     int Configuration::freeBufferSpace() const {
@@ -96,15 +178,6 @@ namespace WaterMeter {
         return start;
     }
 
-    char* Configuration::getTlsConfig(char* start) {
-        _preferences->begin(Tls, true);
-        tls.rootCaCertificate = storeToBuffer(RootCaCert, &start);
-        tls.deviceCertificate = storeToBuffer(DeviceCert, &start);
-        tls.devicePrivateKey = storeToBuffer(DeviceKey, &start);
-        _preferences->end();
-        return start;
-    }
-
     char* Configuration::getWifiConfig(char* start) {
         _preferences->begin(Wifi, true);
         wifi.deviceName = storeToBuffer(DeviceName, &start);
@@ -122,8 +195,60 @@ namespace WaterMeter {
         return start;
     }
 
+    void Configuration::invalidateBlob() const {
+        _preferences->begin(Config, false);
+        _preferences->clear();
+        _preferences->end();
+    }
+
+    // points the configuration into the blob in the buffer, if it is valid
+    bool Configuration::parseBlob(const size_t size) {
+        if (size < BlobHeaderSize + BlobFixedSize || size > static_cast<size_t>(BufferSize)) return false;
+        const auto blob = reinterpret_cast<uint8_t*>(_buffer);
+        uint16_t version;
+        uint16_t storedSize;
+        uint32_t crc;
+        memcpy(&version, blob, sizeof version);
+        memcpy(&storedSize, blob + 2, sizeof storedSize);
+        memcpy(&crc, blob + 4, sizeof crc);
+        if (version != BlobVersion || storedSize != size || crc != crc32(blob + BlobHeaderSize, size - BlobHeaderSize)) {
+            return false;
+        }
+
+        uint32_t fixed[6];
+        const uint8_t* next = blob + BlobHeaderSize;
+        memcpy(fixed, next, sizeof fixed);
+        next += sizeof fixed;
+        const uint8_t flags = *next++;
+        const uint8_t mask = *next++;
+        wifi.bssid = (flags & BssidFlag) != 0 ? const_cast<uint8_t*>(next) : nullptr;
+        next += 6;
+        const auto end = reinterpret_cast<const char*>(blob + size);
+        auto text = reinterpret_cast<const char*>(next);
+        for (int i = 0; i < BlobStringCount; i++) {
+            if ((mask & 1 << i) == 0) {
+                *blobString(i) = nullptr;
+                continue;
+            }
+            const void* terminator = memchr(text, 0, static_cast<size_t>(end - text));
+            if (terminator == nullptr) return false;
+            *blobString(i) = text;
+            text = static_cast<const char*>(terminator) + 1;
+        }
+        ip.localIp = fixed[0];
+        ip.gateway = fixed[1];
+        ip.subnetMask = fixed[2];
+        ip.primaryDns = fixed[3];
+        ip.secondaryDns = fixed[4];
+        mqtt.port = fixed[5];
+        mqtt.useTls = (flags & UseTlsFlag) != 0;
+        _next = _buffer + size;
+        return true;
+    }
+
     void Configuration::putFirmwareConfig(const FirmwareConfig* firmwareConfig) const {
         if (firmwareConfig == nullptr) return;
+        invalidateBlob();
         _preferences->begin(Firmware, false);
         _preferences->putString(Url, firmwareConfig->baseUrl);
         _preferences->end();
@@ -131,6 +256,7 @@ namespace WaterMeter {
 
     void Configuration::putIpConfig(const IpConfig* ipConfig) const {
         if (ipConfig == nullptr) return;
+        invalidateBlob();
         _preferences->begin(Ip, false);
         _preferences->clear();
         _preferences->putUInt(Local, ipConfig->localIp);
@@ -143,6 +269,7 @@ namespace WaterMeter {
 
     void Configuration::putMqttConfig(const MqttConfig* mqttConfig) const {
         if (mqttConfig == nullptr) return;
+        invalidateBlob();
         _preferences->begin(Mqtt, false);
         _preferences->clear();
         putStringIfNotNull(Broker, mqttConfig->broker);
@@ -173,6 +300,7 @@ namespace WaterMeter {
 
     void Configuration::putWifiConfig(const WifiConfig* wifiConfig) const {
         if (wifiConfig == nullptr) return;
+        invalidateBlob();
         _preferences->begin(Wifi, false);
         _preferences->clear();
         putStringIfNotNull(DeviceName, wifiConfig->deviceName);
@@ -184,6 +312,23 @@ namespace WaterMeter {
         _preferences->end();
     }
 
+    // read the separate namespaces and store them as a blob, so the next boot only needs one read
+    void Configuration::rebuildBlob() {
+        getIpConfig();
+        _next = getWifiConfig(_buffer);
+        _next = getMqttConfig(_next);
+        _next = getFirmwareConfig(_next);
+
+        uint8_t blob[BufferSize];
+        const size_t size = buildBlob(blob);
+        if (size == 0) return;
+        _preferences->begin(Config, false);
+        _preferences->putBytes(Blob, blob, size);
+        _preferences->end();
+        memcpy(_buffer, blob, size);
+        parseBlob(size);
+    }
+
     char* Configuration::storeToBuffer(const char* key, char** startLocation) {
         if (_preferences->isKey(key)) {
             SafeCString::pointerStrcpy(*startLocation, _buffer, _preferences->getString(key).c_str());
@@ -11,6 +11,9 @@
 
 // Grabs configuration data via the Preferences object. Can also initialize Preferences using a secrets.h file
 // For security reasons this file is not checked in to source control, and can be removed once the preferences are stored.
+// At boot, everything but the TLS material comes from a single versioned and CRC checked blob, read with one NVS call.
+// The strings stay in the blob buffer. If the blob is missing or invalid (e.g. after a put), it is rebuilt from the
+// separate namespaces. The certificates are only read when TLS is used, via loadTlsConfig() in setup().
 
 #ifndef HEADER_CONFIGURATION
 #define HEADER_CONFIGURATION
@@ -65,6 +68,7 @@ namespace WaterMeter {
         WifiConfig wifi{};
         FirmwareConfig firmware{};
         void begin(bool useSecrets = true);
+        void loadTlsConfig();
         void putFirmwareConfig(const FirmwareConfig* firmwareConfig) const;
         void putMqttConfig(const MqttConfig* mqttConfig) const;
         void putIpConfig(const IpConfig* ipConfig) const;
@@ -72,17 +76,30 @@ namespace WaterMeter {
         void putWifiConfig(const WifiConfig* wifiConfig) const;
         int freeBufferSpace() const;
     private:
-        static constexpr int BufferSize = 8192;
+        static constexpr int BufferSize = 1024;
+        // enough for a root CA, a device certificate and an RSA 2048 key in PEM format
+        static constexpr size_t TlsBufferSize = 6144;
+        static constexpr uint16_t BlobVersion = 1;
+        static constexpr size_t BlobHeaderSize = 8;
+        static constexpr size_t BlobFixedSize = 32;
+        static constexpr int BlobStringCount = 7;
         Preferences* _preferences;
         char _buffer[BufferSize] = {};
         char* _next = _buffer;
+        char _tlsBuffer[TlsBufferSize] = {};
+        bool _isTlsLoaded = false;
         char* storeToBuffer(const char* key, char** startLocation);
+        size_t buildBlob(uint8_t* blob) const;
+        const char** blobString(int index);
+        static uint32_t crc32(const uint8_t* data, size_t size);
         char* getFirmwareConfig(char* start);
         void getIpConfig();
         char* getMqttConfig(char* start);
-        char* getTlsConfig(char* start);
         char* getWifiConfig(char* start);
+        void invalidateBlob() const;
+        bool parseBlob(size_t size);
         void putStringIfNotNull(const char* key, const char* value) const;
+        void rebuildBlob();
     };
 }
 #endif
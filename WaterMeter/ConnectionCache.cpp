@@ -0,0 +1,119 @@
+// Copyright 2024 Rik Essenius
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License. You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and limitations under the License.
+
+#ifdef ESP32
+#include <esp_attr.h>
+#endif
+
+#include <cstddef>
+#include <cstring>
+#include "ConnectionCache.h"
+
+namespace WaterMeter {
+    namespace {
+#ifdef ESP32
+        RTC_NOINIT_ATTR ConnectionCacheData cacheData;
+#else
+        ConnectionCacheData cacheData;
+#endif
+    }
+
+    ConnectionCache::ConnectionCache() {
+        if (cacheData.checksum != calculateChecksum(cacheData)) clear();
+    }
+
+    void ConnectionCache::clear() {
+        memset(&cacheData, 0, sizeof cacheData);
+        seal();
+    }
+
+    void ConnectionCache::forgetBroker() {
+        cacheData.brokerHash = 0;
+        seal();
+    }
+
+    void ConnectionCache::forgetLink() {
+        cacheData.ssidHash = 0;
+        seal();
+    }
+
+    bool ConnectionCache::getBroker(const char* broker, IPAddress& ip) const {
+        if (broker == nullptr || cacheData.brokerHash != hash(broker)) return false;
+        ip = load(cacheData.brokerIp);
+        return true;
+    }
+
+    bool ConnectionCache::getLink(const char* ssid, int32_t& channel, uint8_t* bssid, IpConfig& lease) const {
+        if (ssid == nullptr || cacheData.ssidHash != hash(ssid)) return false;
+        channel = cacheData.channel;
+        memcpy(bssid, cacheData.bssid, sizeof cacheData.bssid);
+        lease.localIp = load(cacheData.lease[0]);
+        lease.gateway = load(cacheData.lease[1]);
+        lease.subnetMask = load(cacheData.lease[2]);
+        lease.primaryDns = load(cacheData.lease[3]);
+        lease.secondaryDns = load(cacheData.lease[4]);
+        return true;
+    }
+
+    void ConnectionCache::saveBroker(const char* broker, const IPAddress& ip) {
+        if (broker == nullptr) return;
+        cacheData.brokerHash = hash(broker);
+        store(cacheData.brokerIp, ip);
+        seal();
+    }
+
+    void ConnectionCache::saveLink(const char* ssid, const int32_t channel, const uint8_t* bssid, const IpConfig& lease) {
+        if (ssid == nullptr || bssid == nullptr) return;
+        cacheData.ssidHash = hash(ssid);
+        cacheData.channel = static_cast<uint8_t>(channel);
+        memcpy(cacheData.bssid, bssid, sizeof cacheData.bssid);
+        store(cacheData.lease[0], lease.localIp);
+        store(cacheData.lease[1], lease.gateway);
+        store(cacheData.lease[2], lease.subnetMask);
+        store(cacheData.lease[3], lease.primaryDns);
+        store(cacheData.lease[4], lease.secondaryDns);
+        seal();
+    }
+
+    // FNV-1a. Zero means 'nothing cached', so that is never returned.
+    uint32_t ConnectionCache::hash(const char* text) {
+        uint32_t result = 2166136261u;
+        for (const char* character = text; *character != 0; character++) {
+            result ^= static_cast<uint8_t>(*character);
+            result *= 16777619u;
+        }
+        return result == 0 ? 1 : result;
+    }
+
+    uint32_t ConnectionCache::calculateChecksum(const ConnectionCacheData& data) {
+        const auto bytes = reinterpret_cast<const uint8_t*>(&data);
+        uint32_t result = 2166136261u;
+        for (size_t i = 0; i < offsetof(ConnectionCacheData, checksum); i++) {
+            result ^= bytes[i];
+            result *= 16777619u;
+        }
+        return result;
+    }
+
+    IPAddress ConnectionCache::load(const uint8_t* source) {
+        return {source[0], source[1], source[2], source[3]};
+    }
+
+    void ConnectionCache::seal() {
+        cacheData.checksum = calculateChecksum(cacheData);
+    }
+
+    void ConnectionCache::store(uint8_t* target, const IPAddress& ip) {
+        for (int i = 0; i < 4; i++) {
+            target[i] = ip[i];
+        }
+    }
+}
@@ -0,0 +1,57 @@
+// Copyright 2024 Rik Essenius
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License. You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and limitations under the License.
+
+// Remembers how the last connection was made: the access point (channel and BSSID), the IP lease and the broker address.
+// Trying those first skips the scan, DHCP and the DNS lookup, so a dropped connection (e.g. a mesh hand-over or a brownout)
+// comes back in a fraction of a second instead of several. The users fall back to the full path if the cached details fail.
+// On the device, the data lives in RTC memory, which survives a reset but not a power cycle.
+// A checksum catches the garbage that is there after power-up.
+
+#ifndef HEADER_CONNECTION_CACHE
+#define HEADER_CONNECTION_CACHE
+
+#include <cstdint>
+#include <IPAddress.h>
+
+#include "Configuration.h"
+
+namespace WaterMeter {
+    struct ConnectionCacheData {
+        uint32_t ssidHash;
+        uint32_t brokerHash;
+        uint8_t bssid[6];
+        uint8_t channel;
+        uint8_t reserved;
+        uint8_t lease[5][4];
+        uint8_t brokerIp[4];
+        uint32_t checksum;
+    };
+
+    class ConnectionCache {
+    public:
+        ConnectionCache();
+        void clear();
+        void forgetBroker();
+        void forgetLink();
+        bool getBroker(const char* broker, IPAddress& ip) const;
+        bool getLink(const char* ssid, int32_t& channel, uint8_t* bssid, IpConfig& lease) const;
+        void saveBroker(const char* broker, const IPAddress& ip);
+        void saveLink(const char* ssid, int32_t channel, const uint8_t* bssid, const IpConfig& lease);
+
+    private:
+        static uint32_t hash(const char* text);
+        static uint32_t calculateChecksum(const ConnectionCacheData& data);
+        static void store(uint8_t* target, const IPAddress& ip);
+        static IPAddress load(const uint8_t* source);
+        void seal();
+    };
+}
+#endif
@@ -10,17 +10,16 @@
 // See the License for the specific language governing permissions and limitations under the License.
 
 #include "Connector.h"
+#include "Clock.h"
 #include "LedDriver.h"
-#include "QueueClient.h"
 
 namespace WaterMeter {
     constexpr unsigned long OneHourInMillis = 3600UL * 1000UL;
-    constexpr long LoopDelayMilliSeconds = 50;
 
     // TODO reduce number of parameters
     Connector::Connector(EventServer* eventServer, WiFiManager* wifi, MqttGateway* mqttGateway, TimeServer* timeServer,
         FirmwareManager* firmwareManager, DataQueue* samplerDataQueue, DataQueue* communicatorDataQueue,
-        Serializer* serializer, QueueClient* samplerQueueClient, QueueClient* communicatorQueueClient) :
+        Serializer* serializer, EventBus* eventBus) :
         EventClient(eventServer),
         _wifi(wifi),
         _mqttGateway(mqttGateway),
@@ -29,47 +28,40 @@ namespace WaterMeter {
         _samplerDataQueue(samplerDataQueue),
         _communicatorDataQueue(communicatorDataQueue),
         _serializer(serializer),
-        _samplerQueueClient(samplerQueueClient),
-        _communicatorQueueClient(communicatorQueueClient),
+        _eventBus(eventBus),
         _state(eventServer, Topic::Connection) {}
 
     ConnectionState Connector::loop() {
         connect();
-        delay(LoopDelayMilliSeconds);
+        // sleep until the next deadline of the state, or until a message or sensor data comes in
+        if (_waitMillis > 0) {
+            const TickType_t ticks = pdMS_TO_TICKS(_waitMillis);
+            ulTaskNotifyTake(pdTRUE, ticks == 0 ? 1 : ticks);
+        }
         return _state;
     }
 
-    void Connector::begin(const Configuration* configuration) {
+    void Connector::begin(const Configuration* configuration, const bool parallelBringUp) {
         _state = ConnectionState::Init;
         _waitDuration = WifiInitialWaitDuration;
         _wifiConnectionFailureCount = 0;
-
-        // what can be sent to the sampler (numerical payload)
-        _eventServer->subscribe(_samplerQueueClient, Topic::BatchSizeDesired);
-        _eventServer->subscribe(_samplerQueueClient, Topic::IdleRate);
-        _eventServer->subscribe(_samplerQueueClient, Topic::NonIdleRate);
-        _eventServer->subscribe(_samplerQueueClient, Topic::ResetSensor);
+        _parallelBringUp = parallelBringUp;
+        _isFirmwareCheckDue = false;
+        // TLS certificates can only be validated with the right time
+        _mqttNeedsTime = configuration->mqtt.useTls;
 
         _eventServer->subscribe(_communicatorDataQueue, Topic::Result);
         _eventServer->subscribe(_communicatorDataQueue, Topic::ConnectionError);
         _eventServer->subscribe(_communicatorDataQueue, Topic::Info);
         _eventServer->subscribe(_serializer, Topic::SensorData);
 
-        // what can be sent to the communicator
-        _eventServer->subscribe(_communicatorQueueClient, Topic::BatchSizeDesired);
-
-        _eventServer->subscribe(_communicatorQueueClient, Topic::Connection);
-        _eventServer->subscribe(_communicatorQueueClient, Topic::WifiSummaryReady);
-        _eventServer->subscribe(_communicatorQueueClient, Topic::FreeQueueSize);
-        _eventServer->subscribe(_communicatorQueueClient, Topic::FreeQueueSpaces);
-        _eventServer->subscribe(_communicatorQueueClient, Topic::SetVolume);
-        _eventServer->subscribe(_communicatorQueueClient, Topic::AddVolume);
-        _eventServer->subscribe(_communicatorQueueClient, Topic::UpdateProgress);
-
         _wifi->configure(&configuration->ip);
     }
 
     ConnectionState Connector::connect() {
+        const ConnectionState previousState = _state;
+        // states that wait for something outside our control poll it. Handlers can ask for a different deadline.
+        _waitMillis = PollIntervalMillis;
         // ReSharper disable once CppDefaultCaseNotHandledInSwitchStatement -- all options handled
         switch (_state) {
         case ConnectionState::Init:
@@ -108,14 +100,29 @@ namespace WaterMeter {
         case ConnectionState::Disconnected:
             handleDisconnected();
         }
+        // with parallel bring-up, the firmware check runs as soon as the time is known, whatever MQTT is doing
+        if (_isFirmwareCheckDue && _wifi->isConnected() && pollTime()) {
+            checkFirmware();
+        }
+        // a state change means there is more to do right away
+        if (_state != previousState) _waitMillis = 0;
         return _state;
     }
 
+    unsigned long Connector::waitMillis() const {
+        return _waitMillis;
+    }
+
     // private methods
 
-    void Connector::handleCheckFirmware() {
+    void Connector::checkFirmware() {
         _firmwareManager->begin(_eventServer->request(Topic::MacRaw, ""));
         _firmwareManager->tryUpdate();
+        _isFirmwareCheckDue = false;
+    }
+
+    void Connector::handleCheckFirmware() {
+        checkFirmware();
         _state = ConnectionState::WifiReady;
     }
 
@@ -168,27 +175,36 @@ namespace WaterMeter {
             return;
         }
 
-        while (_samplerQueueClient->receive()) {}
-        while (_communicatorQueueClient->receive()) {}
+        while (_eventBus->receive(TaskId::Connector)) {}
+
+        const bool hasTime = pollTime();
 
         // Retrieve a retained volume message from MQTT and pass it on to the communicator.
         // This should happen only once.
         if (_mqttGateway->getPreviousVolume()) {
-            _eventServer->unsubscribe(_communicatorQueueClient, Topic::AddVolume);
+            _eventBus->unroute(TaskId::Connector, TaskId::Communicator, Topic::AddVolume);
         }
 
         // returns false if disconnected, minimizing risk of losing data from the queue
         if (!_mqttGateway->handleQueue()) {
             return;
         }
+        // the sensor data needs valid timestamps, so keep it in the queue until the time is there
+        if (!hasTime) return;
         DataQueuePayload* payload;
         while ((payload = _samplerDataQueue->receive()) != nullptr) {
             _eventServer->publish(Topic::SensorData, reinterpret_cast<const char*>(payload));
             if (payload->topic == Topic::Result) {
+                _isFlowIdle = payload->buffer.result.pulseCount == 0;
                 _communicatorDataQueue->send(payload);
             }
 
         }
+
+        // a firmware download gets a slice of every round, after the data. Don't sleep long while it runs.
+        if (_firmwareManager->loop(DownloadBudgetMicros, _isFlowIdle)) {
+            _waitMillis = DownloadWaitMillis;
+        }
     }
 
     void Connector::handleRequestTime() {
@@ -207,6 +223,8 @@ namespace WaterMeter {
             return;
         }
         if (_timeServer->timeWasSet()) {
+            // don't wait for the next periodic refresh to pick up the new time
+            Clock::synchronize();
             _state = ConnectionState::CheckFirmware;
             return;
         }
@@ -221,7 +239,10 @@ namespace WaterMeter {
         const unsigned long mqttWaitDuration = micros() - _mqttConnectTimestamp;
         if (mqttWaitDuration >= MqttReconnectWaitDuration) {
             _state = ConnectionState::WifiReady;
+            return;
         }
+        // nothing to check until the wait is over
+        _waitMillis = (MqttReconnectWaitDuration - mqttWaitDuration + 999UL) / 1000UL;
     }
 
     void Connector::handleWifiConnected() {
@@ -233,8 +254,12 @@ namespace WaterMeter {
             _state = ConnectionState::Disconnected;
             return;
         }
-        _state = ConnectionState::RequestTime;
         _wifiConnectionFailureCount = 0;
+        if (_parallelBringUp) {
+            startParallelBringUp();
+            return;
+        }
+        _state = ConnectionState::RequestTime;
     }
 
     void Connector::handleWifiConnecting() {
@@ -258,6 +283,7 @@ namespace WaterMeter {
 
     void Connector::handleWifiReady() {
         if (_wifi->isConnected()) {
+            if (!pollTime() && _mqttNeedsTime) return;
             _state = ConnectionState::MqttConnecting;
             _mqttConnectTimestamp = micros();
             // this is a synchronous call, takes a lot of time
@@ -268,10 +294,41 @@ namespace WaterMeter {
         _state = ConnectionState::Disconnected;
     }
 
+    // Returns whether the time is known. Without parallel bring-up, the states took care of that already.
+    bool Connector::pollTime() {
+        if (!_isTimeRequested) return true;
+        if (_timeServer->timeWasSet()) {
+            Clock::synchronize();
+            _isTimeRequested = false;
+            return true;
+        }
+        if (micros() - _requestTimeTimestamp > TimeserverWaitDuration) {
+            // setting time failed. Retry.
+            _timeServer->setTime();
+            _requestTimeTimestamp = micros();
+        }
+        return false;
+    }
+
+    // ask for the time and go straight on to MQTT. The time and firmware check get picked up while connecting.
+    void Connector::startParallelBringUp() {
+        if (!_timeServer->timeWasSet()) {
+            _timeServer->setTime();
+            _requestTimeTimestamp = micros();
+            _isTimeRequested = true;
+        }
+        _isFirmwareCheckDue = true;
+        _state = ConnectionState::WifiReady;
+    }
+
     // TODO: create new TaskExecutor class that contains task and virtual loop. Saves 14 coverage blocks
 
     [[ noreturn]] void Connector::task(void* parameter) {
         const auto me = static_cast<Connector*>(parameter);
+        // messages from the other tasks and sensor data wake us up
+        const auto handle = xTaskGetCurrentTaskHandle();
+        me->_eventBus->notifyOnReceive(TaskId::Connector, handle);
+        me->_samplerDataQueue->notifyOnSend(handle);
 
         for (;;) {
             me->loop();
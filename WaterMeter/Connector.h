@@ -10,7 +10,12 @@
 // See the License for the specific language governing permissions and limitations under the License.
 
 // Connector runs a process that connects with the outside world. The connect method uses a state machine
-// to make the connection with Wi-Fi, get the time, check for a firmware upgrade and connect to the MQTT server
+// to make the connection with Wi-Fi, get the time, check for a firmware upgrade and connect to the MQTT server.
+// After a state change the next state runs right away. Otherwise the task sleeps until the state's deadline,
+// or until sensor data or a message from another task wakes it up.
+// With parallel bring-up, the time request goes out as soon as Wi-Fi is connected and MQTT connects without waiting
+// for it (unless TLS needs a valid time). The firmware check runs as soon as the time is known, whatever state MQTT
+// is in, and sensor data is only sent once the time is set.
 
 #ifndef HEADER_CONNECTION
 #define HEADER_CONNECTION
@@ -21,7 +26,7 @@
 #include "TimeServer.h"
 #include "ConnectionState.h"
 #include "DataQueue.h"
-#include "QueueClient.h"
+#include "EventBus.h"
 #include "Serializer.h"
 
 namespace WaterMeter {
@@ -36,13 +41,17 @@ namespace WaterMeter {
     public:
         Connector(EventServer* eventServer, WiFiManager* wifi, MqttGateway* mqttGateway, TimeServer* timeServer,
             FirmwareManager* firmwareManager, DataQueue* samplerDataQueue, DataQueue* communicatorDataQueue,
-            Serializer* serializer, QueueClient* samplerQueueClient, QueueClient* communicatorQueueClient);
-        void begin(const Configuration* configuration);
+            Serializer* serializer, EventBus* eventBus);
+        void begin(const Configuration* configuration, bool parallelBringUp = false);
         ConnectionState connect();
         ConnectionState loop();
         static void task(void* parameter);
+        unsigned long waitMillis() const;
 
     private:
+        static constexpr unsigned long PollIntervalMillis = 50UL;
+        static constexpr unsigned long DownloadBudgetMicros = 20UL * 1000UL;
+        static constexpr unsigned long DownloadWaitMillis = 1UL;
         unsigned long _wifiConnectTimestamp = 0UL;
         unsigned long _mqttConnectTimestamp = 0UL;
         unsigned long _requestTimeTimestamp = 0UL;
@@ -55,12 +64,18 @@ namespace WaterMeter {
         DataQueue* _samplerDataQueue;
         DataQueue* _communicatorDataQueue;
         Serializer* _serializer;
-        QueueClient* _samplerQueueClient;
-        QueueClient* _communicatorQueueClient;
+        EventBus* _eventBus;
         ChangePublisher<ConnectionState> _state;
         unsigned long _waitDuration = WifiInitialWaitDuration;
         unsigned int _wifiConnectionFailureCount = 0;
+        unsigned long _waitMillis = 0UL;
+        bool _parallelBringUp = false;
+        bool _mqttNeedsTime = false;
+        bool _isTimeRequested = false;
+        bool _isFirmwareCheckDue = false;
+        bool _isFlowIdle = false;
 
+        void checkFirmware();
         void handleCheckFirmware();
         void handleDisconnected();
         void handleInit();
@@ -73,6 +88,8 @@ namespace WaterMeter {
         void handleWifiConnected();
         void handleWifiConnecting();
         void handleWifiReady();
+        bool pollTime();
+        void startParallelBringUp();
     };
 }
 #endif
@@ -0,0 +1,142 @@
+// Copyright 2024 Rik Essenius
+// 
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License. You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and limitations under the License.
+
+#include <cstdlib>
+#include "ConsumptionHistory.h"
+#include "EventServer.h"
+
+namespace WaterMeter {
+    constexpr auto HistoryNamespace = "history";
+    // the chunks are m00, m01, ... for minutes, and so on
+    constexpr char MinutesPrefix = 'm';
+    constexpr char HoursPrefix = 'h';
+    constexpr char DaysPrefix = 'd';
+    constexpr auto PeriodsKey = "periods";
+
+    // Before the time server set the time we're in 1970, and we can't tell where pulses belong
+    constexpr uint32_t OneYearInSeconds = 31536000;
+
+    ConsumptionHistory::ConsumptionHistory(EventServer* eventServer, Preferences* preferences, PayloadBuilder* payloadBuilder) :
+        EventClient(eventServer),
+        _preferences(preferences),
+        _payloadBuilder(payloadBuilder) {
+        eventServer->subscribe(this, Topic::Begin);
+    }
+
+    void ConsumptionHistory::begin() {
+        load();
+        _eventServer->subscribe(this, Topic::History);
+    }
+
+    void ConsumptionHistory::addPulse(const uint32_t seconds) {
+        if (seconds < OneYearInSeconds) return;
+        _minutes.add(seconds);
+        const bool isNewHour = _hours.add(seconds);
+        _days.add(seconds);
+        if (isNewHour) {
+            save();
+        }
+    }
+
+    const char* ConsumptionHistory::query(const char* request, const uint32_t now) {
+        char tier[8];
+        const char* comma = strchr(request, ',');
+        const auto tierLength = comma == nullptr ? strlen(request) : static_cast<size_t>(comma - request);
+        if (tierLength >= sizeof tier) return nullptr;
+        memcpy(tier, request, tierLength);
+        tier[tierLength] = 0;
+
+        unsigned long count = MaxQueryCount;
+        unsigned long skip = 0;
+        if (comma != nullptr) {
+            char* end;
+            count = strtoul(comma + 1, &end, 10);
+            if (*end == ',') {
+                skip = strtoul(end + 1, &end, 10);
+            }
+            if (*end != 0) return nullptr;
+        }
+        if (count == 0 || count > MaxQueryCount) count = MaxQueryCount;
+
+        bool ok;
+        if (strcmp(tier, "minute") == 0) ok = writeQuery(tier, _minutes, now, count, skip);
+        else if (strcmp(tier, "hour") == 0) ok = writeQuery(tier, _hours, now, count, skip);
+        else if (strcmp(tier, "day") == 0) ok = writeQuery(tier, _days, now, count, skip);
+        else return nullptr;
+        return ok ? _payloadBuilder->toString() : nullptr;
+    }
+
+    void ConsumptionHistory::update(const Topic topic, const char* payload) {
+        if (topic != Topic::History) return;
+        const auto now = static_cast<uint32_t>(Clock::getTimestamp() / 1000000ULL);
+        const auto result = query(payload, now);
+        if (result == nullptr) {
+            _eventServer->publish(this, Topic::ErrorFormatted, "History: invalid query");
+            return;
+        }
+        _eventServer->publish(this, Topic::HistoryFormatted, result);
+    }
+
+    void ConsumptionHistory::update(const Topic topic, const long payload) {
+        // initialize after the logger, so it can report
+        if (topic == Topic::Begin && payload) {
+            begin();
+        }
+    }
+
+    // private methods
+
+    void ConsumptionHistory::load() {
+        uint32_t periods[3] = {};
+        _preferences->begin(HistoryNamespace, true);
+        if (_preferences->getBytes(PeriodsKey, periods, sizeof periods) == sizeof periods) {
+            _minutes.load(_preferences, MinutesPrefix, periods[0]);
+            _hours.load(_preferences, HoursPrefix, periods[1]);
+            _days.load(_preferences, DaysPrefix, periods[2]);
+        }
+        _preferences->end();
+    }
+
+    void ConsumptionHistory::save() {
+        const uint32_t periods[3] = { _minutes.lastPeriod(), _hours.lastPeriod(), _days.lastPeriod() };
+        _preferences->begin(HistoryNamespace, false);
+        // evaluate all three, so one failing ring doesn't keep the others from being saved
+        const bool minutesSaved = _minutes.save(_preferences, MinutesPrefix);
+        const bool hoursSaved = _hours.save(_preferences, HoursPrefix);
+        const bool daysSaved = _days.save(_preferences, DaysPrefix);
+        const bool periodsSaved = _preferences->putBytes(PeriodsKey, periods, sizeof periods) == sizeof periods;
+        _preferences->end();
+        if (!(minutesSaved && hoursSaved && daysSaved && periodsSaved)) {
+            _eventServer->publish(this, Topic::ErrorFormatted, "History: could not save, retrying next hour");
+        }
+    }
+
+    // Returns false if the skip goes past what the ring keeps, since the start would wrap around.
+    template <typename Ring>
+    bool ConsumptionHistory::writeQuery(const char* tier, const Ring& ring, const uint32_t now, const unsigned long count, const unsigned long skip) {
+        const uint32_t currentPeriod = now / ring.periodSeconds();
+        if (skip >= ring.size() || skip > currentPeriod) return false;
+        const uint32_t lastPeriod = currentPeriod - static_cast<uint32_t>(skip);
+        // without a valid time, there may be fewer periods than asked for
+        const uint32_t firstPeriod = count > lastPeriod ? 0 : lastPeriod - static_cast<uint32_t>(count) + 1;
+        _payloadBuilder->initialize();
+        _payloadBuilder->writeParam("tier", tier);
+        _payloadBuilder->writeTimestampParam("start", static_cast<Timestamp>(firstPeriod) * ring.periodSeconds() * 1000000ULL);
+        _payloadBuilder->writeParam("interval", ring.periodSeconds());
+        _payloadBuilder->writeArrayStart("pulses");
+        for (uint32_t period = firstPeriod; period <= lastPeriod; period++) {
+            _payloadBuilder->writeArrayValue(static_cast<uint32_t>(ring.at(period)));
+        }
+        _payloadBuilder->writeArrayEnd();
+        _payloadBuilder->writeGroupEnd();
+        return true;
+    }
+}
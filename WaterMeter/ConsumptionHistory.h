@@ -0,0 +1,164 @@
+// Copyright 2024 Rik Essenius
+// 
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License. You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and limitations under the License.
+
+// Keeps the number of pulses per minute for a day, per hour for 30 days and per day for a year in fixed rings.
+// The meter adds every pulse, which only touches the current bucket of each ring (and clears skipped buckets).
+// The rings are saved to Preferences whenever a new hour starts, and restored at boot. They are stored in chunks of
+// 240 bytes, and only the chunks with changed buckets are written: a few hundred bytes an hour instead of all 7 KB,
+// which NVS would need room for twice while it replaces the old copy. A chunk that fails to save is tried again next hour.
+// A History query (tier[,count[,skip]], e.g. "hour,24,0") returns the most recent buckets, oldest first.
+// Skipping the whole ring is an invalid query.
+
+#ifndef HEADER_CONSUMPTION_HISTORY
+#define HEADER_CONSUMPTION_HISTORY
+
+#include <cstring>
+#include <limits>
+#include <Preferences.h>
+#include "EventClient.h"
+#include "PayloadBuilder.h"
+
+namespace WaterMeter {
+    template <typename Count, uint16_t Size>
+    class HistoryRing {
+    public:
+        explicit HistoryRing(const uint32_t periodSeconds) : _periodSeconds(periodSeconds) {}
+
+        // returns whether a new period started
+        bool add(const uint32_t seconds) {
+            const uint32_t period = seconds / _periodSeconds;
+            bool isNewPeriod = false;
+            if (period > _lastPeriod) {
+                if (period - _lastPeriod >= Size) {
+                    memset(_counts, 0, sizeof _counts);
+                    _dirtyChunks = AllChunks;
+                }
+                else {
+                    for (uint32_t skipped = _lastPeriod + 1; skipped <= period; skipped++) {
+                        _counts[skipped % Size] = 0;
+                        markDirty(skipped % Size);
+                    }
+                }
+                _lastPeriod = period;
+                isNewPeriod = true;
+            }
+            // if the clock went back a bit, we count it in the latest period
+            const auto index = _lastPeriod % Size;
+            auto& count = _counts[index];
+            if (count < std::numeric_limits<Count>::max()) {
+                count++;
+                markDirty(index);
+            }
+            return isNewPeriod;
+        }
+
+        Count at(const uint32_t period) const {
+            if (period > _lastPeriod || _lastPeriod - period >= Size) return 0;
+            return _counts[period % Size];
+        }
+
+        uint32_t dirtyChunks() const { return _dirtyChunks; }
+        uint32_t lastPeriod() const { return _lastPeriod; }
+        uint32_t periodSeconds() const { return _periodSeconds; }
+        uint16_t size() const { return Size; }
+
+        // only takes the stored rings if all chunks are there, so we don't mix old and new data
+        void load(Preferences* preferences, const char prefix, const uint32_t lastPeriod) {
+            for (uint8_t chunk = 0; chunk < ChunkCount; chunk++) {
+                char key[KeySize];
+                chunkKey(prefix, chunk, key);
+                if (preferences->getBytes(key, chunkStart(chunk), chunkBytes(chunk)) != chunkBytes(chunk)) {
+                    memset(_counts, 0, sizeof _counts);
+                    return;
+                }
+            }
+            _lastPeriod = lastPeriod;
+            _dirtyChunks = 0;
+        }
+
+        // writes the chunks that changed since the last save. Returns false if one of them failed.
+        bool save(Preferences* preferences, const char prefix) {
+            bool isSaved = true;
+            for (uint8_t chunk = 0; chunk < ChunkCount; chunk++) {
+                const uint32_t mask = 1UL << chunk;
+                if ((_dirtyChunks & mask) == 0) continue;
+                char key[KeySize];
+                chunkKey(prefix, chunk, key);
+                if (preferences->putBytes(key, chunkStart(chunk), chunkBytes(chunk)) == chunkBytes(chunk)) {
+                    _dirtyChunks &= ~mask;
+                }
+                else {
+                    isSaved = false;
+                }
+            }
+            return isSaved;
+        }
+
+        static constexpr uint16_t ChunkBytes = 240;
+        static constexpr uint16_t BucketsPerChunk = ChunkBytes / sizeof(Count);
+        static constexpr uint8_t ChunkCount = (Size + BucketsPerChunk - 1) / BucketsPerChunk;
+
+    private:
+        static_assert(ChunkCount < 32, "Dirty chunks must fit in 32 bits");
+        static constexpr uint32_t AllChunks = (1UL << ChunkCount) - 1;
+        static constexpr uint8_t KeySize = 4;
+
+        static void chunkKey(const char prefix, const uint8_t chunk, char* key) {
+            key[0] = prefix;
+            key[1] = static_cast<char>('0' + chunk / 10);
+            key[2] = static_cast<char>('0' + chunk % 10);
+            key[3] = 0;
+        }
+
+        size_t chunkBytes(const uint8_t chunk) const {
+            const auto buckets = chunk == ChunkCount - 1 ? Size - chunk * BucketsPerChunk : BucketsPerChunk;
+            return buckets * sizeof(Count);
+        }
+
+        Count* chunkStart(const uint8_t chunk) { return _counts + chunk * BucketsPerChunk; }
+        const Count* chunkStart(const uint8_t chunk) const { return _counts + chunk * BucketsPerChunk; }
+        void markDirty(const uint32_t index) { _dirtyChunks |= 1UL << (index / BucketsPerChunk); }
+
+        uint32_t _periodSeconds;
+        uint32_t _lastPeriod = 0;
+        uint32_t _dirtyChunks = 0;
+        Count _counts[Size] = {};
+    };
+
+    class ConsumptionHistory final : public EventClient {
+    public:
+        ConsumptionHistory(EventServer* eventServer, Preferences* preferences, PayloadBuilder* payloadBuilder);
+        void begin();
+        void addPulse(uint32_t seconds);
+        const char* query(const char* request, uint32_t now);
+        void update(Topic topic, const char* payload) override;
+        void update(Topic topic, long payload) override;
+
+        static constexpr uint16_t MaxQueryCount = 24;
+        static constexpr uint16_t MinuteCount = 1440;
+        static constexpr uint16_t HourCount = 720;
+        static constexpr uint16_t DayCount = 365;
+
+    private:
+        template <typename Ring>
+        bool writeQuery(const char* tier, const Ring& ring, uint32_t now, unsigned long count, unsigned long skip);
+        void load();
+        void save();
+
+        Preferences* _preferences;
+        PayloadBuilder* _payloadBuilder;
+        // a minute can't have more than 65535 pulses, so 16 bits is enough there
+        HistoryRing<uint16_t, MinuteCount> _minutes{60};
+        HistoryRing<uint32_t, HourCount> _hours{3600};
+        HistoryRing<uint32_t, DayCount> _days{86400};
+    };
+}
+#endif
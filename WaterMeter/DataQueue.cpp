@@ -16,59 +16,202 @@
 
 namespace WaterMeter {
     DataQueue::DataQueue(EventServer* eventServer, DataQueuePayload* payload, const int8_t index, const long queueSize,
-        const long epsilon, const long lowThreshold) :
+        const long epsilon, const long lowThreshold, const long resultLaneSize, const long messageLaneSize) :
         EventClient(eventServer),
-        _bufferHandle(xRingbufferCreate(queueSize, RINGBUF_TYPE_ALLOWSPLIT)),
         _freeSpace(eventServer, Topic::FreeQueueSize, epsilon, lowThreshold, index),
-        _payload(payload) {}
+        _payload(payload),
+        _bulkReceived(0) {
+        // the lanes share the queue size; without lane sizes, everything goes through the bulk lane
+        _bufferHandle[BulkLane] = xRingbufferCreate(queueSize - resultLaneSize - messageLaneSize, RINGBUF_TYPE_ALLOWSPLIT);
+        if (resultLaneSize > 0) _bufferHandle[ResultLane] = xRingbufferCreate(resultLaneSize, RINGBUF_TYPE_ALLOWSPLIT);
+        if (messageLaneSize > 0) _bufferHandle[MessageLane] = xRingbufferCreate(messageLaneSize, RINGBUF_TYPE_ALLOWSPLIT);
+    }
 
     bool DataQueue::canSend(const DataQueuePayload* payload) {
-        return freeSpace() >= requiredSize(payload->size());
+        const Lane lane = laneFor(payload->topic);
+        const size_t size = payload->size();
+        if (lane == BulkLane) return fits(lane, size);
+        if (fits(lane, size) && !hasOverflows()) return true;
+        // results and messages that don't fit their own lane can push out samples, but not earlier overflows.
+        // If the head can be dropped, send() may still need more, so this is an estimate.
+        return _overflowCount < MaxOverflows && (fits(BulkLane, size) || !overflowAtHead());
+    }
+
+    // the room was checked when reserving it, so this doesn't need to query the buffer again
+    bool DataQueue::commit(const DataQueuePayload* payload, const size_t reservedSize) {
+        release(reservedSize, payload->topic);
+        const Lane lane = laneFor(payload->topic);
+        // behind earlier overflows, the reserved room can't be used without getting out of order
+        if (lane != BulkLane && hasOverflows()) return send(payload);
+        return sendToBuffer(lane, payload, payload->size());
+    }
+
+    unsigned long DataQueue::droppedCount() const { return _droppedCount; }
+
+    bool DataQueue::fits(const Lane lane, const size_t size) {
+        return requiredSize(size) + _reservedSpace[lane] <= freeSpace(lane);
     }
 
     size_t DataQueue::freeSpace() {
-        const auto space = xRingbufferGetCurFreeSize(_bufferHandle);
+        for (int lane = 0; lane < LaneCount; lane++) {
+            if (_bufferHandle[lane] != nullptr) _laneFreeSpace[lane] = xRingbufferGetCurFreeSize(_bufferHandle[lane]);
+        }
+        return publishFreeSpace();
+    }
+
+    // only queries the lane itself; the other lanes count with the space they had last time
+    size_t DataQueue::freeSpace(const Lane lane) {
+        _laneFreeSpace[lane] = xRingbufferGetCurFreeSize(_bufferHandle[lane]);
+        publishFreeSpace();
+        return _laneFreeSpace[lane];
+    }
+
+    RingbufHandle_t DataQueue::handle() const { return _bufferHandle[BulkLane]; }
+
+    RingbufHandle_t DataQueue::handle(const Topic topic) const { return _bufferHandle[laneFor(topic)]; }
+
+    DataQueue::Lane DataQueue::laneFor(const Topic topic) const {
+        Lane lane;
+        switch (topic) {
+        case Topic::Result:
+            lane = ResultLane;
+            break;
+        case Topic::ConnectionError:
+        case Topic::Info:
+            lane = MessageLane;
+            break;
+        default:
+            lane = BulkLane;
+        }
+        return _bufferHandle[lane] == nullptr ? BulkLane : lane;
+    }
+
+    // Drops the oldest samples and traces until there is room in the bulk lane. It stops at a result or message that
+    // overflowed earlier, so those stay in order. Returns whether there is room.
+    bool DataQueue::makeRoom(const size_t size) {
+        for (int i = 0; i < MaxEvictions; i++) {
+            if (fits(BulkLane, size)) return true;
+            if (overflowAtHead() || !receiveFrom(BulkLane, &_evicted)) return false;
+            const Lane lane = laneFor(_evicted.topic);
+            if (lane == BulkLane) {
+                _droppedCount++;
+                continue;
+            }
+            // The consumer took the head in the meantime, so we got an overflowed item. The consumer only gets to the
+            // bulk lane when the other lanes are empty, so it goes back in its own lane, still ahead of newer overflows.
+            const size_t evictedSize = _evicted.size();
+            if (!sendToBuffer(lane, &_evicted, evictedSize) && !sendOverflow(&_evicted, evictedSize)) {
+                _droppedCount++;
+            }
+        }
+        return fits(BulkLane, size);
+    }
+
+    // ReSharper disable once CppParameterMayBeConst -- introduces misplaced const
+    void DataQueue::notifyOnSend(TaskHandle_t task) {
+        _notifyTask = task;
+    }
+
+    // whether results or messages that overflowed into the bulk lane are still waiting there
+    bool DataQueue::hasOverflows() {
+        const uint32_t head = _bulkReceived.load();
+        // forget the overflows that were received already
+        while (_overflowCount > 0 && static_cast<int32_t>(_overflowSequence[_overflowHead] - head) < 0) {
+            _overflowHead = (_overflowHead + 1) % MaxOverflows;
+            _overflowCount--;
+        }
+        return _overflowCount > 0;
+    }
+
+    // whether the oldest item in the bulk lane is a result or message that overflowed into it
+    bool DataQueue::overflowAtHead() {
+        return hasOverflows() && _overflowSequence[_overflowHead] == _bulkReceived.load();
+    }
+
+    size_t DataQueue::publishFreeSpace() {
+        size_t space = 0;
+        for (const auto laneSpace : _laneFreeSpace) space += laneSpace;
         _freeSpace = static_cast<long>(space);
         return space;
     }
 
-    RingbufHandle_t DataQueue::handle() const { return _bufferHandle; }
+    void DataQueue::release(const size_t reservedSize, const Topic topic) {
+        const size_t space = requiredSize(reservedSize);
+        size_t& reservedSpace = _reservedSpace[laneFor(topic)];
+        reservedSpace = space > reservedSpace ? 0 : reservedSpace - space;
+    }
 
     size_t DataQueue::requiredSize(const size_t realSize) {
         // round up to nearest 32 bit aligned size, and add an 8 byte header
         return (realSize + 3) / 4 * 4 + 8;
     }
 
+    // the lanes are emptied in priority order
     DataQueuePayload* DataQueue::receive() const {
+        for (int lane = 0; lane < LaneCount; lane++) {
+            if (_bufferHandle[lane] != nullptr && receiveFrom(static_cast<Lane>(lane), _payload)) return _payload;
+        }
+        return nullptr;
+    }
+
+    bool DataQueue::receiveFrom(const Lane lane, DataQueuePayload* payload) const {
         char* item1 = nullptr;
         char* item2 = nullptr;
         size_t item1Size;
         size_t item2Size;
         const BaseType_t returnValue = xRingbufferReceiveSplit(
-            _bufferHandle,
+            _bufferHandle[lane],
             reinterpret_cast<void**>(&item1),
             reinterpret_cast<void**>(&item2),
             &item1Size,
             &item2Size,
             0);
 
-        if (returnValue != pdTRUE || item1 == nullptr) return nullptr;
+        if (returnValue != pdTRUE || item1 == nullptr) return false;
+        if (lane == BulkLane) _bulkReceived.fetch_add(1);
 
-        memcpy(_payload, item1, item1Size);
-        vRingbufferReturnItem(_bufferHandle, item1);
+        memcpy(payload, item1, item1Size);
+        vRingbufferReturnItem(_bufferHandle[lane], item1);
         if (item2 != nullptr) {
-            void* targetAddress = reinterpret_cast<char*>(_payload) + item1Size;
+            void* targetAddress = reinterpret_cast<char*>(payload) + item1Size;
             memcpy(targetAddress, item2, item2Size);
-            vRingbufferReturnItem(_bufferHandle, item2);
+            vRingbufferReturnItem(_bufferHandle[lane], item2);
         }
-        return _payload;
+        return true;
+    }
+
+    bool DataQueue::reserve(const size_t size, const Topic topic) {
+        const Lane lane = laneFor(topic);
+        if (!fits(lane, size)) return false;
+        _reservedSpace[lane] += requiredSize(size);
+        return true;
     }
 
     bool DataQueue::send(const DataQueuePayload* payload) {
         // optimizing the use of the buffer by not sending unused parts
         const size_t size = payload->size();
-        if (requiredSize(size) > freeSpace()) return false;
-        return xRingbufferSend(_bufferHandle, payload, size, 0) == pdTRUE;
+        const Lane lane = laneFor(payload->topic);
+        if (lane == BulkLane) return fits(lane, size) && sendToBuffer(lane, payload, size);
+        // while earlier ones wait in the bulk lane, newer results and messages go there too, so they stay in order
+        if (fits(lane, size) && !hasOverflows()) return sendToBuffer(lane, payload, size);
+        if (_overflowCount == MaxOverflows || !makeRoom(size)) return false;
+        return sendOverflow(payload, size);
+    }
+
+    // remember where the item goes, so eviction can stop there
+    bool DataQueue::sendOverflow(const DataQueuePayload* payload, const size_t size) {
+        if (_overflowCount == MaxOverflows) return false;
+        _overflowSequence[(_overflowHead + _overflowCount) % MaxOverflows] = _bulkSent;
+        if (!sendToBuffer(BulkLane, payload, size)) return false;
+        _overflowCount++;
+        return true;
+    }
+
+    bool DataQueue::sendToBuffer(const Lane lane, const DataQueuePayload* payload, const size_t size) {
+        if (xRingbufferSend(_bufferHandle[lane], payload, size, 0) == pdFALSE) return false;
+        if (lane == BulkLane) _bulkSent++;
+        if (_notifyTask != nullptr) xTaskNotifyGive(_notifyTask);
+        return true;
     }
 
     void DataQueue::update(const Topic topic, const char* payload) {
@@ -78,4 +221,4 @@ namespace WaterMeter {
         SafeCString::strcpy(payloadToSend.buffer.message, payload);
         send(&payloadToSend);
     }
-}
\ No newline at end of file
+}
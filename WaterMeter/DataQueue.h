@@ -11,6 +11,14 @@
 
 // We use a data queue to transport larger items between two processes - usually from Sampler to Communicator
 // We do this to limit the number of times we need to send data, but also to be able to deal with incidental network glitches.
+// A producer that fills a payload over time can reserve room once, and commit the payload without checking again.
+// All producers of a queue run in the same task, so the reservations don't need a lock.
+// A queue can be split in lanes: results, messages and the bulk (samples, traces). Each lane has its own ring buffer,
+// and receive() empties them in that order, so after an outage the results go out before the backlog of samples.
+// If a result or message doesn't fit its lane, it overflows to the bulk lane, where the oldest samples and traces make room.
+// Eviction stops at an overflowed result or message, so those are never dropped or moved out of order. While overflows
+// wait in the bulk lane, newer results and messages go there as well, behind them. When nothing can be
+// evicted, canSend() returns false so the producer reports that it is blocked.
 
 #ifndef HEADER_DATA_QUEUE
 #define HEADER_DATA_QUEUE
@@ -18,6 +26,7 @@
 // ReSharper disable once CppUnusedIncludeDirective -- false positive
 #include <freertos/freeRTOS.h>
 #include <freertos/ringbuf.h>
+#include <atomic>
 
 #include "EventClient.h"
 #include "LongChangePublisher.h"
@@ -27,20 +36,53 @@ namespace WaterMeter {
     class DataQueue final : public EventClient {
     public:
         DataQueue(EventServer* eventServer, DataQueuePayload* payload, int8_t index = 0, long queueSize = 35840,
-            long epsilon = 1024, long lowThreshold = 2048);
+            long epsilon = 1024, long lowThreshold = 2048, long resultLaneSize = 0, long messageLaneSize = 0);
 
         bool canSend(const DataQueuePayload* payload);
+        bool commit(const DataQueuePayload* payload, size_t reservedSize);
+        unsigned long droppedCount() const;
         size_t freeSpace();
         RingbufHandle_t handle() const;
+        RingbufHandle_t handle(Topic topic) const;
         DataQueuePayload* receive() const;
+        void notifyOnSend(TaskHandle_t task);
+        void release(size_t reservedSize, Topic topic);
         static size_t requiredSize(size_t realSize);
+        bool reserve(size_t size, Topic topic);
         bool send(const DataQueuePayload* payload);
         void update(Topic topic, const char* payload) override;
 
     private:
-        RingbufHandle_t _bufferHandle = nullptr;
+        enum Lane : uint8_t { ResultLane = 0, MessageLane, BulkLane, LaneCount };
+        static constexpr int MaxEvictions = 32;
+        static constexpr uint8_t MaxOverflows = 128;
+
+        bool fits(Lane lane, size_t size);
+        bool hasOverflows();
+        size_t freeSpace(Lane lane);
+        Lane laneFor(Topic topic) const;
+        bool makeRoom(size_t size);
+        bool overflowAtHead();
+        size_t publishFreeSpace();
+        bool receiveFrom(Lane lane, DataQueuePayload* payload) const;
+        bool sendOverflow(const DataQueuePayload* payload, size_t size);
+        bool sendToBuffer(Lane lane, const DataQueuePayload* payload, size_t size);
+
+        RingbufHandle_t _bufferHandle[LaneCount] = {};
+        size_t _laneFreeSpace[LaneCount] = {};
+        size_t _reservedSpace[LaneCount] = {};
         LongChangePublisher _freeSpace;
         DataQueuePayload* _payload;
+        DataQueuePayload _evicted{};
+        // Positions of the overflowed items in the bulk lane, counted in items sent to and received from it.
+        // Only the producer sends, but the producer (evicting) and the consumer both receive.
+        uint32_t _overflowSequence[MaxOverflows] = {};
+        uint8_t _overflowHead = 0;
+        uint8_t _overflowCount = 0;
+        uint32_t _bulkSent = 0;
+        mutable std::atomic<uint32_t> _bulkReceived;
+        TaskHandle_t _notifyTask = nullptr;
+        unsigned long _droppedCount = 0;
     };
 }
 #endif
@@ -25,6 +25,9 @@ namespace WaterMeter {
             // this assumes that value is the last element in the struct
             size += offsetof(Samples, value) + buffer.samples.count * sizeof Samples::value[0];
             break;
+        case Topic::Trace:
+            size += offsetof(TraceData, record) + buffer.trace.count * sizeof TraceData::record[0];
+            break;
         case Topic::ConnectionError:
         case Topic::Info:
             size += strlen(buffer.message) + 1;
@@ -19,9 +19,11 @@
 #include "Clock.h"
 #include "EventClient.h"
 #include "SensorSample.h"
+#include "TraceRecord.h"
 
 namespace WaterMeter {
     constexpr uint16_t MaxSamples = 25;
+    constexpr uint16_t MaxTraceRecords = 12;
 
     struct Samples {
         uint16_t count;
@@ -47,9 +49,17 @@ namespace WaterMeter {
         uint32_t maxDuration;
     };
 
+    // TraceData size must be <= Samples size
+
+    struct TraceData {
+        uint16_t count;
+        TraceRecord record[MaxTraceRecords];
+    };
+
     union Content {
         Samples samples{};
         ResultData result;
+        TraceData trace;
         char message[sizeof(Samples)];
         uint32_t value;
     };
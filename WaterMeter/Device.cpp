@@ -11,12 +11,16 @@
 
 // ReSharper disable CppParameterMayBeConst -- does not work because of taskHandle_t definition
 
+#include <algorithm>
 #include <ESP.h>
 
 #include "Device.h"
 
 namespace WaterMeter {
-    Device::Device(EventServer* eventServer) : EventClient(eventServer),
+    constexpr unsigned long Device::HeapIntervalMicros;
+
+    Device::Device(EventServer* eventServer, TaskProfiler* profiler) : EventClient(eventServer),
+        _profiler(profiler),
         // Only catch larger variations or alarmingly low values to avoid very frequent updates
         _freeHeap(eventServer, Topic::FreeHeap, 5000L, 20000L),
         // catch all changes as this is not expected to change
@@ -39,11 +43,20 @@ namespace WaterMeter {
         return ESP.getFreeHeap();  // NOLINT(bugprone-narrowing-conversions)
     }
 
-    void Device::reportHealth() {
+    // returns the time until the next report is due, so the caller can sleep until then
+    unsigned long Device::reportHealth() {
         _freeHeap = freeHeap();
-        if (_samplerHandle == nullptr) return;
-        _freeStackSampler = freeStack(_samplerHandle);
-        _freeStackCommunicator = freeStack(_communicatorHandle);
-        _freeStackConnector = freeStack(_connectorHandle);
+        unsigned long waitMicros = HeapIntervalMicros;
+        if (_profiler != nullptr) waitMicros = std::min(waitMicros, _profiler->report());
+        if (_samplerHandle == nullptr) return waitMicros;
+        const auto now = micros();
+        if (!_isStackScanned || now - _stackScanTimestamp >= StackScanIntervalMicros) {
+            _stackScanTimestamp = now;
+            _isStackScanned = true;
+            _freeStackSampler = freeStack(_samplerHandle);
+            _freeStackCommunicator = freeStack(_communicatorHandle);
+            _freeStackConnector = freeStack(_connectorHandle);
+        }
+        return std::min(waitMicros, StackScanIntervalMicros - (now - _stackScanTimestamp));
     }
 }
\ No newline at end of file
@@ -10,20 +10,27 @@
 // See the License for the specific language governing permissions and limitations under the License.
 
 // Provides several metrics from the device itself, to monitor health.
+// Scanning the stacks for their high-water marks is expensive, so that runs on a slow schedule.
+// reportHealth() returns how long the caller can sleep before the next report is due.
 
 #ifndef HEADER_DEVICE
 #define HEADER_DEVICE
 
 #include <ESP.h>
 #include "LongChangePublisher.h"
+#include "TaskProfiler.h"
 
 namespace WaterMeter {
     class Device final : public EventClient {
     public:
-        explicit Device(EventServer* eventServer);
+        explicit Device(EventServer* eventServer, TaskProfiler* profiler = nullptr);
         void begin(TaskHandle_t samplerHandle, TaskHandle_t communicatorHandle, TaskHandle_t connectorHandle);
-        void reportHealth();
+        unsigned long reportHealth();
+
+        static constexpr unsigned long HeapIntervalMicros = 1000UL * 1000UL;
+        static constexpr unsigned long StackScanIntervalMicros = 60UL * 1000UL * 1000UL;
     private:
+        TaskProfiler* _profiler;
         TaskHandle_t _samplerHandle{};
         TaskHandle_t _communicatorHandle{};
         TaskHandle_t _connectorHandle{};
@@ -31,6 +38,8 @@ namespace WaterMeter {
         ChangePublisher<long> _freeStackSampler;
         ChangePublisher<long> _freeStackCommunicator;
         ChangePublisher<long> _freeStackConnector;
+        unsigned long _stackScanTimestamp = 0;
+        bool _isStackScanned = false;
 
         static long freeHeap();
         static long freeStack(TaskHandle_t taskHandle);
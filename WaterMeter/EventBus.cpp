@@ -0,0 +1,178 @@
+// Copyright 2024 Rik Essenius
+// 
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License. You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and limitations under the License.
+
+#include "EventBus.h"
+#include "EventServer.h"
+
+namespace WaterMeter {
+    const EventBus::Route EventBus::Routes[] = {
+        // what the sampler sends to the communicator.
+        {TaskId::Sampler, TaskId::Communicator, Topic::BatchSize, ForwardPolicy::All, 0},
+        {TaskId::Sampler, TaskId::Communicator, Topic::Blocked, ForwardPolicy::All, 0},
+        // every anomaly gets logged, so none may be dropped
+        {TaskId::Sampler, TaskId::Communicator, Topic::Anomaly, ForwardPolicy::All, 0},
+        {TaskId::Sampler, TaskId::Communicator, Topic::Drifted, ForwardPolicy::All, 0},
+        {TaskId::Sampler, TaskId::Communicator, Topic::FreeQueueSize, ForwardPolicy::All, 0},
+        {TaskId::Sampler, TaskId::Communicator, Topic::FreeQueueSpaces, ForwardPolicy::All, 0},
+        {TaskId::Sampler, TaskId::Communicator, Topic::NoFit, ForwardPolicy::All, 0},
+        {TaskId::Sampler, TaskId::Communicator, Topic::Pulse, ForwardPolicy::All, 0},
+        {TaskId::Sampler, TaskId::Communicator, Topic::ResultWritten, ForwardPolicy::All, 0},
+        // a sample comes in every sample period, so only send the number of samples
+        {TaskId::Sampler, TaskId::Communicator, Topic::Sample, ForwardPolicy::Count, ChattyTopicInterval},
+        {TaskId::Sampler, TaskId::Communicator, Topic::SensorWasReset, ForwardPolicy::All, 0},
+        {TaskId::Sampler, TaskId::Communicator, Topic::SkipSamples, ForwardPolicy::All, 0},
+        {TaskId::Sampler, TaskId::Communicator, Topic::TimeOverrun, ForwardPolicy::All, 0},
+        // SensorReader.begin can publish these
+        {TaskId::Sampler, TaskId::Communicator, Topic::Alert, ForwardPolicy::All, 0},
+        {TaskId::Sampler, TaskId::Communicator, Topic::SensorState, ForwardPolicy::All, 0},
+
+        // what the communicator sends to the connector, to be sent to MQTT. Nothing is sent to the sampler.
+        {TaskId::Communicator, TaskId::Connector, Topic::Alert, ForwardPolicy::All, 0},
+        {TaskId::Communicator, TaskId::Connector, Topic::BatchSize, ForwardPolicy::All, 0},
+        {TaskId::Communicator, TaskId::Connector, Topic::FreeHeap, ForwardPolicy::All, 0},
+        {TaskId::Communicator, TaskId::Connector, Topic::FreeStack, ForwardPolicy::All, 0},
+        {TaskId::Communicator, TaskId::Connector, Topic::Rate, ForwardPolicy::All, 0},
+        {TaskId::Communicator, TaskId::Connector, Topic::SensorWasReset, ForwardPolicy::All, 0},
+        {TaskId::Communicator, TaskId::Connector, Topic::SensorState, ForwardPolicy::All, 0},
+        {TaskId::Communicator, TaskId::Connector, Topic::NoDisplayFound, ForwardPolicy::All, 0},
+        {TaskId::Communicator, TaskId::Connector, Topic::MeterPayload, ForwardPolicy::All, 0},
+        {TaskId::Communicator, TaskId::Connector, Topic::HistoryFormatted, ForwardPolicy::All, 0},
+        {TaskId::Communicator, TaskId::Connector, Topic::CpuFormatted, ForwardPolicy::All, 0},
+
+        // what the connector sends to the sampler (numerical payload)
+        {TaskId::Connector, TaskId::Sampler, Topic::BatchSizeDesired, ForwardPolicy::All, 0},
+        {TaskId::Connector, TaskId::Sampler, Topic::IdleRate, ForwardPolicy::All, 0},
+        {TaskId::Connector, TaskId::Sampler, Topic::NonIdleRate, ForwardPolicy::All, 0},
+        {TaskId::Connector, TaskId::Sampler, Topic::ResetSensor, ForwardPolicy::All, 0},
+        {TaskId::Connector, TaskId::Sampler, Topic::Trace, ForwardPolicy::All, 0},
+
+        // what the connector sends to the communicator
+        {TaskId::Connector, TaskId::Communicator, Topic::BatchSizeDesired, ForwardPolicy::All, 0},
+        {TaskId::Connector, TaskId::Communicator, Topic::Connection, ForwardPolicy::All, 0},
+        {TaskId::Connector, TaskId::Communicator, Topic::WifiSummaryReady, ForwardPolicy::All, 0},
+        {TaskId::Connector, TaskId::Communicator, Topic::FreeQueueSize, ForwardPolicy::All, 0},
+        {TaskId::Connector, TaskId::Communicator, Topic::FreeQueueSpaces, ForwardPolicy::All, 0},
+        {TaskId::Connector, TaskId::Communicator, Topic::SetVolume, ForwardPolicy::All, 0},
+        {TaskId::Connector, TaskId::Communicator, Topic::AddVolume, ForwardPolicy::All, 0},
+        {TaskId::Connector, TaskId::Communicator, Topic::History, ForwardPolicy::All, 0},
+        {TaskId::Connector, TaskId::Communicator, Topic::UpdateProgress, ForwardPolicy::All, 0}
+    };
+
+    EventBus::EventBus(EventServer* samplerEventServer, EventServer* communicatorEventServer, EventServer* connectorEventServer,
+        Log* logger, MessageArena* arena) :
+        _servers{ samplerEventServer, communicatorEventServer, connectorEventServer },
+        _samplerClient(samplerEventServer, logger, 50, 0, arena),
+        _communicatorSamplerClient(communicatorEventServer, logger, 100, 1, arena),
+        _communicatorConnectorClient(communicatorEventServer, logger, 50, 2, arena),
+        _connectorCommunicatorClient(connectorEventServer, logger, 100, 3, arena),
+        _connectorSamplerClient(connectorEventServer, logger, 0, 4, arena) {
+        for (auto& count : _messageCount) count.store(0);
+    }
+
+    void EventBus::begin() {
+        _samplerClient.begin(_communicatorSamplerClient.getQueueHandle());
+        // receive only
+        _communicatorSamplerClient.begin();
+        _communicatorConnectorClient.begin(_connectorCommunicatorClient.getQueueHandle());
+        _connectorCommunicatorClient.begin(_communicatorConnectorClient.getQueueHandle());
+        _connectorSamplerClient.begin(_samplerClient.getQueueHandle());
+
+        for (const auto& entry : Routes) {
+            route(entry.from, entry.to, entry.topic);
+            if (entry.policy != ForwardPolicy::All) {
+                endpoint(entry.from, entry.to)->setForwardPolicy(entry.topic, entry.policy, entry.intervalMillis);
+            }
+        }
+    }
+
+    // send out what the forwarding policies of the task's outbound clients held back
+    void EventBus::flush(const TaskId task) {
+        QueueClient* previous = nullptr;
+        for (uint8_t i = 0; i < TaskCount; i++) {
+            const auto client = endpoint(task, static_cast<TaskId>(i));
+            if (client == nullptr || client == previous) continue;
+            client->flush();
+            previous = client;
+        }
+    }
+
+    unsigned long EventBus::messageCount(const TaskId task) const {
+        return _messageCount[static_cast<uint8_t>(task)].load();
+    }
+
+    // wake up the task whenever one of the other tasks sends it a message
+    // ReSharper disable once CppParameterMayBeConst -- introduces misplaced const
+    void EventBus::notifyOnReceive(const TaskId task, TaskHandle_t taskHandle) {
+        switch (task) {
+        case TaskId::Sampler:
+            _connectorSamplerClient.notifyOnSend(taskHandle);
+            return;
+        case TaskId::Communicator:
+            _samplerClient.notifyOnSend(taskHandle);
+            _connectorCommunicatorClient.notifyOnSend(taskHandle);
+            return;
+        default:
+            _communicatorConnectorClient.notifyOnSend(taskHandle);
+        }
+    }
+
+    // receive one message for the task, trying the peers in task order. Returns false if there was nothing to receive.
+    bool EventBus::receive(const TaskId task) {
+        QueueClient* previous = nullptr;
+        for (uint8_t i = 0; i < TaskCount; i++) {
+            const auto client = endpoint(task, static_cast<TaskId>(i));
+            if (client == nullptr || client == previous) continue;
+            if (client->receive()) {
+                // only the receiving task writes its count, so a load and store is enough
+                auto& count = _messageCount[static_cast<uint8_t>(task)];
+                count.store(count.load() + 1);
+                return true;
+            }
+            previous = client;
+        }
+        return false;
+    }
+
+    void EventBus::route(const TaskId from, const TaskId to, const Topic topic) {
+        const auto client = endpoint(from, to);
+        if (client == nullptr) return;
+        server(from)->subscribe(client, topic);
+    }
+
+    void EventBus::unroute(const TaskId from, const TaskId to, const Topic topic) {
+        const auto client = endpoint(from, to);
+        if (client == nullptr) return;
+        server(from)->unsubscribe(client, topic);
+    }
+
+    // private methods
+
+    // the queue client on the task's side of the link with the peer
+    QueueClient* EventBus::endpoint(const TaskId task, const TaskId peer) {
+        switch (task) {
+        case TaskId::Sampler:
+            if (peer == TaskId::Sampler) return nullptr;
+            return &_samplerClient;
+        case TaskId::Communicator:
+            if (peer == TaskId::Sampler) return &_communicatorSamplerClient;
+            if (peer == TaskId::Connector) return &_communicatorConnectorClient;
+            return nullptr;
+        default:
+            if (peer == TaskId::Sampler) return &_connectorSamplerClient;
+            if (peer == TaskId::Communicator) return &_connectorCommunicatorClient;
+            return nullptr;
+        }
+    }
+
+    EventServer* EventBus::server(const TaskId task) const {
+        return _servers[static_cast<uint8_t>(task)];
+    }
+}
@@ -0,0 +1,72 @@
+// Copyright 2024 Rik Essenius
+// 
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License. You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and limitations under the License.
+
+// The event bus connects the event servers of the three tasks (sampler, communicator and connector).
+// Within a task, events go directly from publisher to subscriber via the task's event server.
+// Between tasks, they go via the queue clients that the bus owns. The routes table in EventBus.cpp is the one place
+// that defines which topics cross to which task, and with which forwarding policy.
+// Each task drains its inbound queues via receive(), which also counts the messages the task received.
+// A task can ask to be notified when a message is sent to it, so it can block until there is work instead of polling.
+// The bus only centralizes the wiring; it is not faster. A cross-task event still takes the same queue hop
+// (and string-to-long conversion) as with hand-wired queue clients. Each count is written by its own task only,
+// and can be read from any task.
+
+#ifndef HEADER_EVENT_BUS
+#define HEADER_EVENT_BUS
+
+#include <atomic>
+#include "QueueClient.h"
+
+namespace WaterMeter {
+    enum class TaskId : uint8_t { Sampler = 0, Communicator, Connector };
+
+    class EventBus {
+    public:
+        EventBus(EventServer* samplerEventServer, EventServer* communicatorEventServer, EventServer* connectorEventServer,
+            Log* logger, MessageArena* arena = nullptr);
+        void begin();
+        void flush(TaskId task);
+        unsigned long messageCount(TaskId task) const;
+        void notifyOnReceive(TaskId task, TaskHandle_t taskHandle);
+        bool receive(TaskId task);
+        void route(TaskId from, TaskId to, Topic topic);
+        void unroute(TaskId from, TaskId to, Topic topic);
+
+        static constexpr uint8_t TaskCount = 3;
+    private:
+        struct Route {
+            TaskId from;
+            TaskId to;
+            Topic topic;
+            ForwardPolicy policy;
+            uint16_t intervalMillis;
+        };
+
+        static const Route Routes[];
+        static constexpr uint16_t ChattyTopicInterval = 100;
+
+        QueueClient* endpoint(TaskId task, TaskId peer);
+        EventServer* server(TaskId task) const;
+
+        EventServer* _servers[TaskCount];
+        // the sampler client sends to the communicator and receives from the connector.
+        QueueClient _samplerClient;
+        // will fill fast if we have flow during startup
+        QueueClient _communicatorSamplerClient;
+        QueueClient _communicatorConnectorClient;
+        // This queue needs more space as it won't be read when offline.
+        QueueClient _connectorCommunicatorClient;
+        // Nothing to send from sampler to connector
+        QueueClient _connectorSamplerClient;
+        std::atomic<uint32_t> _messageCount[TaskCount];
+    };
+}
+#endif
@@ -65,7 +65,13 @@ namespace WaterMeter {
         Begin,
         NoFit,
         MeterPayload,
-        Drifted
+        Drifted,
+        Capture,
+        Trace,
+        TraceFormatted,
+        History,
+        HistoryFormatted,
+        CpuFormatted
     };
 
     union EventPayload {
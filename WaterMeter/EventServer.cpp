@@ -33,6 +33,10 @@ namespace WaterMeter {
         }
     }
 
+    bool EventServer::isProvided(const Topic topic) const {
+        return _providers.find(topic) != _providers.end();
+    }
+
     void EventServer::provides(EventClient* client, const Topic topic) {
         _providers[topic] = client;
     }
@@ -28,6 +28,7 @@ namespace WaterMeter {
         void provides(EventClient* client, Topic topic);
         void cannotProvide(const EventClient* client, Topic topic);
         void cannotProvide(const EventClient* client);
+        bool isProvided(Topic topic) const;
 
         // Request a topic. There can be only one provider
         template <class PayloadType>
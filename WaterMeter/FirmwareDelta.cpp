@@ -0,0 +1,230 @@
+// Copyright 2024 Rik Essenius
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License. You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and limitations under the License.
+
+#include <algorithm>
+#include <cstring>
+#ifdef ESP32
+#include <esp_ota_ops.h>
+#endif
+
+#include "FirmwareDelta.h"
+
+namespace WaterMeter {
+
+    // RunningFirmwareBase
+
+    bool RunningFirmwareBase::read(const uint32_t offset, uint8_t* buffer, const size_t size) {
+#ifdef ESP32
+        const esp_partition_t* partition = esp_ota_get_running_partition();
+        return partition != nullptr && esp_partition_read(partition, offset, buffer, size) == ESP_OK;
+#else
+        return false;
+#endif
+    }
+
+    // DeltaFirmwareSink
+
+    DeltaFirmwareSink::DeltaFirmwareSink(FirmwareBase* base, FirmwareSink* target) :
+        _base(base),
+        _target(target) {}
+
+    // size is the size of the delta. We only know the size of the new image once the header is in.
+    bool DeltaFirmwareSink::begin(uint32_t /*size*/) {
+        _produced = 0;
+        _checksum = InitialChecksum;
+        expectFields(Stage::Header, HeaderSize);
+        return true;
+    }
+
+    size_t DeltaFirmwareSink::write(const uint8_t* data, const size_t size) {
+        size_t index = 0;
+        while (index < size) {
+            switch (_stage) {
+            case Stage::Header:
+            case Stage::Arguments: {
+                const size_t count = std::min(_fieldsNeeded - _fieldCount, size - index);
+                memcpy(_fields + _fieldCount, data + index, count);
+                _fieldCount += count;
+                index += count;
+                if (_fieldCount < _fieldsNeeded) break;
+                const bool ok = _stage == Stage::Header ? applyHeader() : applyArguments();
+                if (!ok) _stage = Stage::Failed;
+                break;
+            }
+            case Stage::Opcode:
+                _opcode = data[index++];
+                if (_opcode == Copy || _opcode == Add) {
+                    expectFields(Stage::Arguments, 8);
+                } else if (_opcode == Data) {
+                    expectFields(Stage::Arguments, 4);
+                } else {
+                    _stage = Stage::Failed;
+                }
+                break;
+            case Stage::Payload: {
+                size_t count;
+                if (_opcode == Add) {
+                    count = applyDiffs(data + index, size - index);
+                    if (count == 0) {
+                        _stage = Stage::Failed;
+                        break;
+                    }
+                } else {
+                    count = std::min(std::min(static_cast<size_t>(_remaining), size - index), static_cast<size_t>(BlockSize));
+                    if (!emit(data + index, count)) {
+                        _stage = Stage::Failed;
+                        break;
+                    }
+                    _remaining -= static_cast<uint32_t>(count);
+                }
+                index += count;
+                if (_remaining == 0) nextCommand();
+                break;
+            }
+            case Stage::Copying:
+                // the rest of the input has to wait until the copy is done
+                return index;
+            default:
+                // trailing bytes after the image is complete, or an earlier error
+                _stage = Stage::Failed;
+                return 0;
+            }
+        }
+        return _stage == Stage::Failed ? 0 : size;
+    }
+
+    bool DeltaFirmwareSink::isBusy() const {
+        return _stage == Stage::Copying;
+    }
+
+    // A copy can be as long as the image, so it goes a block at a time.
+    bool DeltaFirmwareSink::proceed() {
+        if (_stage != Stage::Copying) return _stage != Stage::Failed;
+        if (!copy(std::min(_remaining, static_cast<uint32_t>(BlockSize)))) {
+            _stage = Stage::Failed;
+            return false;
+        }
+        if (_remaining == 0) nextCommand();
+        return true;
+    }
+
+    bool DeltaFirmwareSink::end() {
+        if (_stage != Stage::Done || _checksum != _expectedChecksum) {
+            _target->abort();
+            return false;
+        }
+        return _target->end();
+    }
+
+    void DeltaFirmwareSink::abort() {
+        _stage = Stage::Failed;
+        _target->abort();
+    }
+
+    uint32_t DeltaFirmwareSink::checksum(uint32_t hash, const uint8_t* data, const size_t size) {
+        for (size_t i = 0; i < size; i++) {
+            hash ^= data[i];
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+
+    uint32_t DeltaFirmwareSink::field(const uint8_t* bytes) {
+        return static_cast<uint32_t>(bytes[0]) |
+            static_cast<uint32_t>(bytes[1]) << 8 |
+            static_cast<uint32_t>(bytes[2]) << 16 |
+            static_cast<uint32_t>(bytes[3]) << 24;
+    }
+
+    bool DeltaFirmwareSink::applyHeader() {
+        if (field(_fields) != Magic) return false;
+        _targetSize = field(_fields + 4);
+        _expectedChecksum = field(_fields + 8);
+        if (_targetSize == 0 || !_target->begin(_targetSize)) return false;
+        nextCommand();
+        return true;
+    }
+
+    bool DeltaFirmwareSink::applyArguments() {
+        if (_opcode == Data) {
+            _remaining = field(_fields);
+        } else {
+            _sourceOffset = field(_fields);
+            _remaining = field(_fields + 4);
+        }
+        if (_remaining == 0 || _remaining > _targetSize - _produced) return false;
+        if (_opcode == Copy) {
+            // a copy doesn't need more input; proceed() does it
+            _stage = Stage::Copying;
+            return true;
+        }
+        _expectRunLength = false;
+        _stage = Stage::Payload;
+        return true;
+    }
+
+    bool DeltaFirmwareSink::copy(uint32_t count) {
+        while (count > 0) {
+            const size_t blockCount = std::min(static_cast<size_t>(count), static_cast<size_t>(BlockSize));
+            if (!_base->read(_sourceOffset, _block, blockCount) || !emit(_block, blockCount)) return false;
+            _sourceOffset += static_cast<uint32_t>(blockCount);
+            _remaining -= static_cast<uint32_t>(blockCount);
+            count -= static_cast<uint32_t>(blockCount);
+        }
+        return true;
+    }
+
+    // Applies diffs from the start of data: a run of unchanged bytes, or a stretch of changed ones.
+    // Returns the number of input bytes used, or 0 on error.
+    size_t DeltaFirmwareSink::applyDiffs(const uint8_t* data, const size_t size) {
+        if (_expectRunLength) {
+            _expectRunLength = false;
+            const uint32_t runLength = data[0] + 1U;
+            return runLength <= _remaining && copy(runLength) ? 1 : 0;
+        }
+        if (data[0] == 0) {
+            _expectRunLength = true;
+            return 1;
+        }
+        size_t count = 0;
+        const size_t limit = std::min(std::min(static_cast<size_t>(_remaining), size), static_cast<size_t>(BlockSize));
+        while (count < limit && data[count] != 0) count++;
+        if (!_base->read(_sourceOffset, _block, count)) return 0;
+        for (size_t i = 0; i < count; i++) {
+            _block[i] = static_cast<uint8_t>(_block[i] + data[i]);
+        }
+        if (!emit(_block, count)) return 0;
+        _sourceOffset += static_cast<uint32_t>(count);
+        _remaining -= static_cast<uint32_t>(count);
+        return count;
+    }
+
+    bool DeltaFirmwareSink::emit(const uint8_t* data, const size_t size) {
+        if (_target->write(data, size) != size) return false;
+        _checksum = checksum(_checksum, data, size);
+        _produced += static_cast<uint32_t>(size);
+        return true;
+    }
+
+    void DeltaFirmwareSink::nextCommand() {
+        if (_produced == _targetSize) {
+            _stage = Stage::Done;
+            return;
+        }
+        _stage = Stage::Opcode;
+    }
+
+    void DeltaFirmwareSink::expectFields(const Stage stage, const size_t count) {
+        _stage = stage;
+        _fieldCount = 0;
+        _fieldsNeeded = count;
+    }
+}
@@ -0,0 +1,92 @@
+// Copyright 2024 Rik Essenius
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License. You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and limitations under the License.
+
+// Applies a binary delta against the running firmware while it streams in, writing the new image to another sink.
+// Only a small block buffer is used, whatever the image size.
+//
+// Delta format (little endian):
+//   header:  magic "WMD1", target size (uint32), FNV-1a checksum of the target (uint32), source size (uint32)
+//   then commands until the target is complete:
+//   Copy (1): source offset (uint32), length (uint32)           - take bytes from the running image
+//   Add (2):  source offset (uint32), length (uint32), diffs    - running image bytes plus the diffs (mod 256)
+//   Data (3): length (uint32), bytes                            - new bytes
+// In the diffs, a 0 is followed by a count n for n + 1 unchanged bytes, so length is what comes out, not what goes in.
+// Add is what makes this work well for code: when code moves, only the addresses in it change,
+// so a long stretch with a few differences takes a few bytes instead of a copy and a data command for each.
+
+#ifndef HEADER_FIRMWARE_DELTA
+#define HEADER_FIRMWARE_DELTA
+
+#include <cstddef>
+#include <cstdint>
+#include "FirmwareDownloader.h"
+
+namespace WaterMeter {
+    // the image the delta was made against
+    class FirmwareBase {
+    public:
+        virtual ~FirmwareBase() = default;
+        virtual bool read(uint32_t offset, uint8_t* buffer, size_t size) = 0;
+    };
+
+    class RunningFirmwareBase final : public FirmwareBase {
+    public:
+        bool read(uint32_t offset, uint8_t* buffer, size_t size) override;
+    };
+
+    class DeltaFirmwareSink final : public FirmwareSink {
+    public:
+        DeltaFirmwareSink(FirmwareBase* base, FirmwareSink* target);
+        bool begin(uint32_t size) override;
+        size_t write(const uint8_t* data, size_t size) override;
+        bool isBusy() const override;
+        bool proceed() override;
+        bool end() override;
+        void abort() override;
+
+        static uint32_t checksum(uint32_t hash, const uint8_t* data, size_t size);
+
+        static constexpr uint32_t Magic = 0x31444D57; // "WMD1"
+        static constexpr uint32_t InitialChecksum = 2166136261u;
+        static constexpr size_t HeaderSize = 16;
+        enum Opcode : uint8_t { Copy = 1, Add = 2, Data = 3 };
+
+    private:
+        enum class Stage : uint8_t { Header, Opcode, Arguments, Payload, Copying, Done, Failed };
+        static constexpr size_t BlockSize = 256;
+
+        static uint32_t field(const uint8_t* bytes);
+        bool applyHeader();
+        bool applyArguments();
+        bool copy(uint32_t count);
+        size_t applyDiffs(const uint8_t* data, size_t size);
+        bool emit(const uint8_t* data, size_t size);
+        void nextCommand();
+        void expectFields(Stage stage, size_t count);
+
+        FirmwareBase* _base;
+        FirmwareSink* _target;
+        Stage _stage = Stage::Header;
+        uint8_t _opcode = 0;
+        bool _expectRunLength = false;
+        uint8_t _fields[HeaderSize] = {};
+        size_t _fieldCount = 0;
+        size_t _fieldsNeeded = HeaderSize;
+        uint32_t _sourceOffset = 0;
+        uint32_t _remaining = 0;
+        uint32_t _targetSize = 0;
+        uint32_t _produced = 0;
+        uint32_t _expectedChecksum = 0;
+        uint32_t _checksum = InitialChecksum;
+        uint8_t _block[BlockSize] = {};
+    };
+}
+#endif
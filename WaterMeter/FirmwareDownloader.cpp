@@ -0,0 +1,246 @@
+// Copyright 2024 Rik Essenius
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License. You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and limitations under the License.
+
+#include <ESP.h>
+#include <SafeCString.h>
+#ifdef ESP32
+#include <Update.h>
+#endif
+
+#include "FirmwareDownloader.h"
+#include "EventServer.h"
+
+namespace WaterMeter {
+
+    // HttpFirmwareSource
+
+    HttpFirmwareSource::HttpFirmwareSource(const WiFiClientFactory* wifiClientFactory) :
+        _wifiClientFactory(wifiClientFactory) {}
+
+    int HttpFirmwareSource::open(const char* url, const uint32_t offset) {
+        close();
+#ifdef ESP32
+        // the same client object as the version check, but on a new connection
+        _client = _wifiClientFactory->acquire(ClientRole::Firmware, url);
+        _httpClient.begin(*_client, url);
+        if (offset > 0) {
+            char range[24];
+            SafeCString::sprintf(range, "bytes=%lu-", static_cast<unsigned long>(offset));
+            _httpClient.addHeader("Range", range);
+        }
+        const int httpCode = _httpClient.GET();
+        // with a range request, the content length is what is left
+        const int contentLength = _httpClient.getSize();
+        _size = contentLength > 0 ? offset + static_cast<uint32_t>(contentLength) : 0;
+        return httpCode;
+#else
+        return -1;
+#endif
+    }
+
+    uint32_t HttpFirmwareSource::size() const {
+        return _size;
+    }
+
+    int HttpFirmwareSource::read(uint8_t* buffer, const size_t size) {
+#ifdef ESP32
+        WiFiClient* stream = _httpClient.getStreamPtr();
+        if (stream == nullptr) return -1;
+        const int available = stream->available();
+        if (available <= 0) {
+            return _httpClient.connected() ? 0 : -1;
+        }
+        const size_t wanted = static_cast<size_t>(available) < size ? static_cast<size_t>(available) : size;
+        return static_cast<int>(stream->readBytes(buffer, wanted));
+#else
+        return -1;
+#endif
+    }
+
+    void HttpFirmwareSource::close() {
+        if (_client == nullptr) return;
+        _httpClient.end();
+        // the rest of the body may still be coming in, so the connection can't be used for another request
+        _client->stop();
+        _client = nullptr;
+    }
+
+    // PartitionFirmwareSink
+
+    bool PartitionFirmwareSink::begin(const uint32_t size) {
+#ifdef ESP32
+        return Update.begin(size);
+#else
+        return false;
+#endif
+    }
+
+    size_t PartitionFirmwareSink::write(const uint8_t* data, const size_t size) {
+#ifdef ESP32
+        // the Update API takes a non-const buffer but does not change it
+        return Update.write(const_cast<uint8_t*>(data), size);
+#else
+        return 0;
+#endif
+    }
+
+    bool PartitionFirmwareSink::end() {
+#ifdef ESP32
+        return Update.end(true);
+#else
+        return false;
+#endif
+    }
+
+    void PartitionFirmwareSink::abort() {
+#ifdef ESP32
+        Update.abort();
+#endif
+    }
+
+    // FirmwareDownloader
+
+    FirmwareDownloader::FirmwareDownloader(EventServer* eventServer, FirmwareSource* source, FirmwareSink* sink) :
+        EventClient(eventServer),
+        _source(source),
+        _defaultSink(sink),
+        _sink(sink) {}
+
+    // a different sink can process the download first, e.g. to apply a delta.
+    // If the download is optional, not finding it is not an error.
+    void FirmwareDownloader::start(const char* url, FirmwareSink* sink, const bool isOptional) {
+        SafeCString::strcpy(_url, url);
+        _sink = sink == nullptr ? _defaultSink : sink;
+        _isSinkStarted = false;
+        _isOptional = isOptional;
+        _offset = 0;
+        _chunkIndex = 0;
+        _chunkLength = 0;
+        _size = 0;
+        _progress = -1;
+        _retryCount = 0;
+        _retryTimestamp = micros() - RetryWaitMicros;
+        _state = DownloadState::Connecting;
+    }
+
+    DownloadState FirmwareDownloader::step(const unsigned long budgetMicros) {
+        if (_state == DownloadState::Connecting) {
+            connect();
+        }
+        if (_state == DownloadState::Downloading) {
+            download(budgetMicros);
+        }
+        return _state;
+    }
+
+    void FirmwareDownloader::connect() {
+        if (micros() - _retryTimestamp < RetryWaitMicros) return;
+        const int httpCode = _source->open(_url, _offset);
+        const int expectedCode = _offset == 0 ? HttpOk : HttpPartialContent;
+        if (httpCode != expectedCode || _source->size() == 0) {
+            _source->close();
+            // negative codes are connection errors, worth a retry. A server that ignores the range
+            // would send the whole image again, which we can't use, so any other response ends the download.
+            if (httpCode > 0) {
+                char buffer[64];
+                SafeCString::sprintf(buffer, "Firmware download failed with response code %d", httpCode);
+                fail(buffer, _isOptional && httpCode == HttpNotFound ? Topic::Info : Topic::ConnectionError);
+                return;
+            }
+            retry();
+            return;
+        }
+        if (_offset == 0) {
+            // a retry before any bytes came in. The sink can't begin twice, so start it over.
+            if (_isSinkStarted) _sink->abort();
+            _size = _source->size();
+            _isSinkStarted = _sink->begin(_size);
+            if (!_isSinkStarted) {
+                _source->close();
+                fail("Not enough space for firmware update");
+                return;
+            }
+        }
+        _retryCount = 0;
+        _state = DownloadState::Downloading;
+    }
+
+    void FirmwareDownloader::download(const unsigned long budgetMicros) {
+        const unsigned long startTimestamp = micros();
+        while ((_offset < _size || _sink->isBusy()) && micros() - startTimestamp < budgetMicros) {
+            if (_sink->isBusy()) {
+                if (!_sink->proceed()) {
+                    _source->close();
+                    fail("Could not write firmware update");
+                    return;
+                }
+                continue;
+            }
+            if (_chunkIndex == _chunkLength) {
+                const size_t wanted = _size - _offset < ChunkSize ? _size - _offset : ChunkSize;
+                const int bytesRead = _source->read(_chunk, wanted);
+                if (bytesRead < 0) {
+                    _source->close();
+                    retry();
+                    return;
+                }
+                // nothing available yet, try again next step rather than spin
+                if (bytesRead == 0) break;
+                _chunkIndex = 0;
+                _chunkLength = static_cast<size_t>(bytesRead);
+            }
+            // a busy sink takes the rest of the chunk once it is done
+            const size_t offered = _chunkLength - _chunkIndex;
+            const size_t written = _sink->write(_chunk + _chunkIndex, offered);
+            if (written < offered && !_sink->isBusy()) {
+                _source->close();
+                fail("Could not write firmware update");
+                return;
+            }
+            _chunkIndex += written;
+            _offset += static_cast<uint32_t>(written);
+        }
+
+        const long progress = static_cast<long>(static_cast<uint64_t>(_offset) * 100 / _size);
+        if (progress != _progress) {
+            _progress = progress;
+            _eventServer->publish(Topic::UpdateProgress, progress);
+        }
+
+        if (_offset < _size || _sink->isBusy()) return;
+        _source->close();
+        if (!_sink->end()) {
+            fail("Firmware update did not validate");
+            return;
+        }
+        _state = DownloadState::Complete;
+    }
+
+    void FirmwareDownloader::fail(const char* reason, const Topic topic) {
+        _sink->abort();
+        _state = DownloadState::Failed;
+        _eventServer->publish(topic, reason);
+    }
+
+    // resume from the current offset after a while, unless we tried too often already
+    void FirmwareDownloader::retry() {
+        // what the sink didn't take yet comes in again from the offset
+        _chunkIndex = 0;
+        _chunkLength = 0;
+        _retryCount++;
+        if (_retryCount > MaxRetries) {
+            fail("Firmware download failed after retries");
+            return;
+        }
+        _retryTimestamp = micros();
+        _state = DownloadState::Connecting;
+    }
+}
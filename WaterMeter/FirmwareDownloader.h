@@ -0,0 +1,116 @@
+// Copyright 2024 Rik Essenius
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License. You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and limitations under the License.
+
+// Downloads a firmware image in slices, so the connector can keep publishing while the download runs.
+// Each step reads from the source for at most the given time budget and writes what it got to the sink
+// (the inactive OTA partition). If the connection drops, the next step reopens the source at the current offset
+// with a range request, so the download resumes instead of starting over.
+// Source and sink are interfaces, so the downloader can be tested on the host with in-memory stand-ins.
+
+#ifndef HEADER_FIRMWARE_DOWNLOADER
+#define HEADER_FIRMWARE_DOWNLOADER
+
+#include <HTTPClient.h>
+#include "EventClient.h"
+#include "WiFiClientFactory.h"
+
+namespace WaterMeter {
+    class FirmwareSource {
+    public:
+        virtual ~FirmwareSource() = default;
+        // returns the HTTP status code: 200 for the whole image, 206 when starting at offset
+        virtual int open(const char* url, uint32_t offset) = 0;
+        // size of the whole image, also when opened at an offset
+        virtual uint32_t size() const = 0;
+        // returns the number of bytes read, 0 if nothing is available yet, or -1 if the connection was lost
+        virtual int read(uint8_t* buffer, size_t size) = 0;
+        virtual void close() = 0;
+    };
+
+    class FirmwareSink {
+    public:
+        virtual ~FirmwareSink() = default;
+        virtual bool begin(uint32_t size) = 0;
+        // returns the number of bytes taken. Less than size means an error, unless the sink is busy.
+        virtual size_t write(const uint8_t* data, size_t size) = 0;
+        // A sink can have work of its own before it takes more input (e.g. copying from the running image).
+        // It does that in small steps, so the downloader can keep to its time budget. Returns false on error.
+        virtual bool isBusy() const { return false; }
+        virtual bool proceed() { return true; }
+        // validates the image and marks it for the next boot
+        virtual bool end() = 0;
+        virtual void abort() = 0;
+    };
+
+    class HttpFirmwareSource final : public FirmwareSource {
+    public:
+        explicit HttpFirmwareSource(const WiFiClientFactory* wifiClientFactory);
+        int open(const char* url, uint32_t offset) override;
+        uint32_t size() const override;
+        int read(uint8_t* buffer, size_t size) override;
+        void close() override;
+    private:
+        const WiFiClientFactory* _wifiClientFactory;
+        WiFiClient* _client = nullptr;
+        HTTPClient _httpClient;
+        uint32_t _size = 0;
+    };
+
+    class PartitionFirmwareSink final : public FirmwareSink {
+    public:
+        bool begin(uint32_t size) override;
+        size_t write(const uint8_t* data, size_t size) override;
+        bool end() override;
+        void abort() override;
+    };
+
+    enum class DownloadState : uint8_t { Idle, Connecting, Downloading, Complete, Failed };
+
+    class FirmwareDownloader final : public EventClient {
+    public:
+        FirmwareDownloader(EventServer* eventServer, FirmwareSource* source, FirmwareSink* sink);
+        void start(const char* url, FirmwareSink* sink = nullptr, bool isOptional = false);
+        DownloadState step(unsigned long budgetMicros);
+        DownloadState state() const { return _state; }
+        uint32_t offset() const { return _offset; }
+
+        static constexpr unsigned long RetryWaitMicros = 5UL * 1000UL * 1000UL;
+        static constexpr unsigned int MaxRetries = 10;
+    private:
+        static constexpr int UrlSize = 100;
+        static constexpr size_t ChunkSize = 1024;
+        static constexpr int HttpOk = 200;
+        static constexpr int HttpPartialContent = 206;
+        static constexpr int HttpNotFound = 404;
+
+        void connect();
+        void download(unsigned long budgetMicros);
+        void fail(const char* reason, Topic topic = Topic::ConnectionError);
+        void retry();
+
+        FirmwareSource* _source;
+        FirmwareSink* _defaultSink;
+        FirmwareSink* _sink;
+        DownloadState _state = DownloadState::Idle;
+        bool _isSinkStarted = false;
+        bool _isOptional = false;
+        char _url[UrlSize] = {};
+        uint32_t _offset = 0;
+        uint32_t _size = 0;
+        long _progress = -1;
+        unsigned int _retryCount = 0;
+        unsigned long _retryTimestamp = 0;
+        size_t _chunkIndex = 0;
+        size_t _chunkLength = 0;
+        uint8_t _chunk[ChunkSize] = {};
+    };
+}
+#endif
@@ -11,6 +11,7 @@
 
 #include <HTTPClient.h>
 #include <HTTPUpdate.h>
+#include <ESP.h>
 
 #include "FirmwareManager.h"
 #include "EventServer.h"
@@ -21,12 +22,16 @@ namespace WaterMeter {
         EventServer* eventServer,
         const WiFiClientFactory* wifiClientFactory,
         const FirmwareConfig* firmwareConfig,
-        const char* buildVersion) :
+        const char* buildVersion,
+        FirmwareDownloader* downloader,
+        FirmwareSink* deltaSink) :
 
         EventClient(eventServer),
         _wifiClientFactory(wifiClientFactory),
         _buildVersion(buildVersion),
-        _firmwareConfig(firmwareConfig) {}
+        _firmwareConfig(firmwareConfig),
+        _downloader(downloader),
+        _deltaSink(deltaSink) {}
 
 
     void FirmwareManager::begin(const char* machineId) {
@@ -39,7 +44,7 @@ namespace WaterMeter {
         SafeCString::strcat(buffer, _machineId);
         SafeCString::strcat(buffer, ImageExtension);
 
-        WiFiClient* updateClient = _wifiClientFactory->create(_firmwareConfig->baseUrl);
+        WiFiClient* updateClient = _wifiClientFactory->acquire(ClientRole::Firmware, _firmwareConfig->baseUrl);
 
         httpUpdate.onProgress([this](const int current, const int total) {
             _eventServer->publish(Topic::UpdateProgress, current * 100 / total);
@@ -63,17 +68,65 @@ namespace WaterMeter {
             httpUpdate.getLastError(),
             httpUpdate.getLastErrorString().c_str());
         _eventServer->publish(Topic::Info, buffer);
-        delete updateClient;
+    }
+
+    void FirmwareManager::startDownload(const bool useDelta) {
+        _isDeltaDownload = useDelta && _deltaSink != nullptr;
+        char buffer[BaseUrlSize];
+        SafeCString::strcpy(buffer, _firmwareConfig->baseUrl);
+        SafeCString::strcat(buffer, _machineId);
+        if (_isDeltaDownload) {
+            SafeCString::strcat(buffer, "-");
+            SafeCString::strcat(buffer, _buildVersion);
+            SafeCString::strcat(buffer, DeltaExtension);
+            // there is no delta if we skipped a build, so that is not an error
+            _downloader->start(buffer, _deltaSink, true);
+            return;
+        }
+        SafeCString::strcat(buffer, ImageExtension);
+        _downloader->start(buffer);
     }
 
     void FirmwareManager::tryUpdate() {
         // Make sure this is only done just after rebooting. We don't want reboots in the middle of a flow.
         if (_justRebooted && isUpdateAvailable()) {
-            loadUpdate();
+            if (_downloader == nullptr) {
+                loadUpdate();
+            } else {
+                startDownload(true);
+            }
         }
         _justRebooted = false;
     }
 
+    // Runs the next slice of a download within the budget. Returns whether there is still work to do.
+    bool FirmwareManager::loop(const unsigned long budgetMicros, const bool isFlowIdle) {
+        if (_downloader == nullptr || _restartRequested) return false;
+        switch (_downloader->step(budgetMicros)) {
+        case DownloadState::Connecting:
+        case DownloadState::Downloading:
+            return true;
+        case DownloadState::Complete:
+            // a reboot in the middle of a flow would lose pulses, so wait for a result window without any
+            if (!isFlowIdle) return true;
+            _restartRequested = true;
+            _eventServer->publish(Topic::Info, "Restarting to activate new firmware");
+            restart();
+            return false;
+        default:
+            if (!_isDeltaDownload) return false;
+            _eventServer->publish(Topic::Info, "Delta update failed; loading full image");
+            startDownload(false);
+            return true;
+        }
+    }
+
+    void FirmwareManager::restart() {
+#ifdef ESP32
+        ESP.restart();
+#endif
+    }
+
     bool FirmwareManager::isUpdateAvailable() const {
         if (!_justRebooted) return false;
         char versionUrl[BaseUrlSize];
@@ -81,7 +134,8 @@ namespace WaterMeter {
         SafeCString::strcat(versionUrl, _machineId);
         SafeCString::strcat(versionUrl, VersionExtension);
 
-        const auto client = _wifiClientFactory->create(_firmwareConfig->baseUrl);
+        // the download uses the same client, but the connection ends with this check
+        const auto client = _wifiClientFactory->acquire(ClientRole::Firmware, _firmwareConfig->baseUrl);
         HTTPClient httpClient;
         httpClient.begin(*client, versionUrl);
         bool newBuildAvailable = false;
@@ -106,7 +160,6 @@ namespace WaterMeter {
             _eventServer->publish(Topic::ConnectionError, buffer);
             _eventServer->publish(Topic::Info, versionUrl);
         }
-        // this disposes of client as well.
         httpClient.end();
         return newBuildAvailable;
     }
@@ -14,12 +14,17 @@
 // It looks for a specified url: https://base-url/path/device-name.version which contains available build version.
 // If that number is higher than the build of the device, it updates itself from https://base-url/path/device-name.bin
 // I got the inspiration for this mechanism from https://www.bakke.online/index.php/2017/06/02/self-updating-ota-firmware-for-esp8266/
+// With a downloader, the image is fetched in slices via loop() so the connector keeps publishing meanwhile,
+// and the reboot into the new image waits until there is no flow.
+// With a delta sink as well, it first tries https://base-url/path/device-name-build.delta, a binary diff against
+// the running build. If that is not there or does not apply, it falls back to the full image.
 
 #ifndef HEADER_FIRMWARE_MANAGER
 #define HEADER_FIRMWARE_MANAGER
 
 #include "Configuration.h"
 #include "EventClient.h"
+#include "FirmwareDownloader.h"
 #include "WiFiClientFactory.h"
 
 namespace WaterMeter {
@@ -29,22 +34,32 @@ namespace WaterMeter {
             EventServer* eventServer,
             const WiFiClientFactory* wifiClientFactory,
             const FirmwareConfig* firmwareConfig,
-            const char* buildVersion);
+            const char* buildVersion,
+            FirmwareDownloader* downloader = nullptr,
+            FirmwareSink* deltaSink = nullptr);
 
         void begin(const char* machineId);
         void tryUpdate();
+        bool loop(unsigned long budgetMicros, bool isFlowIdle);
     protected:
         void loadUpdate() const;
+        void startDownload(bool useDelta);
+        void restart();
         bool isUpdateAvailable() const;
     private:
         static constexpr int BaseUrlSize = 100;
         static constexpr auto ImageExtension = ".bin";
         static constexpr auto VersionExtension = ".version";
+        static constexpr auto DeltaExtension = ".delta";
         const WiFiClientFactory* _wifiClientFactory;
         const char* _buildVersion;
         bool _justRebooted = true;
         char _machineId[20] = {};
         const FirmwareConfig* _firmwareConfig;
+        FirmwareDownloader* _downloader;
+        FirmwareSink* _deltaSink;
+        bool _isDeltaDownload = false;
+        bool _restartRequested = false;
     };
 }
 #endif
@@ -38,16 +38,19 @@ namespace WaterMeter {
 
 	constexpr double MinCycleForFit = 0.6;
 
-	FlowDetector::FlowDetector(EventServer* eventServer, EllipseFit* ellipseFit) : EventClient(eventServer), _ellipseFit(ellipseFit) {
+	FlowDetector::FlowDetector(EventServer* eventServer, EllipseFit* ellipseFit, FlowTrace* flowTrace) :
+		EventClient(eventServer), _ellipseFit(ellipseFit), _flowTrace(flowTrace) {
 		_eventServer = eventServer;
 	}
 
 	// Public methods
 
-	void FlowDetector::begin(const unsigned int noiseRange = 3) {
+	void FlowDetector::begin(const unsigned int noiseRange, const OutlierMode outlierMode) {
 		// we assume that the noise range for X and Y is the same.
 		// If the distance between two points is beyond this, it is beyond noise
 		_distanceThreshold = sqrt(2.0 * noiseRange * noiseRange) / MovingAverageNoiseReduction;
+		_outlierMode = outlierMode;
+		_outlierFilter.begin(_distanceThreshold * 2);
 		_eventServer->subscribe(this, Topic::Sample);
 		_eventServer->subscribe(this, Topic::SensorWasReset);
 	}
@@ -58,6 +61,10 @@ namespace WaterMeter {
         _justStarted = true;
         _consecutiveOutlierCount = 0;
 		_confirmedGoodFit = CartesianEllipse();
+		// the shift and the distances were relative to the fit we just dropped
+		_centerShift = { 0, 0 };
+		_outlierFilter.begin(_distanceThreshold * 2);
+		trace(TraceDecision::Reset);
     }
 
 	void FlowDetector::update(const Topic topic, const long payload) {
@@ -76,6 +83,7 @@ namespace WaterMeter {
 	// Private methods
 
 	void FlowDetector::addSample(const SensorSample& sample) {
+		_sampleIndex++;
 		const auto state = sample.state();
 		if (state!= SensorState::Ok) {
 			reportAnomaly(state);
@@ -97,11 +105,21 @@ namespace WaterMeter {
 		// if index is 0, we made the first round and the buffer is full. Otherwise, we wait.
 		if (_firstRound && _movingAverageIndex != 0) {
 			_wasSkipped = true;
+			trace(TraceDecision::Startup);
 			return;
 		}
 
 		const auto averageSample = calcMovingAverage();
-		processMovingAverageSample(averageSample);
+		// work in the frame of the confirmed fit. The shift is only non-zero after a drift in adaptive mode
+		processMovingAverageSample({ averageSample.x - _centerShift.x, averageSample.y - _centerShift.y });
+	}
+
+	void FlowDetector::addTraceRecord(const TraceDecision decision, const uint16_t value) const {
+		uint8_t flags = _previousQuadrant & TraceRecord::QuadrantMask;
+		if (_foundPulse) flags |= TraceRecord::PulseFlag;
+		if (_searchingForPulse) flags |= TraceRecord::SearchingFlag;
+		if (_confirmedGoodFit.isValid()) flags |= TraceRecord::FitFlag;
+		_flowTrace->add(_sampleIndex, decision, flags, value);
 	}
 
 	Coordinate FlowDetector::calcMovingAverage() {
@@ -195,9 +213,19 @@ namespace WaterMeter {
 	// We have an outlier if the point is too far away from the confirmed fit.
     bool FlowDetector::isOutlier(const Coordinate point) {
 		const auto distanceFromEllipse = _confirmedGoodFit.getDistanceFrom(point);
-		if (distanceFromEllipse <= _distanceThreshold * 2) return false;
+		if (_outlierMode == OutlierMode::Fixed) {
+			if (distanceFromEllipse <= _distanceThreshold * 2) return false;
+		}
+		else {
+			if (distanceFromEllipse <= _outlierFilter.threshold()) {
+				_outlierFilter.addDistance(distanceFromEllipse);
+				return false;
+			}
+			_outlierFilter.addOutlier(point);
+		}
 
 	    const auto reportedDistance = static_cast<uint16_t>(std::min(lround(distanceFromEllipse * 100), 4095l));
+		trace(TraceDecision::Outlier, traceDistance(distanceFromEllipse));
 		reportAnomaly(SensorState::Outlier, reportedDistance);
 		_consecutiveOutlierCount++;
 		return true;
@@ -210,6 +238,7 @@ namespace WaterMeter {
 			_waitCount++;
 			if (_waitCount <= MovingAverageSize) {
 				_wasSkipped = true;
+				trace(TraceDecision::Startup);
 				return true;
 			}
 			_startTangent = point.getAngleFrom(_referencePoint);
@@ -225,6 +254,7 @@ namespace WaterMeter {
 		// if we are too close to the previous point, discard
 		if (distance < _distanceThreshold) {
 			_wasSkipped = true;
+			trace(TraceDecision::TooClose, traceDistance(distance));
 			return false;
 		}
 		if (_confirmedGoodFit.isValid() && isOutlier(point)) {
@@ -234,6 +264,7 @@ namespace WaterMeter {
 		if (isStartingUp(point)) {
 			return false;
 		}
+		_referenceDistance = distance;
 		_referencePoint = point;
 		return true;
 	}
@@ -247,21 +278,29 @@ namespace WaterMeter {
 			_previousPoint = _startPoint;
 			_firstRound = false;
 			_wasSkipped = true;
+			trace(TraceDecision::Startup);
 			return;
 		}
 
 		if (!isRelevant(averageSample)) {
 			// not leaving potential loose ends
 			_foundPulse = false;
+			// if the outliers stay together, the signal moved. Follow it rather than starting all over.
+			if (_outlierMode == OutlierMode::Adaptive && _consecutiveOutlierCount > 0 && _outlierFilter.isDrift()) {
+				shiftCenter();
+				return;
+			}
 			// if we have too many outliers in a row, we might have drifted (e.g. the sensor was moved), so we reset the measurement
 			if (_consecutiveOutlierCount > 0 && _consecutiveOutlierCount % MaxConsecutiveOutliers == 0) {
 			    _eventServer->publish(Topic::Drifted, _consecutiveOutlierCount);
+				trace(TraceDecision::Drift, static_cast<uint16_t>(std::min(_consecutiveOutlierCount, 65535u)));
 				resetMeasurement();
 			}
 			return;
 		}
 		_consecutiveOutlierCount = 0;
 		detectPulse(averageSample);
+		trace(TraceDecision::Accepted, traceDistance(_referenceDistance));
 
 		_ellipseFit->addMeasurement(averageSample);
 		if (_ellipseFit->bufferIsFull()) {
@@ -272,6 +311,7 @@ namespace WaterMeter {
 	}
 
 	void FlowDetector::reportAnomaly(SensorState state, const uint16_t value) {
+		if (state != SensorState::Outlier) trace(TraceDecision::Anomaly, static_cast<uint16_t>(state));
 		_foundAnomaly = true;
 		_wasSkipped = true;
 		_eventServer->publish(Topic::Anomaly, static_cast<int16_t>(state) + (value << 4));
@@ -291,9 +331,11 @@ namespace WaterMeter {
             _confirmedGoodFit = fittedEllipse;
             _previousAngleWithCenter = point.getAngleFrom(center);
             _previousQuadrant = _previousAngleWithCenter.getQuadrant();
+            trace(TraceDecision::FitAccepted, traceAngle(_tangentDistanceTravelled));
         }
         else {
             // we need another round
+            trace(TraceDecision::FitRejected, traceAngle(_tangentDistanceTravelled));
             _eventServer->publish(Topic::NoFit, noFitParameter(_tangentDistanceTravelled, fitSucceeded));
         }
         _tangentDistanceTravelled = 0;
@@ -307,19 +349,40 @@ namespace WaterMeter {
             const auto fittedEllipse = executeFit();
             if (fittedEllipse.isValid()) {
                 _confirmedGoodFit = fittedEllipse;
+                trace(TraceDecision::FitAccepted, traceAngle(_angleDistanceTravelled));
             }
             else {
+                trace(TraceDecision::FitRejected, traceAngle(_angleDistanceTravelled));
                 _eventServer->publish(Topic::NoFit, noFitParameter(_angleDistanceTravelled, false));
             }
         }
         else {
             // even though we didn't run a fit, we mark it as succeeded to see the difference with one that failed a fit
+            trace(TraceDecision::FitSkipped, traceAngle(_angleDistanceTravelled));
             _eventServer->publish(Topic::NoFit, noFitParameter(_angleDistanceTravelled, true));
             _ellipseFit->begin();
         }
         _angleDistanceTravelled = 0;
     }
 
+	void FlowDetector::shiftCenter() {
+		const auto shift = _outlierFilter.driftShift(_referencePoint);
+		_centerShift.x += shift.x;
+		_centerShift.y += shift.y;
+		_eventServer->publish(Topic::Drifted, _consecutiveOutlierCount);
+		trace(TraceDecision::Drift, static_cast<uint16_t>(std::min(_consecutiveOutlierCount, 65535u)));
+		_consecutiveOutlierCount = 0;
+		_outlierFilter.resetStreak();
+	}
+
+	uint16_t FlowDetector::traceAngle(const double angleDistance) {
+		return static_cast<uint16_t>(std::min(lround(fabs(angleDistance) * 180 / M_PI), 65535l));
+	}
+
+	uint16_t FlowDetector::traceDistance(const double distance) {
+		return static_cast<uint16_t>(std::min(lround(distance * 100), 65535l));
+	}
+
 	void FlowDetector::updateEllipseFit(const Coordinate point) {
 		// The first time we always run a fit. Re-run if the first time(s) didn't result in a good fit
 		if (!_confirmedGoodFit.isValid()) {
@@ -13,6 +13,9 @@
 // The parameters of the ellipse are estimated via a fitting mechanism using a series of samples (see EllipseFit).
 // We generate an event every time the cycle moves from the 4th to the 3rd quadrant.
 // The detector also tries to filter out anomalies by ignoring points that are too far away from the latest fitted ellipse.
+// In adaptive outlier mode, the outlier threshold follows the noise on the signal, and a drift moves the center of the
+// ellipse rather than forcing a new fit (see OutlierFilter).
+// Every decision can be recorded in a FlowTrace, so we can find out afterwards why a pulse was missed.
 
 // The signal is disturbed by the presence of electrical devices nearby. Therefore, we sample at 100 Hz (twice the rate of the mains frequency),
 // and use a moving average over 4 samples to clean up the signal.
@@ -23,6 +26,8 @@
 #include <CartesianEllipse.h>
 #include <EllipseFit.h>
 #include "EventServer.h"
+#include "FlowTrace.h"
+#include "OutlierFilter.h"
 
 // needed for compilation in Arduino IDE to define NAN
 #include <cmath>
@@ -33,10 +38,12 @@ namespace WaterMeter {
 	using EllipseMath::Coordinate;
 	using EllipseMath::EllipseFit;
 
+	enum class OutlierMode : uint8_t { Fixed = 0, Adaptive };
+
 	class FlowDetector : public EventClient {
 	public:
-		FlowDetector(EventServer* eventServer, EllipseFit* ellipseFit);
-		void begin(unsigned int noiseRange);
+		FlowDetector(EventServer* eventServer, EllipseFit* ellipseFit, FlowTrace* flowTrace = nullptr);
+		void begin(unsigned int noiseRange, OutlierMode outlierMode = OutlierMode::Fixed);
         bool foundAnomaly() const { return _foundAnomaly; }
 		bool foundPulse() const { return _foundPulse; }
 		bool isSearching() const { return _searchingForPulse; }
@@ -51,6 +58,7 @@ namespace WaterMeter {
 		int16_t ellipseAngleTimes10() const { return _confirmedGoodFit.getAngle().degreesTimes10(); }
 	protected:
 		void addSample(const SensorSample& sample);
+		void addTraceRecord(TraceDecision decision, uint16_t value) const;
 		Coordinate calcMovingAverage();
 		void detectPulse(Coordinate point);
 		CartesianEllipse executeFit() const;
@@ -65,6 +73,13 @@ namespace WaterMeter {
         static int16_t noFitParameter(double angleDistance, bool fitSucceeded);
         void runFirstFit(Coordinate point);
         void runNextFit();
+		void shiftCenter();
+		void trace(TraceDecision decision, uint16_t value = 0) const {
+			// inline, as it runs for every decision. Costs just the flag check if tracing is off.
+			if (_flowTrace != nullptr && _flowTrace->isEnabled()) addTraceRecord(decision, value);
+		}
+		static uint16_t traceAngle(double angleDistance);
+		static uint16_t traceDistance(double distance);
         void updateEllipseFit(Coordinate point);
 		void updateMovingAverageArray(const SensorSample& sample);
 
@@ -76,9 +91,12 @@ namespace WaterMeter {
 		bool _justStarted = true;
 		CartesianEllipse _confirmedGoodFit;
 		EllipseFit* _ellipseFit;
+		FlowTrace* _flowTrace;
+		uint32_t _sampleIndex = 0;
 		unsigned int _previousQuadrant = 0;
 		Coordinate _startPoint = {};
 		Coordinate _referencePoint = {};
+		double _referenceDistance = 0;
 
 		Coordinate _previousPoint = {};
 		Angle _startTangent = { NAN };
@@ -97,6 +115,9 @@ namespace WaterMeter {
 		Angle _previousAngleWithPreviousFromStart = {};
 		bool _wasReset = true;
         unsigned int _consecutiveOutlierCount = 0;
+		OutlierMode _outlierMode = OutlierMode::Fixed;
+		OutlierFilter _outlierFilter;
+		Coordinate _centerShift = { 0, 0 };
     };
 }
 
@@ -0,0 +1,88 @@
+// Copyright 2024 Rik Essenius
+// 
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License. You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and limitations under the License.
+
+#include <algorithm>
+
+#include "FlowTrace.h"
+
+namespace WaterMeter {
+    constexpr uint16_t FlowTrace::Capacity;
+
+    FlowTrace::FlowTrace(EventServer* eventServer, DataQueue* dataQueue, DataQueuePayload* payload) :
+        EventClient(eventServer),
+        _dataQueue(dataQueue),
+        _payload(payload) {}
+
+    void FlowTrace::add(const uint32_t sampleIndex, const TraceDecision decision, const uint8_t flags, const uint16_t value) {
+        _records[_next] = { sampleIndex, decision, flags, value };
+        _next = static_cast<uint16_t>((_next + 1) % Capacity);
+        if (_count < Capacity) _count++;
+    }
+
+    void FlowTrace::begin() {
+        _eventServer->subscribe(this, Topic::Trace);
+    }
+
+    void FlowTrace::clear() {
+        _next = 0;
+        _count = 0;
+    }
+
+    bool FlowTrace::dump() {
+        // freeze the ring so the dump is consistent
+        _enabled = false;
+        _payload->topic = Topic::Trace;
+        _payload->timestamp = Clock::getTimestamp();
+        uint16_t index = 0;
+        while (index < _count) {
+            const auto chunkSize = static_cast<uint16_t>(std::min<int>(_count - index, MaxTraceRecords));
+            for (uint16_t i = 0; i < chunkSize; i++) {
+                _payload->buffer.trace.record[i] = recordAt(static_cast<uint16_t>(index + i));
+            }
+            _payload->buffer.trace.count = chunkSize;
+            // if the queue is full, the rest of the dump is lost. The ring stays frozen, so we can dump again later.
+            if (!_dataQueue->send(_payload)) return false;
+            index += chunkSize;
+        }
+        return true;
+    }
+
+    const TraceRecord& FlowTrace::recordAt(const uint16_t index) const {
+        // the oldest record is at _next once the ring has wrapped around
+        const auto start = _count < Capacity ? 0 : _next;
+        return _records[(start + index) % Capacity];
+    }
+
+    void FlowTrace::update(const Topic topic, const char* payload) {
+        if (topic != Topic::Trace) return;
+        long command;
+        // unknown commands leave the trace as it is
+        if (parseTraceCommand(payload, command)) update(topic, command);
+    }
+
+    void FlowTrace::update(const Topic topic, const long payload) {
+        if (topic != Topic::Trace) return;
+        switch (payload) {
+        case TraceOff:
+            _enabled = false;
+            break;
+        case TraceOn:
+            if (!_enabled) clear();
+            _enabled = true;
+            break;
+        case TraceDump:
+            dump();
+            break;
+        default:
+            break;
+        }
+    }
+}
@@ -0,0 +1,51 @@
+// Copyright 2024 Rik Essenius
+// 
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License. You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and limitations under the License.
+
+// Keeps the latest FlowDetector decisions in a fixed size ring, so we can reconstruct why a pulse was missed or an
+// outlier flagged. Recording is off by default and costs a single flag check per decision then.
+// Setting the trace property to "on" (or 1) starts recording, "off" (or 0) stops it, and "dump" (or 2) stops recording and
+// sends the ring (oldest first) over the data queue, to be published as hex encoded chunks. Anything else is ignored.
+
+#ifndef HEADER_FLOW_TRACE
+#define HEADER_FLOW_TRACE
+
+#include "DataQueue.h"
+#include "DataQueuePayload.h"
+#include "EventServer.h"
+#include "TraceRecord.h"
+
+namespace WaterMeter {
+    class FlowTrace final : public EventClient {
+    public:
+        FlowTrace(EventServer* eventServer, DataQueue* dataQueue, DataQueuePayload* payload);
+        void add(uint32_t sampleIndex, TraceDecision decision, uint8_t flags, uint16_t value);
+        void begin();
+        void clear();
+        uint16_t count() const { return _count; }
+        bool dump();
+        bool isEnabled() const { return _enabled; }
+        const TraceRecord& recordAt(uint16_t index) const;
+        void setEnabled(bool enabled) { _enabled = enabled; }
+        using EventClient::update;
+        void update(Topic topic, const char* payload) override;
+        void update(Topic topic, long payload) override;
+
+        static constexpr uint16_t Capacity = 512;
+    private:
+        DataQueue* _dataQueue;
+        DataQueuePayload* _payload;
+        TraceRecord _records[Capacity] = {};
+        uint16_t _next = 0;
+        uint16_t _count = 0;
+        bool _enabled = false;
+    };
+}
+#endif
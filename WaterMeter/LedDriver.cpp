@@ -120,7 +120,8 @@ namespace WaterMeter {
             Led::set(Led::Blue, Led::Off);
             return;
         case Topic::Sample:
-            _sampleFlasher.signal();
+            // the payload is the number of samples since the last one (see Sampler::begin)
+            _sampleFlasher.signal(static_cast<unsigned int>(payload));
             return;
         case Topic::TimeOverrun:
             timeOverrunUpdate(payload > 0);
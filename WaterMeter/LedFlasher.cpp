@@ -27,11 +27,13 @@ namespace WaterMeter {
         reset();
     }
 
-    void LedFlasher::signal() {
-        if (_ledCounter == 0) {
-            Led::toggle(_led);
-            _ledCounter = _interval;
+    void LedFlasher::signal(const unsigned int count) {
+        for (unsigned int i = 0; i < count; i++) {
+            if (_ledCounter == 0) {
+                Led::toggle(_led);
+                _ledCounter = _interval;
+            }
+            _ledCounter--;
         }
-        _ledCounter--;
     }
 }
\ No newline at end of file
@@ -20,7 +20,7 @@ namespace WaterMeter {
         LedFlasher(uint8_t led, unsigned int interval);
         void reset();
         void setInterval(unsigned int interval);
-        void signal();
+        void signal(unsigned int count = 1);
     private:
         unsigned int _interval;
         uint8_t _led;
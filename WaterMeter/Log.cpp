@@ -65,8 +65,37 @@ namespace WaterMeter {
         _eventServer->subscribe(this, Topic::WifiSummaryReady);
     }
 
-    const char* Log::getTimestamp() const {
-        return _eventServer->request(Topic::Time, "");
+    // print everything in the ring. The timestamp is only shown if there is a clock.
+    void Log::print() {
+        // printf doesn't seem to influence other tasks (unlike Serial.printf)
+        xSemaphoreTake(_printMutex, portMAX_DELAY);
+        const bool hasClock = _eventServer->isProvided(Topic::Time);
+        char timestampBuffer[Clock::BufferSize] = {};
+        Timestamp timestamp;
+        const char* message;
+        while ((message = _ring.peek(timestamp)) != nullptr) {
+            if (hasClock) {
+                Clock::formatTimestamp(timestamp, timestampBuffer, Clock::BufferSize);
+            }
+            printf("[%s] %s\n", timestampBuffer, message);
+            _ring.release();
+        }
+        const auto dropped = _ring.takeDropped();
+        if (dropped > 0) {
+            printf("[] Dropped %lu log lines\n", static_cast<unsigned long>(dropped));
+        }
+        xSemaphoreGive(_printMutex);
+    }
+
+    [[noreturn]] void Log::task(void* parameter) {
+        const auto me = static_cast<Log*>(parameter);
+        me->_logTask = xTaskGetCurrentTaskHandle();
+        // catch up on anything that was logged before we started
+        me->print();
+        for (;;) {
+            (void)ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            me->print();
+        }
     }
 
     // ReSharper disable once CyclomaticComplexity - just a case statement
@@ -172,7 +201,7 @@ namespace WaterMeter {
         }
     }
 
-    void Log::printIndexedPayload(const char* entity, const long payload) const {
+    void Log::printIndexedPayload(const char* entity, const long payload) {
         const int index = payload >> 24;
         const long value = payload & 0x00FFFFFF;
         log("Free %s #%d: %ld", entity, index, value);
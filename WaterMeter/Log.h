@@ -10,12 +10,15 @@
 // See the License for the specific language governing permissions and limitations under the License.
 
 // Mechanism to log events to the serial port.
-// It uses a mutex to ensure that only one process is doing this at a time.
+// Callers only format the message into a lock-free ring with the raw time, and the log task prints it later at low priority.
+// Until that task runs (and in the tests) the caller prints right away. Only the printing uses a mutex.
+// Calls below LOG_LEVEL (a build flag, default Info) are compiled out.
 
 #ifndef HEADER_LOG
 #define HEADER_LOG
 
 #include <ESP.h>
+#include "LogRing.h"
 
 #ifndef ESP32
 // hack to redirect printf to capture the output
@@ -25,33 +28,47 @@
 
 #include "PayloadBuilder.h"
 
+#ifndef LOG_LEVEL
+#define LOG_LEVEL 1
+#endif
+
 namespace WaterMeter {
+    enum class LogLevel : uint8_t { Debug = 0, Info, Warning, Error, None };
+
+    constexpr auto MinimumLogLevel = static_cast<LogLevel>(LOG_LEVEL);
+
     class Log final : public EventClient {
     public:
         using EventClient::update;
         Log(EventServer* eventServer, PayloadBuilder* wifiPayloadBuilder);
         void begin();
 
-        template <typename... Arguments>
-        void log(const char* format, const Arguments ... arguments) const {
-            // printf doesn't seem to influence other tasks (unlike Serial.printf)
-            xSemaphoreTake(_printMutex, portMAX_DELAY);
-            printf("[%s] ", getTimestamp());
-            printf(format, arguments...);
-            printf("\n");
-            xSemaphoreGive(_printMutex);
+        template <LogLevel Level = LogLevel::Info, typename... Arguments>
+        void log(const char* format, const Arguments ... arguments) {
+            if (Level < MinimumLogLevel) return;
+            // a full ring counts the line as dropped, and the log task reports that
+            (void)_ring.add(Clock::getTimestamp(), format, arguments...);
+            if (_logTask == nullptr) {
+                print();
+            }
+            else {
+                xTaskNotifyGive(_logTask);
+            }
         }
 
+        [[noreturn]] static void task(void* parameter);
         void update(Topic topic, const char* payload) override;
         void update(Topic topic, long payload) override;
 
     private:
         PayloadBuilder* _wifiPayloadBuilder;
         long _previousConnectionTopic = -1;
+        LogRing _ring;
+        TaskHandle_t _logTask = nullptr;
         static SemaphoreHandle_t _printMutex;
 
-        const char* getTimestamp() const;
-        void printIndexedPayload(const char* entity, long payload) const;
+        void print();
+        void printIndexedPayload(const char* entity, long payload);
     };
 }
 #endif
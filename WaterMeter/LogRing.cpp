@@ -0,0 +1,58 @@
+// Copyright 2024 Rik Essenius
+// 
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License. You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and limitations under the License.
+
+#include "LogRing.h"
+
+namespace WaterMeter {
+    LogRing::LogRing() : _head(0), _dropped(0) {
+        for (uint32_t i = 0; i < SlotCount; i++) {
+            _slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    // returns the oldest ready line, or nullptr if there is none. Only to be called by the consumer.
+    const char* LogRing::peek(Timestamp& timestamp) const {
+        const auto& slot = _slots[_tail % SlotCount];
+        if (slot.sequence.load(std::memory_order_acquire) != _tail + 1) return nullptr;
+        timestamp = slot.timestamp;
+        return slot.message;
+    }
+
+    // hand the slot that peek returned back to the producers
+    void LogRing::release() {
+        _slots[_tail % SlotCount].sequence.store(_tail + SlotCount, std::memory_order_release);
+        _tail++;
+    }
+
+    LogRing::Slot* LogRing::reserve(uint32_t& position) {
+        position = _head.load(std::memory_order_relaxed);
+        for (;;) {
+            const auto slot = &_slots[position % SlotCount];
+            const auto difference = static_cast<int32_t>(slot->sequence.load(std::memory_order_acquire) - position);
+            if (difference == 0) {
+                // on failure, position gets the current head and we try again
+                if (_head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) return slot;
+            }
+            else if (difference < 0) {
+                // the consumer hasn't released this slot yet, so the ring is full
+                _dropped.fetch_add(1, std::memory_order_relaxed);
+                return nullptr;
+            }
+            else {
+                position = _head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    uint32_t LogRing::takeDropped() {
+        return _dropped.exchange(0, std::memory_order_relaxed);
+    }
+}
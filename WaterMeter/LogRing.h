@@ -0,0 +1,62 @@
+// Copyright 2024 Rik Essenius
+// 
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License. You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and limitations under the License.
+
+// Fixed ring of log lines waiting to be printed. Any task can add a line without taking a lock: a producer claims a slot
+// by advancing the head, fills it, and then marks it ready via the slot's sequence number. A single consumer takes the
+// ready lines out in order. If the ring is full, the line is dropped and counted, so callers never wait.
+
+#ifndef HEADER_LOG_RING
+#define HEADER_LOG_RING
+
+#include <atomic>
+#include <cstdio>
+#include "Clock.h"
+
+namespace WaterMeter {
+    class LogRing {
+    public:
+        LogRing();
+
+        template <typename... Arguments>
+        bool add(const Timestamp timestamp, const char* format, const Arguments ... arguments) {
+            uint32_t position;
+            const auto slot = reserve(position);
+            if (slot == nullptr) return false;
+            slot->timestamp = timestamp;
+            (void)snprintf(slot->message, MessageSize, format, arguments...);
+            slot->sequence.store(position + 1, std::memory_order_release);
+            return true;
+        }
+
+        uint32_t takeDropped();
+        const char* peek(Timestamp& timestamp) const;
+        void release();
+
+        // must be a power of two to survive wrapping of the positions
+        static constexpr uint16_t SlotCount = 16;
+        static constexpr uint16_t MessageSize = 384;
+
+    private:
+        struct Slot {
+            std::atomic<uint32_t> sequence;
+            Timestamp timestamp;
+            char message[MessageSize];
+        };
+
+        Slot* reserve(uint32_t& position);
+
+        Slot _slots[SlotCount];
+        std::atomic<uint32_t> _head;
+        uint32_t _tail = 0;
+        std::atomic<uint32_t> _dropped;
+    };
+}
+#endif
@@ -68,6 +68,10 @@ namespace WaterMeter {
         return _sensor->getNoiseRange();
     }
 
+    bool MagnetoSensorReader::isReal() const {
+        return _sensor != nullptr && _sensor->isReal();
+    }
+
     bool MagnetoSensorReader::hardReset() {
         if (_isHardResetting) return false;
         _isHardResetting = true;
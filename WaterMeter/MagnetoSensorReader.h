@@ -35,6 +35,7 @@ namespace WaterMeter {
         double getGain() const;
         int getNoiseRange() const;
         bool hardReset();
+        bool isReal() const;
         SensorSample read() const;
         bool softReset();
         SensorState getState() { return _sensorState; }
@@ -0,0 +1,79 @@
+// Copyright 2024 Rik Essenius
+// 
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License. You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and limitations under the License.
+
+#include <cstring>
+#include "MessageArena.h"
+
+namespace WaterMeter {
+    MessageArena::MessageArena() : _mutex(xSemaphoreCreateMutex()) {}
+
+    bool MessageArena::addReference(const char* message) {
+        const auto index = slotIndex(message);
+        if (index < 0) return false;
+        xSemaphoreTake(_mutex, portMAX_DELAY);
+        // a slot that was released in the meantime can't be revived
+        const bool isLive = _references[index] > 0;
+        if (isLive) _references[index]++;
+        xSemaphoreGive(_mutex);
+        return isLive;
+    }
+
+    const char* MessageArena::allocate(const char* message) {
+        const auto length = strlen(message);
+        // too long messages are the caller's problem, they don't get truncated
+        if (length >= SlotSize) return nullptr;
+        xSemaphoreTake(_mutex, portMAX_DELAY);
+        for (uint8_t i = 0; i < SlotCount; i++) {
+            if (_references[i] == 0) {
+                _references[i] = 1;
+                xSemaphoreGive(_mutex);
+                // we own the slot now, so we can copy outside the lock
+                memcpy(_slots[i], message, length + 1);
+                return _slots[i];
+            }
+        }
+        xSemaphoreGive(_mutex);
+        return nullptr;
+    }
+
+    uint8_t MessageArena::freeSlots() const {
+        uint8_t count = 0;
+        xSemaphoreTake(_mutex, portMAX_DELAY);
+        for (const auto references : _references) {
+            if (references == 0) count++;
+        }
+        xSemaphoreGive(_mutex);
+        return count;
+    }
+
+    bool MessageArena::owns(const char* message) const {
+        return slotIndex(message) >= 0;
+    }
+
+    void MessageArena::release(const char* message) {
+        const auto index = slotIndex(message);
+        if (index < 0) return;
+        xSemaphoreTake(_mutex, portMAX_DELAY);
+        if (_references[index] > 0) _references[index]--;
+        xSemaphoreGive(_mutex);
+    }
+
+    // private methods
+
+    int MessageArena::slotIndex(const char* message) const {
+        const auto start = &_slots[0][0];
+        if (message < start || message >= start + sizeof _slots) return -1;
+        const auto offset = message - start;
+        // only the start of a slot is a valid handle
+        if (offset % SlotSize != 0) return -1;
+        return static_cast<int>(offset / SlotSize);
+    }
+}
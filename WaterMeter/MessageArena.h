@@ -0,0 +1,43 @@
+// Copyright 2024 Rik Essenius
+// 
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License. You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and limitations under the License.
+
+// Fixed set of string slots shared by the queue clients, so string payloads survive until every receiver is done with them.
+// A sender copies a string into a free slot once; a queue client forwarding a string that is already in a slot only adds
+// a reference. The receiver releases its reference after publishing, and the slot is free again when the count drops to zero.
+// A mutex protects the reference counts as the slots are shared between tasks. No heap is used.
+
+#ifndef HEADER_MESSAGE_ARENA
+#define HEADER_MESSAGE_ARENA
+
+// ReSharper disable once CppUnusedIncludeDirective -- semphr.h requires freeRTOS.h
+#include <freertos/freeRTOS.h>
+#include <freertos/semphr.h>
+
+namespace WaterMeter {
+    class MessageArena {
+    public:
+        MessageArena();
+        bool addReference(const char* message);
+        const char* allocate(const char* message);
+        uint8_t freeSlots() const;
+        bool owns(const char* message) const;
+        void release(const char* message);
+
+        static constexpr uint8_t SlotCount = 16;
+        static constexpr uint16_t SlotSize = 256;
+    private:
+        int slotIndex(const char* message) const;
+        char _slots[SlotCount][SlotSize] = {};
+        uint8_t _references[SlotCount] = {};
+        SemaphoreHandle_t _mutex;
+    };
+}
+#endif
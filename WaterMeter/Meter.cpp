@@ -10,14 +10,18 @@
 // See the License for the specific language governing permissions and limitations under the License.
 
 #include "Meter.h"
+#include <climits>
+#include <cstring>
 #include <string>
-#include <cmath>
 
 #include "EventServer.h"
 #include <SafeCString.h>
 
 namespace WaterMeter {
-    Meter::Meter(EventServer* eventServer) : EventClient(eventServer) {
+    Meter::Meter(EventServer* eventServer, ConsumptionHistory* history, MeterJournal* journal) :
+        EventClient(eventServer),
+        _history(history),
+        _journal(journal) {
         eventServer->subscribe(this, Topic::Begin);
     }
 
@@ -25,6 +29,17 @@ namespace WaterMeter {
         _eventServer->subscribe(this, Topic::Pulse);
         _eventServer->subscribe(this, Topic::SetVolume);
         _eventServer->subscribe(this, Topic::AddVolume);
+        _eventServer->subscribe(this, Topic::ResultWritten);
+
+        MeterState state{};
+        if (_journal != nullptr && _journal->load(state)) {
+            _volumeUnits = state.volumeUnits;
+            _pulses = state.pulses;
+            _restoredUnits = _volumeUnits + pulseUnits();
+            _isRestored = true;
+            _savedAt = Clock::getTimestamp();
+            publishValues();
+        }
     }
 
 
@@ -45,19 +60,38 @@ namespace WaterMeter {
     const char* Meter::getMeterPayload(const char* volume) {
         const char* timestamp = _eventServer->request(Topic::Time, "");
         // it's important that volume is the last entry, as extractVolume depends on that
-        SafeCString::sprintf(_jsonBuffer, R"({"timestamp":"%s","pulses":%d,"volume":%s})", timestamp, _pulses, volume);
+        SafeCString::sprintf(_jsonBuffer, R"({"timestamp":"%s","pulses":%lu,"volume":%s})", timestamp, _pulses, volume);
         return _jsonBuffer;
     }
 
     const char* Meter::getVolume() {
-        // trick to avoid rounding errors of .00049999999: take the next higher representable value
-        const double volume = nextafter(_volume + _pulses * PulseDelta, 1e7);
-        SafeCString::sprintf(_volumeBuffer, "%.7f", volume);
+        const auto volume = _volumeUnits + pulseUnits();
+        // write the fraction backwards from the end, then the integer part in front of it
+        char* position = _volumeBuffer + VolumeSize - 1;
+        *position = 0;
+        auto remainder = volume % UnitsPerVolume;
+        for (int i = 0; i < Decimals; i++) {
+            *--position = static_cast<char>('0' + remainder % 10);
+            remainder /= 10;
+        }
+        *--position = '.';
+        auto whole = volume / UnitsPerVolume;
+        do {
+            *--position = static_cast<char>('0' + whole % 10);
+            whole /= 10;
+        } while (whole > 0);
+        // the buffer is big enough for any 64-bit volume, so move the result to the start
+        memmove(_volumeBuffer, position, strlen(position) + 1);
         return _volumeBuffer;
     }
 
     void Meter::newPulse() {
         _pulses++;
+        if (_history != nullptr) {
+            _history->addPulse(static_cast<uint32_t>(Clock::getTimestamp() / 1000000ULL));
+        }
+        _isDirty = true;
+        saveState(false);
         publishValues();
     }
 
@@ -67,17 +101,15 @@ namespace WaterMeter {
         _eventServer->publish(this, Topic::MeterPayload, getMeterPayload(_volumeBuffer));
     }
 
-    bool Meter::setVolume(const char* meterValue, const double addition) {
-        char* end;
-        const auto volume = std::strtod(meterValue, &end);
-        const auto allCharactersParsed = *end == '\0';
-        if (allCharactersParsed) {
-            _volume = volume + addition;
-            _pulses = 0;
-            publishValues();
-            return true;
-        }
-        return false;
+    bool Meter::setVolume(const char* meterValue, const unsigned long long additionUnits) {
+        unsigned long long volume;
+        if (!parseVolume(meterValue, volume)) return false;
+        _volumeUnits = volume + additionUnits;
+        _pulses = 0;
+        _isDirty = true;
+        saveState(true);
+        publishValues();
+        return true;
     }
 
     void Meter::update(const Topic topic, const char* payload) {
@@ -91,7 +123,12 @@ namespace WaterMeter {
             // This caters for any usage between the device boot and MQTT being up.
             // This happens just once, but we can't unsubscribe while we are iterating through the subscribers.
             // it is also not really necessary as the connector is guaranteed to send it only once.
-            setVolume(extractVolume(payload), _volume);
+            if (_isRestored) {
+                reconcileVolume(extractVolume(payload));
+            }
+            else {
+                setVolume(extractVolume(payload), _volumeUnits);
+            }
         }
     }
 
@@ -102,9 +139,79 @@ namespace WaterMeter {
             newPulse();
         }
 
+        // results come in regularly, so this catches the last pulses after the flow stopped
+        else if (topic == Topic::ResultWritten) {
+            saveState(false);
+        }
+
         // we initialize after the base services like logger and led driver were initialized
         else if (topic == Topic::Begin && payload) {
             begin();
         }
     }
+
+    // private methods
+
+    // Accepts digits with an optional decimal point. Decimals beyond our resolution are rounded half up.
+    bool Meter::parseVolume(const char* meterValue, unsigned long long& units) {
+        if (meterValue == nullptr) return false;
+        unsigned long long whole = 0;
+        unsigned long long fraction = 0;
+        int decimals = 0;
+        bool hasDigits = false;
+        bool roundUp = false;
+        const char* position = meterValue;
+        for (; *position >= '0' && *position <= '9'; position++) {
+            whole = whole * 10 + static_cast<unsigned long long>(*position - '0');
+            // prevent overflow when converting to units
+            if (whole >= ULLONG_MAX / UnitsPerVolume) return false;
+            hasDigits = true;
+        }
+        if (*position == '.') {
+            position++;
+            for (; *position >= '0' && *position <= '9'; position++) {
+                if (decimals < Decimals) {
+                    fraction = fraction * 10 + static_cast<unsigned long long>(*position - '0');
+                }
+                else if (decimals == Decimals) {
+                    roundUp = *position >= '5';
+                }
+                decimals++;
+                hasDigits = true;
+            }
+        }
+        if (!hasDigits || *position != '\0') return false;
+        for (; decimals < Decimals; decimals++) {
+            fraction *= 10;
+        }
+        units = whole * UnitsPerVolume + fraction + (roundUp ? 1 : 0);
+        return true;
+    }
+
+    // The journal can be behind if we lost power before it was saved. MQTT got every update, so if its value
+    // is higher, add the difference. The pulses since boot stay counted.
+    void Meter::reconcileVolume(const char* meterValue) {
+        unsigned long long retainedUnits;
+        if (!parseVolume(meterValue, retainedUnits) || retainedUnits <= _restoredUnits) return;
+        _volumeUnits += retainedUnits - _restoredUnits;
+        _restoredUnits = retainedUnits;
+        _isDirty = true;
+        saveState(true);
+        publishValues();
+    }
+
+    // Coalesce writes: only save if something changed, and not more often than the interval unless forced
+    void Meter::saveState(const bool force) {
+        if (_journal == nullptr || !_isDirty) return;
+        const auto now = Clock::getTimestamp();
+        if (!force && now - _savedAt < SaveIntervalMicros) return;
+        _journal->save({ _volumeUnits, _pulses, now });
+        _savedAt = now;
+        _isDirty = false;
+    }
+
+    // the volume of the pulses since the last time the volume was set, rounded to the nearest unit
+    unsigned long long Meter::pulseUnits() const {
+        return (static_cast<unsigned long long>(_pulses) * UnitsPerVolume * 20 + PulsesPerTenUnits) / (2 * PulsesPerTenUnits);
+    }
 }
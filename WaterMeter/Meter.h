@@ -10,35 +10,54 @@
 // See the License for the specific language governing permissions and limitations under the License.
 
 // Translate the pulses to a meter value. 
+// The volume is kept as an integer number of units of 10^-7, the resolution we report, so it doesn't drift
+// over millions of pulses. Parsing and formatting are exact decimal conversions, without floating point.
+// With a journal, the state is restored at begin and saved at most once a minute while pulses come in.
+// The retained MQTT value then only corrects the meter if it is ahead of the restored state.
 #ifndef HEADER_METER
 #define HEADER_METER
 
 #include "EventClient.h"
+#include "ConsumptionHistory.h"
+#include "MeterJournal.h"
 
 namespace WaterMeter {
     class Meter final : public EventClient {
     public:
-        explicit Meter(EventServer* eventServer);
+        explicit Meter(EventServer* eventServer, ConsumptionHistory* history = nullptr, MeterJournal* journal = nullptr);
         void begin();
         const char* extractVolume(const char* payload);
         const char* getVolume();
         const char* getMeterPayload(const char* volume);
         void newPulse();
         void publishValues();
-        bool setVolume(const char* meterValue, double addition = 0.0);
+        bool setVolume(const char* meterValue, unsigned long long additionUnits = 0);
         void update(Topic topic, const char* payload) override;
         void update(Topic topic, long payload) override;
 
     private:
-        // 1 pulse per cycle, this is cycles per 1000 L
+        static bool parseVolume(const char* meterValue, unsigned long long& units);
+        unsigned long long pulseUnits() const;
+        void reconcileVolume(const char* meterValue);
+        void saveState(bool force);
+
+        // 1 pulse per cycle, this is cycles per 1000 L (16432.7), multiplied by 10 to make it an integer.
         // This needs to be calibrated. TODO: Make this a configuration parameter
-        static constexpr double PulsesPerUnit = 16432.7;
-        static constexpr double PulseDelta = 1.0 / PulsesPerUnit;
-        double _volume = 0.0;
+        static constexpr unsigned long long PulsesPerTenUnits = 164327ULL;
+        static constexpr int Decimals = 7;
+        static constexpr unsigned long long UnitsPerVolume = 10000000ULL;
+        static constexpr Timestamp SaveIntervalMicros = 60ULL * 1000000ULL;
+        ConsumptionHistory* _history;
+        MeterJournal* _journal;
+        bool _isDirty = false;
+        bool _isRestored = false;
+        unsigned long long _restoredUnits = 0;
+        Timestamp _savedAt = 0;
+        unsigned long long _volumeUnits = 0;
         unsigned long _pulses = 0;
         static constexpr int BufferSize = 100;
         char _jsonBuffer[BufferSize] = "";
-        static constexpr int VolumeSize = 20;
+        static constexpr int VolumeSize = 24;
         char _volumeBuffer[VolumeSize] = "";
     };
 }
@@ -0,0 +1,73 @@
+// Copyright 2024 Rik Essenius
+// 
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License. You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and limitations under the License.
+
+#include <cstddef>
+#include "MeterJournal.h"
+
+namespace WaterMeter {
+    constexpr auto JournalNamespace = "meter";
+    constexpr int KeySize = 4;
+
+    MeterJournal::MeterJournal(Preferences* preferences) : _preferences(preferences) {}
+
+    bool MeterJournal::load(MeterState& state) {
+        bool found = false;
+        char key[KeySize];
+        _preferences->begin(JournalNamespace, true);
+        for (uint8_t slot = 0; slot < SlotCount; slot++) {
+            Record record{};
+            slotKey(slot, key);
+            if (_preferences->getBytes(key, &record, sizeof record) != sizeof record) continue;
+            if (record.checksum != checksum(record)) continue;
+            if (found && record.sequence <= _sequence) continue;
+            found = true;
+            _sequence = record.sequence;
+            state.volumeUnits = record.volumeUnits;
+            state.pulses = record.pulses;
+            state.timestamp = record.timestamp;
+        }
+        _preferences->end();
+        return found;
+    }
+
+    void MeterJournal::save(const MeterState& state) {
+        _sequence++;
+        Record record{};
+        record.sequence = _sequence;
+        record.pulses = static_cast<uint32_t>(state.pulses);
+        record.volumeUnits = state.volumeUnits;
+        record.timestamp = state.timestamp;
+        record.checksum = checksum(record);
+        char key[KeySize];
+        slotKey(static_cast<uint8_t>(_sequence % SlotCount), key);
+        _preferences->begin(JournalNamespace, false);
+        _preferences->putBytes(key, &record, sizeof record);
+        _preferences->end();
+    }
+
+    // private methods
+
+    // FNV-1a over everything but the checksum itself
+    uint32_t MeterJournal::checksum(const Record& record) {
+        const auto bytes = reinterpret_cast<const uint8_t*>(&record);
+        uint32_t hash = 2166136261U;
+        for (size_t i = 0; i < offsetof(Record, checksum); i++) {
+            hash = (hash ^ bytes[i]) * 16777619U;
+        }
+        return hash;
+    }
+
+    void MeterJournal::slotKey(const uint8_t slot, char* key) {
+        key[0] = 's';
+        key[1] = static_cast<char>('0' + slot);
+        key[2] = 0;
+    }
+}
@@ -0,0 +1,53 @@
+// Copyright 2024 Rik Essenius
+// 
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License. You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and limitations under the License.
+
+// Keeps the meter state in Preferences, so the meter can restore it at boot without waiting for MQTT.
+// Writes rotate over a fixed number of slots, each with a sequence number and a checksum, so no single flash
+// entry gets all the writes and a torn write only loses the last record. Loading picks the newest valid slot.
+
+#ifndef HEADER_METER_JOURNAL
+#define HEADER_METER_JOURNAL
+
+#include <Preferences.h>
+#include "Clock.h"
+
+namespace WaterMeter {
+    struct MeterState {
+        unsigned long long volumeUnits;
+        unsigned long pulses;
+        Timestamp timestamp;
+    };
+
+    class MeterJournal {
+    public:
+        explicit MeterJournal(Preferences* preferences);
+        bool load(MeterState& state);
+        void save(const MeterState& state);
+
+        static constexpr uint8_t SlotCount = 8;
+
+    private:
+        struct Record {
+            uint32_t sequence;
+            uint32_t pulses;
+            uint64_t volumeUnits;
+            uint64_t timestamp;
+            uint32_t checksum;
+        };
+
+        static uint32_t checksum(const Record& record);
+        static void slotKey(uint8_t slot, char* key);
+
+        Preferences* _preferences;
+        uint32_t _sequence = 0;
+    };
+}
+#endif
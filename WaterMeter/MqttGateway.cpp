@@ -16,6 +16,7 @@
 
 #include <SafeCString.h>
 #include "MqttGateway.h"
+#include "TraceRecord.h"
 
 #include <memory>
 
@@ -27,22 +28,28 @@ namespace WaterMeter {
     static const std::map<Topic, std::pair<bool, std::pair<const char*, const char*>>> TopicMap{
         {Topic::BatchSize, {false, {Measurement, MeasurementBatchSize}}},
         {Topic::BatchSizeDesired, {true, {Measurement, MeasurementBatchSizeDesired}}},
+        {Topic::Capture, {true, {Measurement, MeasurementCapture}}},
         {Topic::SamplesFormatted, {false, {Measurement, MeasurementValues}}},
+        {Topic::Trace, {true, {Measurement, MeasurementTrace}}},
+        {Topic::TraceFormatted, {false, {Measurement, MeasurementTrace}}},
         {Topic::Rate, {false, {Result, ResultRate}}},
         {Topic::ResultFormatted, {false, {Result, ResultValues}}},
         {Topic::IdleRate, {true, {Result, ResultIdleRate}}},
         {Topic::NonIdleRate, {true, {Result, ResultNonIdleRate}}},
         {Topic::MeterPayload, {false, {Result, ResultMeter}}},
+        {Topic::History, {true, {Result, ResultHistory}}},
+        {Topic::HistoryFormatted, {false, {Result, ResultHistory}}},
         {Topic::SetVolume, {true, {Result, ResultMeter}}},
         {Topic::FreeHeap, {false, {DeviceLabel, DeviceFreeHeap}}},
         {Topic::FreeStack, {false, {DeviceLabel, DeviceFreeStack}}},
+        {Topic::CpuFormatted, {false, {DeviceLabel, DeviceCpu}}},
         {Topic::FreeQueueSize, {false, {DeviceLabel, DeviceFreeQueueSize}}},
         {Topic::FreeQueueSpaces, {false, {DeviceLabel, DeviceFreeQueueSpaces}}},
         {Topic::SensorWasReset, {false, {DeviceLabel, DeviceResetSensor}}},
         {Topic::ResetSensor, {true, {DeviceLabel, DeviceResetSensor}}}
     };
 
-    static const std::set<Topic> NonRetainedTopics{ Topic::ResetSensor, Topic::SensorWasReset };
+    static const std::set<Topic> NonRetainedTopics{ Topic::HistoryFormatted, Topic::ResetSensor, Topic::SensorWasReset, Topic::TraceFormatted };
 
     constexpr auto RateRange = "0:8640000";
     constexpr auto TypeInteger = "integer";
@@ -73,18 +80,19 @@ namespace WaterMeter {
         WiFiClientFactory* wifiClientFactory,
         const MqttConfig* mqttConfig,
         const DataQueue* dataQueue,
-        const char* buildVersion) :
+        const char* buildVersion,
+        ConnectionCache* connectionCache) :
 
         EventClient(eventServer),
         _mqttClient(mqttClient),
         _wifiClientFactory(wifiClientFactory),
         _mqttConfig(mqttConfig),
         _dataQueue(dataQueue),
+        _connectionCache(connectionCache),
         _buildVersion(buildVersion) {}
 
-    MqttGateway::~MqttGateway() {
-        delete _wifiClient;
-    }
+    // the Wi-Fi client belongs to the factory
+    MqttGateway::~MqttGateway() = default;
 
     // ---- Public methods ----
 
@@ -96,8 +104,10 @@ namespace WaterMeter {
         _eventServer->subscribe(this, Topic::BatchSizeDesired);
         _eventServer->subscribe(this, Topic::FreeHeap);
         _eventServer->subscribe(this, Topic::FreeStack);
+        _eventServer->subscribe(this, Topic::CpuFormatted); // string
         _eventServer->subscribe(this, Topic::FreeQueueSize);
         _eventServer->subscribe(this, Topic::FreeQueueSpaces);
+        _eventServer->subscribe(this, Topic::HistoryFormatted); // string
         _eventServer->subscribe(this, Topic::IdleRate);
         _eventServer->subscribe(this, Topic::NonIdleRate);
         _eventServer->subscribe(this, Topic::Rate);
@@ -105,6 +115,7 @@ namespace WaterMeter {
         _eventServer->subscribe(this, Topic::SamplesFormatted); // string
         _eventServer->subscribe(this, Topic::SensorWasReset);
         _eventServer->subscribe(this, Topic::MeterPayload); // string
+        _eventServer->subscribe(this, Topic::TraceFormatted); // string
     }
 
     void MqttGateway::begin(const char* clientName) {
@@ -114,11 +125,11 @@ namespace WaterMeter {
             _announcementPointer = _announcementBuffer;
             prepareAnnouncementBuffer();
         }
-        delete _wifiClient;
-        _wifiClient = _wifiClientFactory->create(_mqttConfig->useTls);
+        // the same client every time, so a reconnect doesn't set up a new one
+        _wifiClient = _wifiClientFactory->acquire(ClientRole::Mqtt, _mqttConfig->useTls);
         _mqttClient->setClient(*_wifiClient);
         _mqttClient->setBufferSize(512);
-        _mqttClient->setServer(_mqttConfig->broker, static_cast<uint16_t>(_mqttConfig->port));
+        setServer();
         _mqttClient->setCallback([this](const char* topic, const uint8_t* payload, const unsigned int length) {
             this->callback(topic, payload, length);
             });
@@ -140,8 +151,17 @@ namespace WaterMeter {
 
         // should get picked up by isConnected later
         if (!success) {
+            // the broker may have moved, so the next attempt looks it up again
+            if (_usesCachedBroker) {
+                _connectionCache->forgetBroker();
+                _usesCachedBroker = false;
+                _mqttClient->setServer(_mqttConfig->broker, static_cast<uint16_t>(_mqttConfig->port));
+            }
             return;
         }
+        if (canCacheBroker() && !_usesCachedBroker) {
+            _connectionCache->saveBroker(_mqttConfig->broker, _wifiClient->remoteIP());
+        }
 
         // if this doesn't work but the connection is still up, we may still be able to run.
         SafeCString::sprintf(_topicBuffer, BaseTopicTemplate, _clientName, "+/+/set");
@@ -160,16 +180,18 @@ namespace WaterMeter {
         if (!_mqttClient->subscribe(_topicBuffer)) {
             publishError("Could not subscribe to result meter");
         }
+        _previousVolumeWaitStart = micros();
     }
 
+    // The retained meter value comes in via the normal loop in handleQueue, so we don't wait for it here.
+    // Returns true once it arrived or we gave up on it, so the caller can stop listening.
     bool MqttGateway::getPreviousVolume() {
         if (!_justStarted) return false;
-        const auto startTime = micros();
-        while (!_meterPayloadReceived && micros() - startTime < 1e6) {
-            _mqttClient->loop();
-            delay(10);
-        }
+        if (!_meterPayloadReceived && micros() - _previousVolumeWaitStart < PreviousVolumeWaitMicros) return false;
         _justStarted = false;
+        SafeCString::sprintf(_topicBuffer, BaseTopicTemplate, _clientName, Result);
+        SafeCString::strcat(_topicBuffer, "/");
+        SafeCString::strcat(_topicBuffer, ResultMeter);
         _mqttClient->unsubscribe(_topicBuffer);
         return true;
     }
@@ -249,6 +271,11 @@ namespace WaterMeter {
         }
     }
 
+    // Over TLS, the certificate is checked against the host name, so only plain connections skip the lookup.
+    bool MqttGateway::canCacheBroker() const {
+        return _connectionCache != nullptr && !_mqttConfig->useTls;
+    }
+
     bool MqttGateway::isRightTopic(const std::pair<const char*, const char*> topicPair, const char* expectedNode, const char* expectedProperty) {
         return strcmp(topicPair.first, expectedNode) == 0 && strcmp(topicPair.second, expectedProperty) == 0;
     }
@@ -264,22 +291,27 @@ namespace WaterMeter {
         prepareEntity("$implementation", "esp32");
         prepareEntity("$extensions", Empty);
 
-        SafeCString::sprintf(payload, "%s,%s,%s", MeasurementBatchSize, MeasurementBatchSizeDesired, MeasurementValues);
+        SafeCString::sprintf(payload, "%s,%s,%s,%s,%s", MeasurementBatchSize, MeasurementBatchSizeDesired, MeasurementCapture, MeasurementTrace,
+            MeasurementValues);
         prepareNode(Measurement, "Measurement", "1", payload);
         prepareProperty(Measurement, MeasurementBatchSize, "Batch Size", TypeInteger);
         prepareProperty(Measurement, MeasurementBatchSizeDesired, "Desired Batch Size", TypeInteger, "0-20", Settable);
+        prepareProperty(Measurement, MeasurementCapture, "Capture Target", TypeString, Empty, Settable);
+        prepareProperty(Measurement, MeasurementTrace, "Decision Trace", TypeString, Empty, Settable);
         prepareProperty(Measurement, MeasurementValues, "Values", TypeString);
 
-        SafeCString::sprintf(payload, "%s,%s,%s,%s,%s", ResultRate, ResultIdleRate, ResultNonIdleRate, ResultMeter, ResultValues);
+        SafeCString::sprintf(payload, "%s,%s,%s,%s,%s,%s", ResultRate, ResultIdleRate, ResultNonIdleRate, ResultMeter, ResultValues,
+            ResultHistory);
         prepareNode(Result, "Result", "1", payload);
         prepareProperty(Result, ResultRate, "Rate", TypeInteger);
         prepareProperty(Result, ResultIdleRate, "Idle Rate", TypeInteger, RateRange, Settable);
         prepareProperty(Result, ResultNonIdleRate, "Non-Idle Rate", TypeInteger, RateRange, Settable);
         prepareProperty(Result, ResultMeter, "Meter value", TypeString, Empty, Settable); // exception, settable via different topic
         prepareProperty(Result, ResultValues, "Values", TypeString);
+        prepareProperty(Result, ResultHistory, "Consumption History", TypeString, Empty, Settable);
 
-        SafeCString::sprintf(payload, "%s,%s,%s,%s,%s,%s", DeviceFreeHeap, DeviceFreeStack, DeviceFreeQueueSize,
-            DeviceFreeQueueSpaces, DeviceBuild, DeviceMac);
+        SafeCString::sprintf(payload, "%s,%s,%s,%s,%s,%s,%s", DeviceFreeHeap, DeviceFreeStack, DeviceFreeQueueSize,
+            DeviceFreeQueueSpaces, DeviceBuild, DeviceMac, DeviceCpu);
         prepareNode(DeviceLabel, "DeviceLabel", "1", payload);
         prepareProperty(DeviceLabel, DeviceFreeHeap, "Free Heap", TypeInteger);
         prepareProperty(DeviceLabel, DeviceFreeStack, "Free Stack", TypeInteger);
@@ -287,6 +319,7 @@ namespace WaterMeter {
         prepareProperty(DeviceLabel, DeviceFreeQueueSpaces, "Free Queue Spaces", TypeInteger);
         prepareProperty(DeviceLabel, DeviceBuild, "Firmware version", TypeString);
         prepareProperty(DeviceLabel, DeviceMac, "Mac address", TypeString);
+        prepareProperty(DeviceLabel, DeviceCpu, "CPU Load", TypeString);
         prepareProperty(DeviceLabel, DeviceResetSensor, "Reset Sensor", TypeInteger, "1", Settable);
 
         prepareEntity(DeviceLabel, DeviceBuild, _buildVersion);
@@ -347,6 +380,10 @@ namespace WaterMeter {
     }
 
     void MqttGateway::publishToEventServer(const Topic topic, const char* payload) {
+        if (topic == Topic::Trace) {
+            publishTraceCommand(payload);
+            return;
+        }
         if (topic != Topic::SetVolume && topic != Topic::MeterPayload) {
             _eventServer->publish(this, topic, payload);
             return;
@@ -359,6 +396,17 @@ namespace WaterMeter {
         _eventServer->publish(this, topicToSend, _meterPayload);
     }
 
+    // the payload buffer is gone after the callback, so the command crosses to the sampler as a number
+    void MqttGateway::publishTraceCommand(const char* payload) {
+        long command;
+        if (!parseTraceCommand(payload, command)) {
+            SafeCString::sprintf(_topicBuffer, "Ignored unknown trace command '%s'", payload);
+            _eventServer->publish<const char*>(this, Topic::Info, _topicBuffer);
+            return;
+        }
+        _eventServer->publish(this, Topic::Trace, command);
+    }
+
     void MqttGateway::publishToMqtt(const Topic topic, const char* payload) {
         if (topic == Topic::Alert) {
             publishEntity(_clientName, State, "alert");
@@ -378,4 +426,16 @@ namespace WaterMeter {
             }
         }
     }
+
+    void MqttGateway::setServer() {
+        const auto port = static_cast<uint16_t>(_mqttConfig->port);
+        IPAddress brokerIp;
+        _usesCachedBroker = canCacheBroker() && _connectionCache->getBroker(_mqttConfig->broker, brokerIp);
+        if (_usesCachedBroker) {
+            _mqttClient->setServer(brokerIp, port);
+        }
+        else {
+            _mqttClient->setServer(_mqttConfig->broker, port);
+        }
+    }
 }
@@ -22,6 +22,7 @@
 #include <PubSubClient.h>
 
 #include "Configuration.h"
+#include "ConnectionCache.h"
 #include "DataQueue.h"
 #include "WiFiClientFactory.h"
 
@@ -35,13 +36,17 @@ namespace WaterMeter {
     constexpr auto DeviceFreeQueueSize = "free-queue-size";
     constexpr auto DeviceFreeQueueSpaces = "free-queue-spaces";
     constexpr auto DeviceBuild = "firmware-version";
+    constexpr auto DeviceCpu = "cpu";
     constexpr auto DeviceMac = "mac-address";
     constexpr auto DeviceResetSensor = "reset-sensor";
     constexpr auto Measurement = "measurement";
     constexpr auto MeasurementBatchSize = "batch-size";
     constexpr auto MeasurementBatchSizeDesired = "batch-size-desired";
+    constexpr auto MeasurementCapture = "capture";
+    constexpr auto MeasurementTrace = "trace";
     constexpr auto MeasurementValues = "values";
     constexpr auto Result = "result";
+    constexpr auto ResultHistory = "history";
     constexpr auto ResultIdleRate = "idle-rate";
     constexpr auto ResultNonIdleRate = "non-idle-rate";
     constexpr auto ResultRate = "rate";
@@ -57,7 +62,8 @@ namespace WaterMeter {
             WiFiClientFactory* wifiClientFactory,
             const MqttConfig* mqttConfig,
             const DataQueue* dataQueue,
-            const char* buildVersion);
+            const char* buildVersion,
+            ConnectionCache* connectionCache = nullptr);
         MqttGateway(const MqttGateway&) = default;
         MqttGateway(MqttGateway&&) = default;
         MqttGateway& operator=(const MqttGateway&) = default;
@@ -85,6 +91,8 @@ namespace WaterMeter {
         WiFiClient* _wifiClient = nullptr;
         const MqttConfig* _mqttConfig;
         const DataQueue* _dataQueue;
+        ConnectionCache* _connectionCache;
+        bool _usesCachedBroker = false;
         int _announceIndex = 0;
         bool _justStarted = true;
         char _announcementBuffer[AnnouncementBufferSize] = {};
@@ -95,10 +103,14 @@ namespace WaterMeter {
         char _topicBuffer[TopicBufferSize] = {};
         char _meterPayload[PayloadBufferSize] = "";
         bool _meterPayloadReceived = false;
+        unsigned long _previousVolumeWaitStart = 0UL;
+        static constexpr unsigned long PreviousVolumeWaitMicros = 1000000UL;
 
         void callback(const char* topic, const byte* payload, unsigned length);
         static bool isRightTopic(std::pair<const char*, const char*> topicPair, const char* expectedNode, const char* expectedProperty);
+        bool canCacheBroker() const;
         void prepareAnnouncementBuffer();
+        void publishTraceCommand(const char* payload);
         void prepareEntity(const char* entity, const char* payload);
         void prepareEntity(const char* baseTopic, const char* entity, const char* payload);
         void prepareItem(const char* item);
@@ -111,6 +123,7 @@ namespace WaterMeter {
         bool publishProperty(const char* node, const char* property, const char* payload, bool retain = true);
         void publishToEventServer(Topic topic, const char* payload);
         void publishToMqtt(Topic topic, const char* payload);
+        void setServer();
     };
 }
 #endif
\ No newline at end of file
@@ -10,6 +10,7 @@
 // See the License for the specific language governing permissions and limitations under the License.
 
 
+#include <algorithm>
 #include <Wire.h>
 #include "OledDriver.h"
 #include "ConnectionState.h"
@@ -42,12 +43,11 @@ namespace WaterMeter {
     Adafruit_SSD1306* OledDriver::getDriver() { return &_display; }
 
     bool OledDriver::begin() {
-        constexpr int Oled128X32 = 0x3c;
         // SSD1306_SWITCHCAPVCC = generate display voltage from 3.3V internally
         // Do an explicit check whether the oled is there (the driver doesn't do that)
-        _wire->beginTransmission(Oled128X32);
+        _wire->beginTransmission(OledAddress);
         // ReSharper disable once CppRedundantParentheses -- done to show intent
-        if ((_wire->endTransmission() != 0) || !_display.begin(SSD1306_SWITCHCAPVCC, Oled128X32, false, false)) {
+        if ((_wire->endTransmission() != 0) || !_display.begin(SSD1306_SWITCHCAPVCC, OledAddress, false, false)) {
             _eventServer->publish(Topic::NoDisplayFound, true);
             return false;
         }
@@ -58,6 +58,7 @@ namespace WaterMeter {
         showMessageAtLine("Waiting", 3);
         _display.display();
         _needsDisplay = false;
+        for (auto& pageDirty : _pageDirty) pageDirty = false;
         _eventServer->subscribe(this, Topic::Alert);
         _eventServer->subscribe(this, Topic::Blocked);
         _eventServer->subscribe(this, Topic::Connection);
@@ -78,12 +79,12 @@ namespace WaterMeter {
 
     void OledDriver::clearLogo(const int16_t xLocation, const int16_t yLocation) {
         _display.fillRect(xLocation, yLocation, LogoWidth, LogoHeight, BLACK);
-        _needsDisplay = false;
+        markDirty(xLocation, yLocation, LogoWidth, LogoHeight);
     }
 
     unsigned int OledDriver::display() {
         if (_needsDisplay) {
-            _display.display();
+            sendDirtyPages();
             _needsDisplay = false;
             delay(MinDelayForDisplay);
             return MinDelayForDisplay;
@@ -93,9 +94,61 @@ namespace WaterMeter {
 
     void OledDriver::drawBitmap(const unsigned char* logo, const int16_t xLocation, const int16_t yLocation) {
         _display.drawBitmap(xLocation, yLocation, logo, LogoWidth, LogoHeight, WHITE, BLACK);
+        markDirty(xLocation, yLocation, LogoWidth, LogoHeight);
+    }
+
+    void OledDriver::markDirty(const int16_t xLocation, const int16_t yLocation, const int16_t width, const int16_t height) {
+        const int16_t firstColumn = std::max(xLocation, static_cast<int16_t>(0));
+        const int16_t lastColumn = std::min(static_cast<int16_t>(xLocation + width - 1), static_cast<int16_t>(ScreenWidth - 1));
+        if (firstColumn > lastColumn) return;
+        const int16_t firstPage = std::max(static_cast<int16_t>(yLocation / PageHeight), static_cast<int16_t>(0));
+        const int16_t lastPage = std::min(static_cast<int16_t>((yLocation + height - 1) / PageHeight), static_cast<int16_t>(PageCount - 1));
+        for (auto page = firstPage; page <= lastPage; page++) {
+            if (!_pageDirty[page]) {
+                _pageDirty[page] = true;
+                _dirtyFirstColumn[page] = static_cast<uint8_t>(firstColumn);
+                _dirtyLastColumn[page] = static_cast<uint8_t>(lastColumn);
+                continue;
+            }
+            _dirtyFirstColumn[page] = std::min(_dirtyFirstColumn[page], static_cast<uint8_t>(firstColumn));
+            _dirtyLastColumn[page] = std::max(_dirtyLastColumn[page], static_cast<uint8_t>(lastColumn));
+        }
         _needsDisplay = true;
     }
 
+    // Send only the changed part of each page. Uses the horizontal addressing mode that the driver sets up in begin().
+    void OledDriver::sendDirtyPages() {
+#ifdef ESP32
+        const uint8_t* buffer = _display.getBuffer();
+        for (uint8_t page = 0; page < PageCount; page++) {
+            if (!_pageDirty[page]) continue;
+            _display.ssd1306_command(SSD1306_PAGEADDR);
+            _display.ssd1306_command(page);
+            _display.ssd1306_command(page);
+            _display.ssd1306_command(SSD1306_COLUMNADDR);
+            _display.ssd1306_command(_dirtyFirstColumn[page]);
+            _display.ssd1306_command(_dirtyLastColumn[page]);
+            const uint8_t* data = buffer + page * ScreenWidth + _dirtyFirstColumn[page];
+            uint16_t remaining = _dirtyLastColumn[page] - _dirtyFirstColumn[page] + 1;
+            while (remaining > 0) {
+                const uint16_t chunkSize = remaining < MaxDataChunk ? remaining : MaxDataChunk;
+                _wire->beginTransmission(OledAddress);
+                // control byte: data follows
+                _wire->write(static_cast<uint8_t>(0x40));
+                _wire->write(data, chunkSize);
+                _wire->endTransmission();
+                data += chunkSize;
+                remaining -= chunkSize;
+            }
+            _pageDirty[page] = false;
+        }
+#else
+        // the display mock doesn't have a frame buffer
+        _display.display();
+        for (auto& pageDirty : _pageDirty) pageDirty = false;
+#endif
+    }
+
     void OledDriver::setConnectionLogo(const unsigned char* logo) {
         setLogo(logo, ConnectionX, ConnectionY);
     }
@@ -107,7 +160,10 @@ namespace WaterMeter {
     void OledDriver::showMessageAtLine(const char* message, const int16_t line) {
         _display.setCursor(0, static_cast<int16_t>(LineHeight * line));
         _display.print(message);
-        _needsDisplay = true;
+        // long messages wrap to the next lines
+        const auto width = static_cast<int16_t>(strlen(message) * CharacterWidth);
+        const auto lineCount = static_cast<int16_t>((width + ScreenWidth - 1) / ScreenWidth);
+        markDirty(0, static_cast<int16_t>(LineHeight * line), std::min(width, static_cast<int16_t>(ScreenWidth)), static_cast<int16_t>(LineHeight * lineCount));
     }
 
     void OledDriver::switchEventLogo(const unsigned char* logo, const long switchOn) {
@@ -11,6 +11,8 @@
 
 // drives an I2C 128x32 OLED display. Shows icons to indicate status/errors, shows the pulses and volumes, and
 // potentially short error messages.
+// It keeps track of the changed columns in each 8 pixel high page, and on the device only sends those over I2C
+// instead of the whole frame buffer. Logo toggles then take 8 bytes instead of 512.
 
 #ifndef HEADER_OLED_DRIVER
 #define HEADER_OLED_DRIVER
@@ -20,7 +22,7 @@
 #include "EventServer.h"
 
 namespace WaterMeter {
-    class OledDriver final : public EventClient {
+    class OledDriver : public EventClient {
     public:
         explicit OledDriver(EventServer* eventServer, TwoWire* wire = &Wire);
         Adafruit_SSD1306* getDriver();
@@ -29,10 +31,12 @@ namespace WaterMeter {
         void update(Topic topic, const char* payload) override;
         void update(Topic topic, long payload) override;
 
-    private:
+    protected:
         void clearLogo(int16_t xLocation, int16_t yLocation);
         void clearConnectionLogo();
         void drawBitmap(const unsigned char* logo, int16_t xLocation, int16_t yLocation);
+        void markDirty(int16_t xLocation, int16_t yLocation, int16_t width, int16_t height);
+        void sendDirtyPages();
         void setConnectionLogo(const unsigned char* logo);
         void setLogo(const unsigned char* logo, int16_t xLocation, int16_t yLocation);
         void showMessageAtLine(const char* message, int16_t line);
@@ -45,10 +49,19 @@ namespace WaterMeter {
         TwoWire* _wire;
         Adafruit_SSD1306 _display;
         bool _needsDisplay = false;
+        bool _pageDirty[PageCount] = {};
+        uint8_t _dirtyFirstColumn[PageCount] = {};
+        uint8_t _dirtyLastColumn[PageCount] = {};
         static constexpr unsigned int MinDelayForDisplay = 25;
         static constexpr int16_t ScreenWidth = 128;
         static constexpr int16_t ScreenHeight = 32;
         static constexpr int16_t LineHeight = 8;
+        static constexpr int16_t CharacterWidth = 6;
+        static constexpr int16_t PageHeight = 8;
+        static constexpr uint8_t PageCount = ScreenHeight / PageHeight;
+        static constexpr uint8_t OledAddress = 0x3c;
+        // the Wire buffer is 32 bytes, and we need one for the control byte
+        static constexpr uint16_t MaxDataChunk = 31;
         static constexpr int16_t LogoHeight = 7;
         static constexpr int16_t LogoWidth = 8;
         static constexpr int16_t FlowX = 98;
@@ -0,0 +1,87 @@
+// Copyright 2024 Rik Essenius
+// 
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License. You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and limitations under the License.
+
+#include <algorithm>
+#include <cmath>
+
+#include "OutlierFilter.h"
+
+namespace WaterMeter {
+    constexpr unsigned int OutlierFilter::WindowSize;
+    constexpr unsigned int OutlierFilter::MinDriftCount;
+    constexpr double OutlierFilter::MedianFactor;
+
+    void OutlierFilter::addDistance(const double distance) {
+        _distances[_distanceIndex] = distance;
+        _distanceIndex = (_distanceIndex + 1) % WindowSize;
+        if (_distanceCount < WindowSize) _distanceCount++;
+
+        // the window is small, so a partial sort of a copy is cheap enough to do for every accepted point
+        double sorted[WindowSize];
+        std::copy(_distances, _distances + _distanceCount, sorted);
+        const auto middle = sorted + _distanceCount / 2;
+        std::nth_element(sorted, middle, sorted + _distanceCount);
+        _median = *middle;
+        resetStreak();
+    }
+
+    void OutlierFilter::addOutlier(const Coordinate& point) {
+        // only the latest outliers count, so the transition to the new position doesn't delay detecting a drift
+        _streak[_streakIndex] = point;
+        _streakIndex = (_streakIndex + 1) % MinDriftCount;
+        if (_streakCount < MinDriftCount) _streakCount++;
+    }
+
+    void OutlierFilter::begin(const double minimumThreshold) {
+        _minimumThreshold = minimumThreshold;
+        _distanceIndex = 0;
+        _distanceCount = 0;
+        _median = 0;
+        resetStreak();
+    }
+
+    Coordinate OutlierFilter::driftShift(const Coordinate& lastAccepted) const {
+        if (_streakCount == 0) return { 0, 0 };
+        const auto mean = streakMean();
+        return { mean.x - lastAccepted.x, mean.y - lastAccepted.y };
+    }
+
+    // A drift is a streak of outliers that stay together: their spread (RMS distance to their mean) is within
+    // the noise distance. Scattered outliers and a moving signal have a much larger spread.
+    bool OutlierFilter::isDrift() const {
+        if (_streakCount < MinDriftCount) return false;
+        const auto mean = streakMean();
+        double sumOfSquares = 0;
+        for (const auto& point : _streak) {
+            sumOfSquares += (point.x - mean.x) * (point.x - mean.x) + (point.y - mean.y) * (point.y - mean.y);
+        }
+        // the minimum threshold is twice the noise distance
+        return sqrt(sumOfSquares / MinDriftCount) <= _minimumThreshold / 2;
+    }
+
+    void OutlierFilter::resetStreak() {
+        _streakIndex = 0;
+        _streakCount = 0;
+    }
+
+    Coordinate OutlierFilter::streakMean() const {
+        Coordinate sum = { 0, 0 };
+        for (unsigned int i = 0; i < _streakCount; i++) {
+            sum.x += _streak[i].x;
+            sum.y += _streak[i].y;
+        }
+        return { sum.x / _streakCount, sum.y / _streakCount };
+    }
+
+    double OutlierFilter::threshold() const {
+        return std::max(_minimumThreshold, _median * MedianFactor);
+    }
+}
@@ -0,0 +1,54 @@
+// Copyright 2024 Rik Essenius
+// 
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License. You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and limitations under the License.
+
+// Robust outlier stage for the FlowDetector. It keeps the distances from the ellipse of the latest accepted points
+// in a small window, and uses their median to scale the outlier threshold: a noisier signal gets more room, but the
+// threshold never drops below the fixed minimum (twice the noise distance).
+// It also tells drift apart from genuine outliers. Genuine outliers are scattered, while after a drift (e.g. the
+// sensor moved a bit) consecutive outliers sit close together. Once the latest MinDriftCount outliers do, the filter
+// reports the shift between the last accepted point and those outliers, so the detector can move the center instead
+// of re-learning the ellipse.
+
+#ifndef HEADER_OUTLIER_FILTER
+#define HEADER_OUTLIER_FILTER
+
+#include <Coordinate.h>
+
+namespace WaterMeter {
+    using EllipseMath::Coordinate;
+
+    class OutlierFilter {
+    public:
+        void addDistance(double distance);
+        void addOutlier(const Coordinate& point);
+        void begin(double minimumThreshold);
+        Coordinate driftShift(const Coordinate& lastAccepted) const;
+        bool isDrift() const;
+        double median() const { return _median; }
+        void resetStreak();
+        double threshold() const;
+
+        static constexpr unsigned int WindowSize = 16;
+        static constexpr unsigned int MinDriftCount = 10;
+        static constexpr double MedianFactor = 4.0;
+    private:
+        double _distances[WindowSize] = {};
+        unsigned int _distanceIndex = 0;
+        unsigned int _distanceCount = 0;
+        double _median = 0;
+        double _minimumThreshold = 0;
+        Coordinate streakMean() const;
+        Coordinate _streak[MinDriftCount] = {};
+        unsigned int _streakIndex = 0;
+        unsigned int _streakCount = 0;
+    };
+}
+#endif
@@ -24,9 +24,10 @@ namespace WaterMeter {
         return xQueueCreate(length, sizeof(ShortMessage));
     }
 
-    QueueClient::QueueClient(EventServer* eventServer, Log* logger, const uint16_t size, const int8_t index) :
+    QueueClient::QueueClient(EventServer* eventServer, Log* logger, const uint16_t size, const int8_t index, MessageArena* arena) :
         EventClient(eventServer),
         _logger(logger),
+        _arena(arena),
         _freeSpaces(eventServer, Topic::FreeQueueSpaces, 5, 0, index, size),
         // being careful with reporting on spaces as it may use them as well, so just every 5
         _receiveQueue(createQueue(size)),
@@ -37,10 +38,23 @@ namespace WaterMeter {
         _sendQueue = sendQueue;
     }
 
+    void QueueClient::flush() {
+        if (_policyCount == 0) return;
+        const auto now = millis();
+        for (uint8_t i = 0; i < _policyCount; i++) {
+            flush(&_policies[i], now);
+        }
+    }
+
     QueueHandle_t QueueClient::getQueueHandle() const {
         return _receiveQueue;
     }
 
+    // ReSharper disable once CppParameterMayBeConst -- introduces misplaced const
+    void QueueClient::notifyOnSend(TaskHandle_t task) {
+        _notifyTask = task;
+    }
+
     bool QueueClient::receive() {
         if (_receiveQueue == nullptr || uxQueueMessagesWaiting(_receiveQueue) == 0) return false;
         ShortMessage message{};
@@ -48,10 +62,10 @@ namespace WaterMeter {
         // the leftmost bit was set if the payload is a string. Then the payload is the start of the string.
         // A bit crude as it expects that addresses are 32 bits which is true on ESP32 but not on Win64.
         if (message.topic < 0) {
-            _eventServer->publish(
-                this,
-                static_cast<Topic>(message.topic & 0x7fff),
-                reinterpret_cast<const char*>(message.payload));
+            const auto payload = reinterpret_cast<const char*>(message.payload);
+            _eventServer->publish(this, static_cast<Topic>(message.topic & 0x7fff), payload);
+            // all subscribers are done now. Queue clients that forwarded it took their own reference.
+            if (_arena != nullptr) _arena->release(payload);
         }
         else {
             _eventServer->publish(this, static_cast<Topic>(message.topic), static_cast<long>(message.payload));
@@ -61,24 +75,73 @@ namespace WaterMeter {
         return true;
     }
 
+    void QueueClient::setForwardPolicy(const Topic topic, const ForwardPolicy policy, const uint16_t intervalMillis) {
+        auto entry = findPolicy(topic);
+        if (entry == nullptr) {
+            if (policy == ForwardPolicy::All) return;
+            // if we run out of slots, the topic is forwarded as is. That is less efficient, but still correct.
+            if (_policyCount == MaxPolicies) return;
+            entry = &_policies[_policyCount++];
+        }
+        // make the first event go out right away
+        *entry = { topic, policy, intervalMillis, millis() - intervalMillis, 0, false };
+    }
+
     void QueueClient::update(const Topic topic, const char* payload) {
         // if we can convert the input to a long, do that. Otherwise, keep it a string
         char* endPointer;
         const auto longValue = strtol(payload, &endPointer, 0);
         // if end pointer is not at the end, it's not a long value
         if (*endPointer != '\0') {
-            send(topic, reinterpret_cast<intptr_t>(payload), true);
+            sendString(topic, payload);
             return;
         }
-        send(topic, longValue, false);
+        update(topic, longValue);
     }
 
     void QueueClient::update(const Topic topic, const long payload) {
-        send(topic, payload, false);
+        const auto entry = findPolicy(topic);
+        if (entry == nullptr || entry->policy == ForwardPolicy::All) {
+            send(topic, payload, false);
+            return;
+        }
+        const auto now = millis();
+        switch (entry->policy) {
+        case ForwardPolicy::Latest:
+            entry->value = payload;
+            break;
+        case ForwardPolicy::Count:
+            entry->value++;
+            break;
+        default:
+            // MinInterval: anything within the interval is dropped
+            if (now - entry->lastSentMillis < entry->intervalMillis) return;
+            entry->value = payload;
+            break;
+        }
+        entry->pending = true;
+        flush(entry, now);
     }
 
-    void QueueClient::send(const Topic topic, const intptr_t payload, const bool isString) {
-        if (_sendQueue == nullptr) return;
+    // private methods
+
+    QueueClient::TopicPolicy* QueueClient::findPolicy(const Topic topic) {
+        for (uint8_t i = 0; i < _policyCount; i++) {
+            if (_policies[i].topic == topic) return &_policies[i];
+        }
+        return nullptr;
+    }
+
+    void QueueClient::flush(TopicPolicy* entry, const unsigned long now) {
+        if (!entry->pending || now - entry->lastSentMillis < entry->intervalMillis) return;
+        send(entry->topic, entry->value, false);
+        entry->lastSentMillis = now;
+        entry->pending = false;
+        if (entry->policy == ForwardPolicy::Count) entry->value = 0;
+    }
+
+    bool QueueClient::send(const Topic topic, const intptr_t payload, const bool isString) {
+        if (_sendQueue == nullptr) return false;
         auto topic1 = static_cast<int16_t>(topic);
         // trick to be able to handle strings on receive: force it to be negative by setting the leftmost bit.
         if (isString) topic1 |= static_cast<int16_t>(0x8000);
@@ -86,7 +149,28 @@ namespace WaterMeter {
         if (xQueueSendToBack(_sendQueue, &message, 0) == pdFALSE) {
             // Catch 22 - we may need a queue to send an error, and that fails. So we're using a direct log.
             // That uses the default format which gives more details 
-            _logger->log("[E] Instance %p (%d): error sending %d/%lld\n", this, _index, topic, payload);
+            _logger->log<LogLevel::Error>("[E] Instance %p (%d): error sending %d/%lld\n", this, _index, topic, payload);
+            return false;
+        }
+        if (_notifyTask != nullptr) xTaskNotifyGive(_notifyTask);
+        return true;
+    }
+
+    void QueueClient::sendString(const Topic topic, const char* payload) {
+        if (_arena == nullptr) {
+            send(topic, reinterpret_cast<intptr_t>(payload), true);
+            return;
+        }
+        if (_sendQueue == nullptr) return;
+        // a string we received from another task is already in the arena, so we don't need to copy it again.
+        // If it doesn't fit in the arena, we drop it: the sender's buffer is not guaranteed to outlive the receiver.
+        const char* message = _arena->addReference(payload) ? payload : _arena->allocate(payload);
+        if (message == nullptr) {
+            _logger->log<LogLevel::Error>("[E] Instance %p (%d): no arena slot for %d, message dropped\n", this, _index, topic);
+            return;
+        }
+        if (!send(topic, reinterpret_cast<intptr_t>(message), true)) {
+            _arena->release(message);
         }
     }
-}
\ No newline at end of file
+}
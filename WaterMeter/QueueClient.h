@@ -11,6 +11,13 @@
 
 // we use queues to send events between the different processes. Queues handle inter-process communication effectively
 // Every queue client has its own queue that it receives from, and it can also send to another queue (which it doesn't own).
+// By default, every event on a subscribed topic is forwarded. For chatty topics, a forwarding policy can be set: Latest only forwards the latest value once per interval, Count forwards the number
+// of events once per interval, and MinInterval drops events that come within the interval after the last one sent.
+// Latest and Count keep what they didn't send yet until the next event or flush() after the interval.
+// String payloads are passed as pointers. With a message arena, they are copied into an arena slot that stays valid until
+// the receiver has published it, so the sender can reuse its buffer right away. Strings that don't fit, or that find the
+// arena full, are dropped and logged. Without an arena, the sender's buffer must stay intact until the receiver is done with it.
+// If a task to notify is set, every successful send wakes it up, so the receiving task can block instead of polling.
 
 #ifndef HEADER_QUEUE_CLIENT
 #define HEADER_QUEUE_CLIENT
@@ -18,23 +25,47 @@
 #include "EventClient.h"
 #include "Log.h" // exception: log from here only if buffer is full
 #include "LongChangePublisher.h"
+#include "MessageArena.h"
 
 namespace WaterMeter {
+    enum class ForwardPolicy : uint8_t { All = 0, Latest, Count, MinInterval };
+
     class QueueClient final : public EventClient {
     public:
-        QueueClient(EventServer* eventServer, Log* logger, uint16_t size, int8_t index = 0);
+        QueueClient(EventServer* eventServer, Log* logger, uint16_t size, int8_t index = 0, MessageArena* arena = nullptr);
         void begin(QueueHandle_t sendQueue = nullptr);
+        void flush();
         QueueHandle_t getQueueHandle() const;
+        void notifyOnSend(TaskHandle_t task);
         bool receive();
+        void setForwardPolicy(Topic topic, ForwardPolicy policy, uint16_t intervalMillis);
         void update(Topic topic, const char* payload) override;
         void update(Topic topic, long payload) override;
+
+        static constexpr uint8_t MaxPolicies = 8;
     private:
-        void send(Topic topic, intptr_t payload, bool isString = false);
+        struct TopicPolicy {
+            Topic topic;
+            ForwardPolicy policy;
+            uint16_t intervalMillis;
+            unsigned long lastSentMillis;
+            long value;
+            bool pending;
+        };
+
+        TopicPolicy* findPolicy(Topic topic);
+        void flush(TopicPolicy* entry, unsigned long now);
+        bool send(Topic topic, intptr_t payload, bool isString = false);
+        void sendString(Topic topic, const char* payload);
         static QueueHandle_t createQueue(uint16_t length);
+        TopicPolicy _policies[MaxPolicies] = {};
+        uint8_t _policyCount = 0;
         Log* _logger;
+        MessageArena* _arena;
         LongChangePublisher _freeSpaces;
         QueueHandle_t _receiveQueue;
         QueueHandle_t _sendQueue = nullptr;
+        TaskHandle_t _notifyTask = nullptr;
         int8_t _index;
     };
 }
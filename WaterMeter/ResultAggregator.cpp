@@ -78,7 +78,10 @@ namespace WaterMeter {
     void ResultAggregator::flush() {
         Aggregator::flush();
         _payload->topic = Topic::Result;
-        _result->maxStreak = 0;
+        // the last sample carries over to the next batch
+        const SensorSample lastSample = _result->lastSample;
+        *_result = ResultData{};
+        _result->lastSample = lastSample;
         _streak = 0;
     }
 
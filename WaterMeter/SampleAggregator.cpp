@@ -18,9 +18,9 @@ namespace WaterMeter {
     }
 
     void SampleAggregator::addSample(const SensorSample& sample) {
-        // Only record measurements if we need to
-        if (newMessage() && canSend()) {
-
+        // Only record measurements if we need to. Room in the queue is reserved with the first sample of a batch,
+        // so the other samples don't need to query the queue.
+        if (newMessage() && reserve()) {
             _payload->buffer.samples.value[_payload->buffer.samples.count++] = sample;
         }
         else {
@@ -27,9 +27,10 @@ namespace WaterMeter {
         void update(Topic topic, const char* payload) override;
         void update(Topic topic, long payload) override;
         void update(Topic topic, SensorSample payload) override;
-    protected:
+
         static constexpr unsigned char DefaultFlushRate = 25;
         static constexpr unsigned char MaxFlushRate = 25;
+    protected:
         uint16_t _currentSample = 0;
     };
 }
@@ -17,17 +17,19 @@ namespace WaterMeter {
 
     TaskHandle_t Sampler::_taskHandle = nullptr;
     volatile unsigned long Sampler::_interruptCounter = 0;
+    volatile unsigned long Sampler::_interruptTimestamp = 0;
 
     Sampler::Sampler(EventServer* eventServer, MagnetoSensorReader* sensorReader, FlowDetector* flowDetector, Button* button,
-        SampleAggregator* sampleAggregator, ResultAggregator* resultAggregator, QueueClient* queueClient) :
+        SampleAggregator* sampleAggregator, ResultAggregator* resultAggregator, EventBus* eventBus, TaskProfiler* profiler) :
         _eventServer(eventServer), _sensorReader(sensorReader), _flowDetector(flowDetector), _button(button),
-        _sampleAggregator(sampleAggregator), _resultAggregator(resultAggregator), _queueClient(queueClient) {
+        _sampleAggregator(sampleAggregator), _resultAggregator(resultAggregator), _eventBus(eventBus), _profiler(profiler) {
         _sampleQueue = xQueueCreate(SampleQueueSize, sizeof(SensorSample));
         _overrunQueue = xQueueCreate(OverrunQueueSize, sizeof(long));
     }
 
     void ARDUINO_ISR_ATTR Sampler::onTimer() {
         _interruptCounter++;
+        _interruptTimestamp = micros();
         vTaskNotifyGiveFromISR(_taskHandle, nullptr);
     }
 
@@ -36,28 +38,11 @@ namespace WaterMeter {
         _samplePeriod = samplePeriod;
         _ticksPerSample = samplePeriod / 1000UL;
         _button->begin();
-        // what can be sent to the communicator (note: must be numerical payloads)
-        _eventServer->subscribe(_queueClient, Topic::BatchSize);
-        _eventServer->subscribe(_queueClient, Topic::Blocked);
-        _eventServer->subscribe(_queueClient, Topic::Anomaly);
-        _eventServer->subscribe(_queueClient, Topic::Drifted);
-        _eventServer->subscribe(_queueClient, Topic::FreeQueueSize);
-        _eventServer->subscribe(_queueClient, Topic::FreeQueueSpaces);
-        _eventServer->subscribe(_queueClient, Topic::NoFit);
-        _eventServer->subscribe(_queueClient, Topic::Pulse);
-        _eventServer->subscribe(_queueClient, Topic::ResultWritten);
-        _eventServer->subscribe(_queueClient, Topic::Sample);
-        _eventServer->subscribe(_queueClient, Topic::SensorWasReset);
-        _eventServer->subscribe(_queueClient, Topic::SkipSamples);
-        _eventServer->subscribe(_queueClient, Topic::TimeOverrun);
-        // SensorReader.begin can publish these     
-        _eventServer->subscribe(_queueClient, Topic::Alert);
-        _eventServer->subscribe(_queueClient, Topic::SensorState);
-
         if (!_sensorReader->begin(sensor, listSize)) {
             return false;
         }
 
+        // adaptive outlier mode only once the regression baseline has been recorded for it
         _flowDetector->begin(_sensorReader->getNoiseRange());
 
         return true;
@@ -97,6 +82,7 @@ namespace WaterMeter {
         if (ulTaskNotifyTake(pdTRUE, _ticksPerSample) > 0) {
             _notifyCounter++;
             const auto lastReadTime = micros();
+            if (_profiler != nullptr) _profiler->recordWake(lastReadTime - _interruptTimestamp);
             const SensorSample sample = _sensorReader->read();
             if (uxQueueSpacesAvailable(_sampleQueue) == 0) {
                 _queueFullCounter++;
@@ -159,7 +145,8 @@ namespace WaterMeter {
         while (xQueueReceive(_sampleQueue, &sample, _ticksPerSample) == pdTRUE) {
             _sampleCount++;
             handleSample(sample, startTime);
-            _queueClient->receive();
+            _eventBus->receive(TaskId::Sampler);
+            _eventBus->flush(TaskId::Sampler);
             _button->check();
         }
     }
@@ -16,18 +16,20 @@
 #define HEADER_SAMPLER
 
 #include "Button.h"
+#include "EventBus.h"
 #include "EventClient.h"
 #include "FlowDetector.h"
 #include "MagnetoSensorReader.h"
-#include "QueueClient.h"
 #include "ResultAggregator.h"
 #include "SampleAggregator.h"
+#include "TaskProfiler.h"
 
 namespace WaterMeter {
     class Sampler {
     public:
         Sampler(EventServer* eventServer, MagnetoSensorReader* sensorReader, FlowDetector* flowDetector, Button* button,
-            SampleAggregator* sampleAggregator, ResultAggregator* resultAggregator, QueueClient* queueClient);
+            SampleAggregator* sampleAggregator, ResultAggregator* resultAggregator, EventBus* eventBus,
+            TaskProfiler* profiler = nullptr);
         bool begin(MagnetoSensor* sensor[], size_t listSize = 3, unsigned long samplePeriod = 10000UL);
         void beginLoop(TaskHandle_t taskHandle);
         void checkForOverrun(unsigned long lastReadTime);
@@ -50,7 +52,8 @@ namespace WaterMeter {
         Button* _button;
         SampleAggregator* _sampleAggregator;
         ResultAggregator* _resultAggregator;
-        QueueClient* _queueClient;
+        EventBus* _eventBus;
+        TaskProfiler* _profiler;
         unsigned long _additionalDuration = 0;
         unsigned long _samplePeriod = 10000;
         unsigned long _ticksPerSample = 10;
@@ -62,6 +65,7 @@ namespace WaterMeter {
         QueueHandle_t _overrunQueue = nullptr;
         static TaskHandle_t _taskHandle;
         static volatile unsigned long _interruptCounter;
+        static volatile unsigned long _interruptTimestamp;
         volatile unsigned long _notifyCounter = 0;
         volatile unsigned long _queueFullCounter = 0;
         unsigned long _sampleCount = 0;
@@ -9,6 +9,8 @@
 // is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
 // See the License for the specific language governing permissions and limitations under the License.
 
+#include <SafeCString.h>
+
 #include "Serializer.h"
 
 namespace WaterMeter {
@@ -24,9 +26,15 @@ namespace WaterMeter {
             newTopic = Topic::ResultFormatted;
             break;
         case Topic::Samples:
+            // samples being captured go out raw via the capture streamer only
+            if (_eventServer->request(Topic::Capture, 0L) != 0) return;
             convertMeasurements(sensorPayload);
             newTopic = Topic::SamplesFormatted;
             break;
+        case Topic::Trace:
+            convertTrace(sensorPayload);
+            newTopic = Topic::TraceFormatted;
+            break;
         case Topic::ConnectionError:
             convertString(sensorPayload);
             newTopic = Topic::ErrorFormatted;
@@ -93,4 +101,20 @@ namespace WaterMeter {
         }
         _payloadBuilder->writeText(data->buffer.message);
     }
+
+    void Serializer::convertTrace(const DataQueuePayload* payload) const {
+        // each record becomes 16 hex digits: sample index (8), decision (2), flags (2), value (4)
+        char records[MaxTraceRecords * 16 + 1] = {};
+        const auto trace = payload->buffer.trace;
+        for (uint16_t i = 0; i < trace.count; i++) {
+            const auto& record = trace.record[i];
+            SafeCString::pointerSprintf(records + i * 16, records, "%08lx%02x%02x%04x",
+                static_cast<unsigned long>(record.sampleIndex), static_cast<unsigned>(record.decision),
+                static_cast<unsigned>(record.flags), static_cast<unsigned>(record.value));
+        }
+        _payloadBuilder->initialize();
+        _payloadBuilder->writeTimestampParam("timestamp", payload->timestamp);
+        _payloadBuilder->writeParam("trace", records);
+        _payloadBuilder->writeGroupEnd();
+    }
 }
\ No newline at end of file
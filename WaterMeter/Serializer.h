@@ -27,6 +27,7 @@ namespace WaterMeter {
         void convertMeasurements(const DataQueuePayload* payload) const;
         void convertResult(const DataQueuePayload* payload) const;
         void convertString(const DataQueuePayload* data) const;
+        void convertTrace(const DataQueuePayload* payload) const;
         PayloadBuilder* _payloadBuilder;
     };
 }
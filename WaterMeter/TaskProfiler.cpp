@@ -0,0 +1,104 @@
+// Copyright 2024 Rik Essenius
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License. You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and limitations under the License.
+
+#include <cstring>
+
+#include "TaskProfiler.h"
+#include "EventServer.h"
+
+namespace WaterMeter {
+    constexpr unsigned long TaskProfiler::ReportIntervalMicros;
+
+    // loopTask runs the sampler's processing loop. The idle tasks show how much room is left on each core.
+    const TaskProfiler::TrackedTask TaskProfiler::TrackedTasks[TrackedTaskCount] = {
+        {"Sampler", "sampler"},
+        {"loopTask", "loop"},
+        {"Communicator", "communicator"},
+        {"Connector", "connector"},
+        {"Log", "log"},
+        {"IDLE0", "idle0"},
+        {"IDLE1", "idle1"}
+    };
+
+    size_t FreeRtosRunTimeSource::read(TaskRunTime* tasks, const size_t maxTasks, uint32_t& totalRunTime) {
+#ifdef ESP32
+        // this needs room for all tasks, or it returns nothing
+        const auto count = uxTaskGetSystemState(_status, MaxSystemTasks, &totalRunTime);
+        size_t used = 0;
+        for (UBaseType_t i = 0; i < count && used < maxTasks; i++) {
+            tasks[used].name = _status[i].pcTaskName;
+            tasks[used].runTime = _status[i].ulRunTimeCounter;
+            used++;
+        }
+        return used;
+#else
+        (void)tasks;
+        (void)maxTasks;
+        totalRunTime = 0;
+        return 0;
+#endif
+    }
+
+    TaskProfiler::TaskProfiler(EventServer* eventServer, RunTimeSource* source, PayloadBuilder* payloadBuilder) :
+        EventClient(eventServer), _source(source), _payloadBuilder(payloadBuilder), _wakeCount(0), _latencySum(0), _maxLatency(0) {}
+
+    // Only the sampler task writes, so the sums need no more than atomic stores. The reporter resets the maximum,
+    // so that needs a compare and swap.
+    void TaskProfiler::recordWake(const unsigned long latencyMicros) {
+        const auto latency = static_cast<uint32_t>(latencyMicros);
+        _wakeCount.store(_wakeCount.load() + 1);
+        _latencySum.store(_latencySum.load() + latency);
+        auto maxLatency = _maxLatency.load();
+        while (latency > maxLatency && !_maxLatency.compare_exchange_weak(maxLatency, latency)) {}
+    }
+
+    // returns the time until the next report is due
+    unsigned long TaskProfiler::report() {
+        const auto now = micros();
+        if (_isStarted && now - _reportTimestamp < ReportIntervalMicros) return ReportIntervalMicros - (now - _reportTimestamp);
+
+        uint32_t totalRunTime = 0;
+        const size_t taskCount = _source->read(_tasks, MaxTasks, totalRunTime);
+        const uint32_t elapsed = totalRunTime - _previousTotalRunTime;
+        const uint32_t wakeCount = _wakeCount.load();
+        const uint32_t latencySum = _latencySum.load();
+        const uint32_t maxLatency = _maxLatency.exchange(0);
+        const uint32_t wakes = wakeCount - _previousWakeCount;
+
+        // the first round only sets the baseline
+        const bool canReport = _isStarted && elapsed > 0;
+        if (canReport) _payloadBuilder->initialize();
+        for (size_t tracked = 0; tracked < TrackedTaskCount; tracked++) {
+            for (size_t i = 0; i < taskCount; i++) {
+                if (strcmp(_tasks[i].name, TrackedTasks[tracked].name) != 0) continue;
+                if (canReport) {
+                    const double share = 100.0 * (_tasks[i].runTime - _previousRunTime[tracked]) / elapsed;
+                    _payloadBuilder->writeParam(TrackedTasks[tracked].label, share);
+                }
+                _previousRunTime[tracked] = _tasks[i].runTime;
+                break;
+            }
+        }
+        if (canReport) {
+            _payloadBuilder->writeParam("sampler-wakes", wakes);
+            _payloadBuilder->writeParam("latency-us", static_cast<uint32_t>(wakes == 0 ? 0 : (latencySum - _previousLatencySum) / wakes));
+            _payloadBuilder->writeParam("max-latency-us", maxLatency);
+            _payloadBuilder->writeGroupEnd();
+            _eventServer->publish(this, Topic::CpuFormatted, _payloadBuilder->toString());
+        }
+        _previousTotalRunTime = totalRunTime;
+        _previousWakeCount = wakeCount;
+        _previousLatencySum = latencySum;
+        _reportTimestamp = now;
+        _isStarted = true;
+        return ReportIntervalMicros;
+    }
+}
@@ -0,0 +1,83 @@
+// Copyright 2024 Rik Essenius
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License. You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and limitations under the License.
+
+// Reports how busy the tasks are, based on the FreeRTOS run-time stats: the share of a core each task got since the
+// previous report, and the idle share per core, which is the headroom left. For the sampler it also measures the time
+// from the timer notification to the task running, since the sample timing depends on that.
+// FreeRTOS doesn't count context switches per task, so we count the sampler's wake-ups instead.
+// The stats come via RunTimeSource, so the profiler can be tested on the host with a stand-in.
+
+#ifndef HEADER_TASK_PROFILER
+#define HEADER_TASK_PROFILER
+
+#include <atomic>
+#include <ESP.h>
+
+#include "EventClient.h"
+#include "PayloadBuilder.h"
+
+namespace WaterMeter {
+    struct TaskRunTime {
+        const char* name;
+        uint32_t runTime;
+    };
+
+    class RunTimeSource {
+    public:
+        virtual ~RunTimeSource() = default;
+        // fills tasks with at most maxTasks entries, and returns the number of entries. totalRunTime gets the elapsed time.
+        virtual size_t read(TaskRunTime* tasks, size_t maxTasks, uint32_t& totalRunTime) = 0;
+    };
+
+    class FreeRtosRunTimeSource final : public RunTimeSource {
+    public:
+        size_t read(TaskRunTime* tasks, size_t maxTasks, uint32_t& totalRunTime) override;
+#ifdef ESP32
+    private:
+        static constexpr size_t MaxSystemTasks = 24;
+        TaskStatus_t _status[MaxSystemTasks] = {};
+#endif
+    };
+
+    class TaskProfiler final : public EventClient {
+    public:
+        TaskProfiler(EventServer* eventServer, RunTimeSource* source, PayloadBuilder* payloadBuilder);
+        // called by the sampler task each time the timer woke it up
+        void recordWake(unsigned long latencyMicros);
+        unsigned long report();
+
+        static constexpr unsigned long ReportIntervalMicros = 10UL * 1000UL * 1000UL;
+
+    private:
+        struct TrackedTask {
+            const char* name;
+            const char* label;
+        };
+
+        static constexpr size_t TrackedTaskCount = 7;
+        static constexpr size_t MaxTasks = 24;
+        static const TrackedTask TrackedTasks[TrackedTaskCount];
+
+        RunTimeSource* _source;
+        PayloadBuilder* _payloadBuilder;
+        TaskRunTime _tasks[MaxTasks] = {};
+        uint32_t _previousRunTime[TrackedTaskCount] = {};
+        uint32_t _previousTotalRunTime = 0;
+        uint32_t _previousWakeCount = 0;
+        uint32_t _previousLatencySum = 0;
+        unsigned long _reportTimestamp = 0;
+        bool _isStarted = false;
+        std::atomic<uint32_t> _wakeCount;
+        std::atomic<uint32_t> _latencySum;
+        std::atomic<uint32_t> _maxLatency;
+    };
+}
+#endif
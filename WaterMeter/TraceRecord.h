@@ -0,0 +1,73 @@
+// Copyright 2024 Rik Essenius
+// 
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License. You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and limitations under the License.
+
+// One FlowDetector decision, packed into 8 bytes so a useful history fits in a small ring (see FlowTrace).
+// The value depends on the decision: a distance times 100 for TooClose, Outlier and Accepted, the sensor state
+// for Anomaly, the number of consecutive outliers for Drift, and the covered angle in degrees for the fit outcomes.
+
+#ifndef HEADER_TRACE_RECORD
+#define HEADER_TRACE_RECORD
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+namespace WaterMeter {
+    enum class TraceDecision : uint8_t {
+        None = 0,
+        Anomaly,
+        Startup,
+        TooClose,
+        Outlier,
+        Drift,
+        Accepted,
+        FitAccepted,
+        FitRejected,
+        FitSkipped,
+        Reset
+    };
+
+    struct TraceRecord {
+        static constexpr uint8_t QuadrantMask = 0x07;
+        static constexpr uint8_t PulseFlag = 0x10;
+        static constexpr uint8_t SearchingFlag = 0x20;
+        static constexpr uint8_t FitFlag = 0x40;
+
+        uint32_t sampleIndex;
+        TraceDecision decision;
+        uint8_t flags;
+        uint16_t value;
+
+        unsigned int quadrant() const { return flags & QuadrantMask; }
+        bool foundPulse() const { return (flags & PulseFlag) != 0; }
+        bool isSearching() const { return (flags & SearchingFlag) != 0; }
+        bool hasFit() const { return (flags & FitFlag) != 0; }
+    };
+
+    static_assert(sizeof(TraceRecord) == 8, "Trace records must be 8 bytes");
+
+    // The trace property is translated to a number before it crosses to the sampler task, so no string pointer does.
+    enum TraceCommand : long { TraceOff = 0, TraceOn = 1, TraceDump = 2 };
+
+    // accepts "on", "off", "dump" and their numbers. Returns false for anything else.
+    inline bool parseTraceCommand(const char* payload, long& command) {
+        if (strcmp(payload, "off") == 0) command = TraceOff;
+        else if (strcmp(payload, "on") == 0) command = TraceOn;
+        else if (strcmp(payload, "dump") == 0) command = TraceDump;
+        else {
+            char* endPointer;
+            command = strtol(payload, &endPointer, 10);
+            if (*payload == '\0' || *endPointer != '\0') return false;
+        }
+        return command >= TraceOff && command <= TraceDump;
+    }
+}
+#endif
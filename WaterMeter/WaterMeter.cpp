@@ -23,13 +23,20 @@
 #include <Wire.h>
 
 #include "Button.h"
+#include "CaptureStreamer.h"
 #include "Configuration.h"
 #include "Communicator.h"
+#include "ConnectionCache.h"
 #include "Connector.h"
+#include "ConsumptionHistory.h"
 #include "Device.h"
+#include "EventBus.h"
 #include "EventServer.h"
+#include "FirmwareDelta.h"
+#include "FirmwareDownloader.h"
 #include "FirmwareManager.h"
 #include "FlowDetector.h"
+#include "FlowTrace.h"
 #include "LedDriver.h"
 #include "Log.h"
 #include "MagnetoSensorReader.h"
@@ -39,9 +46,10 @@
 #include "ResultAggregator.h"
 #include "SampleAggregator.h"
 #include "Sampler.h"
+#include "TaskProfiler.h"
 #include "TimeServer.h"
 #include "WiFiManager.h"
-#include "QueueClient.h"
+#include "MessageArena.h"
 #include "WiFiClientFactory.h"
 
 
@@ -67,6 +75,15 @@ namespace WaterMeter {
     // Note: port 34 requires a pull-up resistor, see e.g. https://randomnerdtutorials.com/esp32-pinout-reference-gpios/
     constexpr int ButtonPort = 34; 
 
+    // Request the time and connect to MQTT at the same time, rather than one after the other.
+    constexpr bool ParallelBringUp = true;
+
+    // The sensor queue has its own lane for results, so an outage fills up with samples without crowding out the results.
+    // A result takes about 72 bytes, so that lane holds about two hours of idle results.
+    // Nothing sends messages to the sensor queue, so it has no message lane.
+    constexpr long SensorQueueSize = 35840;
+    constexpr long ResultLaneSize = 8192;
+
     // This is where you would normally use an injector framework,
     // We define the objects globally to avoid using (and fragmenting) the heap.
     // we do use dependency injection to hide this design decision as much as possible
@@ -83,7 +100,6 @@ namespace WaterMeter {
     EventServer samplerEventServer;
     MagnetoSensorReader sensorReader(&samplerEventServer);
     EllipseFit ellipseFit;
-    FlowDetector flowDetector(&samplerEventServer, &ellipseFit);
 
     EventServer communicatorEventServer;
     EventServer connectorEventServer;
@@ -92,34 +108,45 @@ namespace WaterMeter {
     PayloadBuilder serializePayloadBuilder(&theClock);
     Serializer serializer(&connectorEventServer, &serializePayloadBuilder);
     DataQueuePayload connectorPayload;
-    DataQueue sensorDataQueue(&connectorEventServer, &connectorPayload);
+    DataQueue sensorDataQueue(&connectorEventServer, &connectorPayload, 0, SensorQueueSize, 1024, 2048, ResultLaneSize);
+    DataQueuePayload tracePayload;
+    FlowTrace flowTrace(&samplerEventServer, &sensorDataQueue, &tracePayload);
+    FlowDetector flowDetector(&samplerEventServer, &ellipseFit, &flowTrace);
     DataQueuePayload measurementPayload;
     DataQueuePayload resultPayload;
     SampleAggregator sampleAggregator(&samplerEventServer, &theClock, &sensorDataQueue, &measurementPayload);
     ResultAggregator resultAggregator(&samplerEventServer, &theClock, &sensorDataQueue, &resultPayload, MeasureIntervalMicros);
 
-    Device device(&communicatorEventServer);
-    Meter meter(&communicatorEventServer);
+    FreeRtosRunTimeSource runTimeSource;
+    PayloadBuilder cpuPayloadBuilder;
+    TaskProfiler taskProfiler(&communicatorEventServer, &runTimeSource, &cpuPayloadBuilder);
+    Device device(&communicatorEventServer, &taskProfiler);
+    PayloadBuilder historyPayloadBuilder;
+    ConsumptionHistory consumptionHistory(&communicatorEventServer, &preferences, &historyPayloadBuilder);
+    MeterJournal meterJournal(&preferences);
+    Meter meter(&communicatorEventServer, &consumptionHistory, &meterJournal);
     LedDriver ledDriver(&communicatorEventServer);
     OledDriver oledDriver(&communicatorEventServer, &Wire1);
     PayloadBuilder wifiPayloadBuilder;
     Log logger(&communicatorEventServer, &wifiPayloadBuilder);
 
-    WiFiManager wifi(&connectorEventServer, &configuration.wifi, &wifiPayloadBuilder);
+    ConnectionCache connectionCache;
+    WiFiManager wifi(&connectorEventServer, &configuration.wifi, &wifiPayloadBuilder, &connectionCache);
     PubSubClient mqttClient;
     MqttGateway mqttGateway(&connectorEventServer, &mqttClient, &wifiClientFactory, &configuration.mqtt, &sensorDataQueue,
-        BuildVersion);
-    FirmwareManager firmwareManager(&connectorEventServer, &wifiClientFactory, &configuration.firmware, BuildVersion);
-
-    QueueClient samplerQueueClient(&samplerEventServer, &logger, 50, 0);
-    // will fill fast if we have flow during startup
-    QueueClient communicatorSamplerQueueClient(&communicatorEventServer, &logger, 100, 1);
-    QueueClient communicatorConnectorQueueClient(&communicatorEventServer, &logger, 50, 2);
-    // This queue needs more space as it won't be read when offline.
-    QueueClient connectorCommunicatorQueueClient(&connectorEventServer, &logger, 100, 3);
-
-    // Nothing to send from sampler to connector
-    QueueClient connectorSamplerQueueClient(&connectorEventServer, &logger, 0, 4);
+        BuildVersion, &connectionCache);
+    HttpFirmwareSource firmwareSource(&wifiClientFactory);
+    PartitionFirmwareSink firmwareSink;
+    RunningFirmwareBase firmwareBase;
+    DeltaFirmwareSink deltaFirmwareSink(&firmwareBase, &firmwareSink);
+    FirmwareDownloader firmwareDownloader(&connectorEventServer, &firmwareSource, &firmwareSink);
+    FirmwareManager firmwareManager(&connectorEventServer, &wifiClientFactory, &configuration.firmware, BuildVersion, &firmwareDownloader,
+        &deltaFirmwareSink);
+    CaptureStreamer captureStreamer(&connectorEventServer, MeasureIntervalMicros, &sensorReader);
+
+    // string payloads between the tasks live here until the receiver is done with them
+    MessageArena messageArena;
+    EventBus eventBus(&samplerEventServer, &communicatorEventServer, &connectorEventServer, &logger, &messageArena);
     DataQueuePayload connectorDataQueuePayload;
     PayloadBuilder serialize2PayloadBuilder(&theClock);
     Serializer serializer2(&communicatorEventServer, &serialize2PayloadBuilder);
@@ -129,23 +156,25 @@ namespace WaterMeter {
     Button button(&buttonPublisher, ButtonPort);
 
     DataQueue connectorDataQueue(&connectorEventServer, &connectorDataQueuePayload, 1, 1024, 128, 256);
-    Sampler sampler(&samplerEventServer, &sensorReader, &flowDetector, &button, &sampleAggregator, &resultAggregator, &samplerQueueClient);
+    Sampler sampler(&samplerEventServer, &sensorReader, &flowDetector, &button, &sampleAggregator, &resultAggregator, &eventBus,
+        &taskProfiler);
     Communicator communicator(&communicatorEventServer, &oledDriver, &device,
-        &connectorDataQueue, &serializer2,
-        &communicatorSamplerQueueClient, &communicatorConnectorQueueClient);
+        &connectorDataQueue, &serializer2, &eventBus);
 
     TimeServer timeServer;
     Connector connector(&connectorEventServer, &wifi, &mqttGateway, &timeServer, &firmwareManager, &sensorDataQueue,
-        &connectorDataQueue, &serializer, &connectorSamplerQueueClient, &connectorCommunicatorQueueClient);
+        &connectorDataQueue, &serializer, &eventBus);
 
     static constexpr BaseType_t Core1 = 1;
     static constexpr BaseType_t Core0 = 0;
     static constexpr uint16_t StackDepth = 10000;
+    static constexpr BaseType_t Priority0 = 0;
     static constexpr BaseType_t Priority1 = 1;
 
     TaskHandle_t samplerTaskHandle;
     TaskHandle_t communicatorTaskHandle;
     TaskHandle_t connectorTaskHandle;
+    TaskHandle_t logTaskHandle;
 
     void setup() {
         Serial.begin(230400);
@@ -161,19 +190,18 @@ namespace WaterMeter {
         Wire1.begin(SdaOled, SclOled); // for display
 
         configuration.begin();
-        // queue for the sampler process
-        samplerQueueClient.begin(communicatorSamplerQueueClient.getQueueHandle());
-
-        // queues for the communicator process, receive only
-        communicatorSamplerQueueClient.begin();
-        communicatorConnectorQueueClient.begin(connectorCommunicatorQueueClient.getQueueHandle());
-
-        // queues for the connector process
-        connectorCommunicatorQueueClient.begin(communicatorConnectorQueueClient.getQueueHandle());
-        connectorSamplerQueueClient.begin(samplerQueueClient.getQueueHandle());
+        // The tasks share the preferences, so read the certificates before they start. Only needed with TLS.
+        if (configuration.mqtt.useTls ||
+            (configuration.firmware.baseUrl != nullptr && strncmp(configuration.firmware.baseUrl, "https", 5) == 0)) {
+            configuration.loadTlsConfig();
+        }
+        // connect the queues between the processes. This must happen before anything publishes.
+        eventBus.begin();
 
         communicator.begin();
-        connector.begin(&configuration);
+        connector.begin(&configuration, ParallelBringUp);
+        captureStreamer.begin();
+        flowTrace.begin();
 
         // ReSharper disable once CppUseStdSize -- we need a C++ 11 compatible way
         sampler.begin(sensor, sizeof sensor / sizeof sensor[0], MeasureIntervalMicros);
@@ -189,6 +217,9 @@ namespace WaterMeter {
         // Take care of logging and LEDs, as well as passing on data to the connector if there is a connection. Also on core 0, as not time sensitive
         xTaskCreatePinnedToCore(Communicator::task, "Communicator", StackDepth, &communicator, Priority1, &communicatorTaskHandle, Core0);
 
+        // Print the log lines when nothing more important needs to run, so logging doesn't slow down the other tasks
+        xTaskCreatePinnedToCore(Log::task, "Log", StackDepth, &logger, Priority0, &logTaskHandle, Core0);
+
         // beginLoop can only run when both sampler and connector have finished setting up, since they can start publishing right away.
         // This also starts the hardware timer.
         sampler.beginLoop(samplerTaskHandle);
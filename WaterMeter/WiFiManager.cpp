@@ -10,15 +10,18 @@
 // See the License for the specific language governing permissions and limitations under the License.
 
 #include "WiFiManager.h"
+#include <ESP.h>
 #include <SafeCString.h>
 #include "EventServer.h"
 #include "WiFi.h"
 
 namespace WaterMeter {
-    WiFiManager::WiFiManager(EventServer* eventServer, const WifiConfig* wifiConfig, PayloadBuilder* payloadBuilder) :
-        EventClient(eventServer), _payloadBuilder(payloadBuilder), _wifiConfig(wifiConfig) {}
+    WiFiManager::WiFiManager(EventServer* eventServer, const WifiConfig* wifiConfig, PayloadBuilder* payloadBuilder,
+        ConnectionCache* connectionCache) :
+        EventClient(eventServer), _payloadBuilder(payloadBuilder), _wifiConfig(wifiConfig), _connectionCache(connectionCache) {}
 
     void WiFiManager::announceReady() {
+        saveToCache();
         setStatusSummary();
         _eventServer->publish(this, Topic::WifiSummaryReady, true);
         _eventServer->provides(this, Topic::IpAddress);
@@ -43,10 +46,16 @@ namespace WaterMeter {
         _hostName = _hostNameBuffer;
 
         WiFi.mode(WIFI_STA);
+        if (connectFromCache()) return;
         WiFi.begin(_wifiConfig->ssid, _wifiConfig->password, 0, _wifiConfig->bssid);
     }
 
     void WiFiManager::configure(const IpConfig* ipConfig) {
+        _usesDhcp = ipConfig->localIp == NoIp;
+        applyIpConfig(ipConfig);
+    }
+
+    void WiFiManager::applyIpConfig(const IpConfig* ipConfig) {
         _localIp = ipConfig->localIp;
         if (ipConfig->gateway == NoIp && ipConfig->localIp != NoIp) {
             _gatewayIp = ipConfig->localIp;
@@ -74,6 +83,29 @@ namespace WaterMeter {
         }
     }
 
+    // Skips the scan by going straight for the channel and access point of the last connection, and DHCP by
+    // taking the last lease (unless the IP address is configured). isConnected() falls back if this doesn't work out.
+    // The lease stays a fixed address, just like the one needsReInit() pins, to avoid the DHCP timeout. It gets
+    // refreshed on the next full connect with DHCP, e.g. after a fallback.
+    bool WiFiManager::connectFromCache() {
+        _isFastConnecting = false;
+        if (_connectionCache == nullptr) return false;
+        int32_t channel;
+        uint8_t bssid[6];
+        IpConfig lease = IpAutoConfig;
+        if (!_connectionCache->getLink(_wifiConfig->ssid, channel, bssid, lease)) return false;
+        if (_usesDhcp && lease.localIp != NoIp) {
+            applyIpConfig(&lease);
+            _dns1Ip = lease.primaryDns;
+            _dns2Ip = lease.secondaryDns;
+        }
+        // a configured access point wins over the cached one
+        WiFi.begin(_wifiConfig->ssid, _wifiConfig->password, channel, _wifiConfig->bssid == nullptr ? bssid : _wifiConfig->bssid);
+        _isFastConnecting = true;
+        _fastConnectTimestamp = micros();
+        return true;
+    }
+
     void WiFiManager::disconnect() {
         WiFi.disconnect();
     }
@@ -114,14 +146,43 @@ namespace WaterMeter {
         return _needsReconnect;
     }
 
+    void WiFiManager::fallBack() {
+        _isFastConnecting = false;
+        _connectionCache->forgetLink();
+        _eventServer->publish(Topic::Info, "Cached Wi-Fi details failed; scanning");
+        WiFi.disconnect();
+        if (_usesDhcp) {
+            applyIpConfig(&IpAutoConfig);
+            _dns1Ip = NoIp;
+            _dns2Ip = NoIp;
+        }
+        WiFi.begin(_wifiConfig->ssid, _wifiConfig->password, 0, _wifiConfig->bssid);
+    }
+
     bool WiFiManager::isConnected() {
-        return WiFi.isConnected();
+        const bool isConnected = WiFi.isConnected();
+        if (_isFastConnecting) {
+            if (isConnected) {
+                _isFastConnecting = false;
+            }
+            else if (micros() - _fastConnectTimestamp > FastConnectTimeoutMicros) {
+                fallBack();
+            }
+        }
+        return isConnected;
     }
 
     void WiFiManager::reconnect() {
+        if (connectFromCache()) return;
         WiFi.reconnect();
     }
 
+    void WiFiManager::saveToCache() const {
+        if (_connectionCache == nullptr) return;
+        const IpConfig lease{WiFi.localIP(), WiFi.gatewayIP(), WiFi.subnetMask(), WiFi.dnsIP(0), WiFi.dnsIP(1)};
+        _connectionCache->saveLink(_wifiConfig->ssid, WiFi.channel(), WiFi.BSSID(), lease);
+    }
+
     void WiFiManager::setStatusSummary() const {
         _payloadBuilder->initialize();
         _payloadBuilder->writeParam("ssid", WiFi.SSID().c_str());
@@ -10,6 +10,8 @@
 // See the License for the specific language governing permissions and limitations under the License.
 
 // Sets up and maintains the Wi-Fi connection, and provides details that the communicator will need (e.g. IP address, MAC Address).
+// With a connection cache, it first tries the access point and lease of the last connection, and goes for the full scan
+// and DHCP if that doesn't connect quickly.
 
 #ifndef HEADER_WIFI_MANAGER
 #define HEADER_WIFI_MANAGER
@@ -20,13 +22,15 @@
 #include "EventClient.h"
 #include "PayloadBuilder.h"
 #include "Configuration.h"
+#include "ConnectionCache.h"
 
 namespace WaterMeter {
     const IPAddress NoIp(0, 0, 0, 0);
 
     class WiFiManager : public EventClient {
     public:
-        WiFiManager(EventServer* eventServer, const WifiConfig* wifiConfig, PayloadBuilder* payloadBuilder);
+        WiFiManager(EventServer* eventServer, const WifiConfig* wifiConfig, PayloadBuilder* payloadBuilder,
+            ConnectionCache* connectionCache = nullptr);
         virtual void announceReady();
         virtual void begin();
         void configure(const IpConfig* ipConfig = &IpAutoConfig);
@@ -38,13 +42,21 @@ namespace WaterMeter {
         virtual void reconnect();
         void setStatusSummary() const;
 
+        static constexpr unsigned long FastConnectTimeoutMicros = 1500UL * 1000UL;
+
     private:
         static constexpr int HostnameLength = 64;
         static constexpr int MacAddressSize = 20;
         static constexpr int IpAddressSize = 16;
 
+        void applyIpConfig(const IpConfig* ipConfig);
+        bool connectFromCache();
+        void fallBack();
+        void saveToCache() const;
+
         PayloadBuilder* _payloadBuilder;
         const WifiConfig* _wifiConfig;
+        ConnectionCache* _connectionCache;
         WiFiClientSecure _wifiClient;
         IPAddress _localIp = NoIp;
         IPAddress _gatewayIp = NoIp;
@@ -56,6 +68,9 @@ namespace WaterMeter {
         char _ipAddress[IpAddressSize] = "";
         char _macAddress[MacAddressSize] = "";
         bool _needsReconnect = true;
+        bool _usesDhcp = true;
+        bool _isFastConnecting = false;
+        unsigned long _fastConnectTimestamp = 0;
     };
 }
 #endif
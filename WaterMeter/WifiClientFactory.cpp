@@ -12,7 +12,31 @@
 #include "WiFiClientFactory.h"
 
 namespace WaterMeter {
-    WiFiClientFactory::WiFiClientFactory(const TlsConfig* config) : _config(config) {}
+    WiFiClientFactory::WiFiClientFactory(const TlsConfig* config) :
+        _config(config) {}
+
+    WiFiClientFactory::~WiFiClientFactory() {
+        for (auto& roleClients : _clients) {
+            for (const auto client : roleClients) {
+                delete client;
+            }
+        }
+    }
+
+    // The client keeps its certificate settings, so a reconnect only needs the handshake.
+    // Note that the Arduino WiFiClientSecure frees its TLS context on stop and has no session cache,
+    // so resuming TLS sessions would need support in the core.
+    WiFiClient* WiFiClientFactory::acquire(const ClientRole role, const bool useTls) const {
+        WiFiClient*& client = _clients[static_cast<int>(role)][useTls ? 1 : 0];
+        if (client == nullptr) {
+            client = create(useTls);
+        }
+        return client;
+    }
+
+    WiFiClient* WiFiClientFactory::acquire(const ClientRole role, const char* url) const {
+        return acquire(role, isHttps(url));
+    }
 
     WiFiClient* WiFiClientFactory::create(const bool useTls) const {
         if (!useTls) return new WiFiClient();
@@ -37,7 +61,11 @@ namespace WaterMeter {
     }
 
     WiFiClient* WiFiClientFactory::create(const char* url) const {
+        return create(isHttps(url));
+    }
+
+    bool WiFiClientFactory::isHttps(const char* url) {
         constexpr auto Https = "https";
-        return create(url != nullptr && strncmp(url, Https, strlen(Https)) == 0);
+        return url != nullptr && strncmp(url, Https, strlen(Https)) == 0;
     }
 }
\ No newline at end of file
@@ -10,6 +10,8 @@
 // See the License for the specific language governing permissions and limitations under the License.
 
 // Creates a Wi-Fi client. This allows for hiding specifics like using HTTPS or HTTP, and using certificates.
+// acquire() hands out one long-lived client per role, so MQTT reconnects and firmware requests don't rebuild and
+// reconfigure a client. Only the client object is reused: every request still makes its own connection and TLS handshake.
 
 #ifndef HEADER_WIFI_CLIENT_FACTORY
 #define HEADER_WIFI_CLIENT_FACTORY
@@ -18,13 +20,23 @@
 #include "Configuration.h"
 
 namespace WaterMeter {
+    enum class ClientRole : uint8_t { Mqtt = 0, Firmware, Count };
+
     class WiFiClientFactory {
     public:
         explicit WiFiClientFactory(const TlsConfig* config);
+        WiFiClientFactory(const WiFiClientFactory&) = delete;
+        WiFiClientFactory& operator=(const WiFiClientFactory&) = delete;
+        ~WiFiClientFactory();
+        WiFiClient* acquire(ClientRole role, bool useTls) const;
+        WiFiClient* acquire(ClientRole role, const char* url) const;
         WiFiClient* create(bool useTls) const;
         WiFiClient* create(const char* url) const;
     private:
+        static bool isHttps(const char* url);
         const TlsConfig* _config;
+        // a cache, so acquiring doesn't change what the factory is
+        mutable WiFiClient* _clients[static_cast<int>(ClientRole::Count)][2] = {};
     };
 }
 #endif
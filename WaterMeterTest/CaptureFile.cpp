@@ -0,0 +1,145 @@
+// Copyright 2024 Rik Essenius
+// 
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License. You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and limitations under the License.
+
+#include "CaptureFile.h"
+
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <vector>
+
+#ifdef _WIN32
+// ensure that Windows.h doesn't define min and max, which mess up the std::min and std::max
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace WaterMeterCppTest {
+    using WaterMeter::CaptureMagic;
+    using WaterMeter::CaptureVersion;
+    using WaterMeter::StreamingSampleCount;
+
+    constexpr char CaptureFile::Extension[];
+
+    CaptureFile::~CaptureFile() {
+        close();
+    }
+
+    void CaptureFile::close() {
+#ifdef _WIN32
+        if (_data != nullptr) UnmapViewOfFile(_data);
+        if (_mapping != nullptr) CloseHandle(_mapping);
+        if (_file != nullptr) CloseHandle(_file);
+#else
+        if (_data != nullptr) munmap(const_cast<uint8_t*>(_data), _size);
+#endif
+        _data = nullptr;
+        _mapping = nullptr;
+        _file = nullptr;
+        _size = 0;
+        _sampleCount = 0;
+    }
+
+    bool CaptureFile::convert(const char* textFileName, const char* captureFileName, const CaptureHeader& settings) {
+        std::ifstream text(textFileName);
+        if (!text.is_open()) return false;
+        text.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+        std::vector<CaptureSample> samples;
+        CaptureSample sample{};
+        while (text >> sample.x >> sample.y) {
+            samples.push_back(sample);
+        }
+
+        CaptureHeader header = settings;
+        memcpy(header.magic, CaptureMagic, sizeof header.magic);
+        header.version = CaptureVersion;
+        header.headerSize = sizeof(CaptureHeader);
+        header.sampleCount = static_cast<uint32_t>(samples.size());
+
+        std::ofstream capture(captureFileName, std::ios::binary | std::ios::trunc);
+        if (!capture.is_open()) return false;
+        capture.write(reinterpret_cast<const char*>(&header), sizeof header);
+        capture.write(reinterpret_cast<const char*>(samples.data()), static_cast<std::streamsize>(samples.size() * sizeof(CaptureSample)));
+        return capture.good();
+    }
+
+    CaptureHeader CaptureFile::defaultHeader() {
+        CaptureHeader header{};
+        memcpy(header.magic, CaptureMagic, sizeof header.magic);
+        header.version = CaptureVersion;
+        header.headerSize = sizeof(CaptureHeader);
+        header.sampleRateHz = 100;
+        header.gain = 390;
+        header.noiseRange = 3;
+        header.sensorType = CaptureSensorType::Unknown;
+        return header;
+    }
+
+    bool CaptureFile::isCaptureFile(const char* fileName) {
+        const auto nameLength = strlen(fileName);
+        const auto extensionLength = strlen(Extension);
+        return nameLength > extensionLength && strcmp(fileName + nameLength - extensionLength, Extension) == 0;
+    }
+
+    bool CaptureFile::isValid() {
+        if (_size < sizeof(CaptureHeader)) return false;
+        const auto& fileHeader = header();
+        if (memcmp(fileHeader.magic, CaptureMagic, sizeof CaptureMagic) != 0 || fileHeader.version != CaptureVersion) return false;
+        if (fileHeader.headerSize < sizeof(CaptureHeader) || _size < fileHeader.headerSize) return false;
+        const auto available = static_cast<uint32_t>((_size - fileHeader.headerSize) / sizeof(CaptureSample));
+        if (fileHeader.sampleCount == StreamingSampleCount) {
+            _sampleCount = available;
+            return true;
+        }
+        _sampleCount = fileHeader.sampleCount;
+        return _sampleCount <= available;
+    }
+
+    bool CaptureFile::open(const char* fileName) {
+        close();
+#ifdef _WIN32
+        const auto file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return false;
+        _file = file;
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+            close();
+            return false;
+        }
+        _size = static_cast<size_t>(size.QuadPart);
+        _mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (_mapping != nullptr) {
+            _data = static_cast<const uint8_t*>(MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0));
+        }
+#else
+        const auto descriptor = ::open(fileName, O_RDONLY);
+        if (descriptor < 0) return false;
+        struct stat status {};
+        if (fstat(descriptor, &status) == 0 && status.st_size > 0) {
+            _size = static_cast<size_t>(status.st_size);
+            const auto mapped = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+            if (mapped != MAP_FAILED) _data = static_cast<const uint8_t*>(mapped);
+        }
+        // the mapping stays valid after closing the descriptor
+        ::close(descriptor);
+#endif
+        if (_data == nullptr || !isValid()) {
+            close();
+            return false;
+        }
+        return true;
+    }
+}
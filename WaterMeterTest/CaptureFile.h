@@ -0,0 +1,57 @@
+// Copyright 2024 Rik Essenius
+// 
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License. You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and limitations under the License.
+
+// Binary sensor capture (see CaptureFormat): a 32 byte header (sample rate, sensor type, gain, noise range, sample count)
+// followed by packed little endian int16 x/y pairs. The file is memory mapped on open, so replaying it
+// does not parse anything; convert() creates a capture from the whitespace separated text files in testData.
+// A stream saved from the device (sample count StreamingSampleCount) gets its sample count from the file size.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "CaptureFormat.h"
+
+namespace WaterMeterCppTest {
+    using WaterMeter::CaptureHeader;
+    using WaterMeter::CaptureSample;
+    using WaterMeter::CaptureSensorType;
+
+    class CaptureFile {
+    public:
+        CaptureFile() = default;
+        ~CaptureFile();
+        CaptureFile(const CaptureFile&) = delete;
+        CaptureFile& operator=(const CaptureFile&) = delete;
+
+        static bool convert(const char* textFileName, const char* captureFileName, const CaptureHeader& settings = defaultHeader());
+        static CaptureHeader defaultHeader();
+        static bool isCaptureFile(const char* fileName);
+
+        void close();
+        const CaptureHeader& header() const { return *reinterpret_cast<const CaptureHeader*>(_data); }
+        bool isOpen() const { return _data != nullptr; }
+        bool open(const char* fileName);
+        const CaptureSample* samples() const { return reinterpret_cast<const CaptureSample*>(_data + header().headerSize); }
+        uint32_t sampleCount() const { return _sampleCount; }
+
+        static constexpr char Extension[] = ".capture";
+    private:
+        bool isValid();
+        const uint8_t* _data = nullptr;
+        size_t _size = 0;
+        uint32_t _sampleCount = 0;
+        // platform handles, void* so the header does not need Windows.h
+        void* _file = nullptr;
+        void* _mapping = nullptr;
+    };
+}
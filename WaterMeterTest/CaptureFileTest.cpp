@@ -0,0 +1,81 @@
+// Copyright 2024 Rik Essenius
+// 
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License. You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and limitations under the License.
+
+#include <gtest/gtest.h>
+
+#include "CaptureFile.h"
+#include "MagnetoSensorSimulation.h"
+#include "RegressionRunner.h"
+
+namespace WaterMeterCppTest {
+
+    TEST(CaptureFileTest, ConvertTest) {
+        auto settings = CaptureFile::defaultHeader();
+        settings.gain = 1090;
+        settings.noiseRange = 2;
+        settings.sensorType = CaptureSensorType::Hmc;
+        ASSERT_TRUE(CaptureFile::convert("testData\\rawSensorData.txt", "rawSensorData.capture", settings)) << "Converted";
+
+        CaptureFile capture;
+        ASSERT_TRUE(capture.open("rawSensorData.capture")) << "Opened";
+        EXPECT_EQ(100u, capture.header().sampleRateHz) << "Sample rate";
+        EXPECT_EQ(1090.0f, capture.header().gain) << "Gain";
+        EXPECT_EQ(2, capture.header().noiseRange) << "Noise range";
+        EXPECT_EQ(CaptureSensorType::Hmc, capture.header().sensorType) << "Sensor type";
+
+        MagnetoSensorSimulation textSensor;
+        MagnetoSensorSimulation captureSensor("rawSensorData.capture");
+        EXPECT_EQ(1090.0, captureSensor.getGain()) << "Gain from capture";
+        EXPECT_EQ(2, captureSensor.getNoiseRange()) << "Noise range from capture";
+        SensorData expected{};
+        SensorData actual{};
+        uint32_t count = 0;
+        while (textSensor.read(expected)) {
+            ASSERT_TRUE(captureSensor.read(actual)) << "Capture sample #" << count;
+            ASSERT_EQ(expected.x, actual.x) << "X #" << count;
+            ASSERT_EQ(expected.y, actual.y) << "Y #" << count;
+            count++;
+        }
+        EXPECT_FALSE(captureSensor.read(actual)) << "Capture done at the same point";
+        EXPECT_TRUE(captureSensor.done()) << "Done";
+        EXPECT_EQ(count, capture.sampleCount()) << "Sample count";
+    }
+
+    TEST(CaptureFileTest, InvalidFileTest) {
+        CaptureFile capture;
+        EXPECT_FALSE(capture.open("doesNotExist.capture")) << "Missing file";
+        EXPECT_FALSE(capture.open("testData\\60cycles.txt")) << "Text file is not a capture";
+        EXPECT_FALSE(capture.isOpen()) << "Not open";
+        EXPECT_EQ(0u, capture.sampleCount()) << "No samples";
+        EXPECT_FALSE(CaptureFile::convert("testData\\doesNotExist.txt", "doesNotExist.capture")) << "Cannot convert missing file";
+        EXPECT_TRUE(CaptureFile::isCaptureFile("a.capture")) << "Capture extension";
+        EXPECT_FALSE(CaptureFile::isCaptureFile(".capture")) << "Extension only";
+        EXPECT_FALSE(CaptureFile::isCaptureFile("a.txt")) << "Text extension";
+    }
+
+    TEST(CaptureFileTest, RegressionRunnerTest) {
+        ASSERT_TRUE(CaptureFile::convert("testData\\60cycles.txt", "60cycles.capture")) << "Converted";
+        RegressionCase textCase;
+        textCase.fileName = "60cycles.txt";
+        RegressionCase captureCase;
+        captureCase.fileName = "60cycles.capture";
+        const RegressionRunner textRunner;
+        const RegressionRunner captureRunner("");
+        const auto textResult = textRunner.runCase(textCase);
+        const auto captureResult = captureRunner.runCase(captureCase);
+        ASSERT_TRUE(captureResult.opened) << "Capture opened";
+        EXPECT_EQ(textResult.samples, captureResult.samples) << "Samples";
+        EXPECT_EQ(1u, captureResult.actual.firstPulses) << "First pulses";
+        EXPECT_EQ(59u, captureResult.actual.nextPulses) << "Next pulses";
+        EXPECT_EQ(textResult.centerTimes10.x, captureResult.centerTimes10.x) << "Center X";
+        EXPECT_EQ(textResult.radiusTimes10.y, captureResult.radiusTimes10.y) << "Radius Y";
+    }
+}
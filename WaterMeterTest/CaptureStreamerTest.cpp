@@ -0,0 +1,257 @@
+// Copyright 2024 Rik Essenius
+// 
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License. You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and limitations under the License.
+
+// Runs the capture streamer against a real socket on the loopback interface, so we see the bytes as a listener would.
+
+#include <WinSock2.h>
+#include <WS2tcpip.h>
+#pragma comment(lib, "Ws2_32.lib")
+
+#include "gtest/gtest.h"
+#include <string>
+#include <vector>
+
+#include "CaptureStreamer.h"
+#include "ConnectionState.h"
+#include "MagnetoSensorMock.h"
+#include "Serializer.h"
+#include "TestEventClient.h"
+
+namespace WaterMeterCppTest {
+    using WaterMeter::CaptureHeader;
+    using WaterMeter::CaptureSample;
+    using WaterMeter::CaptureSensorType;
+    using WaterMeter::CaptureStreamer;
+    using WaterMeter::ConnectionState;
+    using WaterMeter::DataQueuePayload;
+    using WaterMeter::MagnetoSensor;
+    using WaterMeter::MagnetoSensorReader;
+    using WaterMeter::MaxSamples;
+    using WaterMeter::PayloadBuilder;
+    using WaterMeter::Serializer;
+
+    class SocketCaptureStreamer final : public CaptureStreamer {
+    public:
+        using CaptureStreamer::CaptureStreamer;
+        using CaptureStreamer::parseTarget;
+
+        ~SocketCaptureStreamer() override {
+            SocketCaptureStreamer::stopSocket();
+        }
+
+    protected:
+        bool connectSocket(const char* host, const uint16_t port) override {
+            _socket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+            sockaddr_in address{};
+            address.sin_family = AF_INET;
+            address.sin_port = htons(port);
+            inet_pton(AF_INET, host, &address.sin_addr);
+            if (connect(_socket, reinterpret_cast<sockaddr*>(&address), sizeof address) == 0) return true;
+            stopSocket();
+            return false;
+        }
+
+        size_t writeSocket(const uint8_t* buffer, const size_t size) override {
+            const auto sent = send(_socket, reinterpret_cast<const char*>(buffer), static_cast<int>(size), 0);
+            return sent < 0 ? 0 : static_cast<size_t>(sent);
+        }
+
+        void stopSocket() override {
+            if (_socket != INVALID_SOCKET) closesocket(_socket);
+            _socket = INVALID_SOCKET;
+        }
+
+    private:
+        SOCKET _socket = INVALID_SOCKET;
+    };
+
+    class CaptureStreamerTest : public testing::Test {
+    public:
+        static void SetUpTestSuite() {
+            WSADATA data;
+            WSAStartup(MAKEWORD(2, 2), &data);
+        }
+
+        static void TearDownTestSuite() {
+            WSACleanup();
+        }
+
+    protected:
+        static SOCKET listenOnLoopback(uint16_t& port) {
+            const auto listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+            sockaddr_in address{};
+            address.sin_family = AF_INET;
+            address.sin_port = 0;
+            inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+            bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof address);
+            listen(listener, 1);
+            int length = sizeof address;
+            getsockname(listener, reinterpret_cast<sockaddr*>(&address), &length);
+            port = ntohs(address.sin_port);
+            return listener;
+        }
+
+        static std::vector<uint8_t> receiveAll(const SOCKET connection) {
+            std::vector<uint8_t> data;
+            char buffer[256];
+            int received;
+            while ((received = recv(connection, buffer, sizeof buffer, 0)) > 0) {
+                data.insert(data.end(), buffer, buffer + received);
+            }
+            return data;
+        }
+    };
+
+    TEST_F(CaptureStreamerTest, StreamTest) {
+        digitalWrite(MagnetoSensorReader::DefaultPowerPort, LOW);
+        EventServer eventServer;
+        MagnetoSensorMock sensor;
+        MagnetoSensor* sensorList[] = { &sensor };
+        MagnetoSensorReader sensorReader(&eventServer);
+        ASSERT_TRUE(sensorReader.begin(sensorList, 1)) << "Sensor reader started";
+        SocketCaptureStreamer streamer(&eventServer, 10000UL, &sensorReader);
+        streamer.begin();
+        PayloadBuilder payloadBuilder;
+        Serializer serializer(&eventServer, &payloadBuilder);
+        eventServer.subscribe(&serializer, Topic::SensorData);
+        TestEventClient samplesClient(&eventServer);
+        eventServer.subscribe(&samplesClient, Topic::SamplesFormatted);
+        TestEventClient infoClient(&eventServer);
+        eventServer.subscribe(&infoClient, Topic::Info);
+        TestEventClient batchSizeClient(&eventServer);
+        eventServer.subscribe(&batchSizeClient, Topic::BatchSizeDesired);
+        eventServer.publish(Topic::BatchSizeDesired, "0");
+
+        uint16_t port;
+        const auto listener = listenOnLoopback(port);
+        const auto target = "127.0.0.1:" + std::to_string(port);
+        eventServer.publish(Topic::Capture, target.c_str());
+        ASSERT_TRUE(streamer.isStreaming()) << "Streaming";
+        EXPECT_EQ(1L, eventServer.request(Topic::Capture, 0L)) << "Capture state provided";
+        EXPECT_STREQ(("Capture streaming to " + target).c_str(), infoClient.getPayload()) << "Info published";
+        EXPECT_STREQ("25", batchSizeClient.getPayload()) << "Full batches while streaming";
+        // a change while streaming is kept for later, and the maximum is published again
+        const auto batchSizeCount = batchSizeClient.getCallCount();
+        eventServer.publish(Topic::BatchSizeDesired, "5");
+        EXPECT_EQ(batchSizeCount + 2, batchSizeClient.getCallCount()) << "Change and maximum published";
+        const auto connection = accept(listener, nullptr, nullptr);
+        ASSERT_NE(INVALID_SOCKET, connection) << "Accepted";
+
+        DataQueuePayload payload{};
+        payload.topic = Topic::Samples;
+        payload.buffer.samples.count = MaxSamples;
+        for (int16_t i = 0; i < static_cast<int16_t>(MaxSamples); i++) {
+            payload.buffer.samples.value[i] = {{i, static_cast<int16_t>(-i)}};
+        }
+        eventServer.publish(Topic::SensorData, reinterpret_cast<const char*>(&payload));
+        EXPECT_EQ(0, samplesClient.getCallCount()) << "Samples not serialized while streaming";
+
+        // results still go the regular way, and are not streamed
+        DataQueuePayload result{};
+        result.topic = Topic::Result;
+        eventServer.publish(Topic::SensorData, reinterpret_cast<const char*>(&result));
+
+        eventServer.publish(Topic::Capture, "off");
+        EXPECT_FALSE(streamer.isStreaming()) << "Stopped";
+        EXPECT_STREQ("Capture stopped", infoClient.getPayload()) << "Stop info published";
+        EXPECT_STREQ("5", batchSizeClient.getPayload()) << "Desired batch size restored";
+
+        const auto data = receiveAll(connection);
+        closesocket(connection);
+        closesocket(listener);
+        ASSERT_EQ(sizeof(CaptureHeader) + MaxSamples * sizeof(CaptureSample), data.size()) << "Header and one batch";
+        const auto header = reinterpret_cast<const CaptureHeader*>(data.data());
+        EXPECT_EQ(0, memcmp("WMCP", header->magic, 4)) << "Magic";
+        EXPECT_EQ(100u, header->sampleRateHz) << "Sample rate";
+        EXPECT_EQ(WaterMeter::StreamingSampleCount, header->sampleCount) << "Sample count unknown";
+        EXPECT_FLOAT_EQ(3000.0f, header->gain) << "Gain from the sensor";
+        EXPECT_EQ(12, header->noiseRange) << "Noise range from the sensor";
+        EXPECT_EQ(CaptureSensorType::Qmc, header->sensorType) << "Sensor type from the gain";
+        const auto samples = reinterpret_cast<const CaptureSample*>(data.data() + header->headerSize);
+        for (int16_t i = 0; i < static_cast<int16_t>(MaxSamples); i++) {
+            EXPECT_EQ(i, samples[i].x) << "X #" << i;
+            EXPECT_EQ(-i, samples[i].y) << "Y #" << i;
+        }
+
+        eventServer.publish(Topic::SensorData, reinterpret_cast<const char*>(&payload));
+        EXPECT_EQ(1, samplesClient.getCallCount()) << "Samples serialized again after stopping";
+    }
+
+    TEST_F(CaptureStreamerTest, ConnectionLostTest) {
+        EventServer eventServer;
+        SocketCaptureStreamer streamer(&eventServer, 10000UL);
+        streamer.begin();
+        TestEventClient infoClient(&eventServer);
+        eventServer.subscribe(&infoClient, Topic::Info);
+        TestEventClient batchSizeClient(&eventServer);
+        eventServer.subscribe(&batchSizeClient, Topic::BatchSizeDesired);
+
+        uint16_t port;
+        const auto listener = listenOnLoopback(port);
+        eventServer.publish(Topic::Capture, ("127.0.0.1:" + std::to_string(port)).c_str());
+        ASSERT_TRUE(streamer.isStreaming()) << "Streaming";
+        const auto connection = accept(listener, nullptr, nullptr);
+
+        eventServer.publish(Topic::Connection, static_cast<long>(ConnectionState::MqttReady));
+        EXPECT_TRUE(streamer.isStreaming()) << "Still streaming while MQTT is ready";
+
+        // the samples stop coming in without MQTT, so the capture would get a gap
+        eventServer.publish(Topic::Connection, static_cast<long>(ConnectionState::WifiReady));
+        EXPECT_FALSE(streamer.isStreaming()) << "Stopped when MQTT dropped";
+        EXPECT_STREQ("Capture stopped: connection lost", infoClient.getPayload()) << "Reason published";
+        EXPECT_STREQ("25", batchSizeClient.getPayload()) << "Default batch size restored";
+        closesocket(connection);
+        closesocket(listener);
+    }
+
+    TEST_F(CaptureStreamerTest, ErrorTest) {
+        EventServer eventServer;
+        SocketCaptureStreamer streamer(&eventServer, 10000UL);
+        streamer.begin();
+        TestEventClient errorClient(&eventServer);
+        eventServer.subscribe(&errorClient, Topic::ConnectionError);
+
+        eventServer.publish(Topic::Capture, "127.0.0.1:notaport");
+        EXPECT_FALSE(streamer.isStreaming()) << "Not streaming with invalid target";
+        EXPECT_STREQ("Capture: invalid target '127.0.0.1:notaport'", errorClient.getPayload()) << "Invalid target reported";
+
+        // grab a free port, and close it again so nobody is listening
+        uint16_t port;
+        closesocket(listenOnLoopback(port));
+        const auto target = "127.0.0.1:" + std::to_string(port);
+        eventServer.publish(Topic::Capture, target.c_str());
+        EXPECT_FALSE(streamer.isStreaming()) << "Not streaming without listener";
+        EXPECT_STREQ(("Capture: could not connect to " + target).c_str(), errorClient.getPayload()) << "Connect failure reported";
+        EXPECT_EQ(0L, eventServer.request(Topic::Capture, 0L)) << "Capture state off";
+    }
+
+    TEST_F(CaptureStreamerTest, SensorTypeTest) {
+        EXPECT_EQ(CaptureSensorType::Null, CaptureStreamer::sensorType(false, 0.0)) << "Null sensor";
+        EXPECT_EQ(CaptureSensorType::Hmc, CaptureStreamer::sensorType(true, 1370.0)) << "Highest HMC gain";
+        EXPECT_EQ(CaptureSensorType::Hmc, CaptureStreamer::sensorType(true, 230.0)) << "Lowest HMC gain";
+        EXPECT_EQ(CaptureSensorType::Qmc, CaptureStreamer::sensorType(true, 3000.0)) << "QMC at 8 Gauss";
+        EXPECT_EQ(CaptureSensorType::Qmc, CaptureStreamer::sensorType(true, 12000.0)) << "QMC at 2 Gauss";
+    }
+
+    TEST_F(CaptureStreamerTest, ParseTargetTest) {
+        char host[20];
+        uint16_t port;
+        EXPECT_TRUE(SocketCaptureStreamer::parseTarget("192.168.1.10:9000", host, sizeof host, port)) << "Host and port";
+        EXPECT_STREQ("192.168.1.10", host) << "Host";
+        EXPECT_EQ(9000, port) << "Port";
+        EXPECT_TRUE(SocketCaptureStreamer::parseTarget("capture.local", host, sizeof host, port)) << "Host only";
+        EXPECT_STREQ("capture.local", host) << "Host without port";
+        EXPECT_EQ(CaptureStreamer::DefaultPort, port) << "Default port";
+        EXPECT_FALSE(SocketCaptureStreamer::parseTarget(":9000", host, sizeof host, port)) << "No host";
+        EXPECT_FALSE(SocketCaptureStreamer::parseTarget("host:70000", host, sizeof host, port)) << "Port out of range";
+        EXPECT_FALSE(SocketCaptureStreamer::parseTarget("a.very.long.host.name.example", host, sizeof host, port)) << "Host too long";
+    }
+}
@@ -11,6 +11,7 @@
 
 #include "gtest/gtest.h"
 #include <regex>
+#include <sys/time.h>
 #include "Clock.h"
 
 namespace WaterMeterCppTest {
@@ -28,6 +29,30 @@ namespace WaterMeterCppTest {
         EXPECT_STREQ(R"(abcd)", destination) << "Destination not changed";
     }
 
+    TEST(ClockTest, formatTimestampCacheTest) {
+        char destination[Clock::BufferSize];
+        EXPECT_TRUE(Clock::formatTimestamp(1645491723456789ULL, destination, sizeof destination)) << "Format OK";
+        EXPECT_STREQ("2022-02-22T01:02:03.456789Z", destination) << "Formatted correctly";
+        EXPECT_TRUE(Clock::formatTimestamp(1645491723000001ULL, destination, sizeof destination)) << "Same second OK";
+        EXPECT_STREQ("2022-02-22T01:02:03.000001Z", destination) << "Cached prefix with new fraction";
+        Clock::formatTimestamp(951782400999999ULL, destination, sizeof destination);
+        EXPECT_STREQ("2000-02-29T00:00:00.999999Z", destination) << "Leap day, cache replaced";
+        Clock::formatTimestamp(4107542399000000ULL, destination, sizeof destination);
+        EXPECT_STREQ("2100-02-28T23:59:59.000000Z", destination) << "2100 is not a leap year";
+        Clock::formatTimestamp(0ULL, destination, sizeof destination);
+        EXPECT_STREQ("1970-01-01T00:00:00.000000Z", destination) << "Epoch";
+    }
+
+    TEST(ClockTest, getTimestampTest) {
+        Clock::synchronize();
+        timeval currentTime{};
+        gettimeofday(&currentTime, nullptr);
+        const auto wallTime = static_cast<Timestamp>(currentTime.tv_sec) * 1000000ULL + static_cast<Timestamp>(currentTime.tv_usec);
+        const auto timestamp = Clock::getTimestamp();
+        EXPECT_LT(timestamp > wallTime ? timestamp - wallTime : wallTime - timestamp, 10000ULL) << "Close to the wall clock";
+        EXPECT_GE(Clock::getTimestamp(), timestamp) << "Does not go back";
+    }
+
     TEST(ClockTest, test1) {
         EventServer eventServer;
         // the mock only mocks the time setting and detection, but keeps the rest
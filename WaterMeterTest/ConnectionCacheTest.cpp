@@ -0,0 +1,71 @@
+// Copyright 2024 Rik Essenius
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License. You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and limitations under the License.
+
+#include "gtest/gtest.h"
+
+#include <cstring>
+#include <IPAddress.h>
+
+#include "ConnectionCache.h"
+
+namespace WaterMeterCppTest {
+    using WaterMeter::ConnectionCache;
+    using WaterMeter::IpConfig;
+    using WaterMeter::IpAutoConfig;
+
+    class ConnectionCacheTest : public testing::Test {
+    public:
+        void SetUp() override {
+            ConnectionCache().clear();
+        }
+    };
+
+    TEST_F(ConnectionCacheTest, linkTest) {
+        ConnectionCache cache;
+        int32_t channel = 0;
+        uint8_t bssid[6] = {};
+        IpConfig lease = IpAutoConfig;
+        EXPECT_FALSE(cache.getLink("ssid", channel, bssid, lease)) << "Nothing cached yet";
+
+        constexpr uint8_t CachedBssid[6] = {0x55, 0x44, 0x33, 0x22, 0x11, 0x00};
+        const IpConfig cachedLease{{10, 0, 0, 2}, {10, 0, 0, 1}, {255, 255, 0, 0}, {8, 8, 8, 8}, {8, 8, 4, 4}};
+        cache.saveLink("ssid", 13, CachedBssid, cachedLease);
+
+        // a new instance sees the same data, as after a reset
+        const ConnectionCache cache2;
+        EXPECT_FALSE(cache2.getLink("other", channel, bssid, lease)) << "Other network not cached";
+        ASSERT_TRUE(cache2.getLink("ssid", channel, bssid, lease)) << "Link cached";
+        EXPECT_EQ(13, channel) << "Channel";
+        EXPECT_EQ(0, memcmp(CachedBssid, bssid, sizeof bssid)) << "BSSID";
+        EXPECT_EQ(cachedLease.localIp, lease.localIp) << "Local IP";
+        EXPECT_EQ(cachedLease.gateway, lease.gateway) << "Gateway";
+        EXPECT_EQ(cachedLease.subnetMask, lease.subnetMask) << "Subnet mask";
+        EXPECT_EQ(cachedLease.primaryDns, lease.primaryDns) << "Primary DNS";
+        EXPECT_EQ(cachedLease.secondaryDns, lease.secondaryDns) << "Secondary DNS";
+
+        cache.forgetLink();
+        EXPECT_FALSE(cache.getLink("ssid", channel, bssid, lease)) << "Link forgotten";
+    }
+
+    TEST_F(ConnectionCacheTest, brokerTest) {
+        ConnectionCache cache;
+        IPAddress brokerIp;
+        EXPECT_FALSE(cache.getBroker("broker", brokerIp)) << "Nothing cached yet";
+        cache.saveBroker("broker", IPAddress(192, 168, 1, 10));
+        EXPECT_FALSE(cache.getBroker("other", brokerIp)) << "Other broker not cached";
+        EXPECT_FALSE(cache.getBroker(nullptr, brokerIp)) << "No broker not cached";
+        ASSERT_TRUE(cache.getBroker("broker", brokerIp)) << "Broker cached";
+        EXPECT_EQ(IPAddress(192, 168, 1, 10), brokerIp) << "Broker IP";
+
+        cache.forgetBroker();
+        EXPECT_FALSE(cache.getBroker("broker", brokerIp)) << "Broker forgotten";
+    }
+}
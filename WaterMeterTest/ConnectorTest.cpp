@@ -21,6 +21,7 @@
 #include "TestEventClient.h"
 #include "TimeServerMock.h"
 #include "DataQueue.h"
+#include "HTTPClient.h"
 
 namespace WaterMeterCppTest {
     using WaterMeter::Configuration;
@@ -32,7 +33,8 @@ namespace WaterMeterCppTest {
     using WaterMeter::FirmwareManager;
     using WaterMeter::Log;
     using WaterMeter::PayloadBuilder;
-    using WaterMeter::QueueClient;
+    using WaterMeter::EventBus;
+    using WaterMeter::TaskId;
     using WaterMeter::Serializer;
     using WaterMeter::WiFiClientFactory;
     using WaterMeter::WifiInitialWaitDuration;
@@ -57,8 +59,9 @@ namespace WaterMeterCppTest {
         static PayloadBuilder payloadBuilder;
         static Serializer serializer;
         static QueueHandle_t queueHandle;
-        static QueueClient queueClient1;
-        static QueueClient communicatorQueueClient;
+        static EventServer samplerEventServer;
+        static EventServer communicatorEventServer;
+        static EventBus eventBus;
         static DataQueue dataQueue;
         static DataQueue commsDataQueue;
 
@@ -66,8 +69,6 @@ namespace WaterMeterCppTest {
         static void SetUpTestCase() {
             disableDelay(false);
             setRealTime(false);
-            queueClient1.begin(communicatorQueueClient.getQueueHandle());
-            communicatorQueueClient.begin();
         }
 
         // Predicate function within the test file
@@ -95,10 +96,12 @@ namespace WaterMeterCppTest {
     DataQueue ConnectorTest::commsDataQueue(&eventServer, &payload, 1, 2, 1, 2);
 
     QueueHandle_t ConnectorTest::queueHandle = nullptr;
-    QueueClient ConnectorTest::queueClient1(&eventServer, &logger, 10, 1);
-    QueueClient ConnectorTest::communicatorQueueClient(&eventServer, &logger, 10, 2);
+    EventServer ConnectorTest::samplerEventServer;
+    EventServer ConnectorTest::communicatorEventServer;
+    // not started, so the connector's events stay on its own event server
+    EventBus ConnectorTest::eventBus(&samplerEventServer, &communicatorEventServer, &eventServer, &logger);
     Connector ConnectorTest::connector(&eventServer, &wifiMock, &mqttGatewayMock, &timeServer, &firmwareManager, &dataQueue,
-                                       &commsDataQueue, &serializer, &queueClient1, &communicatorQueueClient);
+                                       &commsDataQueue, &serializer, &eventBus);
     
     TEST_F(ConnectorTest, maxWifiFailuresTest) {
         EXPECT_STREQ("", getPrintOutput()) << "Print buffer empty start";
@@ -116,8 +119,8 @@ namespace WaterMeterCppTest {
         EXPECT_EQ(ConnectionState::Init, connector.loop()) << "Failed too many times) << re-init";
         EXPECT_STREQ("", getPrintOutput()) << "Print buffer empty end";
 
-        EXPECT_FALSE(uxQueueMessagesWaiting(queueClient1.getQueueHandle())) << "queueClient1 ok";
-        EXPECT_FALSE(uxQueueMessagesWaiting(communicatorQueueClient.getQueueHandle())) << "communicatorQueueClient ok";
+        EXPECT_FALSE(eventBus.receive(TaskId::Sampler)) << "Nothing for the sampler";
+        EXPECT_FALSE(eventBus.receive(TaskId::Communicator)) << "Nothing for the communicator";
     }
 
     TEST_F(ConnectorTest, reInitTest) {
@@ -138,8 +141,8 @@ namespace WaterMeterCppTest {
         wifiMock.setIsConnected(false);
         expectConnectWithState(ConnectionState::Disconnected, "Disconnected");
         EXPECT_STREQ("", getPrintOutput()) << "Print buffer empty end";
-        EXPECT_FALSE(uxQueueMessagesWaiting(queueClient1.getQueueHandle())) << "queueClient1 ok";
-        EXPECT_FALSE(uxQueueMessagesWaiting(communicatorQueueClient.getQueueHandle())) << "communicatorQueueClient ok";
+        EXPECT_FALSE(eventBus.receive(TaskId::Sampler)) << "Nothing for the sampler";
+        EXPECT_FALSE(eventBus.receive(TaskId::Communicator)) << "Nothing for the communicator";
     }
 
     TEST_F(ConnectorTest, scriptTest) {
@@ -167,12 +170,10 @@ namespace WaterMeterCppTest {
         expectConnectWithState(ConnectionState::MqttConnecting, "Connecting to MQTT 1");
         expectConnectWithState(ConnectionState::MqttConnected, "Connected to MQTT 1");
 
-        const auto timestampReady = micros();
         EXPECT_EQ(ConnectionState::MqttReady, connector.loop()) << "MQTT ready";
-
-        // we're doing the division to filter out the few micros that the statement costs
-        EXPECT_EQ(50UL, (micros() - timestampReady) / 1000UL) << "50 ms wait time when ready";
+        EXPECT_EQ(0UL, connector.waitMillis()) << "No wait after a state change";
         expectConnectWithState(ConnectionState::MqttReady, "MQTT stays ready if nothing changes");
+        EXPECT_EQ(50UL, connector.waitMillis()) << "Poll every 50 ms when ready";
 
         // disconnecting Wi-Fi should change state to Disconnected
         wifiMock.setIsConnected(false);
@@ -198,6 +199,9 @@ namespace WaterMeterCppTest {
         expectConnectWithState(ConnectionState::WifiReady, "back to Wifi Ready");
         expectConnectWithState(ConnectionState::MqttConnecting, "Connecting to MQTT 3");
         expectConnectWithState(ConnectionState::WaitingForMqttReconnect, "awaiting MQTT timeout");
+        expectConnectWithState(ConnectionState::WaitingForMqttReconnect, "still awaiting MQTT timeout");
+        EXPECT_GT(connector.waitMillis(), 0UL) << "Sleeps while waiting for the reconnect";
+        EXPECT_LE(connector.waitMillis(), 2000UL) << "Sleeps no longer than the reconnect wait";
         delay(2000);
         expectConnectWithState(ConnectionState::WifiReady, "done waiting, back to Wifi Ready");
 
@@ -226,6 +230,91 @@ namespace WaterMeterCppTest {
         EXPECT_STREQ("", getPrintOutput()) << "Print buffer empty end";
     }
 
+    TEST_F(ConnectorTest, parallelBringUpTest) {
+        EXPECT_STREQ("", getPrintOutput()) << "Print buffer empty start";
+        // a firmware manager of its own, so the check after a reboot isn't used up by the other tests
+        FirmwareManager bringUpFirmwareManager(&eventServer, &wifiClientFactory, &firmwareConfig, "0.99.3");
+        Connector bringUpConnector(&eventServer, &wifiMock, &mqttGatewayMock, &timeServer, &bringUpFirmwareManager,
+            &dataQueue, &commsDataQueue, &serializer, &eventBus);
+        auto expectState = [&](const ConnectionState state, const char* message) {
+            EXPECT_EQ(state, bringUpConnector.connect()) << message;
+        };
+        // a failing version check shows up as a connection error, so we can see when the check ran
+        HTTPClient::ReturnValue = 404;
+        TestEventClient errorListener(&eventServer);
+        eventServer.subscribe(&errorListener, Topic::ConnectionError);
+        TestEventClient sensorDataListener(&eventServer);
+        eventServer.subscribe(&sensorDataListener, Topic::SensorData);
+        while (dataQueue.receive() != nullptr) {}
+
+        timeServer.reset();
+        timeServer.setResponding(false);
+        bringUpConnector.begin(&configuration, true);
+        wifiMock.setNeedsReconnect(false);
+        wifiMock.setIsConnected(true);
+        mqttGatewayMock.setIsConnected(true);
+
+        expectState(ConnectionState::WifiConnecting, "Wifi connecting");
+        expectState(ConnectionState::WifiConnected, "Wifi connected");
+        expectState(ConnectionState::WifiReady, "Time requested, straight to Wifi ready");
+
+        // the time has not come in yet, but MQTT does not need to wait for it
+        expectState(ConnectionState::MqttConnecting, "Connecting to MQTT without time");
+        expectState(ConnectionState::MqttConnected, "Connected to MQTT without time");
+        expectState(ConnectionState::MqttReady, "MQTT ready without time");
+
+        // sensor data needs the time for its timestamps
+        DataQueuePayload samples{};
+        samples.topic = Topic::Samples;
+        samples.buffer.samples.count = 1;
+        ASSERT_TRUE(dataQueue.send(&samples)) << "Samples queued";
+        expectState(ConnectionState::MqttReady, "MQTT stays ready while waiting for time");
+        EXPECT_EQ(0, sensorDataListener.getCallCount()) << "Sensor data stays queued without time";
+        EXPECT_EQ(0, errorListener.getCallCount()) << "No firmware check without time";
+
+        // the time comes in while MQTT is down: the firmware check doesn't wait for MQTT
+        mqttGatewayMock.setIsConnected(false);
+        expectState(ConnectionState::WifiReady, "MQTT dropped");
+        expectState(ConnectionState::MqttConnecting, "Connecting to MQTT again");
+        expectState(ConnectionState::WaitingForMqttReconnect, "Waiting for MQTT");
+        timeServer.setResponding(true);
+        timeServer.setTime();
+        expectState(ConnectionState::WaitingForMqttReconnect, "Still waiting for MQTT with time");
+        EXPECT_EQ(1, errorListener.getCallCount()) << "Firmware checked while MQTT is down";
+        EXPECT_STREQ("Firmware version check failed with response code 404. URL:", errorListener.getPayload()) << "Version check";
+        EXPECT_EQ(0, sensorDataListener.getCallCount()) << "Sensor data waits for MQTT";
+
+        mqttGatewayMock.setIsConnected(true);
+        delay(2000);
+        expectState(ConnectionState::WifiReady, "Done waiting");
+        expectState(ConnectionState::MqttConnecting, "Connecting to MQTT with time");
+        expectState(ConnectionState::MqttConnected, "Connected to MQTT with time");
+        expectState(ConnectionState::MqttReady, "MQTT ready with time");
+        expectState(ConnectionState::MqttReady, "MQTT stays ready");
+        EXPECT_EQ(1, sensorDataListener.getCallCount()) << "Sensor data sent once the time is set";
+        EXPECT_EQ(1, errorListener.getCallCount()) << "Firmware checked only once";
+
+        // TLS certificates can't be validated without the time, so then MQTT waits for it
+        configuration.mqtt.useTls = true;
+        timeServer.reset();
+        timeServer.setResponding(false);
+        bringUpConnector.begin(&configuration, true);
+        expectState(ConnectionState::WifiConnecting, "TLS: Wifi connecting");
+        expectState(ConnectionState::WifiConnected, "TLS: Wifi connected");
+        expectState(ConnectionState::WifiReady, "TLS: Time requested");
+        expectState(ConnectionState::WifiReady, "TLS: waiting for time");
+        expectState(ConnectionState::WifiReady, "TLS: still waiting for time");
+        timeServer.setResponding(true);
+        timeServer.setTime();
+        expectState(ConnectionState::MqttConnecting, "TLS: connecting to MQTT with time");
+        configuration.mqtt.useTls = false;
+        EXPECT_EQ(1, errorListener.getCallCount()) << "No new firmware check after the reboot one";
+
+        eventServer.unsubscribe(&errorListener);
+        eventServer.unsubscribe(&sensorDataListener);
+        EXPECT_STREQ("", getPrintOutput()) << "Print buffer empty end";
+    }
+
     TEST_F(ConnectorTest, timeFailTest) {
         EXPECT_STREQ("", getPrintOutput()) << "Print buffer empty start";
 
@@ -259,27 +348,24 @@ namespace WaterMeterCppTest {
         connector.begin(&configuration);
         constexpr char Buffer[] = "12345.6789012";
         EventServer receivingEventServer;
-        QueueClient receivingQueueClient(&receivingEventServer, &logger, 20);
-        communicatorQueueClient.begin(receivingQueueClient.getQueueHandle());
-        receivingQueueClient.begin();
+        EventServer unusedEventServer;
+        // a started bus with the connector's event server, so the routes to the communicator are in place
+        EventBus startedBus(&unusedEventServer, &receivingEventServer, &eventServer, &logger);
+        startedBus.begin();
         eventServer.publish(Topic::SetVolume, Buffer);
         // now the entry is in the queue. Pick it up at the other end.
         TestEventClient client(&receivingEventServer);
         receivingEventServer.subscribe(&client, Topic::SetVolume);
-        receivingQueueClient.receive();
+        EXPECT_TRUE(startedBus.receive(TaskId::Communicator)) << "Communicator received";
+        EXPECT_FALSE(startedBus.receive(TaskId::Communicator)) << "Nothing else for the communicator";
+        EXPECT_EQ(1UL, startedBus.messageCount(TaskId::Communicator)) << "Message counted";
 
         EXPECT_EQ(1, client.getCallCount()) << "Test client called";
         EXPECT_STREQ("12345.6789012", client.getPayload()) << "Payload ok";
         EXPECT_STREQ("", getPrintOutput()) << "Print buffer empty end";
 
-        EXPECT_FALSE(uxQueueMessagesWaiting(queueClient1.getQueueHandle())) << "queueClient1 ok";
-        EXPECT_FALSE(uxQueueMessagesWaiting(communicatorQueueClient.getQueueHandle())) << "communicatorQueueClient ok";
-        // make sure the client has no send queue for the other tests
-        communicatorQueueClient.begin();
-        EXPECT_FALSE(uxQueueMessagesWaiting(queueClient1.getQueueHandle())) << "queueClient1 ok";
-        EXPECT_FALSE(uxQueueMessagesWaiting(communicatorQueueClient.getQueueHandle())) << "communicatorQueueClient ok";
-
-        EXPECT_STREQ("", getPrintOutput()) << "Print buffer empty end";
+        EXPECT_FALSE(eventBus.receive(TaskId::Sampler)) << "Nothing for the sampler";
+        EXPECT_FALSE(eventBus.receive(TaskId::Communicator)) << "Nothing for the communicator";
     }
 
     TEST_F(ConnectorTest, wifiInitTest) {
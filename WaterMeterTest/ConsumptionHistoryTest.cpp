@@ -0,0 +1,170 @@
+// Copyright 2024 Rik Essenius
+// 
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License. You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and limitations under the License.
+
+#include "gtest/gtest.h"
+#include "ConsumptionHistory.h"
+#include "EventServer.h"
+#include "TestEventClient.h"
+
+namespace WaterMeterCppTest {
+    using WaterMeter::ConsumptionHistory;
+    using WaterMeter::EventServer;
+    using WaterMeter::HistoryRing;
+    using WaterMeter::PayloadBuilder;
+
+    // 2024-01-01T00:00:00Z
+    constexpr uint32_t Now = 1704067200;
+
+    class ConsumptionHistoryTest : public testing::Test {
+    protected:
+        EventServer eventServer;
+        Preferences preferences;
+        PayloadBuilder payloadBuilder;
+
+        void SetUp() override {
+            // start without history saved by earlier tests
+            preferences.begin("history", false);
+            preferences.clear();
+            preferences.end();
+        }
+    };
+
+    TEST_F(ConsumptionHistoryTest, ringTest) {
+        HistoryRing<uint16_t, 4> ring(10);
+        EXPECT_TRUE(ring.add(100)) << "First pulse starts a period";
+        EXPECT_FALSE(ring.add(105)) << "Same period";
+        EXPECT_EQ(2, ring.at(10)) << "Two pulses in period 10";
+        EXPECT_TRUE(ring.add(130)) << "New period";
+        EXPECT_EQ(0, ring.at(11)) << "Skipped period is empty";
+        EXPECT_EQ(2, ring.at(10)) << "Period 10 still there";
+        EXPECT_FALSE(ring.add(95)) << "Clock going back doesn't start a period";
+        EXPECT_EQ(2, ring.at(13)) << "Counted in the latest period";
+        EXPECT_TRUE(ring.add(160)) << "Period 16";
+        EXPECT_EQ(0, ring.at(10)) << "Period 10 fell off";
+        EXPECT_EQ(0, ring.at(12)) << "Period 12 fell off";
+        EXPECT_EQ(2, ring.at(13)) << "Period 13 is the oldest left";
+        EXPECT_EQ(0, ring.at(17)) << "Future period is empty";
+        EXPECT_TRUE(ring.add(1000)) << "Far ahead";
+        EXPECT_EQ(0, ring.at(13)) << "Everything cleared";
+        EXPECT_EQ(1, ring.at(100)) << "Only the new pulse";
+
+        HistoryRing<uint8_t, 2> smallRing(1);
+        for (int i = 0; i < 300; i++) smallRing.add(5);
+        EXPECT_EQ(255, smallRing.at(5)) << "Count saturates";
+    }
+
+    TEST_F(ConsumptionHistoryTest, queryTest) {
+        ConsumptionHistory history(&eventServer, &preferences, &payloadBuilder);
+        history.begin();
+
+        history.addPulse(1000);
+        history.addPulse(Now - 120);
+        history.addPulse(Now - 60);
+        history.addPulse(Now - 59);
+        history.addPulse(Now);
+
+        EXPECT_STREQ(R"({"tier":"minute","start":"2023-12-31T23:58:00.000000Z","interval":60,"pulses":[1,2,1]})",
+            history.query("minute,3", Now)) << "Minutes OK, pulse before the time was set ignored";
+        EXPECT_STREQ(R"({"tier":"hour","start":"2023-12-31T23:00:00.000000Z","interval":3600,"pulses":[3,1]})",
+            history.query("hour,2,0", Now)) << "Hours OK";
+        EXPECT_STREQ(R"({"tier":"day","start":"2023-12-31T00:00:00.000000Z","interval":86400,"pulses":[3]})",
+            history.query("day,1,1", Now)) << "Skip OK";
+        EXPECT_STREQ(R"({"tier":"minute","start":"2023-12-31T23:59:00.000000Z","interval":60,"pulses":[2,1,0]})",
+            history.query("minute,3", Now + 60)) << "Query moves with the time";
+        EXPECT_EQ(nullptr, history.query("week", Now)) << "Unknown tier";
+        EXPECT_EQ(nullptr, history.query("hour,x", Now)) << "Invalid count";
+        EXPECT_EQ(nullptr, history.query("hour,1,2,3", Now)) << "Too many parameters";
+        EXPECT_EQ(nullptr, history.query("centuries", Now)) << "Tier too long";
+        EXPECT_EQ(nullptr, history.query("minute,3,1440", Now)) << "Skip past the minutes";
+        EXPECT_EQ(nullptr, history.query("day,1,365", Now)) << "Skip past the days";
+        EXPECT_NE(nullptr, history.query("day,1,364", Now)) << "Skip to the oldest day OK";
+        EXPECT_EQ(nullptr, history.query("minute,1,3", 120)) << "Skip before the epoch";
+        const std::string early = history.query("minute,5", 120);
+        EXPECT_NE(std::string::npos, early.find(R"("start":"1970-01-01T00:00:00.000000Z")")) << "Count clipped at the epoch";
+
+        const std::string fullDay = history.query("day", Now);
+        EXPECT_NE(std::string::npos, fullDay.find(R"("pulses":[0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,3,1])")) << "Default count";
+
+        // everything older than a day is gone from the minutes
+        history.addPulse(Now + 86400);
+        EXPECT_STREQ(R"({"tier":"minute","start":"2024-01-01T23:59:00.000000Z","interval":60,"pulses":[0,1]})",
+            history.query("minute,2", Now + 86400)) << "Old minutes cleared";
+        EXPECT_STREQ(R"({"tier":"hour","start":"2023-12-31T23:00:00.000000Z","interval":3600,"pulses":[3,1]})",
+            history.query("hour,2,24", Now + 86400)) << "Hours still there";
+    }
+
+    TEST_F(ConsumptionHistoryTest, persistTest) {
+        {
+            ConsumptionHistory history(&eventServer, &preferences, &payloadBuilder);
+            history.begin();
+            history.addPulse(Now - 10);
+            history.addPulse(Now - 5);
+            // a new hour saves the rings
+            history.addPulse(Now + 3600);
+        }
+        ConsumptionHistory restored(&eventServer, &preferences, &payloadBuilder);
+        restored.begin();
+        EXPECT_STREQ(R"({"tier":"hour","start":"2023-12-31T23:00:00.000000Z","interval":3600,"pulses":[2,0,1]})",
+            restored.query("hour,3", Now + 3600)) << "Restored from preferences";
+    }
+
+    TEST_F(ConsumptionHistoryTest, chunkTest) {
+        using MinuteRing = HistoryRing<uint16_t, ConsumptionHistory::MinuteCount>;
+        EXPECT_EQ(12, MinuteRing::ChunkCount) << "A day of minutes takes 12 chunks";
+        EXPECT_EQ(7, (HistoryRing<uint32_t, ConsumptionHistory::DayCount>::ChunkCount)) << "The last day chunk is partial";
+
+        MinuteRing minutes(60);
+        minutes.add(Now);
+        EXPECT_EQ(0xFFFU, minutes.dirtyChunks()) << "Starting a ring clears and dirties all chunks";
+        preferences.begin("history", false);
+        EXPECT_TRUE(minutes.save(&preferences, 'm')) << "All chunks saved";
+        EXPECT_EQ(0U, minutes.dirtyChunks()) << "Nothing left to save";
+
+        // Now is at the start of the ring, so the next minute is in the first chunk as well
+        minutes.add(Now + 60);
+        EXPECT_EQ(1U, minutes.dirtyChunks()) << "Only the first chunk changed";
+        EXPECT_TRUE(minutes.save(&preferences, 'm')) << "Changed chunk saved";
+        preferences.end();
+
+        MinuteRing restored(60);
+        preferences.begin("history", true);
+        restored.load(&preferences, 'm', minutes.lastPeriod());
+        preferences.end();
+        EXPECT_EQ(1, restored.at(Now / 60)) << "First minute restored";
+        EXPECT_EQ(1, restored.at(Now / 60 + 1)) << "Second minute restored";
+        EXPECT_EQ(0U, restored.dirtyChunks()) << "Restored ring is clean";
+
+        MinuteRing incomplete(60);
+        preferences.begin("history", false);
+        preferences.clear();
+        preferences.end();
+        preferences.begin("history", true);
+        incomplete.load(&preferences, 'm', minutes.lastPeriod());
+        preferences.end();
+        EXPECT_EQ(0U, incomplete.lastPeriod()) << "Missing chunks are not loaded";
+    }
+
+    TEST_F(ConsumptionHistoryTest, eventTest) {
+        ConsumptionHistory history(&eventServer, &preferences, &payloadBuilder);
+        TestEventClient resultListener(&eventServer);
+        TestEventClient errorListener(&eventServer);
+        eventServer.subscribe(&resultListener, Topic::HistoryFormatted);
+        eventServer.subscribe(&errorListener, Topic::ErrorFormatted);
+        eventServer.publish(Topic::Begin, true);
+
+        eventServer.publish(Topic::History, "day,1");
+        EXPECT_EQ(1, resultListener.getCallCount()) << "Result published";
+        EXPECT_EQ(0, strncmp(R"({"tier":"day","start":")", resultListener.getPayload(), 23)) << "Result payload OK";
+        eventServer.publish(Topic::History, "year");
+        EXPECT_EQ(1, errorListener.getCallCount()) << "Error published";
+        EXPECT_STREQ("History: invalid query", errorListener.getPayload()) << "Error payload OK";
+    }
+}
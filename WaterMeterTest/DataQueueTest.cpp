@@ -42,6 +42,136 @@ namespace WaterMeterCppTest {
         ASSERT_FALSE(dataQueue.send(&payload));
     }
 
+    TEST(DataQueueTest, laneTest) {
+        EventServer eventServer;
+        DataQueuePayload payload{};
+        DataQueue singleLane(&eventServer, &payload);
+        EXPECT_EQ(singleLane.handle(), singleLane.handle(Topic::Result)) << "Without lane sizes, results share the buffer";
+
+        DataQueue dataQueue(&eventServer, &payload, 0, 8192, 1024, 2048, 2048, 1024);
+        EXPECT_NE(dataQueue.handle(), dataQueue.handle(Topic::Result)) << "Results have their own lane";
+        EXPECT_NE(dataQueue.handle(), dataQueue.handle(Topic::Info)) << "Messages have their own lane";
+        EXPECT_EQ(dataQueue.handle(Topic::Info), dataQueue.handle(Topic::ConnectionError)) << "Errors go with messages";
+        EXPECT_EQ(dataQueue.handle(), dataQueue.handle(Topic::Trace)) << "Traces go with the samples";
+
+        payload.topic = Topic::Samples;
+        payload.buffer.samples.count = 1;
+        payload.buffer.samples.value[0] = {{10, 20}};
+        EXPECT_TRUE(dataQueue.send(&payload)) << "Samples sent";
+        dataQueue.update(Topic::Info, "Hello");
+        payload.topic = Topic::Result;
+        payload.buffer.result = {};
+        payload.buffer.result.sampleCount = 81;
+        EXPECT_TRUE(dataQueue.send(&payload)) << "Result sent";
+
+        // the result comes first, then the message, and the samples last
+        auto received = dataQueue.receive();
+        ASSERT_NE(nullptr, received) << "Result received";
+        EXPECT_EQ(Topic::Result, received->topic) << "Result first";
+        EXPECT_EQ(81U, received->buffer.result.sampleCount) << "Sample count OK";
+        received = dataQueue.receive();
+        ASSERT_NE(nullptr, received) << "Message received";
+        EXPECT_EQ(Topic::Info, received->topic) << "Message second";
+        EXPECT_STREQ("Hello", received->buffer.message) << "Message OK";
+        received = dataQueue.receive();
+        ASSERT_NE(nullptr, received) << "Samples received";
+        EXPECT_EQ(Topic::Samples, received->topic) << "Samples last";
+        EXPECT_EQ(nullptr, dataQueue.receive()) << "Queue empty";
+        EXPECT_EQ(0UL, dataQueue.droppedCount()) << "Nothing dropped";
+    }
+
+    TEST(DataQueueTest, overflowTest) {
+        EventServer eventServer;
+        DataQueuePayload payload{};
+        DataQueue dataQueue(&eventServer, &payload, 0, 8192, 1024, 2048, 2048);
+        payload.topic = Topic::Samples;
+        payload.buffer.samples.count = 1;
+        int samples = 0;
+        while (samples < 100 && dataQueue.send(&payload)) samples++;
+        EXPECT_LT(0, samples) << "Samples sent";
+        EXPECT_FALSE(dataQueue.canSend(&payload)) << "Samples can't push out samples";
+
+        // results fill their own lane, then push out the samples, and finally block
+        payload.topic = Topic::Result;
+        payload.buffer.result = {};
+        uint32_t results = 0;
+        while (results < 200 && dataQueue.canSend(&payload)) {
+            payload.buffer.result.sampleCount = results + 1;
+            if (!dataQueue.send(&payload)) break;
+            results++;
+        }
+        EXPECT_GT(200U, results) << "Results got blocked";
+        EXPECT_FALSE(dataQueue.canSend(&payload)) << "Results can't push out earlier results";
+        EXPECT_LT(0UL, dataQueue.droppedCount()) << "Samples were dropped";
+
+        // no result was lost or moved out of order
+        uint32_t received = 0;
+        const DataQueuePayload* item;
+        while ((item = dataQueue.receive()) != nullptr) {
+            if (item->topic != Topic::Result) continue;
+            received++;
+            EXPECT_EQ(received, item->buffer.result.sampleCount) << "Result " << received << " in order";
+        }
+        EXPECT_EQ(results, received) << "All results received";
+    }
+
+    TEST(DataQueueTest, overflowOrderTest) {
+        EventServer eventServer;
+        DataQueuePayload payload{};
+        DataQueue dataQueue(&eventServer, &payload, 0, 8192, 1024, 2048, 2048);
+        payload.topic = Topic::Result;
+        payload.buffer.result = {};
+        const auto resultLane = dataQueue.handle(Topic::Result);
+        uint32_t sent = 0;
+        while (sent < 100 && xRingbufferGetCurFreeSize(resultLane) >= DataQueue::requiredSize(payload.size())) {
+            payload.buffer.result.sampleCount = ++sent;
+            ASSERT_TRUE(dataQueue.send(&payload)) << "Result " << sent << " sent to its lane";
+        }
+        payload.buffer.result.sampleCount = ++sent;
+        EXPECT_TRUE(dataQueue.send(&payload)) << "Result overflowed to the bulk lane";
+
+        auto received = dataQueue.receive();
+        ASSERT_NE(nullptr, received) << "First result received";
+        EXPECT_EQ(1U, received->buffer.result.sampleCount) << "Oldest result first";
+
+        // the result lane has room again, but the overflowed result must go out first
+        payload.buffer.result.sampleCount = ++sent;
+        EXPECT_TRUE(dataQueue.send(&payload)) << "Newer result sent";
+        uint32_t expected = 2;
+        while ((received = dataQueue.receive()) != nullptr) {
+            EXPECT_EQ(expected, received->buffer.result.sampleCount) << "Result " << expected << " in order";
+            expected++;
+        }
+        EXPECT_EQ(sent + 1, expected) << "All results received";
+    }
+
+    TEST(DataQueueTest, reserveTest) {
+        EventServer eventServer;
+        DataQueuePayload payload{};
+        DataQueue dataQueue(&eventServer, &payload);
+        payload.topic = Topic::Samples;
+        payload.buffer.samples.count = 1;
+        payload.buffer.samples.value[0] = {{10, 20}};
+
+        size_t reservations = 0;
+        while (dataQueue.reserve(payload.size(), payload.topic)) reservations++;
+        EXPECT_LT(0U, reservations) << "Could reserve";
+        EXPECT_FALSE(dataQueue.canSend(&payload)) << "Reserved room is not available to others";
+        EXPECT_FALSE(dataQueue.send(&payload)) << "Send fails";
+
+        dataQueue.release(payload.size(), payload.topic);
+        EXPECT_TRUE(dataQueue.canSend(&payload)) << "Released room is available again";
+
+        // a commit uses its reservation, so it doesn't need to check the room again
+        EXPECT_TRUE(dataQueue.commit(&payload, payload.size())) << "Committed";
+
+        const auto received = dataQueue.receive();
+        ASSERT_NE(nullptr, received) << "Committed payload received";
+        EXPECT_EQ(Topic::Samples, received->topic) << "Topic OK";
+        EXPECT_EQ(1U, static_cast<unsigned>(received->buffer.samples.count)) << "Count OK";
+        EXPECT_EQ(payload.buffer.samples.value[0], received->buffer.samples.value[0]) << "Sample OK";
+    }
+
     TEST(DataQueueTest, test1) {
         EventServer eventServer;
         Clock theClock(&eventServer);
@@ -0,0 +1,149 @@
+// Copyright 2024 Rik Essenius
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License. You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and limitations under the License.
+
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <unordered_map>
+
+#include "DeltaEncoder.h"
+#include "FirmwareDelta.h"
+
+namespace WaterMeterCppTest {
+    using WaterMeter::DeltaFirmwareSink;
+
+    namespace {
+        uint64_t keyAt(const std::vector<uint8_t>& buffer, const size_t position) {
+            uint64_t key;
+            memcpy(&key, buffer.data() + position, sizeof key);
+            return key;
+        }
+    }
+
+    std::vector<uint8_t> DeltaEncoder::encode(const std::vector<uint8_t>& source, const std::vector<uint8_t>& target) {
+        // index the first occurrence of every key in the source
+        std::unordered_map<uint64_t, uint32_t> index;
+        for (size_t i = 0; i + KeySize <= source.size(); i++) {
+            index.emplace(keyAt(source, i), static_cast<uint32_t>(i));
+        }
+
+        std::vector<uint8_t> delta;
+        appendField(delta, DeltaFirmwareSink::Magic);
+        appendField(delta, static_cast<uint32_t>(target.size()));
+        appendField(delta, DeltaFirmwareSink::checksum(DeltaFirmwareSink::InitialChecksum, target.data(), target.size()));
+        appendField(delta, static_cast<uint32_t>(source.size()));
+
+        std::vector<uint8_t> data;
+        long long alignment = 0;
+        size_t position = 0;
+        while (position < target.size()) {
+            // exact match
+            if (position + KeySize <= target.size()) {
+                const auto found = index.find(keyAt(target, position));
+                if (found != index.end()) {
+                    const size_t from = found->second;
+                    size_t length = 0;
+                    while (from + length < source.size() && position + length < target.size() &&
+                        source[from + length] == target[position + length]) {
+                        length++;
+                    }
+                    if (length >= MinimumMatch) {
+                        flushData(delta, data);
+                        delta.push_back(DeltaFirmwareSink::Copy);
+                        appendField(delta, static_cast<uint32_t>(from));
+                        appendField(delta, static_cast<uint32_t>(length));
+                        alignment = static_cast<long long>(from) - static_cast<long long>(position);
+                        position += length;
+                        continue;
+                    }
+                }
+            }
+
+            // approximate match along the last alignment: keep the length where matches outnumber mismatches most
+            const long long from = static_cast<long long>(position) + alignment;
+            if (from >= 0 && static_cast<size_t>(from) < source.size()) {
+                long score = 0;
+                long bestScore = 0;
+                size_t bestLength = 0;
+                for (size_t i = 0; position + i < target.size() && static_cast<size_t>(from) + i < source.size(); i++) {
+                    score += source[from + i] == target[position + i] ? 1 : -1;
+                    if (score > bestScore) {
+                        bestScore = score;
+                        bestLength = i + 1;
+                    }
+                    if (score < bestScore - static_cast<long>(MinimumMatch)) break;
+                }
+                if (bestLength >= MinimumMatch) {
+                    flushData(delta, data);
+                    delta.push_back(DeltaFirmwareSink::Add);
+                    appendField(delta, static_cast<uint32_t>(from));
+                    appendField(delta, static_cast<uint32_t>(bestLength));
+                    appendDiffs(delta, source, static_cast<size_t>(from), target, position, bestLength);
+                    position += bestLength;
+                    continue;
+                }
+            }
+            data.push_back(target[position++]);
+        }
+        flushData(delta, data);
+        return delta;
+    }
+
+    bool DeltaEncoder::encodeFile(const char* sourceFileName, const char* targetFileName, const char* deltaFileName) {
+        std::vector<uint8_t> source;
+        std::vector<uint8_t> target;
+        if (!readFile(sourceFileName, source) || !readFile(targetFileName, target)) return false;
+        const std::vector<uint8_t> delta = encode(source, target);
+        std::ofstream output(deltaFileName, std::ios::binary);
+        output.write(reinterpret_cast<const char*>(delta.data()), static_cast<std::streamsize>(delta.size()));
+        return output.good();
+    }
+
+    void DeltaEncoder::appendField(std::vector<uint8_t>& delta, const uint32_t value) {
+        for (int i = 0; i < 4; i++) {
+            delta.push_back(static_cast<uint8_t>(value >> (8 * i)));
+        }
+    }
+
+    // unchanged bytes go in as a 0 followed by the run length minus one
+    void DeltaEncoder::appendDiffs(std::vector<uint8_t>& delta, const std::vector<uint8_t>& source, const size_t from,
+        const std::vector<uint8_t>& target, const size_t position, const size_t length) {
+        size_t i = 0;
+        while (i < length) {
+            const auto diff = static_cast<uint8_t>(target[position + i] - source[from + i]);
+            if (diff != 0) {
+                delta.push_back(diff);
+                i++;
+                continue;
+            }
+            size_t run = 1;
+            while (i + run < length && run < 256 && target[position + i + run] == source[from + i + run]) run++;
+            delta.push_back(0);
+            delta.push_back(static_cast<uint8_t>(run - 1));
+            i += run;
+        }
+    }
+
+    void DeltaEncoder::flushData(std::vector<uint8_t>& delta, std::vector<uint8_t>& data) {
+        if (data.empty()) return;
+        delta.push_back(DeltaFirmwareSink::Data);
+        appendField(delta, static_cast<uint32_t>(data.size()));
+        delta.insert(delta.end(), data.begin(), data.end());
+        data.clear();
+    }
+
+    bool DeltaEncoder::readFile(const char* fileName, std::vector<uint8_t>& content) {
+        std::ifstream input(fileName, std::ios::binary);
+        if (!input) return false;
+        content.assign(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+        return true;
+    }
+}
@@ -0,0 +1,38 @@
+// Copyright 2024 Rik Essenius
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License. You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and limitations under the License.
+
+// Creates the firmware deltas that DeltaFirmwareSink applies (see FirmwareDelta.h for the format).
+// Exact matches with the old image become copies; where the alignment of the last match still mostly holds
+// (code where only addresses moved), it writes the byte differences as an add, with runs of unchanged bytes collapsed.
+// Everything else goes in as data. encodeFile() creates device-name-build.delta from two .bin files.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace WaterMeterCppTest {
+    class DeltaEncoder {
+    public:
+        static std::vector<uint8_t> encode(const std::vector<uint8_t>& source, const std::vector<uint8_t>& target);
+        static bool encodeFile(const char* sourceFileName, const char* targetFileName, const char* deltaFileName);
+    private:
+        static constexpr size_t KeySize = 8;
+        static constexpr size_t MinimumMatch = 16;
+
+        static void appendDiffs(std::vector<uint8_t>& delta, const std::vector<uint8_t>& source, size_t from,
+            const std::vector<uint8_t>& target, size_t position, size_t length);
+        static void appendField(std::vector<uint8_t>& delta, uint32_t value);
+        static void flushData(std::vector<uint8_t>& delta, std::vector<uint8_t>& data);
+        static bool readFile(const char* fileName, std::vector<uint8_t>& content);
+    };
+}
@@ -16,7 +16,11 @@
 
 namespace WaterMeterCppTest {
     using WaterMeter::Device;
-    
+
+    void nextStackScan() {
+        delay(Device::StackScanIntervalMicros / 1000);
+    }
+
     // ReSharper disable once CyclomaticComplexity -- caused by EXPECT macros
     TEST(DeviceTest, test1) {
         EventServer eventServer;
@@ -26,7 +30,7 @@ namespace WaterMeterCppTest {
         uxTaskGetStackHighWaterMarkReset();
         Device device(&eventServer);
         // ensure that nothing breaks when we call it too early
-        device.reportHealth();
+        EXPECT_EQ(Device::HeapIntervalMicros, device.reportHealth()) << "Without task handles, only the heap is due";
         EXPECT_EQ(0, stackListener.getCallCount()) << "Stack not called as not yet initialized";
         EXPECT_EQ(1, heapListener.getCallCount()) << "Heap called as does not need task handles";
         EXPECT_STREQ("32000", heapListener.getPayload()) << "Free heap is 32k";
@@ -37,35 +41,48 @@ namespace WaterMeterCppTest {
         EXPECT_EQ(3, stackListener.getCallCount()) << "Stack called three times";
         EXPECT_EQ(1, heapListener.getCallCount()) << "Heap not called again - 29k does not pass lower limit of 25k";
         EXPECT_STREQ("33558182", stackListener.getPayload()) << "Free stack for sampler is 2-3750 (due to nullptr handles)";
+        nextStackScan();
         device.reportHealth();
         EXPECT_EQ(4, stackListener.getCallCount()) << "Stack called again - different value";
         EXPECT_EQ(1, heapListener.getCallCount()) << "Heap not called again - 26k does not pass new lower limit of 25k";
         EXPECT_STREQ("1564", stackListener.getPayload()) << "Free stack is 1564";
 
+        nextStackScan();
         device.reportHealth();
         EXPECT_EQ(5, stackListener.getCallCount()) << "Stack called yet again";
         EXPECT_EQ(2, heapListener.getCallCount()) << "Heap called again, passed lower limit of 25k";
         EXPECT_STREQ("1628", stackListener.getPayload()) << "Free stack is 1628";
+        nextStackScan();
         device.reportHealth();
         EXPECT_EQ(5, stackListener.getCallCount()) << "Stack not called as still the same";
         EXPECT_EQ(2, heapListener.getCallCount()) << "Heap not called as not below limit/threshold (20k is edge case)";
         EXPECT_STREQ("23000", heapListener.getPayload()) << "Free heap is 23k";
+        nextStackScan();
         device.reportHealth();
         EXPECT_EQ(5, stackListener.getCallCount()) << "Stack still not called as still the same";
         EXPECT_EQ(3, heapListener.getCallCount()) << "Heap called as below low threshold";
         EXPECT_STREQ("17000", heapListener.getPayload()) << "Free heap is 17k";
+        nextStackScan();
         device.reportHealth();
         EXPECT_EQ(6, stackListener.getCallCount()) << "Stack called as different value";
         EXPECT_EQ(4, heapListener.getCallCount()) << "Heap called as below low threshold";
         EXPECT_STREQ("1500", stackListener.getPayload()) << "Free stack is 1500";
         EXPECT_STREQ("14000", heapListener.getPayload()) << "Free heap is 14000";
+        nextStackScan();
         device.reportHealth();
         EXPECT_EQ(4, heapListener.getCallCount()) << "Heap not called as same value (even below low threshold)";
+        nextStackScan();
         device.reportHealth();
         EXPECT_EQ(5, heapListener.getCallCount()) << "Heap called as below low threshold again";
         EXPECT_STREQ("11000", heapListener.getPayload()) << "Free heap is 11000";
+        nextStackScan();
         device.reportHealth();
         EXPECT_EQ(6, heapListener.getCallCount()) << "Heap called as large enough difference (up)";
         EXPECT_STREQ("32000", heapListener.getPayload()) << "Free heap is 32000";
+
+        // stack scans are expensive, so they don't run before the interval passed
+        const auto stackCallCount = stackListener.getCallCount();
+        EXPECT_EQ(Device::HeapIntervalMicros, device.reportHealth()) << "Heap check is the next deadline";
+        EXPECT_EQ(stackCallCount, stackListener.getCallCount()) << "Stack not scanned before the interval passed";
     }
 }
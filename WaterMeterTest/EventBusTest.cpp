@@ -0,0 +1,139 @@
+// Copyright 2024 Rik Essenius
+// 
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License. You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and limitations under the License.
+
+#include "gtest/gtest.h"
+#include "EventBus.h"
+#include <SafeCString.h>
+#include "TestEventClient.h"
+#include "freertos/ringbuf.h"
+
+namespace WaterMeterCppTest {
+    using WaterMeter::EventBus;
+    using WaterMeter::Log;
+    using WaterMeter::MessageArena;
+    using WaterMeter::TaskId;
+
+    TEST(EventBusTest, routeTest) {
+        uxQueueReset();
+        uxRingbufReset();
+        EventServer samplerEventServer;
+        EventServer communicatorEventServer;
+        EventServer connectorEventServer;
+        Log logger(&communicatorEventServer, nullptr);
+        EventBus eventBus(&samplerEventServer, &communicatorEventServer, &connectorEventServer, &logger);
+        TestEventClient communicatorClient(&communicatorEventServer);
+        TestEventClient connectorClient(&connectorEventServer);
+        TestEventClient samplerClient(&samplerEventServer);
+        communicatorEventServer.subscribe(&communicatorClient, Topic::Pulse);
+        communicatorEventServer.subscribe(&communicatorClient, Topic::Connection);
+        connectorEventServer.subscribe(&connectorClient, Topic::FreeHeap);
+        connectorEventServer.subscribe(&connectorClient, Topic::Pulse);
+        samplerEventServer.subscribe(&samplerClient, Topic::IdleRate);
+
+        samplerEventServer.publish(Topic::Pulse, 1L);
+        EXPECT_FALSE(eventBus.receive(TaskId::Communicator)) << "Nothing routed before begin";
+
+        eventBus.begin();
+        samplerEventServer.publish(Topic::Pulse, 1L);
+        connectorEventServer.publish(Topic::Connection, 3L);
+        communicatorEventServer.publish(Topic::FreeHeap, 32000L);
+        connectorEventServer.publish(Topic::IdleRate, 50L);
+        // not routed
+        communicatorEventServer.publish(Topic::Pulse, 0L);
+
+        EXPECT_TRUE(eventBus.receive(TaskId::Communicator)) << "Communicator received from sampler";
+        EXPECT_EQ(Topic::Pulse, communicatorClient.getTopic()) << "Sampler message first";
+        EXPECT_TRUE(eventBus.receive(TaskId::Communicator)) << "Communicator received from connector";
+        EXPECT_EQ(Topic::Connection, communicatorClient.getTopic()) << "Connector message next";
+        EXPECT_STREQ("3", communicatorClient.getPayload()) << "Connection payload";
+        EXPECT_FALSE(eventBus.receive(TaskId::Communicator)) << "Communicator done";
+
+        EXPECT_TRUE(eventBus.receive(TaskId::Connector)) << "Connector received";
+        EXPECT_EQ(1, connectorClient.getCallCount()) << "Only the routed topic reached the connector";
+        EXPECT_STREQ("32000", connectorClient.getPayload()) << "Free heap payload";
+        EXPECT_FALSE(eventBus.receive(TaskId::Connector)) << "Connector done";
+
+        EXPECT_TRUE(eventBus.receive(TaskId::Sampler)) << "Sampler received";
+        EXPECT_STREQ("50", samplerClient.getPayload()) << "Idle rate payload";
+        EXPECT_FALSE(eventBus.receive(TaskId::Sampler)) << "Sampler done";
+
+        EXPECT_EQ(1UL, eventBus.messageCount(TaskId::Sampler)) << "Sampler count";
+        EXPECT_EQ(2UL, eventBus.messageCount(TaskId::Communicator)) << "Communicator count";
+        EXPECT_EQ(1UL, eventBus.messageCount(TaskId::Connector)) << "Connector count";
+
+        eventBus.unroute(TaskId::Connector, TaskId::Communicator, Topic::Connection);
+        connectorEventServer.publish(Topic::Connection, 4L);
+        EXPECT_FALSE(eventBus.receive(TaskId::Communicator)) << "Unrouted topic not sent";
+        eventBus.route(TaskId::Connector, TaskId::Communicator, Topic::Connection);
+        connectorEventServer.publish(Topic::Connection, 5L);
+        EXPECT_TRUE(eventBus.receive(TaskId::Communicator)) << "Routed again";
+        EXPECT_STREQ("5", communicatorClient.getPayload()) << "Connection payload after routing again";
+    }
+
+    TEST(EventBusTest, forwardPolicyTest) {
+        uxQueueReset();
+        uxRingbufReset();
+        EventServer samplerEventServer;
+        EventServer communicatorEventServer;
+        EventServer connectorEventServer;
+        Log logger(&communicatorEventServer, nullptr);
+        EventBus eventBus(&samplerEventServer, &communicatorEventServer, &connectorEventServer, &logger);
+        TestEventClient sampleClient(&communicatorEventServer);
+        communicatorEventServer.subscribe(&sampleClient, Topic::Sample);
+        TestEventClient anomalyClient(&communicatorEventServer);
+        communicatorEventServer.subscribe(&anomalyClient, Topic::Anomaly);
+        eventBus.begin();
+
+        // every anomaly gets logged, so they all go across
+        samplerEventServer.publish(Topic::Anomaly, 1L);
+        samplerEventServer.publish(Topic::Anomaly, 2L);
+        samplerEventServer.publish(Topic::Anomaly, 3L);
+        while (eventBus.receive(TaskId::Communicator)) {}
+        EXPECT_EQ(3, anomalyClient.getCallCount()) << "All anomalies forwarded";
+        EXPECT_STREQ("3", anomalyClient.getPayload()) << "Last anomaly";
+
+        // samples are counted, the first one goes out right away
+        for (long i = 0; i < 10; i++) {
+            samplerEventServer.publish(Topic::Sample, i);
+        }
+        while (eventBus.receive(TaskId::Communicator)) {}
+        EXPECT_EQ(1, sampleClient.getCallCount()) << "One sample message";
+        delay(101);
+        eventBus.flush(TaskId::Sampler);
+        while (eventBus.receive(TaskId::Communicator)) {}
+        EXPECT_EQ(2, sampleClient.getCallCount()) << "Flushed count";
+        EXPECT_STREQ("9", sampleClient.getPayload()) << "Remaining samples counted";
+    }
+
+    TEST(EventBusTest, historyQueryTest) {
+        uxQueueReset();
+        uxRingbufReset();
+        EventServer samplerEventServer;
+        EventServer communicatorEventServer;
+        EventServer connectorEventServer;
+        Log logger(&communicatorEventServer, nullptr);
+        MessageArena arena;
+        EventBus eventBus(&samplerEventServer, &communicatorEventServer, &connectorEventServer, &logger, &arena);
+        TestEventClient historyClient(&communicatorEventServer);
+        communicatorEventServer.subscribe(&historyClient, Topic::History);
+        eventBus.begin();
+
+        // the MQTT callback frees its payload buffer right after publishing
+        char payload[20];
+        SafeCString::strcpy(payload, "hour,24,0");
+        connectorEventServer.publish(Topic::History, payload);
+        SafeCString::strcpy(payload, "overwritten");
+
+        EXPECT_TRUE(eventBus.receive(TaskId::Communicator)) << "Query received";
+        EXPECT_STREQ("hour,24,0", historyClient.getPayload()) << "Query survived the sender's buffer";
+        EXPECT_EQ(MessageArena::SlotCount, arena.freeSlots()) << "Arena slot released";
+    }
+}
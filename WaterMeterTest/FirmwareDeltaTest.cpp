@@ -0,0 +1,242 @@
+// Copyright 2024 Rik Essenius
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License. You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and limitations under the License.
+
+#include <cstring>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "DeltaEncoder.h"
+#include "EventServer.h"
+#include "FirmwareDelta.h"
+#include "FirmwareManager.h"
+#include "TestEventClient.h"
+
+#include "HTTPClient.h"
+
+namespace WaterMeterCppTest {
+    using WaterMeter::DeltaFirmwareSink;
+    using WaterMeter::DownloadState;
+    using WaterMeter::FirmwareBase;
+    using WaterMeter::FirmwareConfig;
+    using WaterMeter::FirmwareDownloader;
+    using WaterMeter::FirmwareManager;
+    using WaterMeter::FirmwareSink;
+    using WaterMeter::FirmwareSource;
+    using WaterMeter::WiFiClientFactory;
+
+    class MemoryBase final : public FirmwareBase {
+    public:
+        explicit MemoryBase(const std::vector<uint8_t>* image) : _image(image) {}
+        bool read(const uint32_t offset, uint8_t* buffer, const size_t size) override {
+            if (offset + size > _image->size()) return false;
+            memcpy(buffer, _image->data() + offset, size);
+            return true;
+        }
+    private:
+        const std::vector<uint8_t>* _image;
+    };
+
+    class MemorySink final : public FirmwareSink {
+    public:
+        std::vector<uint8_t> image;
+        bool ended = false;
+        bool aborted = false;
+
+        bool begin(uint32_t size) override {
+            image.clear();
+            image.reserve(size);
+            aborted = false;
+            return true;
+        }
+        size_t write(const uint8_t* data, const size_t size) override {
+            image.insert(image.end(), data, data + size);
+            return size;
+        }
+        bool end() override { return ended = true; }
+        void abort() override { aborted = true; }
+    };
+
+    // serves the delta and the full image by URL, or 404 for the delta if there isn't one
+    class FileSource final : public FirmwareSource {
+    public:
+        std::vector<uint8_t> delta;
+        std::vector<uint8_t> image;
+
+        int open(const char* url, const uint32_t offset) override {
+            const bool wantsDelta = strstr(url, ".delta") != nullptr;
+            _content = wantsDelta ? &delta : &image;
+            _position = offset;
+            if (_content->empty()) return 404;
+            return offset > 0 ? 206 : 200;
+        }
+        uint32_t size() const override { return static_cast<uint32_t>(_content->size()); }
+        int read(uint8_t* buffer, size_t size) override {
+            const size_t count = std::min(size, _content->size() - _position);
+            memcpy(buffer, _content->data() + _position, count);
+            _position += count;
+            return static_cast<int>(count);
+        }
+        void close() override {}
+    private:
+        const std::vector<uint8_t>* _content = &image;
+        size_t _position = 0;
+    };
+
+    class FirmwareDeltaTest : public testing::Test {
+    public:
+        // like the downloader: let the sink do its own work when it is busy, and offer what it didn't take again
+        static size_t feed(DeltaFirmwareSink& deltaSink, const uint8_t* data, const size_t size) {
+            size_t index = 0;
+            while (index < size || deltaSink.isBusy()) {
+                if (deltaSink.isBusy()) {
+                    if (!deltaSink.proceed()) return index;
+                    continue;
+                }
+                const size_t written = deltaSink.write(data + index, size - index);
+                if (written == 0 && !deltaSink.isBusy()) return index;
+                index += written;
+            }
+            return index;
+        }
+
+        std::vector<uint8_t> oldImage;
+        std::vector<uint8_t> newImage;
+
+        // a pseudo random 'build', and a next build with inserted code, moved addresses and a new tail
+        void SetUp() override {
+            uint32_t seed = 12345;
+            for (int i = 0; i < 20000; i++) {
+                seed = seed * 1103515245u + 12345u;
+                oldImage.push_back(static_cast<uint8_t>(seed >> 16));
+            }
+            newImage.assign(oldImage.begin(), oldImage.begin() + 5000);
+            for (int i = 0; i < 100; i++) newImage.push_back(static_cast<uint8_t>(i * 3));
+            for (size_t i = 5000; i < 15000; i++) {
+                newImage.push_back(static_cast<uint8_t>(i % 50 == 0 ? oldImage[i] + 4 : oldImage[i]));
+            }
+            newImage.insert(newImage.end(), oldImage.begin() + 15000, oldImage.end());
+            for (int i = 0; i < 300; i++) newImage.push_back(static_cast<uint8_t>(i));
+        }
+    };
+
+    TEST_F(FirmwareDeltaTest, roundTripTest) {
+        const std::vector<uint8_t> delta = DeltaEncoder::encode(oldImage, newImage);
+        EXPECT_LT(delta.size(), newImage.size()) << "Delta smaller than the image";
+
+        MemoryBase base(&oldImage);
+        MemorySink sink;
+        DeltaFirmwareSink deltaSink(&base, &sink);
+        ASSERT_TRUE(deltaSink.begin(static_cast<uint32_t>(delta.size()))) << "Begin";
+
+        // feed in odd slices, so headers and arguments get split as well
+        constexpr size_t Slice = 7;
+        for (size_t i = 0; i < delta.size(); i += Slice) {
+            const size_t count = std::min(Slice, delta.size() - i);
+            ASSERT_EQ(count, feed(deltaSink, delta.data() + i, count)) << "Write at " << i;
+        }
+        EXPECT_TRUE(deltaSink.end()) << "Delta applied";
+        EXPECT_TRUE(sink.ended) << "Target finalized";
+        EXPECT_EQ(newImage, sink.image) << "Same image";
+    }
+
+    TEST_F(FirmwareDeltaTest, sizeTest) {
+        // copies, and adds that only hold the moved addresses, are what make deltas small
+        const std::vector<uint8_t> delta = DeltaEncoder::encode(oldImage, newImage);
+        EXPECT_LT(delta.size() * 10, newImage.size()) << "Delta an order of magnitude smaller";
+        const std::vector<uint8_t> same = DeltaEncoder::encode(oldImage, oldImage);
+        EXPECT_EQ(DeltaFirmwareSink::HeaderSize + 9, same.size()) << "Same image is a single copy";
+    }
+
+    TEST_F(FirmwareDeltaTest, copyStepTest) {
+        // the same image is a single copy of everything, which must not run in one go
+        const std::vector<uint8_t> delta = DeltaEncoder::encode(oldImage, oldImage);
+        MemoryBase base(&oldImage);
+        MemorySink sink;
+        DeltaFirmwareSink deltaSink(&base, &sink);
+        deltaSink.begin(static_cast<uint32_t>(delta.size()));
+        EXPECT_EQ(delta.size(), deltaSink.write(delta.data(), delta.size())) << "Copy command taken";
+        EXPECT_TRUE(deltaSink.isBusy()) << "Copy pending";
+        EXPECT_TRUE(sink.image.empty()) << "Nothing copied in write";
+
+        EXPECT_TRUE(deltaSink.proceed()) << "First step";
+        EXPECT_EQ(256u, sink.image.size()) << "One block per step";
+        EXPECT_EQ(0u, deltaSink.write(delta.data(), 1)) << "No input taken while copying";
+
+        int steps = 1;
+        while (deltaSink.isBusy()) {
+            ASSERT_TRUE(deltaSink.proceed()) << "Step " << steps;
+            steps++;
+        }
+        EXPECT_EQ(static_cast<int>((oldImage.size() + 255) / 256), steps) << "Steps";
+        EXPECT_TRUE(deltaSink.end()) << "Delta applied";
+        EXPECT_EQ(oldImage, sink.image) << "Same image";
+    }
+
+    TEST_F(FirmwareDeltaTest, corruptDeltaTest) {
+        std::vector<uint8_t> delta = DeltaEncoder::encode(oldImage, newImage);
+        // the inserted code is data, so changing its last byte keeps the structure intact but breaks the checksum
+        const auto inserted = std::search(delta.begin(), delta.end(), newImage.begin() + 5000, newImage.begin() + 5100);
+        ASSERT_NE(delta.end(), inserted) << "Inserted code found";
+        inserted[99] ^= 0xff;
+
+        MemoryBase base(&oldImage);
+        MemorySink sink;
+        DeltaFirmwareSink deltaSink(&base, &sink);
+        deltaSink.begin(static_cast<uint32_t>(delta.size()));
+        EXPECT_EQ(delta.size(), feed(deltaSink, delta.data(), delta.size())) << "Structure is fine";
+        EXPECT_FALSE(deltaSink.end()) << "Checksum mismatch";
+        EXPECT_TRUE(sink.aborted) << "Target aborted";
+
+        // a complete header, but not the right magic
+        const uint8_t garbage[DeltaFirmwareSink::HeaderSize] = { 'W', 'M', 'D', '2', 1 };
+        deltaSink.begin(sizeof garbage);
+        EXPECT_EQ(0u, deltaSink.write(garbage, sizeof garbage)) << "Header not accepted";
+    }
+
+    TEST_F(FirmwareDeltaTest, fallbackTest) {
+        EventServer eventServer;
+        TestEventClient infoListener(&eventServer);
+        eventServer.subscribe(&infoListener, Topic::Info);
+        TestEventClient errorListener(&eventServer);
+        eventServer.subscribe(&errorListener, Topic::ConnectionError);
+        constexpr FirmwareConfig Config{"http://localhost/images/"};
+        FileSource source;
+        source.image = newImage;
+        MemoryBase base(&oldImage);
+        MemorySink sink;
+        DeltaFirmwareSink deltaSink(&base, &sink);
+        FirmwareDownloader downloader(&eventServer, &source, &sink);
+        const WiFiClientFactory wifiClientFactory(nullptr);
+        FirmwareManager manager(&eventServer, &wifiClientFactory, &Config, "0.1.2", &downloader, &deltaSink);
+        manager.begin("001122334455");
+        HTTPClient::ReturnValue = 200;
+
+        // delta available
+        source.delta = DeltaEncoder::encode(oldImage, newImage);
+        manager.tryUpdate();
+        EXPECT_TRUE(manager.loop(1000000, false)) << "Delta downloaded, waiting for idle flow";
+        EXPECT_EQ(DownloadState::Complete, downloader.state()) << "Complete";
+        EXPECT_EQ(newImage, sink.image) << "Image from delta";
+
+        // no delta for this build: fall back to the full image
+        FirmwareManager fullManager(&eventServer, &wifiClientFactory, &Config, "0.1.2", &downloader, &deltaSink);
+        fullManager.begin("001122334455");
+        source.delta.clear();
+        sink.image.clear();
+        fullManager.tryUpdate();
+        EXPECT_TRUE(fullManager.loop(1000000, false)) << "Delta failed, full image started";
+        EXPECT_STREQ("Delta update failed; loading full image", infoListener.getPayload()) << "Fallback reported";
+        EXPECT_EQ(0, errorListener.getCallCount()) << "Missing delta is not an error";
+        EXPECT_TRUE(fullManager.loop(1000000, false)) << "Full image downloaded";
+        EXPECT_EQ(DownloadState::Complete, downloader.state()) << "Full image complete";
+        EXPECT_EQ(newImage, sink.image) << "Image from full download";
+    }
+}
@@ -0,0 +1,224 @@
+// Copyright 2024 Rik Essenius
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License. You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and limitations under the License.
+
+#include <cstring>
+
+#include "gtest/gtest.h"
+#include "FirmwareDownloader.h"
+#include "FirmwareManager.h"
+#include "EventServer.h"
+#include "TestEventClient.h"
+
+#include "HTTPClient.h"
+
+namespace WaterMeterCppTest {
+    using WaterMeter::DownloadState;
+    using WaterMeter::FirmwareConfig;
+    using WaterMeter::FirmwareDownloader;
+    using WaterMeter::FirmwareManager;
+    using WaterMeter::FirmwareSink;
+    using WaterMeter::FirmwareSource;
+    using WaterMeter::WiFiClientFactory;
+
+    // Stands in for the HTTP server: serves an in-memory image, honors range requests,
+    // hands out only what has 'arrived' and can drop the connection.
+    class FirmwareSourceStandIn final : public FirmwareSource {
+    public:
+        static constexpr uint32_t ImageSize = 3000;
+        uint8_t image[ImageSize] = {};
+        uint32_t available = ImageSize;
+        uint32_t lastOffset = 0;
+        int openCount = 0;
+        bool ignoreRange = false;
+        bool dropConnection = false;
+
+        FirmwareSourceStandIn() {
+            for (uint32_t i = 0; i < ImageSize; i++) image[i] = static_cast<uint8_t>(i * 7);
+        }
+
+        int open(const char* url, const uint32_t offset) override {
+            openCount++;
+            lastOffset = offset;
+            _position = ignoreRange ? 0 : offset;
+            return offset > 0 && !ignoreRange ? 206 : 200;
+        }
+
+        uint32_t size() const override { return ImageSize; }
+
+        int read(uint8_t* buffer, const size_t size) override {
+            if (dropConnection) {
+                dropConnection = false;
+                return -1;
+            }
+            if (_position >= available) return 0;
+            size_t count = available - _position;
+            if (count > size) count = size;
+            memcpy(buffer, image + _position, count);
+            _position += static_cast<uint32_t>(count);
+            return static_cast<int>(count);
+        }
+
+        void close() override {}
+
+    private:
+        uint32_t _position = 0;
+    };
+
+    class FirmwareSinkStandIn final : public FirmwareSink {
+    public:
+        uint8_t partition[FirmwareSourceStandIn::ImageSize] = {};
+        uint32_t written = 0;
+        bool ended = false;
+        bool aborted = false;
+        bool begun = false;
+        int beginCount = 0;
+
+        // like Update, a second begin fails unless the first one was aborted
+        bool begin(const uint32_t size) override {
+            beginCount++;
+            if (begun || size > sizeof partition) return false;
+            begun = true;
+            return true;
+        }
+
+        size_t write(const uint8_t* data, const size_t size) override {
+            memcpy(partition + written, data, size);
+            written += static_cast<uint32_t>(size);
+            return size;
+        }
+
+        bool end() override {
+            ended = true;
+            return true;
+        }
+
+        void abort() override {
+            aborted = true;
+            begun = false;
+        }
+    };
+
+    class FirmwareDownloaderTest : public testing::Test {
+    public:
+        static EventServer eventServer;
+        static TestEventClient progressListener;
+        static TestEventClient errorListener;
+        static TestEventClient infoListener;
+
+        // ReSharper disable once CppInconsistentNaming
+        static void SetUpTestCase() {
+            eventServer.subscribe(&progressListener, Topic::UpdateProgress);
+            eventServer.subscribe(&errorListener, Topic::ConnectionError);
+            eventServer.subscribe(&infoListener, Topic::Info);
+        }
+
+        void SetUp() override {
+            progressListener.reset();
+            errorListener.reset();
+            infoListener.reset();
+        }
+    };
+
+    EventServer FirmwareDownloaderTest::eventServer;
+    TestEventClient FirmwareDownloaderTest::progressListener(&eventServer);
+    TestEventClient FirmwareDownloaderTest::errorListener(&eventServer);
+    TestEventClient FirmwareDownloaderTest::infoListener(&eventServer);
+
+    TEST_F(FirmwareDownloaderTest, resumeTest) {
+        FirmwareSourceStandIn source;
+        FirmwareSinkStandIn sink;
+        FirmwareDownloader downloader(&eventServer, &source, &sink);
+        EXPECT_EQ(DownloadState::Idle, downloader.step(1000000)) << "Nothing to do before start";
+
+        downloader.start("http://localhost/images/001122334455.bin");
+        source.available = 1000;
+        EXPECT_EQ(DownloadState::Downloading, downloader.step(1000000)) << "Downloading first slice";
+        EXPECT_EQ(1000u, downloader.offset()) << "Took what was there";
+        EXPECT_STREQ("33", progressListener.getPayload()) << "Progress after first slice";
+
+        source.available = 2000;
+        source.dropConnection = true;
+        EXPECT_EQ(DownloadState::Connecting, downloader.step(1000000)) << "Connection dropped";
+        EXPECT_EQ(DownloadState::Connecting, downloader.step(1000000)) << "Waiting before reconnecting";
+        EXPECT_EQ(1, source.openCount) << "Not reopened yet";
+
+        delayMicroseconds(FirmwareDownloader::RetryWaitMicros);
+        EXPECT_EQ(DownloadState::Downloading, downloader.step(1000000)) << "Resumed";
+        EXPECT_EQ(1000u, source.lastOffset) << "Range request from where we were";
+        EXPECT_EQ(2000u, downloader.offset()) << "Second slice done";
+
+        source.available = FirmwareSourceStandIn::ImageSize;
+        EXPECT_EQ(DownloadState::Complete, downloader.step(1000000)) << "Complete";
+        EXPECT_STREQ("100", progressListener.getPayload()) << "Progress 100";
+        EXPECT_TRUE(sink.ended) << "Image finalized";
+        EXPECT_EQ(0, memcmp(source.image, sink.partition, FirmwareSourceStandIn::ImageSize)) << "Image intact";
+        EXPECT_EQ(0, errorListener.getCallCount()) << "No errors";
+    }
+
+    TEST_F(FirmwareDownloaderTest, retryBeforeFirstBytesTest) {
+        FirmwareSourceStandIn source;
+        FirmwareSinkStandIn sink;
+        FirmwareDownloader downloader(&eventServer, &source, &sink);
+        downloader.start("http://localhost/images/001122334455.bin");
+        source.dropConnection = true;
+        EXPECT_EQ(DownloadState::Connecting, downloader.step(1000000)) << "Connection dropped before the first bytes";
+        EXPECT_EQ(0u, downloader.offset()) << "Nothing downloaded";
+        EXPECT_FALSE(sink.aborted) << "Sink not aborted yet";
+
+        delayMicroseconds(FirmwareDownloader::RetryWaitMicros);
+        EXPECT_EQ(DownloadState::Complete, downloader.step(1000000)) << "Started over and completed";
+        EXPECT_EQ(0u, source.lastOffset) << "Requested from the start";
+        EXPECT_TRUE(sink.aborted) << "First begin aborted";
+        EXPECT_EQ(2, sink.beginCount) << "Sink began again";
+        EXPECT_EQ(0, memcmp(source.image, sink.partition, FirmwareSourceStandIn::ImageSize)) << "Image intact";
+        EXPECT_EQ(0, errorListener.getCallCount()) << "No errors";
+    }
+
+    TEST_F(FirmwareDownloaderTest, rangeIgnoredTest) {
+        FirmwareSourceStandIn source;
+        FirmwareSinkStandIn sink;
+        FirmwareDownloader downloader(&eventServer, &source, &sink);
+        downloader.start("http://localhost/images/001122334455.bin");
+        source.available = 500;
+        EXPECT_EQ(DownloadState::Downloading, downloader.step(1000000)) << "Downloading";
+
+        source.dropConnection = true;
+        source.ignoreRange = true;
+        EXPECT_EQ(DownloadState::Connecting, downloader.step(1000000)) << "Connection dropped";
+        delayMicroseconds(FirmwareDownloader::RetryWaitMicros);
+        EXPECT_EQ(DownloadState::Failed, downloader.step(1000000)) << "Can't resume without range support";
+        EXPECT_TRUE(sink.aborted) << "Partial image discarded";
+        EXPECT_STREQ("Firmware download failed with response code 200", errorListener.getPayload()) << "Error reported";
+    }
+
+    TEST_F(FirmwareDownloaderTest, restartWaitsForIdleFlowTest) {
+        constexpr FirmwareConfig Config{"http://localhost/images/"};
+        FirmwareSourceStandIn source;
+        FirmwareSinkStandIn sink;
+        FirmwareDownloader downloader(&eventServer, &source, &sink);
+        const WiFiClientFactory wifiClientFactory(nullptr);
+        FirmwareManager manager(&eventServer, &wifiClientFactory, &Config, "0.1.2", &downloader);
+        manager.begin("001122334455");
+
+        EXPECT_FALSE(manager.loop(1000000, true)) << "Nothing to do without an update";
+        HTTPClient::ReturnValue = 200;
+        manager.tryUpdate();
+        EXPECT_EQ(DownloadState::Connecting, downloader.state()) << "Download started instead of blocking update";
+
+        EXPECT_TRUE(manager.loop(1000000, false)) << "Downloaded, but flow is not idle";
+        EXPECT_EQ(DownloadState::Complete, downloader.state()) << "Download complete";
+        EXPECT_STREQ("Current firmware: '0.1.2'; available: '0.1.1'", infoListener.getPayload()) << "No restart yet";
+
+        EXPECT_FALSE(manager.loop(1000000, true)) << "Restarts when idle";
+        EXPECT_STREQ("Restarting to activate new firmware", infoListener.getPayload()) << "Restart announced";
+        EXPECT_FALSE(manager.loop(1000000, true)) << "Restart only once";
+    }
+}
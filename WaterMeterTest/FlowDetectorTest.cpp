@@ -190,6 +190,48 @@ namespace WaterMeterCppTest {
 		flowTestWithFile("anomaly.txt", 1, 3, 50, 0, 1);
 	}
 
+	TEST_F(FlowDetectorTest, AdaptiveDriftTest) {
+		// the signal jumps to a new position while there is no flow, and then continues there.
+		// In adaptive mode, the detector should follow it without throwing away the fit.
+		constexpr int CyclesBefore = 8;
+		constexpr int CyclesAfter = 4;
+		constexpr int SamplesPerCycle = 32;
+		constexpr int16_t Shift = 30;
+		for (const auto mode : { WaterMeter::OutlierMode::Fixed, WaterMeter::OutlierMode::Adaptive }) {
+			const auto label = mode == WaterMeter::OutlierMode::Adaptive ? "Adaptive: " : "Fixed: ";
+			EventServer localEventServer;
+			FlowDetector flowDetector(&localEventServer, &ellipseFit);
+			PulseTestEventClient pulseClient(&localEventServer);
+			flowDetector.begin(3, mode);
+			int sampleNumber = 0;
+			for (; sampleNumber < CyclesBefore * SamplesPerCycle; sampleNumber++) {
+				localEventServer.publish(Topic::Sample, getSample(sampleNumber));
+			}
+			const auto centerBefore = flowDetector.ellipseCenterTimes10();
+			const auto pulsesBefore = pulseClient.pulses(true);
+			auto shifted = getSample(sampleNumber - 1);
+			shifted.x += Shift;
+			for (int i = 0; i < 40; i++) {
+				localEventServer.publish(Topic::Sample, shifted);
+			}
+			for (; sampleNumber < (CyclesBefore + CyclesAfter) * SamplesPerCycle; sampleNumber++) {
+				auto sample = getSample(sampleNumber);
+				sample.x += Shift;
+				localEventServer.publish(Topic::Sample, sample);
+			}
+			EXPECT_EQ(1u, pulseClient.drifts()) << label << "Drift detected";
+			if (mode == WaterMeter::OutlierMode::Adaptive) {
+				EXPECT_GT(20u, pulseClient.anomalies()) << label << "Drift recognized early";
+				EXPECT_LE(pulsesBefore + CyclesAfter - 1, pulseClient.pulses(true)) << label << "Pulses continue after the drift";
+				EXPECT_NEAR(centerBefore.x, flowDetector.ellipseCenterTimes10().x, 30) << label << "Fit kept (center in original frame)";
+				EXPECT_NEAR(centerBefore.y, flowDetector.ellipseCenterTimes10().y, 30) << label << "Fit kept (center Y)";
+			}
+			else {
+				EXPECT_LE(50u, pulseClient.anomalies()) << label << "Drift only after the maximum number of outliers";
+			}
+		}
+	}
+
 	TEST_F(FlowDetectorTest, 60CyclesTest) {
 		flowTestWithFile("60cycles.txt", 1, 59, 0);
 	}
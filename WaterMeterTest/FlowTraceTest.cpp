@@ -0,0 +1,152 @@
+// Copyright 2024 Rik Essenius
+// 
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License. You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and limitations under the License.
+
+#include "gtest/gtest.h"
+
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <vector>
+
+#include "DataQueue.h"
+#include "FlowDetector.h"
+#include "FlowTrace.h"
+#include "PulseTestEventClient.h"
+#include "Serializer.h"
+#include "TestEventClient.h"
+#include "TraceDecoder.h"
+
+namespace WaterMeterCppTest {
+    using EllipseMath::EllipseFit;
+    using WaterMeter::DataQueue;
+    using WaterMeter::DataQueuePayload;
+    using WaterMeter::FlowDetector;
+    using WaterMeter::FlowTrace;
+    using WaterMeter::PayloadBuilder;
+    using WaterMeter::Serializer;
+
+    class FlowTraceTest : public testing::Test {
+    protected:
+        static std::vector<CaptureSample> runDetector(EventServer* eventServer, FlowTrace* flowTrace, PulseTestEventClient* pulseClient) {
+            EllipseFit ellipseFit;
+            FlowDetector flowDetector(eventServer, &ellipseFit, flowTrace);
+            flowDetector.begin(3);
+            std::vector<CaptureSample> samples;
+            std::ifstream measurements("testData\\crash.txt");
+            EXPECT_TRUE(measurements.is_open()) << "File open";
+            measurements.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+            SensorSample measurement{};
+            while (measurements >> measurement.x >> measurement.y) {
+                samples.push_back({ measurement.x, measurement.y });
+                eventServer->publish(Topic::Sample, measurement);
+            }
+            pulseClient->close();
+            return samples;
+        }
+    };
+
+    TEST_F(FlowTraceTest, RingTest) {
+        EventServer eventServer;
+        FlowTrace flowTrace(&eventServer, nullptr, nullptr);
+        flowTrace.begin();
+        EXPECT_FALSE(flowTrace.isEnabled()) << "Off by default";
+        eventServer.publish(Topic::Trace, "on");
+        EXPECT_TRUE(flowTrace.isEnabled()) << "Switched on";
+        for (uint32_t i = 1; i <= FlowTrace::Capacity + 3; i++) {
+            flowTrace.add(i, TraceDecision::Accepted, 0, 0);
+        }
+        EXPECT_EQ(FlowTrace::Capacity, flowTrace.count()) << "Ring is bounded";
+        EXPECT_EQ(4u, flowTrace.recordAt(0).sampleIndex) << "Oldest record first";
+        EXPECT_EQ(FlowTrace::Capacity + 3u, flowTrace.recordAt(FlowTrace::Capacity - 1).sampleIndex) << "Newest record last";
+        eventServer.publish(Topic::Trace, 0L);
+        EXPECT_FALSE(flowTrace.isEnabled()) << "Switched off";
+        EXPECT_EQ(FlowTrace::Capacity, flowTrace.count()) << "Records kept when switching off";
+        eventServer.publish(Topic::Trace, 1L);
+        EXPECT_EQ(0, flowTrace.count()) << "Switching on starts a new trace";
+        eventServer.publish(Topic::Trace, "onn");
+        EXPECT_TRUE(flowTrace.isEnabled()) << "Unknown command ignored";
+    }
+
+    TEST_F(FlowTraceTest, DetectorTest) {
+        EventServer eventServer;
+        FlowTrace flowTrace(&eventServer, nullptr, nullptr);
+        PulseTestEventClient pulseClient(&eventServer);
+        runDetector(&eventServer, &flowTrace, &pulseClient);
+        EXPECT_EQ(0, flowTrace.count()) << "Nothing recorded when disabled";
+
+        EventServer tracedEventServer;
+        PulseTestEventClient tracedPulseClient(&tracedEventServer);
+        flowTrace.setEnabled(true);
+        runDetector(&tracedEventServer, &flowTrace, &tracedPulseClient);
+        EXPECT_EQ(FlowTrace::Capacity, flowTrace.count()) << "Ring filled";
+
+        // every record after the first pulse that has a pulse flag set must be an accepted point, and vice versa
+        unsigned int pulses = 0;
+        uint32_t previousIndex = 0;
+        for (uint16_t i = 0; i < flowTrace.count(); i++) {
+            const auto& record = flowTrace.recordAt(i);
+            EXPECT_LE(previousIndex, record.sampleIndex) << "Sample index ascending #" << i;
+            previousIndex = record.sampleIndex;
+            if (record.decision == TraceDecision::Accepted && record.foundPulse()) pulses++;
+        }
+        EXPECT_LT(0u, pulses) << "Pulses traced";
+        EXPECT_GE(tracedPulseClient.pulses(false) + tracedPulseClient.pulses(true), pulses) << "No more pulses traced than found";
+        EXPECT_EQ(pulseClient.pulses(true), tracedPulseClient.pulses(true)) << "Tracing doesn't change the outcome";
+    }
+
+    TEST_F(FlowTraceTest, DumpTest) {
+        EventServer eventServer;
+        DataQueuePayload queuePayload{};
+        DataQueue dataQueue(&eventServer, &queuePayload);
+        DataQueuePayload tracePayload{};
+        FlowTrace flowTrace(&eventServer, &dataQueue, &tracePayload);
+        flowTrace.begin();
+        eventServer.publish(Topic::Trace, "on");
+        constexpr uint16_t RecordCount = 30;
+        for (uint16_t i = 1; i <= RecordCount; i++) {
+            flowTrace.add(i, static_cast<TraceDecision>(i % 10 + 1), static_cast<uint8_t>(i % 5 | TraceRecord::SearchingFlag), static_cast<uint16_t>(i * 100));
+        }
+
+        eventServer.publish(Topic::Trace, "dump");
+        EXPECT_FALSE(flowTrace.isEnabled()) << "Dump freezes the trace";
+
+        PayloadBuilder payloadBuilder;
+        Serializer serializer(&eventServer, &payloadBuilder);
+        eventServer.subscribe(&serializer, Topic::SensorData);
+        TestEventClient traceClient(&eventServer);
+        eventServer.subscribe(&traceClient, Topic::TraceFormatted);
+        std::vector<TraceRecord> decoded;
+        while (const auto payload = dataQueue.receive()) {
+            EXPECT_EQ(Topic::Trace, payload->topic) << "Trace payload";
+            eventServer.publish(Topic::SensorData, reinterpret_cast<const char*>(payload));
+            EXPECT_TRUE(TraceDecoder::decode(traceClient.getPayload(), decoded)) << "Decoded";
+        }
+        EXPECT_EQ(3, traceClient.getCallCount()) << "Sent in three chunks";
+        ASSERT_EQ(RecordCount, decoded.size()) << "All records decoded";
+        for (uint16_t i = 0; i < RecordCount; i++) {
+            const auto& expected = flowTrace.recordAt(i);
+            EXPECT_EQ(expected.sampleIndex, decoded[i].sampleIndex) << "Index #" << i;
+            EXPECT_EQ(expected.decision, decoded[i].decision) << "Decision #" << i;
+            EXPECT_EQ(expected.flags, decoded[i].flags) << "Flags #" << i;
+            EXPECT_EQ(expected.value, decoded[i].value) << "Value #" << i;
+        }
+
+        const CaptureSample samples[] = { {10, -10}, {11, -11} };
+        std::ostringstream replay;
+        TraceDecoder::replay(replay, std::vector<TraceRecord>(decoded.begin(), decoded.begin() + 3), samples, 2);
+        EXPECT_EQ(
+            "Sample,X,Y,Decision,Quadrant,Pulse,Searching,Fit,Value\n"
+            "1,10,-10,Startup,1,0,1,0,100\n"
+            "2,11,-11,TooClose,2,0,1,0,200\n"
+            "3,,,Outlier,3,0,1,0,300\n", replay.str()) << "Replay next to the samples";
+        EXPECT_FALSE(TraceDecoder::decode("{\"trace\":\"0000000106\"}", decoded)) << "Incomplete record";
+    }
+}
@@ -59,15 +59,15 @@ namespace WaterMeterCppTest {
             // force a known state
             Led::set(Led::Running, Led::Off);
             for (int i = 0; i < interval; i++) {
-                ledDriver->update(Topic::Sample, 508);
+                ledDriver->update(Topic::Sample, 1);
                 expectRunningLed(Led::On, messageOn.c_str(), i);
             }
             const std::string messageOff = messageBase + "OFF";
             for (int i = 0; i < interval; i++) {
-                ledDriver->update(Topic::Sample, 507);
+                ledDriver->update(Topic::Sample, 1);
                 expectRunningLed(Led::Off, messageOff.c_str(), i);
             }
-            ledDriver->update(Topic::Sample, 515);
+            ledDriver->update(Topic::Sample, 1);
             expectRunningLed(Led::On, messageOn.c_str(), 255);
         }
 
@@ -84,33 +84,38 @@ namespace WaterMeterCppTest {
         Led::set(Led::Running, Led::Off);
         // go partway into a cycle
         for (unsigned int i = 0; i < LedDriver::ExcludeInterval / 5; i++) {
-            eventServer.publish(Topic::Sample, 512);
+            eventServer.publish(Topic::Sample, 1);
             expectRunningLed(Led::On, "In first part", i);
         }
         // set a new state. Check whether it kicks in right away
         eventServer.publish(Topic::Anomaly, true);
         for (unsigned int i = 0; i < LedDriver::ExcludeInterval; i++) {
-            eventServer.publish(Topic::Sample, 511);
+            eventServer.publish(Topic::Sample, 1);
             expectRunningLed(Led::On, "Started new cycle high", i);
         }
         for (unsigned int i = 0; i < LedDriver::ExcludeInterval; i++) {
-            eventServer.publish(Topic::Sample, 510);
+            eventServer.publish(Topic::Sample, 1);
             expectRunningLed(Led::Off, "Started new cycle low", i);
         }
         // just into new cycle
-        eventServer.publish(Topic::Sample, 513);
+        eventServer.publish(Topic::Sample, 1);
         expectRunningLed(Led::On, "Started second cycle high", 1);
 
         // ending flow. Check whether the cycle adapts
         eventServer.publish(Topic::Anomaly, false);
         for (unsigned int i = 0; i < LedDriver::IdleInterval; i++) {
-            eventServer.publish(Topic::Sample, 514);
+            eventServer.publish(Topic::Sample, 1);
             expectRunningLed(Led::On, "Started new idle cycle high", i);
         }
         for (unsigned int i = 0; i < LedDriver::IdleInterval; i++) {
-            eventServer.publish(Topic::Sample, 509);
+            eventServer.publish(Topic::Sample, 1);
             expectRunningLed(Led::Off, "Started new idle cycle high", i);
         }
+        // the sampler sends the number of samples in a period, which should be handled as that many separate samples
+        eventServer.publish(Topic::Sample, static_cast<long>(LedDriver::IdleInterval));
+        expectRunningLed(Led::On, "Aggregated samples complete a high cycle", 0);
+        eventServer.publish(Topic::Sample, 1);
+        expectRunningLed(Led::Off, "Next sample goes low", 0);
     }
 
     TEST_F(LedDriverTest, cycleTest) {
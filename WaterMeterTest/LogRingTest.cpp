@@ -0,0 +1,65 @@
+// Copyright 2024 Rik Essenius
+// 
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License. You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and limitations under the License.
+
+#include "gtest/gtest.h"
+#include <string>
+#include "LogRing.h"
+
+namespace WaterMeterCppTest {
+    using WaterMeter::LogRing;
+    using WaterMeter::Timestamp;
+
+    TEST(LogRingTest, orderTest) {
+        LogRing ring;
+        Timestamp timestamp = 0;
+        EXPECT_EQ(nullptr, ring.peek(timestamp)) << "Empty at start";
+        EXPECT_TRUE(ring.add(1000, "Line %d: %s", 1, "one")) << "Added first";
+        EXPECT_TRUE(ring.add(2000, "Value %.2f", 12.345)) << "Added second";
+        EXPECT_STREQ("Line 1: one", ring.peek(timestamp)) << "First line formatted";
+        EXPECT_EQ(1000u, timestamp) << "First timestamp";
+        EXPECT_STREQ("Line 1: one", ring.peek(timestamp)) << "Peek does not remove";
+        ring.release();
+        EXPECT_STREQ("Value 12.35", ring.peek(timestamp)) << "Second line formatted";
+        EXPECT_EQ(2000u, timestamp) << "Second timestamp";
+        ring.release();
+        EXPECT_EQ(nullptr, ring.peek(timestamp)) << "Empty again";
+        EXPECT_EQ(0u, ring.takeDropped()) << "Nothing dropped";
+    }
+
+    TEST(LogRingTest, fullTest) {
+        LogRing ring;
+        Timestamp timestamp = 0;
+        // go around a few times to check the wrapping
+        for (unsigned int round = 0; round < 3; round++) {
+            for (unsigned int i = 0; i < LogRing::SlotCount; i++) {
+                EXPECT_TRUE(ring.add(i, "%u", i)) << "Added " << i;
+            }
+            EXPECT_FALSE(ring.add(99, "overflow")) << "Full ring drops the line";
+            EXPECT_FALSE(ring.add(99, "overflow")) << "And the next one";
+            EXPECT_EQ(2u, ring.takeDropped()) << "Dropped lines counted";
+            EXPECT_EQ(0u, ring.takeDropped()) << "Dropped count reset";
+            for (unsigned int i = 0; i < LogRing::SlotCount; i++) {
+                EXPECT_STREQ(std::to_string(i).c_str(), ring.peek(timestamp)) << "Line " << i;
+                EXPECT_EQ(i, timestamp) << "Timestamp " << i;
+                ring.release();
+            }
+            EXPECT_EQ(nullptr, ring.peek(timestamp)) << "Empty after round " << round;
+        }
+    }
+
+    TEST(LogRingTest, truncateTest) {
+        LogRing ring;
+        Timestamp timestamp = 0;
+        const std::string longMessage(LogRing::MessageSize + 10, 'x');
+        EXPECT_TRUE(ring.add(0, "%s", longMessage.c_str())) << "Added long line";
+        EXPECT_EQ(LogRing::MessageSize - 1u, strlen(ring.peek(timestamp))) << "Truncated to the slot";
+    }
+}
@@ -23,6 +23,7 @@ namespace WaterMeterCppTest {
     using WaterMeter::ConnectionState;
     using WaterMeter::EventServer;
     using WaterMeter::Log;
+    using WaterMeter::LogLevel;
     using WaterMeter::PayloadBuilder;
     using WaterMeter::Topic;
     using WaterMeter::SensorState;
@@ -118,5 +119,11 @@ namespace WaterMeterCppTest {
         eventServer.publish(Topic::NoFit, 55);
         EXPECT_STREQ("[] No fit: 55 deg\n", getPrintOutput()) << "NoFit logged OK";
         clearPrintOutput();
+
+        log.log<LogLevel::Debug>("Debug %d", 1);
+        EXPECT_STREQ("", getPrintOutput()) << "Debug level compiled out";
+        log.log<LogLevel::Error>("Error %d", 2);
+        EXPECT_STREQ("[] Error 2\n", getPrintOutput()) << "Error level logged";
+        clearPrintOutput();
     }
 }
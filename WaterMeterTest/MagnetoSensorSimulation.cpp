@@ -14,6 +14,14 @@
 namespace WaterMeterCppTest {
     MagnetoSensorSimulation::MagnetoSensorSimulation(const char* fileName) : MagnetoSensor(0, nullptr) {
         _fileName = fileName;
+        if (CaptureFile::isCaptureFile(fileName)) {
+            if (!_capture.open(fileName)) {
+                throw std::runtime_error("Cannot open capture " + std::string(fileName));
+            }
+            _index = 0;
+            _doneReading = false;
+            return;
+        }
         _measurements.open(fileName);
         _measurements.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
 
@@ -25,6 +33,18 @@ namespace WaterMeterCppTest {
     }
 
     bool MagnetoSensorSimulation::read(SensorData& sample) {
+        if (_capture.isOpen()) {
+            // a soft reset does not rewind the data, just like with the text file
+            if (_captureIndex >= _capture.sampleCount()) {
+                _doneReading = true;
+                return false;
+            }
+            const auto& captured = _capture.samples()[_captureIndex++];
+            sample.x = captured.x;
+            sample.y = captured.y;
+            _index++;
+            return true;
+        }
         if (!(_measurements >> sample.x)) {
             _doneReading = true;
             return false;
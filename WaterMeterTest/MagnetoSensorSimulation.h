@@ -9,7 +9,8 @@
 // is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
 // See the License for the specific language governing permissions and limitations under the License.
 
-// If we don't detect a sensor, we use this null sensor instead. That makes the code a bit cleaner.
+// Replays recorded sensor data, either from a whitespace separated text file or from a binary capture file
+// (see CaptureFile), which is recognized by its extension.
 
 #ifndef HEADER_MAGNETO_SENSOR_TEST
 #define HEADER_MAGNETO_SENSOR_TEST
@@ -17,6 +18,8 @@
 #include <fstream>
 #include <MagnetoSensor.h>
 
+#include "CaptureFile.h"
+
 namespace WaterMeterCppTest {
     using MagnetoSensors::MagnetoSensor;
     using MagnetoSensors::SensorData;
@@ -33,11 +36,11 @@ namespace WaterMeterCppTest {
         }
 
         double getGain() const override {
-            return 390;
+            return _capture.isOpen() && _capture.header().gain > 0 ? _capture.header().gain : 390;
         }
 
         int getNoiseRange() const override {
-            return 3;
+            return _capture.isOpen() && _capture.header().noiseRange > 0 ? _capture.header().noiseRange : 3;
         }
 
         bool isOn() override {
@@ -61,6 +64,8 @@ namespace WaterMeterCppTest {
     private:
         const char* _fileName;
         std::ifstream _measurements;
+        CaptureFile _capture;
+        uint32_t _captureIndex = 0;
         bool _doneReading = false;
         int _index = 0;
     };
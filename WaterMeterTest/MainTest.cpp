@@ -20,6 +20,7 @@
 #include <MagnetoSensorNull.h>
 
 #include "Button.h"
+#include "CaptureStreamer.h"
 #include "Communicator.h"
 #include "Connector.h"
 #include "Device.h"
@@ -36,7 +37,7 @@
 #include "WiFiManager.h"
 #include "Log.h"
 #include "SampleAggregator.h"
-#include "QueueClient.h"
+#include "EventBus.h"
 
 #include "HTTPClient.h"
 #include "Meter.h"
@@ -110,7 +111,6 @@ namespace WaterMeterCppTest {
             EventServer samplerEventServer;
             MagnetoSensorReader sensorReader(&samplerEventServer);
             EllipseFit ellipseFit;
-            FlowDetector flowDetector(&samplerEventServer, &ellipseFit);
 
             EventServer communicatorEventServer;
             EventServer connectorEventServer;
@@ -120,6 +120,9 @@ namespace WaterMeterCppTest {
             Serializer serializer(&connectorEventServer, &serializePayloadBuilder);
             DataQueuePayload connectorPayload;
             DataQueue sensorDataQueue(&connectorEventServer, &connectorPayload);
+            DataQueuePayload tracePayload;
+            FlowTrace flowTrace(&samplerEventServer, &sensorDataQueue, &tracePayload);
+            FlowDetector flowDetector(&samplerEventServer, &ellipseFit, &flowTrace);
             DataQueuePayload measurementPayload;
             DataQueuePayload resultPayload;
             SampleAggregator sampleAggregator(&samplerEventServer, &theClock, &sensorDataQueue, &measurementPayload);
@@ -139,16 +142,9 @@ namespace WaterMeterCppTest {
                                     &sensorDataQueue,
                                     BuildVersion);
             FirmwareManager firmwareManager(&connectorEventServer, &wifiClientFactory, &configuration.firmware, BuildVersion);
+            CaptureStreamer captureStreamer(&connectorEventServer, MeasureIntervalMicros);
 
-            QueueClient samplerQueueClient(&samplerEventServer, &logger, 50, 0);
-            // will fill fast if we have flow during startup
-            QueueClient communicatorSamplerQueueClient(&communicatorEventServer, &logger, 100, 1);
-            QueueClient communicatorConnectorQueueClient(&communicatorEventServer, &logger, 50, 2);
-            // This queue needs more space as it won't be read when offline.
-            QueueClient connectorCommunicatorQueueClient(&connectorEventServer, &logger, 100, 3);
-
-            // Nothing to send from sampler to connector
-            QueueClient connectorSamplerQueueClient(&connectorEventServer, &logger, 0, 4);
+            EventBus eventBus(&samplerEventServer, &communicatorEventServer, &connectorEventServer, &logger);
             DataQueuePayload connectorDataQueuePayload;
             PayloadBuilder serialize2PayloadBuilder(&theClock);
             Serializer serializer2(&communicatorEventServer, &serialize2PayloadBuilder);
@@ -159,15 +155,13 @@ namespace WaterMeterCppTest {
 
             DataQueue connectorDataQueue(&connectorEventServer, &connectorDataQueuePayload, 1, 1024, 128, 256);
             SamplerDriver sampler(&samplerEventServer, &sensorReader, &flowDetector, &button, &sampleAggregator, &resultAggregator,
-                            &samplerQueueClient);
+                            &eventBus);
             Communicator communicator(&communicatorEventServer, &oledDriver, &device,
-                                      &connectorDataQueue, &serializer2,
-                                      &communicatorSamplerQueueClient, &communicatorConnectorQueueClient);
+                                      &connectorDataQueue, &serializer2, &eventBus);
 
             TimeServer timeServer;
             Connector connector(&connectorEventServer, &wifi, &mqttGateway, &timeServer, &firmwareManager, &sensorDataQueue,
-                                &connectorDataQueue, &serializer, &connectorSamplerQueueClient,
-                                &connectorCommunicatorQueueClient);
+                                &connectorDataQueue, &serializer, &eventBus);
 
             static constexpr BaseType_t Core1 = 1;
             static constexpr BaseType_t Core0 = 0;
@@ -193,23 +187,16 @@ namespace WaterMeterCppTest {
             configuration.putFirmwareConfig(&firmwareConfig);
             configuration.begin(false);
 
-            // queue for the sampler process
-            samplerQueueClient.begin(communicatorSamplerQueueClient.getQueueHandle());
-
-            // queues for the communicator process
-            // receive only
-            communicatorSamplerQueueClient.begin();
-            communicatorConnectorQueueClient.begin(connectorCommunicatorQueueClient.getQueueHandle());
-
-            // queues for the connector process
-            connectorCommunicatorQueueClient.begin(communicatorConnectorQueueClient.getQueueHandle());
-            connectorSamplerQueueClient.begin(samplerQueueClient.getQueueHandle());
+            // connect the queues between the processes
+            eventBus.begin();
 
             // disable the timestamps to make it easier to test
             communicatorEventServer.cannotProvide(&theClock, Topic::Time);
             EXPECT_STREQ("", getPrintOutput()) << "Print output empty 1";
             communicator.begin();
             connector.begin(&configuration);
+            captureStreamer.begin();
+            flowTrace.begin();
 
             EXPECT_FALSE(sampler.begin(sensor, std::size(sensor), MeasureIntervalMicros)) << "Sampler found null sensor";
             EXPECT_STREQ("[] Starting\n", getPrintOutput()) << "Print output started";
@@ -240,8 +227,7 @@ namespace WaterMeterCppTest {
             sampler.loop();
             communicator.loop();
             connector.loop();
-            while (communicatorSamplerQueueClient.receive()) {}
-            while (communicatorConnectorQueueClient.receive()) {}
+            while (eventBus.receive(TaskId::Communicator)) {}
 
             EXPECT_EQ(Led::On, Led::get(Led::Aux)) << "AUX on";
             EXPECT_EQ(Led::On, Led::get(Led::Running)) << "RUNNING on";
@@ -351,9 +337,9 @@ namespace WaterMeterCppTest {
 
             clearPrintOutput();
             // connector unsubscribes right after starting as it should occur only once, so we need to set it manually here
-            connectorEventServer.subscribe(&connectorCommunicatorQueueClient, Topic::AddVolume);
+            eventBus.route(TaskId::Connector, TaskId::Communicator, Topic::AddVolume);
             connectorEventServer.publish(Topic::AddVolume, R"({"timestamp":"","pulses":0,"volume":00123.0000000})");
-            connectorEventServer.unsubscribe(&connectorCommunicatorQueueClient, Topic::AddVolume);
+            eventBus.unroute(TaskId::Connector, TaskId::Communicator, Topic::AddVolume);
 
             EXPECT_STREQ("", mqttClient.getPayloads()) << "Nothing sent to MQTT yet (1)";
             connector.loop();
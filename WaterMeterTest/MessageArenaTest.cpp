@@ -0,0 +1,59 @@
+// Copyright 2024 Rik Essenius
+// 
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License. You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and limitations under the License.
+
+#include "gtest/gtest.h"
+#include <string>
+#include "MessageArena.h"
+
+namespace WaterMeterCppTest {
+    using WaterMeter::MessageArena;
+
+    TEST(MessageArenaTest, referenceTest) {
+        MessageArena arena;
+        EXPECT_EQ(MessageArena::SlotCount, arena.freeSlots()) << "All slots free at start";
+        char buffer[] = "hello";
+        const auto message = arena.allocate(buffer);
+        ASSERT_NE(nullptr, message) << "Allocated";
+        EXPECT_NE(buffer, message) << "Copied";
+        buffer[0] = 'j';
+        EXPECT_STREQ("hello", message) << "Copy not affected by changing the source";
+        EXPECT_TRUE(arena.owns(message)) << "Owns the copy";
+        EXPECT_FALSE(arena.owns(buffer)) << "Does not own the source";
+        EXPECT_FALSE(arena.owns(message + 1)) << "Only the start of a slot is a handle";
+        EXPECT_EQ(MessageArena::SlotCount - 1, arena.freeSlots()) << "One slot taken";
+
+        EXPECT_TRUE(arena.addReference(message)) << "Reference added";
+        EXPECT_FALSE(arena.addReference(buffer)) << "Can't add a reference to a foreign string";
+        arena.release(message);
+        EXPECT_EQ(MessageArena::SlotCount - 1, arena.freeSlots()) << "Still referenced";
+        arena.release(message);
+        EXPECT_EQ(MessageArena::SlotCount, arena.freeSlots()) << "Free after last release";
+        EXPECT_FALSE(arena.addReference(message)) << "Released slot can't be revived";
+        arena.release(message);
+        EXPECT_EQ(MessageArena::SlotCount, arena.freeSlots()) << "Extra release ignored";
+    }
+
+    TEST(MessageArenaTest, limitTest) {
+        MessageArena arena;
+        const std::string tooLong(MessageArena::SlotSize, 'x');
+        EXPECT_EQ(nullptr, arena.allocate(tooLong.c_str())) << "Too long message not allocated";
+        const std::string longest(MessageArena::SlotSize - 1, 'y');
+        const auto first = arena.allocate(longest.c_str());
+        EXPECT_STREQ(longest.c_str(), first) << "Longest message fits";
+        for (uint8_t i = 1; i < MessageArena::SlotCount; i++) {
+            EXPECT_NE(nullptr, arena.allocate("x")) << "Allocated " << static_cast<int>(i);
+        }
+        EXPECT_EQ(0, arena.freeSlots()) << "Full";
+        EXPECT_EQ(nullptr, arena.allocate("x")) << "Nothing left";
+        arena.release(first);
+        EXPECT_EQ(first, arena.allocate("z")) << "Released slot reused";
+    }
+}
@@ -0,0 +1,66 @@
+// Copyright 2024 Rik Essenius
+// 
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License. You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and limitations under the License.
+
+#include "gtest/gtest.h"
+#include "MeterJournal.h"
+
+namespace WaterMeterCppTest {
+    using WaterMeter::MeterJournal;
+    using WaterMeter::MeterState;
+
+    class MeterJournalTest : public testing::Test {
+    protected:
+        Preferences preferences;
+
+        void SetUp() override {
+            preferences.begin("meter", false);
+            preferences.clear();
+            preferences.end();
+        }
+    };
+
+    TEST_F(MeterJournalTest, saveLoadTest) {
+        MeterJournal journal(&preferences);
+        MeterState state{};
+        EXPECT_FALSE(journal.load(state)) << "Nothing saved yet";
+
+        // go around the slots more than once; the last one must win
+        for (unsigned long i = 1; i <= MeterJournal::SlotCount * 2 + 3; i++) {
+            journal.save({ i * 1000ULL, i, i * 10ULL });
+        }
+        MeterJournal restored(&preferences);
+        ASSERT_TRUE(restored.load(state)) << "State found";
+        constexpr unsigned long Last = MeterJournal::SlotCount * 2 + 3;
+        EXPECT_EQ(Last * 1000ULL, state.volumeUnits) << "Volume of the last save";
+        EXPECT_EQ(Last, state.pulses) << "Pulses of the last save";
+        EXPECT_EQ(Last * 10ULL, state.timestamp) << "Timestamp of the last save";
+
+        // continuing after a restore keeps the sequence going
+        restored.save({ 1ULL, 2, 3ULL });
+        MeterJournal again(&preferences);
+        ASSERT_TRUE(again.load(state)) << "State found again";
+        EXPECT_EQ(1ULL, state.volumeUnits) << "Newest record after restart wins";
+    }
+
+    TEST_F(MeterJournalTest, corruptSlotTest) {
+        MeterJournal journal(&preferences);
+        journal.save({ 100ULL, 1, 10ULL });
+        journal.save({ 200ULL, 2, 20ULL });
+        // the second save went to slot 2; damage it
+        uint8_t garbage[32] = { 0xFF };
+        preferences.begin("meter", false);
+        preferences.putBytes("s2", garbage, sizeof garbage);
+        preferences.end();
+        MeterState state{};
+        ASSERT_TRUE(journal.load(state)) << "Older record found";
+        EXPECT_EQ(100ULL, state.volumeUnits) << "Falls back to the previous record";
+    }
+}
@@ -21,6 +21,7 @@
 
 namespace WaterMeterCppTest {
     using WaterMeter::Meter;
+    using WaterMeter::MeterJournal;
 
     class MeterTest : public testing::Test {
     public:
@@ -71,5 +72,65 @@ namespace WaterMeterCppTest {
 
         EXPECT_FALSE(meter.setVolume("x")) << "non-double not accepted";
         EXPECT_STREQ(expected[std::size(expected) - 1], meter.getVolume()) << "Value not changed";
+        EXPECT_FALSE(meter.setVolume("")) << "empty not accepted";
+        EXPECT_FALSE(meter.setVolume(".")) << "no digits not accepted";
+        EXPECT_FALSE(meter.setVolume("1.2.3")) << "two decimal points not accepted";
+        EXPECT_FALSE(meter.setVolume("-1")) << "negative not accepted";
+        EXPECT_FALSE(meter.setVolume("99999999999999999999")) << "overflow not accepted";
+        EXPECT_STREQ(expected[std::size(expected) - 1], meter.getVolume()) << "Value still not changed";
+    }
+
+    TEST_F(MeterTest, exactVolumeTest) {
+        Meter meter(&eventServer);
+        EXPECT_TRUE(meter.setVolume("00123.0000000")) << "Leading zeros accepted";
+        EXPECT_STREQ("123.0000000", meter.getVolume()) << "Leading zeros removed";
+        EXPECT_TRUE(meter.setVolume(".5")) << "No integer part accepted";
+        EXPECT_STREQ("0.5000000", meter.getVolume()) << "Fraction only";
+        EXPECT_TRUE(meter.setVolume("7.")) << "No fraction accepted";
+        EXPECT_STREQ("7.0000000", meter.getVolume()) << "Integer only";
+        EXPECT_TRUE(meter.setVolume("1.23456785")) << "Extra decimals accepted";
+        EXPECT_STREQ("1.2345679", meter.getVolume()) << "Extra decimals rounded half up";
+        EXPECT_TRUE(meter.setVolume("98765.4321098")) << "Large value accepted";
+        EXPECT_STREQ("98765.4321098", meter.getVolume()) << "Large value exact";
+
+        // a million cycles (two pulse events each) should add 1000000 / 16432.7 = 60.85427227, rounded once
+        meter.setVolume("0");
+        for (long i = 0; i < 1000000; i++) {
+            meter.update(Topic::Pulse, 1L);
+        }
+        EXPECT_STREQ("60.8542723", meter.getVolume()) << "No accumulated rounding";
+    }
+
+    TEST_F(MeterTest, journalTest) {
+        Preferences preferences;
+        preferences.begin("meter", false);
+        preferences.clear();
+        preferences.end();
+        MeterJournal journal(&preferences);
+        TestEventClient volumeClient(&eventServer);
+        eventServer.subscribe(&volumeClient, Topic::Volume);
+        {
+            Meter meter(&eventServer, nullptr, &journal);
+            meter.begin();
+            EXPECT_EQ(0, volumeClient.getCallCount()) << "Nothing restored";
+            EXPECT_TRUE(meter.setVolume("100.5")) << "Set volume";
+            // the first pulse is within the save interval, so it is not saved yet
+            meter.update(Topic::Pulse, 1L);
+        }
+        volumeClient.reset();
+        MeterJournal restoredJournal(&preferences);
+        Meter meter(&eventServer, nullptr, &restoredJournal);
+        meter.begin();
+        EXPECT_EQ(1, volumeClient.getCallCount()) << "Restored volume published at begin";
+        EXPECT_STREQ("100.5000000", volumeClient.getPayload()) << "Restored the explicitly set volume";
+
+        // a retained value that is behind the journal is ignored
+        eventServer.publish(Topic::AddVolume, R"({"timestamp":"","pulses":0,"volume":99.0})");
+        EXPECT_STREQ("100.5000000", meter.getVolume()) << "Older retained value ignored";
+
+        // pulses since boot are kept when MQTT knew a higher value
+        meter.update(Topic::Pulse, 1L);
+        eventServer.publish(Topic::AddVolume, R"({"timestamp":"","pulses":1,"volume":100.5000609})");
+        EXPECT_STREQ("100.5001218", meter.getVolume()) << "Missing pulse added from the retained value";
     }
 }
@@ -109,6 +109,8 @@ namespace WaterMeterCppTest {
         uint8_t loopPayload[LoopPayloadSize] = { '{','"', 'q', '"', ':', '1','2','3','.','4','5','6', '}' };
         mqttClient.setLoopCallback("homie/client1/result/meter", loopPayload, LoopPayloadSize);
 
+        // we don't wait for the retained value, the loop picks it up
+        gateway.handleQueue();
         EXPECT_TRUE(gateway.getPreviousVolume()) << "Found previous volume";
         ASSERT_EQ(1, volumeListener.getCallCount()) << "Volume published";
         ASSERT_STREQ("{\"q\":123.456}", volumeListener.getPayload()) << "add volume payload ok";
@@ -120,7 +122,7 @@ namespace WaterMeterCppTest {
             EXPECT_TRUE(gateway.publishNextAnnouncement()) << "Announcement #" << count;
             count++;
         }
-        EXPECT_EQ(57, count) << "announcement count";
+        EXPECT_EQ(68, count) << "announcement count";
         gateway.publishNextAnnouncement();
         EXPECT_EQ(0, errorListener.getCallCount()) << "Error not called";
         EXPECT_EQ(0, infoListener.getCallCount()) << "Info not called";
@@ -128,9 +130,9 @@ namespace WaterMeterCppTest {
         EXPECT_STREQ(MqttConfigWithUser.user, mqttClient.user()) << "User OK";
         EXPECT_STREQ("client1", mqttClient.id()) << "Client ID OK";
         // check if the homie init events were sent 
-        EXPECT_EQ(static_cast<size_t>(2158), strlen(mqttClient.getTopics())) << "Topic length OK";
-        EXPECT_EQ(static_cast<size_t>(617), strlen(mqttClient.getPayloads())) << "Payload length OK";
-        EXPECT_EQ(57, mqttClient.getCallCount()) << "Call count";
+        EXPECT_EQ(static_cast<size_t>(2587), strlen(mqttClient.getTopics())) << "Topic length OK";
+        EXPECT_EQ(static_cast<size_t>(745), strlen(mqttClient.getPayloads())) << "Payload length OK";
+        EXPECT_EQ(68, mqttClient.getCallCount()) << "Call count";
 
         gateway.announceReady();
 
@@ -150,6 +152,11 @@ namespace WaterMeterCppTest {
         EXPECT_STREQ("homie/client1/device/reset-sensor\n", mqttClient.getTopics()) << "Payload OK";
         EXPECT_STREQ("1[x]\n", mqttClient.getPayloads()) << "Payload OK";
 
+        mqttClient.reset();
+        eventServer.publish(Topic::HistoryFormatted, R"({"tier":"day"})");
+        EXPECT_STREQ("homie/client1/result/history\n", mqttClient.getTopics()) << "History topic OK";
+        EXPECT_STREQ("{\"tier\":\"day\"}[x]\n", mqttClient.getPayloads()) << "History not retained";
+
         // Incoming valid callback from MQTT should get passed on to the event server
 
         TestEventClient callBackListener(&eventServer);
@@ -175,6 +182,23 @@ namespace WaterMeterCppTest {
         EXPECT_STREQ("123.456", callBackListener.getPayload()) << "callBackListener got right payload";
         callBackListener.reset();
 
+        // Trace commands cross to the sampler as numbers, unknown ones are reported and ignored
+        TestEventClient traceListener(&eventServer);
+        TestEventClient infoListener(&eventServer);
+        eventServer.subscribe(&traceListener, Topic::Trace);
+        eventServer.subscribe(&infoListener, Topic::Info);
+        SafeCString::strcpy(topic, "homie/device_id/measurement/trace/set");
+        uint8_t dumpPayload[] = { 'd', 'u', 'm', 'p' };
+        mqttClient.callBack(topic, dumpPayload, sizeof dumpPayload);
+        EXPECT_EQ(1, traceListener.getCallCount()) << "Trace command passed on";
+        EXPECT_STREQ("2", traceListener.getPayload()) << "Dump passed on as a number";
+        uint8_t bogusPayload[] = { 'o', 'n', 'n' };
+        mqttClient.callBack(topic, bogusPayload, sizeof bogusPayload);
+        EXPECT_EQ(1, traceListener.getCallCount()) << "Unknown trace command not passed on";
+        EXPECT_STREQ("Ignored unknown trace command 'onn'", infoListener.getPayload()) << "Unknown trace command reported";
+        eventServer.unsubscribe(&traceListener);
+        eventServer.unsubscribe(&infoListener);
+
         // Empty payload should get ignored
         mqttClient.callBack(topic, payload1, 0);
         EXPECT_EQ(0, callBackListener.getCallCount()) << "callBackListener not called";
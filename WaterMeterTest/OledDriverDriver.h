@@ -0,0 +1,31 @@
+// Copyright 2024 Rik Essenius
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License. You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and limitations under the License.
+
+
+#pragma once
+
+#include "OledDriver.h"
+
+namespace WaterMeterCppTest {
+    using WaterMeter::EventServer;
+    using WaterMeter::OledDriver;
+
+    class OledDriverDriver final : public OledDriver {
+    public:
+        using OledDriver::OledDriver;
+        using OledDriver::markDirty;
+        using OledDriver::_needsDisplay;
+        using OledDriver::_pageDirty;
+        using OledDriver::_dirtyFirstColumn;
+        using OledDriver::_dirtyLastColumn;
+        using OledDriver::PageCount;
+    };
+}
@@ -14,6 +14,7 @@
 #include <ESP.h>
 #include "TestEventClient.h"
 #include "OledDriver.h"
+#include "OledDriverDriver.h"
 #include "EventServer.h"
 #include "ConnectionState.h"
 
@@ -92,7 +93,9 @@ namespace WaterMeterCppTest {
             EXPECT_EQ(118, display->getX()) << "mqtt X=118";
             EXPECT_EQ(0, display->getY()) << "mqtt Y=0";
 
+            oledDriver.display();
             eventServer.publish(Topic::Alert, false);
+            EXPECT_EQ(25u, oledDriver.display()) << "clearing a logo needs a display";
             EXPECT_EQ(108, display->getX()) << "alert off X=108";
             EXPECT_EQ(0, display->getY()) << "alert off Y=0";
             EXPECT_EQ(7, display->getHeight()) << "alert off H=7";
@@ -143,4 +146,73 @@ namespace WaterMeterCppTest {
             EXPECT_STREQ("No fit:   35 deg ", display->getMessage()) << "NoFit message OK";
         }
 
+        TEST_F(OledDriverTest, markDirtyMergeTest) {
+            OledDriverDriver oledDriver(&eventServer, &Wire1);
+            oledDriver.markDirty(30, 0, 8, 7);
+            oledDriver.markDirty(10, 0, 8, 7);
+            EXPECT_TRUE(oledDriver._pageDirty[0]) << "Page 0 dirty";
+            EXPECT_EQ(10, oledDriver._dirtyFirstColumn[0]) << "Merged range starts at the leftmost region";
+            EXPECT_EQ(37, oledDriver._dirtyLastColumn[0]) << "Merged range ends at the rightmost region";
+            oledDriver.markDirty(20, 2, 4, 4);
+            EXPECT_EQ(10, oledDriver._dirtyFirstColumn[0]) << "Region inside the range keeps the start";
+            EXPECT_EQ(37, oledDriver._dirtyLastColumn[0]) << "Region inside the range keeps the end";
+            for (uint8_t page = 1; page < OledDriverDriver::PageCount; page++) {
+                EXPECT_FALSE(oledDriver._pageDirty[page]) << "Page " << static_cast<int>(page) << " clean";
+            }
+        }
+
+        TEST_F(OledDriverTest, markDirtyPageEdgeTest) {
+            OledDriverDriver oledDriver(&eventServer, &Wire1);
+            // rows 5 to 11 cross from page 0 into page 1
+            oledDriver.markDirty(0, 5, 8, 7);
+            EXPECT_TRUE(oledDriver._pageDirty[0]) << "Page 0 dirty";
+            EXPECT_TRUE(oledDriver._pageDirty[1]) << "Page 1 dirty";
+            EXPECT_FALSE(oledDriver._pageDirty[2]) << "Page 2 clean";
+            EXPECT_EQ(0, oledDriver._dirtyFirstColumn[1]) << "Page 1 start";
+            EXPECT_EQ(7, oledDriver._dirtyLastColumn[1]) << "Page 1 end";
+
+            // rows 8 to 15 are exactly page 1
+            oledDriver.markDirty(50, 8, 10, 8);
+            EXPECT_FALSE(oledDriver._pageDirty[2]) << "Region ending at the page edge leaves page 2 clean";
+            EXPECT_EQ(59, oledDriver._dirtyLastColumn[1]) << "Page 1 range extended";
+            EXPECT_EQ(7, oledDriver._dirtyLastColumn[0]) << "Page 0 range unchanged";
+
+            // clipped to the screen
+            oledDriver.markDirty(120, 28, 16, 8);
+            EXPECT_TRUE(oledDriver._pageDirty[3]) << "Last page dirty";
+            EXPECT_EQ(120, oledDriver._dirtyFirstColumn[3]) << "Last page start";
+            EXPECT_EQ(127, oledDriver._dirtyLastColumn[3]) << "Clipped at the right edge";
+            oledDriver.markDirty(-4, 16, 8, 4);
+            EXPECT_EQ(0, oledDriver._dirtyFirstColumn[2]) << "Clipped at the left edge";
+            EXPECT_EQ(3, oledDriver._dirtyLastColumn[2]) << "Page 2 end";
+        }
+
+        TEST_F(OledDriverTest, markDirtyClearTest) {
+            Wire1.setFlatline(true);
+            OledDriverDriver oledDriver(&eventServer, &Wire1);
+            oledDriver.getDriver()->sensorPresent(true);
+            EXPECT_TRUE(oledDriver.begin()) << "Display found";
+            EXPECT_EQ(0u, oledDriver.display()) << "Nothing to send after begin";
+
+            // off screen regions don't need a display
+            oledDriver.markDirty(130, 0, 8, 7);
+            EXPECT_FALSE(oledDriver._needsDisplay) << "Off screen to the right";
+            oledDriver.markDirty(-10, 0, 8, 7);
+            EXPECT_FALSE(oledDriver._needsDisplay) << "Off screen to the left";
+
+            oledDriver.markDirty(0, 5, 8, 7);
+            EXPECT_TRUE(oledDriver._needsDisplay) << "Needs display";
+            EXPECT_EQ(25u, oledDriver.display()) << "Dirty pages sent";
+            for (uint8_t page = 0; page < OledDriverDriver::PageCount; page++) {
+                EXPECT_FALSE(oledDriver._pageDirty[page]) << "Page " << static_cast<int>(page) << " clean after send";
+            }
+            EXPECT_EQ(0u, oledDriver.display()) << "Nothing left to send";
+
+            // a new region starts a new range instead of merging with the one that was sent
+            oledDriver.markDirty(100, 0, 8, 7);
+            EXPECT_EQ(100, oledDriver._dirtyFirstColumn[0]) << "New range start";
+            EXPECT_EQ(107, oledDriver._dirtyLastColumn[0]) << "New range end";
+            EXPECT_FALSE(oledDriver._pageDirty[1]) << "Page 1 stays clean";
+        }
+
     }
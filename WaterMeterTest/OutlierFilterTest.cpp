@@ -0,0 +1,76 @@
+// Copyright 2024 Rik Essenius
+// 
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License. You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and limitations under the License.
+
+#include "gtest/gtest.h"
+#include "OutlierFilter.h"
+
+namespace WaterMeterCppTest {
+    using WaterMeter::OutlierFilter;
+
+    TEST(OutlierFilterTest, ThresholdTest) {
+        OutlierFilter filter;
+        filter.begin(4.0);
+        EXPECT_DOUBLE_EQ(4.0, filter.threshold()) << "Minimum threshold without history";
+        for (int i = 0; i < 5; i++) {
+            filter.addDistance(0.5);
+        }
+        EXPECT_DOUBLE_EQ(0.5, filter.median()) << "Median";
+        EXPECT_DOUBLE_EQ(4.0, filter.threshold()) << "Clean signal keeps the minimum";
+
+        // a noisier signal widens the threshold, but one large distance doesn't
+        filter.addDistance(100);
+        EXPECT_DOUBLE_EQ(0.5, filter.median()) << "Median ignores a single large distance";
+        for (unsigned int i = 0; i < OutlierFilter::WindowSize; i++) {
+            filter.addDistance(i % 2 == 0 ? 1.5 : 2.5);
+        }
+        EXPECT_DOUBLE_EQ(2.5, filter.median()) << "Median of noisy window";
+        EXPECT_DOUBLE_EQ(10.0, filter.threshold()) << "Noisy signal widens the threshold";
+
+        filter.begin(4.0);
+        EXPECT_DOUBLE_EQ(4.0, filter.threshold()) << "Begin forgets the history";
+    }
+
+    TEST(OutlierFilterTest, DriftTest) {
+        OutlierFilter filter;
+        filter.begin(4.0);
+        for (unsigned int i = 0; i < OutlierFilter::MinDriftCount - 1; i++) {
+            filter.addOutlier({ 120.0 + (i % 2), 80.0 - (i % 3) });
+        }
+        EXPECT_FALSE(filter.isDrift()) << "Not enough outliers yet";
+        filter.addOutlier({ 120.0, 80.0 });
+        EXPECT_TRUE(filter.isDrift()) << "Outliers close together are a drift";
+        const auto shift = filter.driftShift({ 100.0, 100.0 });
+        EXPECT_NEAR(20.4, shift.x, 0.001) << "Shift X";
+        EXPECT_NEAR(-20.9, shift.y, 0.001) << "Shift Y";
+
+        filter.addDistance(1.0);
+        EXPECT_FALSE(filter.isDrift()) << "An accepted point ends the streak";
+        EXPECT_DOUBLE_EQ(0.0, filter.driftShift({ 100.0, 100.0 }).x) << "No shift without streak";
+
+        for (unsigned int i = 0; i < 2 * OutlierFilter::MinDriftCount; i++) {
+            filter.addOutlier({ i % 2 == 0 ? 150.0 : 50.0, 100.0 });
+        }
+        EXPECT_FALSE(filter.isDrift()) << "Scattered outliers are not a drift";
+
+        // moving towards a new position, and then staying there
+        filter.resetStreak();
+        for (int i = 1; i <= 3; i++) {
+            filter.addOutlier({ 100.0 + 7.5 * i, 100.0 });
+        }
+        for (unsigned int i = 0; i < OutlierFilter::MinDriftCount - 1; i++) {
+            filter.addOutlier({ 130.0, 100.0 });
+            EXPECT_FALSE(filter.isDrift()) << "Still in transition #" << i;
+        }
+        filter.addOutlier({ 130.0, 100.0 });
+        EXPECT_TRUE(filter.isDrift()) << "Stable at the new position";
+        EXPECT_DOUBLE_EQ(30.0, filter.driftShift({ 100.0, 100.0 }).x) << "Shift to the new position";
+    }
+}
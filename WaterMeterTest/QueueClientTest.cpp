@@ -17,7 +17,9 @@
 #include "freertos/ringbuf.h"
 
 namespace WaterMeterCppTest {
+    using WaterMeter::ForwardPolicy;
     using WaterMeter::Log;
+    using WaterMeter::MessageArena;
     using WaterMeter::QueueClient;
     
     class QueueClientTest : public testing::Test {
@@ -90,4 +92,141 @@ namespace WaterMeterCppTest {
         }
 
     }
+
+    TEST_F(QueueClientTest, forwardPolicyTest) {
+        uxQueueReset();
+        uxRingbufReset();
+        EventServer localServer;
+        QueueClient qClient(&localServer, &logger, 20, 24);
+        qClient.begin(qClient.getQueueHandle());
+        TestEventClient sampleClient(&localServer);
+        TestEventClient anomalyClient(&localServer);
+        TestEventClient noFitClient(&localServer);
+        TestEventClient pulseClient(&localServer);
+        localServer.subscribe(&sampleClient, Topic::Sample);
+        localServer.subscribe(&anomalyClient, Topic::Anomaly);
+        localServer.subscribe(&noFitClient, Topic::NoFit);
+        localServer.subscribe(&pulseClient, Topic::Pulse);
+        for (const auto topic : { Topic::Sample, Topic::Anomaly, Topic::NoFit, Topic::Pulse }) {
+            localServer.subscribe(&qClient, topic);
+        }
+        qClient.setForwardPolicy(Topic::Sample, ForwardPolicy::Count, 10);
+        qClient.setForwardPolicy(Topic::Anomaly, ForwardPolicy::Latest, 10);
+        qClient.setForwardPolicy(Topic::NoFit, ForwardPolicy::MinInterval, 10);
+
+        // the first event of each topic goes out right away, the rest waits for the interval (or is dropped)
+        for (long i = 0; i < 5; i++) {
+            localServer.publish(Topic::Sample, i);
+        }
+        localServer.publish(Topic::Anomaly, 1L);
+        localServer.publish(Topic::Anomaly, 2L);
+        localServer.publish(Topic::Anomaly, 3L);
+        localServer.publish(Topic::NoFit, 7L);
+        localServer.publish(Topic::NoFit, 8L);
+        localServer.publish(Topic::Pulse, 1L);
+        localServer.publish(Topic::Pulse, 0L);
+        while (qClient.receive()) {}
+        EXPECT_EQ(1, sampleClient.getCallCount()) << "One sample message";
+        EXPECT_STREQ("1", sampleClient.getPayload()) << "Sample count 1";
+        EXPECT_EQ(1, anomalyClient.getCallCount()) << "One anomaly message";
+        EXPECT_STREQ("1", anomalyClient.getPayload()) << "First anomaly";
+        EXPECT_EQ(1, noFitClient.getCallCount()) << "One no fit message";
+        EXPECT_STREQ("7", noFitClient.getPayload()) << "First no fit";
+        EXPECT_EQ(2, pulseClient.getCallCount()) << "All pulses forwarded";
+        EXPECT_STREQ("0", pulseClient.getPayload()) << "Last pulse";
+
+        qClient.flush();
+        EXPECT_FALSE(qClient.receive()) << "Nothing flushed within the interval";
+
+        delay(11);
+        qClient.flush();
+        while (qClient.receive()) {}
+        EXPECT_EQ(2, sampleClient.getCallCount()) << "Count flushed";
+        EXPECT_STREQ("4", sampleClient.getPayload()) << "Remaining 4 samples counted";
+        EXPECT_EQ(2, anomalyClient.getCallCount()) << "Latest anomaly flushed";
+        EXPECT_STREQ("3", anomalyClient.getPayload()) << "Latest anomaly wins";
+        EXPECT_EQ(1, noFitClient.getCallCount()) << "Dropped no fit not flushed";
+
+        qClient.flush();
+        EXPECT_FALSE(qClient.receive()) << "Nothing pending after flush";
+
+        localServer.publish(Topic::NoFit, 9L);
+        localServer.publish(Topic::Sample, 5L);
+        while (qClient.receive()) {}
+        EXPECT_STREQ("9", noFitClient.getPayload()) << "No fit forwarded after interval";
+        EXPECT_EQ(2, sampleClient.getCallCount()) << "Sample within interval after flush held back";
+
+        qClient.setForwardPolicy(Topic::NoFit, ForwardPolicy::All, 0);
+        localServer.publish(Topic::NoFit, 10L);
+        localServer.publish(Topic::NoFit, 11L);
+        while (qClient.receive()) {}
+        EXPECT_EQ(4, noFitClient.getCallCount()) << "All no fits forwarded after policy reset";
+    }
+
+    TEST_F(QueueClientTest, arenaTest) {
+        uxQueueReset();
+        uxRingbufReset();
+        MessageArena arena;
+        EventServer senderServer;
+        EventServer forwarderServer;
+        EventServer receiverServer;
+        QueueClient sender(&senderServer, &logger, 5, 25, &arena);
+        QueueClient forwarder(&forwarderServer, &logger, 5, 26, &arena);
+        QueueClient receiver(&receiverServer, &logger, 5, 27, &arena);
+        sender.begin(forwarder.getQueueHandle());
+        forwarder.begin(receiver.getQueueHandle());
+        senderServer.subscribe(&sender, Topic::Alert);
+        forwarderServer.subscribe(&forwarder, Topic::Alert);
+        TestEventClient forwarderClient(&forwarderServer);
+        TestEventClient receiverClient(&receiverServer);
+        forwarderServer.subscribe(&forwarderClient, Topic::Alert);
+        receiverServer.subscribe(&receiverClient, Topic::Alert);
+
+        char buffer[20];
+        SafeCString::strcpy(buffer, "first");
+        senderServer.publish(Topic::Alert, buffer);
+        SafeCString::strcpy(buffer, "second");
+        senderServer.publish(Topic::Alert, buffer);
+        // the sender is free to reuse its buffer right away
+        SafeCString::strcpy(buffer, "overwritten");
+        EXPECT_EQ(MessageArena::SlotCount - 2, arena.freeSlots()) << "Two slots in use";
+
+        EXPECT_TRUE(forwarder.receive()) << "Forwarder received first";
+        EXPECT_STREQ("first", forwarderClient.getPayload()) << "First message intact";
+        EXPECT_EQ(MessageArena::SlotCount - 2, arena.freeSlots()) << "Forwarded message kept its slot without a copy";
+        EXPECT_TRUE(forwarder.receive()) << "Forwarder received second";
+        EXPECT_STREQ("second", forwarderClient.getPayload()) << "Second message intact";
+
+        EXPECT_TRUE(receiver.receive()) << "Receiver received first";
+        EXPECT_STREQ("first", receiverClient.getPayload()) << "First message intact after two hops";
+        EXPECT_EQ(MessageArena::SlotCount - 1, arena.freeSlots()) << "First slot released";
+        EXPECT_TRUE(receiver.receive()) << "Receiver received second";
+        EXPECT_STREQ("second", receiverClient.getPayload()) << "Second message intact after two hops";
+        EXPECT_EQ(MessageArena::SlotCount, arena.freeSlots()) << "All slots released";
+
+        // a message that doesn't fit in the arena is dropped, as the sender's buffer may be gone by the time it arrives
+        const std::string tooLong(MessageArena::SlotSize, 'x');
+        clearPrintOutput();
+        senderServer.publish(Topic::Alert, tooLong.c_str());
+        EXPECT_EQ(MessageArena::SlotCount, arena.freeSlots()) << "Too long message not in the arena";
+        EXPECT_FALSE(forwarder.receive()) << "Too long message not sent";
+        EXPECT_NE(std::string::npos, std::string(getPrintOutput()).find("message dropped")) << "Drop logged";
+    }
+
+    TEST_F(QueueClientTest, notifyTest) {
+        uxQueueReset();
+        QueueClient sender(&eventServer, &logger, 0, 28);
+        QueueClient receiver(&eventServer, &logger, 5, 29);
+        sender.begin(receiver.getQueueHandle());
+        eventServer.subscribe(&sender, Topic::Pulse);
+        // clear any pending notifications
+        ulTaskNotifyTake(pdTRUE, 0);
+        eventServer.publish(Topic::Pulse, 1L);
+        EXPECT_EQ(0UL, ulTaskNotifyTake(pdTRUE, 0)) << "No notification without a task to notify";
+        sender.notifyOnSend(xTaskGetCurrentTaskHandle());
+        eventServer.publish(Topic::Pulse, 0L);
+        eventServer.publish(Topic::Pulse, 1L);
+        EXPECT_EQ(2UL, ulTaskNotifyTake(pdTRUE, 0)) << "Notified on every send";
+        eventServer.unsubscribe(&sender);
+    }
 }
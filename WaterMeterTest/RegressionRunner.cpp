@@ -0,0 +1,223 @@
+// Copyright 2024 Rik Essenius
+// 
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License. You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and limitations under the License.
+
+#include "RegressionRunner.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <sstream>
+#include <thread>
+#include <EllipseFit.h>
+
+#include "CaptureFile.h"
+#include "FlowDetector.h"
+#include "PulseTestEventClient.h"
+
+namespace WaterMeterCppTest {
+    using EllipseMath::EllipseFit;
+    using WaterMeter::FlowDetector;
+
+    RegressionRunner::RegressionRunner(std::string dataFolder) : _dataFolder(std::move(dataFolder)) {}
+
+    std::vector<std::string> RegressionRunner::diff(const std::vector<RegressionCase>& baseline, const std::vector<RegressionResult>& results) {
+        std::map<std::string, const RegressionResult*> resultMap;
+        for (const auto& result : results) {
+            resultMap[caseName(result.actual)] = &result;
+        }
+        std::vector<std::string> differences;
+        for (const auto& expected : baseline) {
+            const auto name = caseName(expected);
+            const auto entry = resultMap.find(name);
+            if (entry == resultMap.end()) {
+                differences.push_back(name + ": no result");
+                continue;
+            }
+            const auto result = entry->second;
+            if (!result->opened) {
+                differences.push_back(name + ": could not open");
+                continue;
+            }
+            const auto& actual = result->actual;
+            const std::pair<const char*, std::pair<unsigned int, unsigned int>> counts[] = {
+                {"firstPulses", {expected.firstPulses, actual.firstPulses}},
+                {"nextPulses", {expected.nextPulses, actual.nextPulses}},
+                {"anomalies", {expected.anomalies, actual.anomalies}},
+                {"noFits", {expected.noFits, actual.noFits}},
+                {"drifts", {expected.drifts, actual.drifts}}
+            };
+            for (const auto& count : counts) {
+                if (count.second.first != count.second.second) {
+                    std::stringstream message;
+                    message << name << ": " << count.first << " expected " << count.second.first << ", got " << count.second.second;
+                    differences.push_back(message.str());
+                }
+            }
+        }
+        return differences;
+    }
+
+    // the same capture can be in the baseline once for each outlier mode
+    std::string RegressionRunner::caseName(const RegressionCase& testCase) {
+        return testCase.outlierMode == OutlierMode::Fixed ? testCase.fileName : testCase.fileName + " (adaptive)";
+    }
+
+    const char* RegressionRunner::modeName(const OutlierMode mode) {
+        return mode == OutlierMode::Adaptive ? "Adaptive" : "Fixed";
+    }
+
+    std::string RegressionRunner::escapeJson(const std::string& input) {
+        std::string output;
+        for (const auto character : input) {
+            if (character == '"' || character == '\\') output += '\\';
+            output += character;
+        }
+        return output;
+    }
+
+    // Format: header line, then File,NoiseLimit,OutlierMode,FirstPulses,NextPulses,Anomalies,NoFits,Drifts[,...].
+    // OutlierMode is Fixed or Adaptive.
+    // Extra columns (as written by writeCsv) are ignored, so a result file can be used as a baseline.
+    bool RegressionRunner::readBaseline(const std::string& fileName, std::vector<RegressionCase>& cases) {
+        std::ifstream baseline(fileName);
+        if (!baseline.is_open()) return false;
+        baseline.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+        std::string line;
+        while (std::getline(baseline, line)) {
+            if (line.empty()) continue;
+            std::stringstream fields(line);
+            RegressionCase testCase;
+            char separator;
+            std::string mode;
+            std::getline(fields, testCase.fileName, ',');
+            fields >> testCase.noiseLimit >> separator;
+            std::getline(fields, mode, ',');
+            if (mode == modeName(OutlierMode::Adaptive)) {
+                testCase.outlierMode = OutlierMode::Adaptive;
+            } else if (mode != modeName(OutlierMode::Fixed)) {
+                return false;
+            }
+            fields >> testCase.firstPulses >> separator >> testCase.nextPulses >> separator
+                >> testCase.anomalies >> separator >> testCase.noFits >> separator >> testCase.drifts;
+            if (fields.fail()) return false;
+            cases.push_back(testCase);
+        }
+        return true;
+    }
+
+    std::vector<RegressionResult> RegressionRunner::run(const std::vector<RegressionCase>& cases, unsigned int threadCount) const {
+        std::vector<RegressionResult> results(cases.size());
+        if (threadCount == 0) threadCount = std::max(1u, std::thread::hardware_concurrency());
+        threadCount = std::min(threadCount, static_cast<unsigned int>(cases.size()));
+
+        // workers pick up the next case until all are done, so a long capture does not hold up a whole batch
+        std::atomic<size_t> nextCase(0);
+        std::vector<std::thread> workers;
+        for (unsigned int i = 0; i < threadCount; i++) {
+            workers.emplace_back([&] {
+                size_t index;
+                while ((index = nextCase++) < cases.size()) {
+                    results[index] = runCase(cases[index]);
+                }
+            });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        return results;
+    }
+
+    RegressionResult RegressionRunner::runCase(const RegressionCase& testCase) const {
+        RegressionResult result;
+        result.actual.fileName = testCase.fileName;
+        result.actual.noiseLimit = testCase.noiseLimit;
+        result.actual.outlierMode = testCase.outlierMode;
+        const auto path = _dataFolder + testCase.fileName;
+        const auto isCapture = CaptureFile::isCaptureFile(path.c_str());
+        CaptureFile capture;
+        std::ifstream measurements;
+        if (isCapture) {
+            result.opened = capture.open(path.c_str());
+        } else {
+            measurements.open(path);
+            result.opened = measurements.is_open();
+        }
+        if (!result.opened) return result;
+
+        const auto start = std::chrono::steady_clock::now();
+        EventServer eventServer;
+        EllipseFit ellipseFit;
+        FlowDetector flowDetector(&eventServer, &ellipseFit);
+        PulseTestEventClient pulseClient(&eventServer);
+        flowDetector.begin(testCase.noiseLimit, testCase.outlierMode);
+        SensorSample measurement{};
+        if (isCapture) {
+            for (uint32_t i = 0; i < capture.sampleCount(); i++) {
+                measurement.x = capture.samples()[i].x;
+                measurement.y = capture.samples()[i].y;
+                result.samples++;
+                eventServer.publish(Topic::Sample, measurement);
+            }
+        } else {
+            measurements.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+            while (measurements >> measurement.x) {
+                measurements >> measurement.y;
+                result.samples++;
+                eventServer.publish(Topic::Sample, measurement);
+            }
+        }
+        const auto end = std::chrono::steady_clock::now();
+
+        result.actual.firstPulses = pulseClient.pulses(false);
+        result.actual.nextPulses = pulseClient.pulses(true);
+        result.actual.anomalies = pulseClient.anomalies();
+        result.actual.noFits = pulseClient.noFits();
+        result.actual.drifts = pulseClient.drifts();
+        result.centerTimes10 = flowDetector.ellipseCenterTimes10();
+        result.radiusTimes10 = flowDetector.ellipseRadiusTimes10();
+        result.angleTimes10 = flowDetector.ellipseAngleTimes10();
+        result.wallTimeMillis = std::chrono::duration<double, std::milli>(end - start).count();
+        return result;
+    }
+
+    void RegressionRunner::writeCsv(std::ostream& stream, const std::vector<RegressionResult>& results) {
+        stream << "File,NoiseLimit,OutlierMode,FirstPulses,NextPulses,Anomalies,NoFits,Drifts,Samples,CenterX10,CenterY10,RadiusX10,RadiusY10,Angle10,WallTimeMs\n";
+        for (const auto& result : results) {
+            const auto& actual = result.actual;
+            stream << actual.fileName << "," << actual.noiseLimit << "," << modeName(actual.outlierMode) << ","
+                << actual.firstPulses << "," << actual.nextPulses << "," << actual.anomalies << "," << actual.noFits << ","
+                << actual.drifts << "," << result.samples << ","
+                << result.centerTimes10.x << "," << result.centerTimes10.y << "," << result.radiusTimes10.x << ","
+                << result.radiusTimes10.y << "," << result.angleTimes10 << "," << result.wallTimeMillis << "\n";
+        }
+    }
+
+    void RegressionRunner::writeJson(std::ostream& stream, const std::vector<RegressionResult>& results) {
+        stream << "[";
+        for (size_t i = 0; i < results.size(); i++) {
+            const auto& result = results[i];
+            const auto& actual = result.actual;
+            stream << (i == 0 ? "\n" : ",\n")
+                << "  {\"file\":\"" << escapeJson(actual.fileName) << "\",\"opened\":" << (result.opened ? "true" : "false")
+                << ",\"noiseLimit\":" << actual.noiseLimit << ",\"outlierMode\":\"" << modeName(actual.outlierMode)
+                << "\",\"firstPulses\":" << actual.firstPulses
+                << ",\"nextPulses\":" << actual.nextPulses << ",\"anomalies\":" << actual.anomalies
+                << ",\"noFits\":" << actual.noFits << ",\"drifts\":" << actual.drifts << ",\"samples\":" << result.samples
+                << ",\"fit\":{\"centerX10\":" << result.centerTimes10.x << ",\"centerY10\":" << result.centerTimes10.y
+                << ",\"radiusX10\":" << result.radiusTimes10.x << ",\"radiusY10\":" << result.radiusTimes10.y
+                << ",\"angle10\":" << result.angleTimes10 << "},\"wallTimeMs\":" << result.wallTimeMillis << "}";
+        }
+        stream << "\n]\n";
+    }
+}
@@ -0,0 +1,66 @@
+// Copyright 2024 Rik Essenius
+// 
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License. You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and limitations under the License.
+
+// Replays a set of sensor captures (text or binary, see CaptureFile) through independent FlowDetector/EllipseFit
+// instances on a pool of threads. Every capture gets its own EventServer, so the runs do not share any state.
+// The cases (file, noise limit, outlier mode and expected counts) come from a golden baseline in CSV format; results can be written
+// as CSV (in the same format, so a result file can become the next baseline) or as JSON, and diffed against the baseline.
+
+#pragma once
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "FlowDetector.h"
+#include "SensorSample.h"
+
+namespace WaterMeterCppTest {
+    using WaterMeter::OutlierMode;
+    using WaterMeter::SensorSample;
+
+    struct RegressionCase {
+        std::string fileName;
+        unsigned int noiseLimit = 3;
+        OutlierMode outlierMode = OutlierMode::Fixed;
+        unsigned int firstPulses = 0;
+        unsigned int nextPulses = 0;
+        unsigned int anomalies = 0;
+        unsigned int noFits = 0;
+        unsigned int drifts = 0;
+    };
+
+    struct RegressionResult {
+        RegressionCase actual;
+        bool opened = false;
+        unsigned int samples = 0;
+        SensorSample centerTimes10 = {};
+        SensorSample radiusTimes10 = {};
+        int16_t angleTimes10 = 0;
+        double wallTimeMillis = 0;
+    };
+
+    class RegressionRunner {
+    public:
+        explicit RegressionRunner(std::string dataFolder = "testData\\");
+        static std::vector<std::string> diff(const std::vector<RegressionCase>& baseline, const std::vector<RegressionResult>& results);
+        static bool readBaseline(const std::string& fileName, std::vector<RegressionCase>& cases);
+        std::vector<RegressionResult> run(const std::vector<RegressionCase>& cases, unsigned int threadCount = 0) const;
+        RegressionResult runCase(const RegressionCase& testCase) const;
+        static void writeCsv(std::ostream& stream, const std::vector<RegressionResult>& results);
+        static void writeJson(std::ostream& stream, const std::vector<RegressionResult>& results);
+    private:
+        static std::string caseName(const RegressionCase& testCase);
+        static std::string escapeJson(const std::string& input);
+        static const char* modeName(OutlierMode mode);
+        std::string _dataFolder;
+    };
+}
@@ -0,0 +1,102 @@
+// Copyright 2024 Rik Essenius
+// 
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License. You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and limitations under the License.
+
+// The baseline run doubles as the regression tool: run with --gtest_filter=RegressionRunnerTest.* after adding
+// captures to testData and regressionBaseline.csv, and inspect regressionResult.csv/.json for the details.
+
+#include <gtest/gtest.h>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "RegressionRunner.h"
+
+namespace WaterMeterCppTest {
+
+    class RegressionRunnerTest : public testing::Test {
+    protected:
+        static std::vector<RegressionCase> readBaseline() {
+            std::vector<RegressionCase> cases;
+            EXPECT_TRUE(RegressionRunner::readBaseline("testData\\regressionBaseline.csv", cases)) << "Baseline read";
+            return cases;
+        }
+    };
+
+    TEST_F(RegressionRunnerTest, BaselineTest) {
+        const auto baseline = readBaseline();
+        ASSERT_FALSE(baseline.empty()) << "Baseline has cases";
+        const RegressionRunner runner;
+        const auto results = runner.run(baseline, 4);
+        ASSERT_EQ(baseline.size(), results.size()) << "Result for every case";
+
+        std::ofstream csv("regressionResult.csv");
+        RegressionRunner::writeCsv(csv, results);
+        std::ofstream json("regressionResult.json");
+        RegressionRunner::writeJson(json, results);
+
+        const auto differences = RegressionRunner::diff(baseline, results);
+        for (const auto& difference : differences) {
+            std::cout << difference << "\n";
+        }
+        EXPECT_TRUE(differences.empty()) << "No differences with baseline";
+    }
+
+    TEST_F(RegressionRunnerTest, ParallelMatchesSerialTest) {
+        const auto baseline = readBaseline();
+        const RegressionRunner runner;
+        const auto serial = runner.run(baseline, 1);
+        const auto parallel = runner.run(baseline, 8);
+        ASSERT_EQ(serial.size(), parallel.size()) << "Same number of results";
+        for (size_t i = 0; i < serial.size(); i++) {
+            const auto& fileName = serial[i].actual.fileName;
+            EXPECT_EQ(fileName, parallel[i].actual.fileName) << "Same order";
+            EXPECT_EQ(serial[i].samples, parallel[i].samples) << fileName << ": samples";
+            EXPECT_EQ(serial[i].actual.nextPulses, parallel[i].actual.nextPulses) << fileName << ": pulses";
+            EXPECT_EQ(serial[i].actual.anomalies, parallel[i].actual.anomalies) << fileName << ": anomalies";
+            EXPECT_EQ(serial[i].centerTimes10.x, parallel[i].centerTimes10.x) << fileName << ": center X";
+            EXPECT_EQ(serial[i].radiusTimes10.y, parallel[i].radiusTimes10.y) << fileName << ": radius Y";
+        }
+    }
+
+    TEST_F(RegressionRunnerTest, DiffTest) {
+        RegressionCase expected;
+        expected.fileName = "60cycles.txt";
+        expected.firstPulses = 1;
+        expected.nextPulses = 59;
+        RegressionCase missing;
+        missing.fileName = "doesNotExist.txt";
+        RegressionCase notRun;
+        notRun.fileName = "notRun.txt";
+
+        const RegressionRunner runner;
+        auto results = runner.run({ expected, missing }, 2);
+        EXPECT_TRUE(results[0].opened) << "First file opened";
+        EXPECT_FALSE(results[1].opened) << "Second file not opened";
+        results[0].actual.nextPulses = 58;
+
+        const auto differences = RegressionRunner::diff({ expected, missing, notRun }, results);
+        ASSERT_EQ(3u, differences.size()) << "Three differences";
+        EXPECT_EQ("60cycles.txt: nextPulses expected 59, got 58", differences[0]) << "Count difference";
+        EXPECT_EQ("doesNotExist.txt: could not open", differences[1]) << "Missing file";
+        EXPECT_EQ("notRun.txt: no result", differences[2]) << "Missing result";
+
+        // the same capture in adaptive mode is a case of its own
+        RegressionCase adaptive = expected;
+        adaptive.outlierMode = OutlierMode::Adaptive;
+        const auto adaptiveDifferences = RegressionRunner::diff({ adaptive }, { results[0] });
+        ASSERT_EQ(1u, adaptiveDifferences.size()) << "Fixed result does not count for adaptive";
+        EXPECT_EQ("60cycles.txt (adaptive): no result", adaptiveDifferences[0]) << "Adaptive case named";
+
+        std::stringstream json;
+        RegressionRunner::writeJson(json, { results[1] });
+        EXPECT_NE(std::string::npos, json.str().find("\"file\":\"doesNotExist.txt\",\"opened\":false")) << "JSON written";
+    }
+}
@@ -107,11 +107,10 @@ namespace WaterMeterCppTest {
         EXPECT_EQ(currentTimestamp, payload.timestamp) << "Timestamp not set";
         EXPECT_EQ(0U, static_cast<unsigned>(payload.buffer.samples.count)) << "Buffer empty";
 
-        // check whether failure to write is handled OK
+        // check whether failure to write is handled OK. Room is reserved at the start of a batch.
         eventServer.publish(Topic::BatchSizeDesired, 2L);
         EXPECT_EQ(2L, aggregator.getFlushRate()) << "Flush rate changed back to 2";
         SensorSample sample4{{-3000, -3000}};
-        aggregator.addSample(sample4);
         setRingBufferBufferFull(dataQueue.handle(), true);
         aggregator.addSample(sample4);
         EXPECT_EQ(0U, static_cast<unsigned>(payload.buffer.samples.count)) << "Buffer flushed since we can't write";
@@ -21,8 +21,8 @@ namespace WaterMeterCppTest {
         using Sampler::sensorLoop;
 
         SamplerDriver(EventServer* eventServer, MagnetoSensorReader* sensorReader, FlowDetector* flowDetector, Button* button,
-            SampleAggregator* sampleAggregator, ResultAggregator* resultAggregator, QueueClient* queueClient)
-            : Sampler(eventServer, sensorReader, flowDetector, button, sampleAggregator, resultAggregator, queueClient) {}
+            SampleAggregator* sampleAggregator, ResultAggregator* resultAggregator, EventBus* eventBus)
+            : Sampler(eventServer, sensorReader, flowDetector, button, sampleAggregator, resultAggregator, eventBus) {}
 
 
     };
@@ -53,9 +53,12 @@ namespace WaterMeterCppTest {
         DataQueuePayload payload3;
         SampleAggregator sampleAggregator(&eventServer, nullptr, &dataQueue1, &payload2);
         ResultAggregator resultAggregator(&eventServer, nullptr, &dataQueue2, &payload3, 10000);
-        QueueClient queueClient(&eventServer, nullptr, 10, 0);
+        EventServer communicatorEventServer;
+        EventServer connectorEventServer;
+        // not started, so nothing gets sent to the other event servers
+        EventBus eventBus(&eventServer, &communicatorEventServer, &connectorEventServer, nullptr);
         Button button(&buttonPublisher, 34);
-        SamplerDriver sampler(&eventServer, &reader, &flowDetector, &button, &sampleAggregator, &resultAggregator, &queueClient);
+        SamplerDriver sampler(&eventServer, &reader, &flowDetector, &button, &sampleAggregator, &resultAggregator, &eventBus);
 
         EXPECT_TRUE(sampler.begin(list, 1)) << "Begin with mock sensor succeeds";
         auto handle = reinterpret_cast<TaskHandle_t>(3);
@@ -0,0 +1,85 @@
+// Copyright 2024 Rik Essenius
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License. You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and limitations under the License.
+
+#include <algorithm>
+
+#include "gtest/gtest.h"
+
+#include "EventServer.h"
+#include "TaskProfiler.h"
+#include "TestEventClient.h"
+
+namespace WaterMeterCppTest {
+    using WaterMeter::PayloadBuilder;
+    using WaterMeter::RunTimeSource;
+    using WaterMeter::TaskProfiler;
+    using WaterMeter::TaskRunTime;
+
+    // emulates the FreeRTOS run-time stats: the counters only go up, and the total is the elapsed time
+    class RunTimeSourceStub final : public RunTimeSource {
+    public:
+        TaskRunTime tasks[5] = {{"Sampler", 0}, {"loopTask", 0}, {"Connector", 0}, {"IDLE0", 0}, {"IDLE1", 0}};
+        uint32_t totalRunTime = 0;
+
+        size_t read(TaskRunTime* target, const size_t maxTasks, uint32_t& total) override {
+            const size_t count = std::min(maxTasks, sizeof tasks / sizeof tasks[0]);
+            for (size_t i = 0; i < count; i++) target[i] = tasks[i];
+            total = totalRunTime;
+            return count;
+        }
+
+        void run(const uint32_t sampler, const uint32_t loop, const uint32_t connector, const uint32_t idle0, const uint32_t idle1, const uint32_t total) {
+            tasks[0].runTime += sampler;
+            tasks[1].runTime += loop;
+            tasks[2].runTime += connector;
+            tasks[3].runTime += idle0;
+            tasks[4].runTime += idle1;
+            totalRunTime += total;
+        }
+    };
+
+    TEST(TaskProfilerTest, reportTest) {
+        EventServer eventServer;
+        TestEventClient cpuListener(&eventServer);
+        eventServer.subscribe(&cpuListener, Topic::CpuFormatted);
+        RunTimeSourceStub source;
+        PayloadBuilder payloadBuilder;
+        TaskProfiler profiler(&eventServer, &source, &payloadBuilder);
+
+        source.run(100, 200, 300, 400, 500, 1000);
+        EXPECT_EQ(TaskProfiler::ReportIntervalMicros, profiler.report()) << "Next report due after the interval";
+        EXPECT_EQ(0, cpuListener.getCallCount()) << "First round only sets the baseline";
+
+        source.run(50000, 200000, 100000, 850000, 750000, 1000000);
+        profiler.recordWake(10);
+        profiler.recordWake(30);
+        profiler.recordWake(20);
+        EXPECT_GE(TaskProfiler::ReportIntervalMicros, profiler.report()) << "Waits at most the interval";
+        EXPECT_EQ(0, cpuListener.getCallCount()) << "Not reported before the interval passed";
+
+        delay(TaskProfiler::ReportIntervalMicros / 1000);
+        profiler.report();
+        ASSERT_EQ(1, cpuListener.getCallCount()) << "Reported";
+        EXPECT_STREQ(
+            R"({"sampler":5,"loop":20,"connector":10,"idle0":85,"idle1":75,)"
+            R"("sampler-wakes":3,"latency-us":20,"max-latency-us":30})",
+            cpuListener.getPayload()) << "Shares since the last report, and the sampler latency";
+
+        source.run(0, 0, 0, 1000000, 500000, 1000000);
+        profiler.recordWake(5);
+        delay(TaskProfiler::ReportIntervalMicros / 1000);
+        profiler.report();
+        EXPECT_STREQ(
+            R"({"sampler":0,"loop":0,"connector":0,"idle0":100,"idle1":50,)"
+            R"("sampler-wakes":1,"latency-us":5,"max-latency-us":5})",
+            cpuListener.getPayload()) << "Maximum starts over each report";
+    }
+}
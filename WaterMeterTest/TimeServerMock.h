@@ -18,8 +18,12 @@ namespace WaterMeterCppTest {
 
     class TimeServerMock final : public TimeServer {
     public:
-        void setTime() override { _wasSet = true; }
+        void setTime() override { if (_isResponding) _wasSet = true; }
         bool timeWasSet() const override { return _wasSet; }
         void reset() { _wasSet = false; }
+        // while not responding, time requests don't set the time
+        void setResponding(const bool isResponding) { _isResponding = isResponding; }
+    private:
+        bool _isResponding = true;
     };
 }
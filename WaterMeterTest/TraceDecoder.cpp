@@ -0,0 +1,87 @@
+// Copyright 2024 Rik Essenius
+// 
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License. You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and limitations under the License.
+
+#include "TraceDecoder.h"
+
+#include <cstring>
+
+namespace WaterMeterCppTest {
+    constexpr int RecordDigits = 16;
+
+    bool TraceDecoder::decode(const char* payload, std::vector<TraceRecord>& records) {
+        // accept both the full JSON payload and just the hex string
+        constexpr auto Label = "\"trace\":\"";
+        const char* start = strstr(payload, Label);
+        start = start == nullptr ? payload : start + strlen(Label);
+        const char* end = strchr(start, '"');
+        const auto length = end == nullptr ? strlen(start) : static_cast<size_t>(end - start);
+        if (length % RecordDigits != 0) return false;
+        for (auto position = start; position < start + length; position += RecordDigits) {
+            uint32_t sampleIndex;
+            uint32_t decision;
+            uint32_t flags;
+            uint32_t value;
+            if (!parseHex(position, 8, sampleIndex) || !parseHex(position + 8, 2, decision) ||
+                !parseHex(position + 10, 2, flags) || !parseHex(position + 12, 4, value)) {
+                return false;
+            }
+            records.push_back({ sampleIndex, static_cast<TraceDecision>(decision), static_cast<uint8_t>(flags), static_cast<uint16_t>(value) });
+        }
+        return true;
+    }
+
+    const char* TraceDecoder::decisionName(const TraceDecision decision) {
+        switch (decision) {
+        case TraceDecision::Anomaly: return "Anomaly";
+        case TraceDecision::Startup: return "Startup";
+        case TraceDecision::TooClose: return "TooClose";
+        case TraceDecision::Outlier: return "Outlier";
+        case TraceDecision::Drift: return "Drift";
+        case TraceDecision::Accepted: return "Accepted";
+        case TraceDecision::FitAccepted: return "FitAccepted";
+        case TraceDecision::FitRejected: return "FitRejected";
+        case TraceDecision::FitSkipped: return "FitSkipped";
+        case TraceDecision::Reset: return "Reset";
+        default: return "None";
+        }
+    }
+
+    bool TraceDecoder::parseHex(const char* input, const int digits, uint32_t& value) {
+        value = 0;
+        for (int i = 0; i < digits; i++) {
+            const auto character = input[i];
+            uint32_t digit;
+            if (character >= '0' && character <= '9') digit = character - '0';
+            else if (character >= 'a' && character <= 'f') digit = character - 'a' + 10;
+            else if (character >= 'A' && character <= 'F') digit = character - 'A' + 10;
+            else return false;
+            value = value << 4 | digit;
+        }
+        return true;
+    }
+
+    void TraceDecoder::replay(std::ostream& stream, const std::vector<TraceRecord>& records, const CaptureSample* samples,
+        const size_t sampleCount) {
+        stream << "Sample,X,Y,Decision,Quadrant,Pulse,Searching,Fit,Value\n";
+        for (const auto& record : records) {
+            stream << record.sampleIndex << ",";
+            if (record.sampleIndex > 0 && record.sampleIndex <= sampleCount) {
+                const auto& sample = samples[record.sampleIndex - 1];
+                stream << sample.x << "," << sample.y;
+            }
+            else {
+                stream << ",";
+            }
+            stream << "," << decisionName(record.decision) << "," << record.quadrant() << "," << record.foundPulse() << ","
+                << record.isSearching() << "," << record.hasFit() << "," << record.value << "\n";
+        }
+    }
+}
@@ -0,0 +1,38 @@
+// Copyright 2024 Rik Essenius
+// 
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License. You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and limitations under the License.
+
+// Decodes FlowDetector decision traces as published on measurement/trace (see FlowTrace and Serializer), and replays
+// them next to the raw samples of a capture, so a miscount can be followed sample by sample.
+// The sample index in a record is 1-based and counts from the moment the detector started, so the capture
+// needs to start there as well (which is the case for the files in testData).
+
+#pragma once
+
+#include <ostream>
+#include <vector>
+
+#include "CaptureFormat.h"
+#include "TraceRecord.h"
+
+namespace WaterMeterCppTest {
+    using WaterMeter::CaptureSample;
+    using WaterMeter::TraceDecision;
+    using WaterMeter::TraceRecord;
+
+    class TraceDecoder {
+    public:
+        static bool decode(const char* payload, std::vector<TraceRecord>& records);
+        static const char* decisionName(TraceDecision decision);
+        static void replay(std::ostream& stream, const std::vector<TraceRecord>& records, const CaptureSample* samples, size_t sampleCount);
+    private:
+        static bool parseHex(const char* input, int digits, uint32_t& value);
+    };
+}
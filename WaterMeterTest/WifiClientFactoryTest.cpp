@@ -13,6 +13,8 @@
 #include "WiFiClientFactory.h"
 
 namespace WaterMeterCppTest {
+    using WaterMeter::ClientRole;
+    using WaterMeter::Configuration;
     using WaterMeter::TlsConfig;
     using WaterMeter::WiFiClientFactory;
 
@@ -36,4 +38,36 @@ namespace WaterMeterCppTest {
         EXPECT_TRUE(dynamic_cast<WiFiClientSecure*>(secureClient)->isSecure()) << "Secure client with certs is secure";
     }
 
+    TEST(WifiClientFactoryTest, configurationTest) {
+        Preferences preferences;
+        constexpr TlsConfig Config{"abc", "defg", "hijkl"};
+        Configuration configuration(&preferences);
+        configuration.putTlsConfig(&Config);
+        configuration.begin(false);
+        EXPECT_EQ(nullptr, configuration.tls.rootCaCertificate) << "Certificates not loaded at begin";
+        // setup() loads them before the tasks start
+        configuration.loadTlsConfig();
+        EXPECT_STREQ("abc", configuration.tls.rootCaCertificate) << "Root CA loaded";
+        EXPECT_STREQ("defg", configuration.tls.deviceCertificate) << "Device certificate loaded";
+        EXPECT_STREQ("hijkl", configuration.tls.devicePrivateKey) << "Device key loaded";
+        const WiFiClientFactory factory(&configuration.tls);
+        const auto secureClient = factory.create(true);
+        EXPECT_TRUE(dynamic_cast<WiFiClientSecure*>(secureClient)->isSecure()) << "Secure client with loaded certs is secure";
+        delete secureClient;
+    }
+
+    TEST(WifiClientFactoryTest, acquireTest) {
+        constexpr TlsConfig Config{"a", "b", "c"};
+        const WiFiClientFactory factory(&Config);
+        const auto mqttClient = factory.acquire(ClientRole::Mqtt, true);
+        EXPECT_EQ(mqttClient, factory.acquire(ClientRole::Mqtt, true)) << "Reconnects reuse the client";
+        EXPECT_STREQ("WifiClientSecure", mqttClient->getType()) << "MQTT client is secure";
+        const auto firmwareClient = factory.acquire(ClientRole::Firmware, "https://localhost/images/");
+        EXPECT_NE(mqttClient, firmwareClient) << "Firmware has its own client";
+        EXPECT_EQ(firmwareClient, factory.acquire(ClientRole::Firmware, "https://localhost/images/x.bin"))
+            << "Version check and download share the client";
+        const auto plainClient = factory.acquire(ClientRole::Firmware, "http://localhost/images/");
+        EXPECT_NE(firmwareClient, plainClient) << "Plain client differs";
+        EXPECT_STREQ("WifiClient", plainClient->getType()) << "Plain client is not secure";
+    }
 }
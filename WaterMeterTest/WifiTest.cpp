@@ -21,6 +21,7 @@
 #include "WiFiManager.h"
 
 namespace WaterMeterCppTest {
+    using WaterMeter::ConnectionCache;
     using WaterMeter::IpConfig;
     using WaterMeter::NoIp;
     using WaterMeter::PayloadBuilder;
@@ -91,6 +92,50 @@ namespace WaterMeterCppTest {
             payloadBuilder.toString()) << "Info OK";
     }
 
+    TEST_F(WiFiTest, cachedConnectionTest) {
+        constexpr WifiConfig Config{"ssid", "password", "hostname", nullptr};
+        PayloadBuilder payloadBuilder;
+        TestEventClient infoListener(&eventServer);
+        eventServer.subscribe(&infoListener, Topic::Info);
+        ConnectionCache connectionCache;
+        connectionCache.clear();
+        WiFiManager wifi(&eventServer, &Config, &payloadBuilder, &connectionCache);
+        wifi.configure();
+        wifi.begin();
+        while (!wifi.isConnected()) {}
+        wifi.announceReady();
+
+        int32_t channel;
+        uint8_t bssid[6];
+        IpConfig lease{};
+        ASSERT_TRUE(connectionCache.getLink("ssid", channel, bssid, lease)) << "Link cached";
+        EXPECT_EQ(13, channel) << "Channel cached";
+        EXPECT_EQ(IPAddress(10, 0, 0, 2), lease.localIp) << "Lease cached";
+
+        // after a reset, the lease is used right away, so no second round to fix the IP address
+        WiFi.reset();
+        WiFiManager wifi2(&eventServer, &Config, &payloadBuilder, &connectionCache);
+        wifi2.configure();
+        wifi2.begin();
+        while (!wifi2.isConnected()) {}
+        EXPECT_FALSE(wifi2.needsReInit()) << "Cached lease is fixed already";
+        EXPECT_EQ(IPAddress(10, 0, 0, 2), WiFi.localIP()) << "Local IP from cache";
+        EXPECT_EQ(0, infoListener.getCallCount()) << "No fallback";
+
+        // if the cached access point doesn't answer in time, forget it and do the full scan
+        wifi2.disconnect();
+        WiFi.connectIn(3);
+        wifi2.reconnect();
+        EXPECT_FALSE(wifi2.isConnected()) << "Not connected yet";
+        delay(WiFiManager::FastConnectTimeoutMicros / 1000 + 1);
+        EXPECT_FALSE(wifi2.isConnected()) << "Falls back";
+        EXPECT_STREQ("Cached Wi-Fi details failed; scanning", infoListener.getPayload()) << "Fallback reported";
+        EXPECT_FALSE(connectionCache.getLink("ssid", channel, bssid, lease)) << "Link forgotten";
+        while (!wifi2.isConnected()) {}
+        EXPECT_TRUE(wifi2.needsReInit()) << "DHCP again, so fixing the IP address again";
+        eventServer.unsubscribe(&infoListener);
+    }
+
     TEST_F(WiFiTest,failSetNameTest) {
         constexpr WifiConfig Config{"ssid", "password", "", nullptr};
         PayloadBuilder payloadBuilder;